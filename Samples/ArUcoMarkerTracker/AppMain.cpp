@@ -15,22 +15,35 @@
 
 namespace ArUcoMarkerTracker
 {
-    struct DetectedMarker
+    //
+    // Detects the ArUco markers in a visible light camera frame. Returns the positions of
+    // their corners on the unit plane of the camera, and the camera to origin transform
+    // of the frame.
+    //
+    bool DetectArUcoMarkers(
+        HoloLensForCV::SensorFrame^ frame,
+        MarkerMapView* view)
     {
-        int32_t markerId;
+        Windows::Foundation::Numerics::float4x4 camToRef;
 
-        Eigen::Vector3f point;
-        Eigen::Vector3f dir;
+        if (!Windows::Foundation::Numerics::invert(frame->CameraViewTransform, &camToRef))
+        {
+            return false;
+        }
 
-        // Image position
-        int x;
-        int y;
-    };
+        Windows::Foundation::Numerics::float4x4 camToOrigin = camToRef * frame->FrameToOrigin;
 
-    std::map<int32_t, DetectedMarker> DetectArUcoMarkers(
-        HoloLensForCV::SensorFrame^ frame)
-    {
-        std::map<int32_t, DetectedMarker> detectedMarkers;
+        view->CameraToOriginRotation <<
+            camToOrigin.m11, camToOrigin.m21, camToOrigin.m31,
+            camToOrigin.m12, camToOrigin.m22, camToOrigin.m32,
+            camToOrigin.m13, camToOrigin.m23, camToOrigin.m33;
+
+        view->CameraToOriginTranslation = Eigen::Vector3d(
+            camToOrigin.m41,
+            camToOrigin.m42,
+            camToOrigin.m43);
+
+        view->Observations.clear();
 
         cv::Ptr<cv::aruco::DetectorParameters> arucoDetectorParameters =
             cv::aruco::DetectorParameters::create();
@@ -55,142 +68,46 @@ namespace ArUcoMarkerTracker
             arucoMarkerIds,
             arucoDetectorParameters,
             arucoRejectedCandidates);
- 
-        if (!arucoMarkerIds.empty())
+
+        for (size_t i = 0; i < arucoMarkerIds.size(); ++i)
         {
-            Windows::Foundation::Numerics::float4x4 camToRef;
+            const auto& markerCorners = arucoMarkers[i];
 
-            if (!Windows::Foundation::Numerics::invert(frame->CameraViewTransform, &camToRef))
+            if (markerCorners.size() != 4)
             {
-                return detectedMarkers;
-            }
+                dbg::trace(
+                    L"DetectArUcoMarkers: skipping marker id %i with %i corners",
+                    arucoMarkerIds[i],
+                    markerCorners.size());
 
-            Windows::Foundation::Numerics::float4x4 camToOrigin = camToRef * frame->FrameToOrigin;
-            Eigen::Vector3f camPinhole(camToOrigin.m41, camToOrigin.m42, camToOrigin.m43);
+                continue;
+            }
 
-            Eigen::Matrix3f camToOriginR;
+            for (size_t j = 0; j < markerCorners.size(); ++j)
+            {
+                Windows::Foundation::Point uv;
 
-            camToOriginR(0, 0) = camToOrigin.m11;
-            camToOriginR(0, 1) = camToOrigin.m12;
-            camToOriginR(0, 2) = camToOrigin.m13;
-            camToOriginR(1, 0) = camToOrigin.m21;
-            camToOriginR(1, 1) = camToOrigin.m22;
-            camToOriginR(1, 2) = camToOrigin.m23;
-            camToOriginR(2, 0) = camToOrigin.m31;
-            camToOriginR(2, 1) = camToOrigin.m32;
-            camToOriginR(2, 2) = camToOrigin.m33;
+                uv.X = static_cast<float>(markerCorners[j].x);
+                uv.Y = static_cast<float>(markerCorners[j].y);
 
-            for (size_t i = 0; i < arucoMarkerIds.size(); ++i)
-            {
-                const auto& markerCorners = arucoMarkers[i];
+                Windows::Foundation::Point xy;
 
-                if (markerCorners.size() != 4)
+                if (!frame->SensorStreamingCameraIntrinsics->MapImagePointToCameraUnitPlane(uv, &xy))
                 {
-                    dbg::trace(
-                        L"DetectArUcoMarkers: skipping marker id %i with %i corners",
-                        arucoMarkerIds[i],
-                        markerCorners.size());
-
                     continue;
                 }
 
-                for (size_t j = 0; j < markerCorners.size(); ++j)
-                {
-                    DetectedMarker detectedMarker;
-
-                    detectedMarker.markerId =
-                        arucoMarkerIds[i] * 4 + j;
-
-                    detectedMarker.x = static_cast<int>(markerCorners[j].x);
-                    detectedMarker.y = static_cast<int>(markerCorners[j].y);
-                    detectedMarker.point = camPinhole;
-
-                    Windows::Foundation::Point uv;
+                MarkerCornerObservation observation;
 
-                    uv.X = static_cast<float>(markerCorners[j].x);
-                    uv.Y = static_cast<float>(markerCorners[j].y);
+                observation.CornerId = arucoMarkerIds[i] * 4 + static_cast<int32_t>(j);
+                observation.UnitPlanePoint = Eigen::Vector2d(xy.X, xy.Y);
 
-                    Windows::Foundation::Point xy;
-
-                    if (!frame->SensorStreamingCameraIntrinsics->MapImagePointToCameraUnitPlane(uv, &xy))
-                    {
-                        continue;
-                    }
-
-                    Eigen::Vector3f dirCam;
-
-                    dirCam[0] = xy.X;
-                    dirCam[1] = xy.Y;
-                    dirCam[2] = 1.0f;
-
-                    detectedMarker.dir =
-                        camToOriginR.transpose() * dirCam;
-
-                    detectedMarkers[detectedMarker.markerId] =
-                        detectedMarker;
-                }
+                view->Observations.push_back(
+                    observation);
             }
         }
 
-        return detectedMarkers;
-    }
-
-    struct TrackedMarker
-    {
-        int32_t markerId;
-        Eigen::Vector3f point;
-    };
-
-    std::map<int32_t, TrackedMarker> TrackArUcoMarkers(
-        HoloLensForCV::SensorFrame^ leftFrame,
-        HoloLensForCV::SensorFrame^ rightFrame)
-    {
-        std::map<int32_t, TrackedMarker> trackedMarkers;
-
-        Windows::Foundation::Numerics::float4x4 leftCamToRef;
-
-        if (!Windows::Foundation::Numerics::invert(leftFrame->CameraViewTransform, &leftCamToRef))
-        {
-            return trackedMarkers;
-        }
-
-        auto leftCamToOrigin = leftCamToRef * leftFrame->FrameToOrigin;
-
-        auto leftDetections = DetectArUcoMarkers(leftFrame);
-        auto rightDetections = DetectArUcoMarkers(rightFrame);
-
-        for (auto leftDetectionIterator : leftDetections)
-        {
-            auto leftDetection = leftDetectionIterator.second;
-
-            if (rightDetections.count(leftDetection.markerId))
-            {
-                auto rightDetection = rightDetections[leftDetection.markerId];
-
-                auto a = leftDetection.point;
-                auto b = leftDetection.dir;
-                auto c = rightDetection.point;
-                auto d = rightDetection.dir;
-
-                Eigen::Matrix<float, 3, 2> A;
-
-                A.col(0) = b;
-                A.col(1) = -d;
-
-                Eigen::Vector3f y = (c - a);
-
-                Eigen::Vector2f x = (A.transpose() * A).inverse() * (A.transpose() * y);
-
-                TrackedMarker triangulatedMarkerCorner;
-
-                triangulatedMarkerCorner.markerId = leftDetection.markerId;
-                triangulatedMarkerCorner.point = (a + b * x[0] + c + d * x[1]) * 0.5f;
-
-                trackedMarkers[triangulatedMarkerCorner.markerId] = triangulatedMarkerCorner;
-            }
-        }
-
-        return trackedMarkers;
+        return true;
     }
 
     AppMain::AppMain(
@@ -306,80 +223,149 @@ namespace ArUcoMarkerTracker
 
         s_previousTimestamp = leftFrame->Timestamp.UniversalTime;
 
-        concurrency::create_task([this, leftFrame, rightFrame]()
+        //
+        // The side cameras see the markers at the periphery of the front cameras; their
+        // frames contribute views when they are close enough in time. Each view carries
+        // its own pose, so they need not be exactly synchronized with the front pair.
+        //
+        const float c_sideCameraTimestampTolerance = 0.017f;
+
+        std::vector<HoloLensForCV::SensorFrame^> frames;
+
+        frames.push_back(leftFrame);
+        frames.push_back(rightFrame);
+
+        for (const auto sideSensorType :
+            { HoloLensForCV::SensorType::VisibleLightLeftLeft, HoloLensForCV::SensorType::VisibleLightRightRight })
+        {
+            HoloLensForCV::SensorFrame^ sideFrame = _multiFrameBuffer->GetFrameForTime(
+                sideSensorType,
+                commonTime,
+                c_sideCameraTimestampTolerance);
+
+            if (sideFrame)
+            {
+                frames.push_back(sideFrame);
+            }
+        }
+
+        concurrency::create_task([this, frames]()
         {
-            auto trackedMarkers = TrackArUcoMarkers(
-                leftFrame,
-                rightFrame);
+            std::vector<MarkerMapView> views;
+            std::set<int32_t> observedCornerIds;
 
+            for (const auto& frame : frames)
             {
-                std::lock_guard<std::mutex> guard(_markerRenderersMutex);
+                MarkerMapView view;
 
-                Windows::Foundation::Numerics::float3 focusPoint(0.0f, 0.0f, 0.0f);
-                int32_t numberOfMarkersDetected = 0;
+                if (!DetectArUcoMarkers(frame, &view))
+                {
+                    continue;
+                }
 
-                for (auto& triangulatedMarkerCornerIterator : trackedMarkers)
+                for (const auto& observation : view.Observations)
                 {
-                    auto& triangulatedMarkerCorner =
-                        triangulatedMarkerCornerIterator.second;
+                    observedCornerIds.insert(observation.CornerId);
+                }
 
-                    Windows::Foundation::Numerics::float3 p(
-                        triangulatedMarkerCorner.point.x(),
-                        triangulatedMarkerCorner.point.y(),
-                        triangulatedMarkerCorner.point.z());
+                views.push_back(
+                    std::move(view));
+            }
 
-                    if (std::isnan(p.x + p.y + p.z))
-                    {
-                        continue;
-                    }
+            if (_markerMap.AddViews(views))
+            {
+                OptimizeMarkerMap();
+            }
 
-                    if (_markerRenderers.find(triangulatedMarkerCorner.markerId) == _markerRenderers.end())
-                    {
-#if 0
-                        dbg::trace(L"AppMain::OnUpdateFor3DTracking: adding marker renderer for marker id %i", triangulatedMarkerCorner.markerId);
-#endif
+            UpdateMarkerRenderers(
+                observedCornerIds);
 
-                        _markerRenderers[triangulatedMarkerCorner.markerId] =
-                            std::make_shared<Rendering::MarkerRenderer>(
-                                _deviceResources,
-                                0.0035f /* markerSize */);
-                    }
+            InterlockedDecrement(&_markerUpdatesInProgress);
+        });
+    }
 
-#if 0
-                    dbg::trace(L"AppMain::OnUpdateFor3DTracking: moving marker id %i to [%f, %f, %f]", triangulatedMarkerCorner.markerId, p.x, p.y, p.z);
-#endif
+    void AppMain::OptimizeMarkerMap()
+    {
+        if (InterlockedIncrement(&_markerMapOptimizationsInProgress) > 1)
+        {
+            InterlockedDecrement(&_markerMapOptimizationsInProgress);
 
-                    _markerRenderers[triangulatedMarkerCorner.markerId]->SetIsEnabled(true);
-                    _markerRenderers[triangulatedMarkerCorner.markerId]->SetPosition(p);
+            return;
+        }
 
-                    focusPoint += p;
-                    ++numberOfMarkersDetected;
+        //
+        // Bundle adjustment runs in the background, once per batch of new keyframes, so
+        // that marker detection keeps up with the cameras. A keyframe added just as the
+        // loop ends is picked up with the next one.
+        //
+        concurrency::create_task([this]()
+        {
+            do
+            {
+                _markerMap.Optimize();
+            }
+            while (_markerMap.NeedsOptimization());
 
-                    _lastObservedMarkerTimestamp[triangulatedMarkerCorner.markerId] =
-                        leftFrame->Timestamp.UniversalTime;
-                }
+            InterlockedDecrement(&_markerMapOptimizationsInProgress);
+        });
+    }
 
-                _optionalFocusPoint = focusPoint / static_cast<float>(numberOfMarkersDetected);
-                _hasFocusPoint = numberOfMarkersDetected > 0;
+    void AppMain::UpdateMarkerRenderers(
+        const std::set<int32_t>& observedCornerIds)
+    {
+        //
+        // Show every stable corner of the map, at its optimized position, and focus on
+        // the corners seen in the latest frames.
+        //
+        const auto stableCorners = _markerMap.GetStableCorners();
 
-                for (auto& markerRendererIterator : _markerRenderers)
-                {
-                    const long long timeSinceLastObservation =
-                        leftFrame->Timestamp.UniversalTime -
-                        _lastObservedMarkerTimestamp[markerRendererIterator.first];
+        std::lock_guard<std::mutex> guard(_markerRenderersMutex);
 
-                    const float timeSinceLastObservationInSeconds =
-                        static_cast<float>(timeSinceLastObservation) * 1e-7f;
+        Windows::Foundation::Numerics::float3 focusPoint(0.0f, 0.0f, 0.0f);
+        int32_t numberOfMarkersDetected = 0;
 
-                    if (timeSinceLastObservationInSeconds > 3.0f)
-                    {
-                        markerRendererIterator.second->SetIsEnabled(false);
-                    }
-                }
+        for (const auto& stableCornerIterator : stableCorners)
+        {
+            const int32_t cornerId = stableCornerIterator.first;
+
+            Windows::Foundation::Numerics::float3 p(
+                stableCornerIterator.second.x(),
+                stableCornerIterator.second.y(),
+                stableCornerIterator.second.z());
+
+            if (std::isnan(p.x + p.y + p.z))
+            {
+                continue;
             }
 
-            InterlockedDecrement(&_markerUpdatesInProgress);
-        });
+            if (_markerRenderers.find(cornerId) == _markerRenderers.end())
+            {
+#if 0
+                dbg::trace(L"AppMain::UpdateMarkerRenderers: adding marker renderer for corner id %i", cornerId);
+#endif
+
+                _markerRenderers[cornerId] =
+                    std::make_shared<Rendering::MarkerRenderer>(
+                        _deviceResources,
+                        0.0035f /* markerSize */);
+            }
+
+            _markerRenderers[cornerId]->SetIsEnabled(true);
+            _markerRenderers[cornerId]->SetPosition(p);
+
+            if (observedCornerIds.count(cornerId))
+            {
+                focusPoint += p;
+                ++numberOfMarkersDetected;
+            }
+        }
+
+        if (numberOfMarkersDetected > 0)
+        {
+            _optionalFocusPoint = focusPoint / static_cast<float>(numberOfMarkersDetected);
+        }
+
+        _hasFocusPoint = numberOfMarkersDetected > 0;
     }
 
     void AppMain::OnPreRender()
@@ -435,12 +421,18 @@ namespace ArUcoMarkerTracker
     {
         std::vector<HoloLensForCV::SensorType> enabledSensorTypes;
 
+        enabledSensorTypes.emplace_back(
+            HoloLensForCV::SensorType::VisibleLightLeftLeft);
+
         enabledSensorTypes.emplace_back(
             HoloLensForCV::SensorType::VisibleLightLeftFront);
 
         enabledSensorTypes.emplace_back(
             HoloLensForCV::SensorType::VisibleLightRightFront);
 
+        enabledSensorTypes.emplace_back(
+            HoloLensForCV::SensorType::VisibleLightRightRight);
+
         _multiFrameBuffer =
             ref new HoloLensForCV::MultiFrameBuffer();
 
@@ -11,6 +11,8 @@
 
 #pragma once
 
+#include "MarkerMap.h"
+
 namespace ArUcoMarkerTracker
 {
     class AppMain : public Holographic::AppMainBase
@@ -45,9 +47,18 @@ namespace ArUcoMarkerTracker
 
         void OnUpdateForMarkerTracker();
 
+        // Starts optimizing the marker map in the background, unless it already is.
+        void OptimizeMarkerMap();
+
+        void UpdateMarkerRenderers(
+            _In_ const std::set<int32_t>& observedCornerIds);
+
     private:
+        MarkerMap _markerMap;
+        volatile long _markerMapOptimizationsInProgress{ 0 };
+
+        // Marker renderers by corner id, at the stable corners of the marker map
         std::map<int32_t, std::shared_ptr<Rendering::MarkerRenderer>> _markerRenderers;
-        std::map<int32_t, long long> _lastObservedMarkerTimestamp;
         std::mutex _markerRenderersMutex;
         volatile long _markerUpdatesInProgress{ 0 };
 
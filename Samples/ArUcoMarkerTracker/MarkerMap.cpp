@@ -0,0 +1,1038 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#include "pch.h"
+
+#include "MarkerMap.h"
+
+namespace ArUcoMarkerTracker
+{
+    namespace
+    {
+        const double c_degreesToRadians = 3.14159265358979323846 / 180.0;
+
+        //
+        // Minimum depth of a corner in front of a camera observing it, in meters. The
+        // cameras look down the negative Z axis, so the depth of a camera space point is
+        // -z, as in pcloud_compute.py.
+        //
+        const double c_minimumDepth = 0.05;
+
+        //
+        // Minimum smallest eigenvalue of the normal matrix of the rays a new corner is
+        // triangulated from; about a quarter of the squared angle between two rays.
+        //
+        const double c_minimumTriangulationEigenvalue = 1e-5;
+
+        const double c_initialDamping = 1e-4;
+        const double c_minimumDamping = 1e-8;
+        const double c_maximumDamping = 1e6;
+
+        // Relative decrease of the cost below which the optimization has converged
+        const double c_convergenceThreshold = 1e-6;
+
+        typedef Eigen::Matrix<double, 2, 3> Matrix23d;
+        typedef Eigen::Matrix<double, 2, 6> Matrix26d;
+        typedef Eigen::Matrix<double, 6, 3> Matrix63d;
+        typedef Eigen::Matrix<double, 6, 6> Matrix66d;
+        typedef Eigen::Matrix<double, 6, 1> Vector6d;
+
+        typedef MarkerMap::Pose Pose;
+
+        //
+        // A reprojection residual of the window: a corner observed in a view of a keyframe.
+        //
+        struct Residual
+        {
+            uint32_t Corner;
+            uint32_t Keyframe;
+            uint32_t View;
+            Eigen::Vector2d UnitPlanePoint;
+        };
+
+        //
+        // The residuals of a corner in a keyframe, and the pose and cross blocks of the
+        // normal equations accumulated over them.
+        //
+        struct CornerKeyframePair
+        {
+            uint32_t Keyframe;
+            uint32_t FirstResidual;
+            uint32_t EndResidual;
+
+            Matrix66d PoseHessian;
+            Vector6d PoseGradient;
+            Matrix63d CrossHessian;
+        };
+
+        struct CornerBlock
+        {
+            int32_t CornerId;
+            uint32_t FirstPair;
+            uint32_t EndPair;
+
+            Eigen::Vector3d Position;
+            Eigen::Matrix3d PriorInformation;
+            Eigen::Vector3d PriorPosition;
+
+            Eigen::Matrix3d Hessian;
+            Eigen::Vector3d Gradient;
+
+            // Inverse of the damped Hessian, kept for the back substitution
+            Eigen::Matrix3d InverseHessian;
+        };
+
+        Eigen::Matrix3d SkewSymmetric(
+            _In_ const Eigen::Vector3d& v)
+        {
+            Eigen::Matrix3d skewSymmetric;
+
+            skewSymmetric <<
+                0.0, -v.z(), v.y(),
+                v.z(), 0.0, -v.x(),
+                -v.y(), v.x(), 0.0;
+
+            return skewSymmetric;
+        }
+
+        Eigen::Matrix3d RotationFromVector(
+            _In_ const Eigen::Vector3d& rotationVector)
+        {
+            const double angle =
+                rotationVector.norm();
+
+            if (angle < 1e-12)
+            {
+                return Eigen::Matrix3d::Identity() + SkewSymmetric(rotationVector);
+            }
+
+            return Eigen::AngleAxisd(angle, rotationVector / angle).toRotationMatrix();
+        }
+
+        Eigen::Vector3d RotationToVector(
+            _In_ const Eigen::Matrix3d& rotation)
+        {
+            const Eigen::AngleAxisd angleAxis(
+                rotation);
+
+            return angleAxis.angle() * angleAxis.axis();
+        }
+
+        //
+        // The weight of a whitened residual under the Huber loss, and its contribution
+        // to the cost.
+        //
+        double HuberWeight(
+            _In_ double error,
+            _In_ double threshold,
+            _Out_ double* cost)
+        {
+            if (error <= threshold)
+            {
+                *cost = error * error;
+
+                return 1.0;
+            }
+
+            *cost = 2.0 * threshold * error - threshold * threshold;
+
+            return threshold / error;
+        }
+
+        //
+        // Computes the whitened reprojection error of a corner in a view of a keyframe,
+        // and optionally its Jacobians with respect to the keyframe pose update (rotation
+        // vector applied on the left, in the origin frame, then translation) and to the
+        // corner position. Returns false if the corner is not in front of the camera.
+        //
+        bool EvaluateReprojection(
+            _In_ const Pose& rigToOrigin,
+            _In_ const Pose& viewToRig,
+            _In_ const Eigen::Vector3d& position,
+            _In_ const Eigen::Vector2d& unitPlanePoint,
+            _In_ double inverseSigma,
+            _Out_ Eigen::Vector2d* residual,
+            _Out_opt_ Matrix26d* poseJacobian,
+            _Out_opt_ Matrix23d* cornerJacobian)
+        {
+            const Eigen::Vector3d originOffset =
+                position - rigToOrigin.Translation;
+
+            const Eigen::Matrix3d originToCamera =
+                viewToRig.Rotation.transpose() * rigToOrigin.Rotation.transpose();
+
+            const Eigen::Vector3d cameraPoint =
+                originToCamera * originOffset - viewToRig.Rotation.transpose() * viewToRig.Translation;
+
+            if (-cameraPoint.z() < c_minimumDepth)
+            {
+                return false;
+            }
+
+            //
+            // The unit plane point is (x / z, y / z) for either sign of z.
+            //
+            const double inverseDepth =
+                1.0 / cameraPoint.z();
+
+            *residual =
+                (cameraPoint.head<2>() * inverseDepth - unitPlanePoint) * inverseSigma;
+
+            if (nullptr != poseJacobian || nullptr != cornerJacobian)
+            {
+                Matrix23d projectionJacobian;
+
+                projectionJacobian <<
+                    inverseDepth, 0.0, -cameraPoint.x() * inverseDepth * inverseDepth,
+                    0.0, inverseDepth, -cameraPoint.y() * inverseDepth * inverseDepth;
+
+                const Matrix23d positionJacobian =
+                    inverseSigma * projectionJacobian * originToCamera;
+
+                if (nullptr != cornerJacobian)
+                {
+                    *cornerJacobian = positionJacobian;
+                }
+
+                if (nullptr != poseJacobian)
+                {
+                    poseJacobian->leftCols<3>() = positionJacobian * SkewSymmetric(originOffset);
+                    poseJacobian->rightCols<3>() = -positionJacobian;
+                }
+            }
+
+            return true;
+        }
+    }
+
+    MarkerMapSettings::MarkerMapSettings()
+        : MaximumKeyframes(20)
+        , MaximumIterations(5)
+        , KeyframeTranslationInMeters(0.05)
+        , KeyframeRotationInDegrees(5.0)
+        , ObservationSigmaInPixels(0.5)
+        , FocalLengthInPixels(450.0)
+        , HuberThreshold(2.0)
+        , PoseSigmaInMeters(0.01)
+        , PoseSigmaInDegrees(0.5)
+        , MinimumKeyframesForStableCorner(2)
+    {
+    }
+
+    MarkerMap::MarkerMap(
+        _In_ const MarkerMapSettings& settings)
+        : _settings(settings)
+        , _nextKeyframeId(0)
+        , _lastOptimizedKeyframeId(0)
+    {
+        REQUIRES(_settings.MaximumKeyframes > 0);
+    }
+
+    bool MarkerMap::AddViews(
+        _In_ const std::vector<MarkerMapView>& views)
+    {
+        if (views.empty())
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> guard(_mutex);
+
+        //
+        // Start the new keyframe from the correction the last optimization applied to
+        // the tracked pose of the last keyframe: the tracking drifts slowly, so this is
+        // a much better initial guess than the tracked pose itself.
+        //
+        Eigen::Matrix3d correctionRotation =
+            Eigen::Matrix3d::Identity();
+
+        Eigen::Vector3d correctionTranslation =
+            Eigen::Vector3d::Zero();
+
+        if (!_keyframes.empty())
+        {
+            const Keyframe& lastKeyframe = _keyframes.back();
+
+            correctionRotation =
+                lastKeyframe.OptimizedPose.Rotation * lastKeyframe.TrackedPose.Rotation.transpose();
+
+            correctionTranslation =
+                lastKeyframe.OptimizedPose.Translation - correctionRotation * lastKeyframe.TrackedPose.Translation;
+        }
+
+        //
+        // Triangulate the corners which are not in the map yet from the rays of all the
+        // views observing them, as the point closest to the rays in the least squares
+        // sense. Corners seen in a single view are left for a later frame.
+        //
+        struct Rays
+        {
+            Eigen::Matrix3d A;
+            Eigen::Vector3d b;
+            uint32_t NumberOfRays;
+        };
+
+        std::map<int32_t, Rays> newCornerRays;
+
+        for (const MarkerMapView& view : views)
+        {
+            const Eigen::Matrix3d cameraToOriginRotation =
+                correctionRotation * view.CameraToOriginRotation;
+
+            const Eigen::Vector3d cameraCenter =
+                correctionRotation * view.CameraToOriginTranslation + correctionTranslation;
+
+            for (const MarkerCornerObservation& observation : view.Observations)
+            {
+                if (_corners.count(observation.CornerId))
+                {
+                    continue;
+                }
+
+                const Eigen::Vector3d direction =
+                    (cameraToOriginRotation * observation.UnitPlanePoint.homogeneous()).normalized();
+
+                const Eigen::Matrix3d projection =
+                    Eigen::Matrix3d::Identity() - direction * direction.transpose();
+
+                auto raysIterator = newCornerRays.find(observation.CornerId);
+
+                if (raysIterator == newCornerRays.end())
+                {
+                    raysIterator = newCornerRays.emplace(
+                        observation.CornerId,
+                        Rays{ Eigen::Matrix3d::Zero(), Eigen::Vector3d::Zero(), 0 }).first;
+                }
+
+                raysIterator->second.A += projection;
+                raysIterator->second.b += projection * cameraCenter;
+                ++raysIterator->second.NumberOfRays;
+            }
+        }
+
+        std::map<int32_t, Eigen::Vector3d> newCorners;
+
+        for (const auto& raysIterator : newCornerRays)
+        {
+            const Rays& rays = raysIterator.second;
+
+            if (rays.NumberOfRays < 2)
+            {
+                continue;
+            }
+
+            const Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigenSolver(
+                rays.A,
+                Eigen::EigenvaluesOnly);
+
+            if (eigenSolver.eigenvalues()[0] < c_minimumTriangulationEigenvalue)
+            {
+                continue;
+            }
+
+            const Eigen::Vector3d position =
+                rays.A.ldlt().solve(rays.b);
+
+            bool inFrontOfAllViews = true;
+
+            for (const MarkerMapView& view : views)
+            {
+                const Eigen::Vector3d cameraCenter =
+                    correctionRotation * view.CameraToOriginTranslation + correctionTranslation;
+
+                const Eigen::Vector3d cameraPoint =
+                    (correctionRotation * view.CameraToOriginRotation).transpose() * (position - cameraCenter);
+
+                for (const MarkerCornerObservation& observation : view.Observations)
+                {
+                    if (observation.CornerId == raysIterator.first && -cameraPoint.z() < c_minimumDepth)
+                    {
+                        inFrontOfAllViews = false;
+                    }
+                }
+            }
+
+            if (inFrontOfAllViews)
+            {
+                newCorners[raysIterator.first] = position;
+            }
+        }
+
+        //
+        // Decide whether the frame becomes a keyframe: it must observe a corner of the
+        // map, and either add corners to the map or have moved far enough.
+        //
+        const Pose trackedPose{ views[0].CameraToOriginRotation, views[0].CameraToOriginTranslation };
+
+        bool observesMap = false;
+
+        for (const MarkerMapView& view : views)
+        {
+            for (const MarkerCornerObservation& observation : view.Observations)
+            {
+                observesMap |=
+                    _corners.count(observation.CornerId) > 0 ||
+                    newCorners.count(observation.CornerId) > 0;
+            }
+        }
+
+        if (!observesMap)
+        {
+            return false;
+        }
+
+        if (newCorners.empty() && !_keyframes.empty())
+        {
+            const Pose& lastTrackedPose =
+                _keyframes.back().TrackedPose;
+
+            const double translation =
+                (trackedPose.Translation - lastTrackedPose.Translation).norm();
+
+            const double rotation =
+                RotationToVector(trackedPose.Rotation * lastTrackedPose.Rotation.transpose()).norm();
+
+            if (translation < _settings.KeyframeTranslationInMeters &&
+                rotation < _settings.KeyframeRotationInDegrees * c_degreesToRadians)
+            {
+                return false;
+            }
+        }
+
+        Keyframe keyframe;
+
+        keyframe.Id = _nextKeyframeId++;
+        keyframe.TrackedPose = trackedPose;
+        keyframe.OptimizedPose.Rotation = correctionRotation * trackedPose.Rotation;
+        keyframe.OptimizedPose.Translation = correctionRotation * trackedPose.Translation + correctionTranslation;
+
+        std::set<int32_t> observedCornerIds;
+
+        for (uint32_t viewIndex = 0; viewIndex < views.size(); ++viewIndex)
+        {
+            const MarkerMapView& view = views[viewIndex];
+
+            Pose viewToRig;
+
+            viewToRig.Rotation =
+                trackedPose.Rotation.transpose() * view.CameraToOriginRotation;
+
+            viewToRig.Translation =
+                trackedPose.Rotation.transpose() * (view.CameraToOriginTranslation - trackedPose.Translation);
+
+            keyframe.ViewToRig.push_back(viewToRig);
+
+            for (const MarkerCornerObservation& observation : view.Observations)
+            {
+                if (!_corners.count(observation.CornerId) && !newCorners.count(observation.CornerId))
+                {
+                    continue;
+                }
+
+                keyframe.Observations.push_back(
+                    KeyframeObservation{ viewIndex, observation.CornerId, observation.UnitPlanePoint });
+
+                observedCornerIds.insert(observation.CornerId);
+            }
+        }
+
+        for (const auto& newCornerIterator : newCorners)
+        {
+            Corner corner;
+
+            corner.Position = newCornerIterator.second;
+            corner.PriorInformation = Eigen::Matrix3d::Zero();
+            corner.PriorPosition = newCornerIterator.second;
+            corner.NumberOfKeyframes = 0;
+            corner.Optimized = false;
+
+            _corners[newCornerIterator.first] = corner;
+        }
+
+        for (const int32_t cornerId : observedCornerIds)
+        {
+            ++_corners[cornerId].NumberOfKeyframes;
+        }
+
+        _keyframes.push_back(
+            std::move(keyframe));
+
+        while (_keyframes.size() > _settings.MaximumKeyframes)
+        {
+            MarginalizeOldestKeyframe();
+        }
+
+        return true;
+    }
+
+    void MarkerMap::MarginalizeOldestKeyframe()
+    {
+        //
+        // Fold the observations of the keyframe into the priors of their corners,
+        // linearized at the current estimates and with the keyframe pose held fixed.
+        // The prior mean combines the previous prior with the current estimate, which
+        // the observations are assumed to be centered on.
+        //
+        const Keyframe& keyframe =
+            _keyframes.front();
+
+        const double inverseSigma =
+            _settings.FocalLengthInPixels / _settings.ObservationSigmaInPixels;
+
+        std::map<int32_t, Eigen::Matrix3d> information;
+
+        for (const KeyframeObservation& observation : keyframe.Observations)
+        {
+            const Corner& corner =
+                _corners[observation.CornerId];
+
+            Eigen::Vector2d residual;
+            Matrix23d cornerJacobian;
+
+            if (!EvaluateReprojection(
+                    keyframe.OptimizedPose,
+                    keyframe.ViewToRig[observation.View],
+                    corner.Position,
+                    observation.UnitPlanePoint,
+                    inverseSigma,
+                    &residual,
+                    nullptr /* poseJacobian */,
+                    &cornerJacobian))
+            {
+                continue;
+            }
+
+            double cost;
+
+            const double weight =
+                HuberWeight(residual.norm(), _settings.HuberThreshold, &cost);
+
+            auto informationIterator = information.find(observation.CornerId);
+
+            if (informationIterator == information.end())
+            {
+                informationIterator = information.emplace(
+                    observation.CornerId,
+                    Eigen::Matrix3d::Zero()).first;
+            }
+
+            informationIterator->second +=
+                weight * cornerJacobian.transpose() * cornerJacobian;
+        }
+
+        for (const auto& informationIterator : information)
+        {
+            Corner& corner =
+                _corners[informationIterator.first];
+
+            const Eigen::Matrix3d priorInformation =
+                corner.PriorInformation + informationIterator.second;
+
+            corner.PriorPosition =
+                (priorInformation + 1e-9 * Eigen::Matrix3d::Identity()).ldlt().solve(
+                    corner.PriorInformation * corner.PriorPosition +
+                    informationIterator.second * corner.Position);
+
+            corner.PriorInformation =
+                priorInformation;
+        }
+
+        _keyframes.pop_front();
+    }
+
+    void MarkerMap::Optimize()
+    {
+        dbg::TimerGuard timerGuard(
+            L"MarkerMap::Optimize",
+            50.0 /* minimum_time_elapsed_in_milliseconds */);
+
+        std::lock_guard<std::mutex> optimizeGuard(_optimizeMutex);
+
+        //
+        // Take a snapshot of the window: the keyframes, and the corners they observe.
+        //
+        std::vector<uint64_t> keyframeIds;
+        std::vector<Pose> trackedPoses, poses;
+        std::vector<std::vector<Pose>> viewToRig;
+        std::vector<Residual, Eigen::aligned_allocator<Residual>> residuals;
+        std::vector<CornerBlock, Eigen::aligned_allocator<CornerBlock>> corners;
+
+        {
+            std::lock_guard<std::mutex> guard(_mutex);
+
+            _lastOptimizedKeyframeId = _nextKeyframeId;
+
+            std::map<int32_t, uint32_t> cornerIndices;
+
+            for (const Keyframe& keyframe : _keyframes)
+            {
+                for (const KeyframeObservation& observation : keyframe.Observations)
+                {
+                    cornerIndices[observation.CornerId] = 0;
+                }
+            }
+
+            for (auto& cornerIndexIterator : cornerIndices)
+            {
+                const Corner& corner =
+                    _corners[cornerIndexIterator.first];
+
+                CornerBlock cornerBlock;
+
+                cornerBlock.CornerId = cornerIndexIterator.first;
+                cornerBlock.Position = corner.Position;
+                cornerBlock.PriorInformation = corner.PriorInformation;
+                cornerBlock.PriorPosition = corner.PriorPosition;
+
+                cornerIndexIterator.second = static_cast<uint32_t>(corners.size());
+                corners.push_back(cornerBlock);
+            }
+
+            for (const Keyframe& keyframe : _keyframes)
+            {
+                const uint32_t keyframeIndex =
+                    static_cast<uint32_t>(keyframeIds.size());
+
+                keyframeIds.push_back(keyframe.Id);
+                trackedPoses.push_back(keyframe.TrackedPose);
+                poses.push_back(keyframe.OptimizedPose);
+                viewToRig.push_back(keyframe.ViewToRig);
+
+                for (const KeyframeObservation& observation : keyframe.Observations)
+                {
+                    residuals.push_back(
+                        Residual{ cornerIndices[observation.CornerId], keyframeIndex, observation.View, observation.UnitPlanePoint });
+                }
+            }
+        }
+
+        const size_t numberOfKeyframes =
+            keyframeIds.size();
+
+        if (0 == numberOfKeyframes)
+        {
+            return;
+        }
+
+        //
+        // Group the residuals by corner, then by keyframe.
+        //
+        std::sort(
+            residuals.begin(),
+            residuals.end(),
+            [](const Residual& a, const Residual& b)
+        {
+            return a.Corner != b.Corner ? a.Corner < b.Corner : a.Keyframe < b.Keyframe;
+        });
+
+        std::vector<CornerKeyframePair, Eigen::aligned_allocator<CornerKeyframePair>> pairs;
+
+        for (uint32_t residualIndex = 0; residualIndex < residuals.size(); ++residualIndex)
+        {
+            const Residual& residual = residuals[residualIndex];
+
+            if (0 == residualIndex ||
+                residual.Corner != residuals[residualIndex - 1].Corner ||
+                residual.Keyframe != residuals[residualIndex - 1].Keyframe)
+            {
+                if (0 == residualIndex || residual.Corner != residuals[residualIndex - 1].Corner)
+                {
+                    corners[residual.Corner].FirstPair = static_cast<uint32_t>(pairs.size());
+                }
+
+                CornerKeyframePair pair;
+
+                pair.Keyframe = residual.Keyframe;
+                pair.FirstResidual = residualIndex;
+
+                pairs.push_back(pair);
+            }
+
+            pairs.back().EndResidual = residualIndex + 1;
+            corners[residual.Corner].EndPair = static_cast<uint32_t>(pairs.size());
+        }
+
+        const double inverseSigma =
+            _settings.FocalLengthInPixels / _settings.ObservationSigmaInPixels;
+
+        const double inverseRotationSigma =
+            1.0 / (_settings.PoseSigmaInDegrees * c_degreesToRadians);
+
+        const double inverseTranslationSigma =
+            1.0 / _settings.PoseSigmaInMeters;
+
+        //
+        // The cost of a state: the robust reprojection errors and the corner priors,
+        // evaluated in parallel per corner, and the pose priors.
+        //
+        std::vector<double> cornerCosts(corners.size());
+
+        auto computeCost = [&](
+            const std::vector<Pose>& statePoses,
+            const std::vector<Eigen::Vector3d>& statePositions)
+        {
+            concurrency::parallel_for(size_t(0), corners.size(), [&](size_t cornerIndex)
+            {
+                const CornerBlock& corner = corners[cornerIndex];
+                const Eigen::Vector3d& position = statePositions[cornerIndex];
+
+                const Eigen::Vector3d priorOffset =
+                    position - corner.PriorPosition;
+
+                double cost =
+                    priorOffset.dot(corner.PriorInformation * priorOffset);
+
+                for (uint32_t pairIndex = corner.FirstPair; pairIndex < corner.EndPair; ++pairIndex)
+                {
+                    for (uint32_t residualIndex = pairs[pairIndex].FirstResidual; residualIndex < pairs[pairIndex].EndResidual; ++residualIndex)
+                    {
+                        const Residual& residual = residuals[residualIndex];
+
+                        Eigen::Vector2d error;
+
+                        if (EvaluateReprojection(
+                                statePoses[residual.Keyframe],
+                                viewToRig[residual.Keyframe][residual.View],
+                                position,
+                                residual.UnitPlanePoint,
+                                inverseSigma,
+                                &error,
+                                nullptr /* poseJacobian */,
+                                nullptr /* cornerJacobian */))
+                        {
+                            double residualCost;
+
+                            HuberWeight(error.norm(), _settings.HuberThreshold, &residualCost);
+
+                            cost += residualCost;
+                        }
+                    }
+                }
+
+                cornerCosts[cornerIndex] = cost;
+            });
+
+            double cost = 0.0;
+
+            for (const double cornerCost : cornerCosts)
+            {
+                cost += cornerCost;
+            }
+
+            for (size_t keyframeIndex = 0; keyframeIndex < numberOfKeyframes; ++keyframeIndex)
+            {
+                cost +=
+                    RotationToVector(statePoses[keyframeIndex].Rotation * trackedPoses[keyframeIndex].Rotation.transpose()).squaredNorm() *
+                    inverseRotationSigma * inverseRotationSigma;
+
+                cost +=
+                    (statePoses[keyframeIndex].Translation - trackedPoses[keyframeIndex].Translation).squaredNorm() *
+                    inverseTranslationSigma * inverseTranslationSigma;
+            }
+
+            return cost;
+        };
+
+        std::vector<Eigen::Vector3d> positions(corners.size());
+
+        for (size_t cornerIndex = 0; cornerIndex < corners.size(); ++cornerIndex)
+        {
+            positions[cornerIndex] = corners[cornerIndex].Position;
+        }
+
+        double cost =
+            computeCost(poses, positions);
+
+        double damping =
+            c_initialDamping;
+
+        std::vector<Matrix66d, Eigen::aligned_allocator<Matrix66d>> poseHessians(numberOfKeyframes);
+        std::vector<Vector6d, Eigen::aligned_allocator<Vector6d>> poseGradients(numberOfKeyframes);
+
+        for (int32_t iteration = 0; iteration < _settings.MaximumIterations; ++iteration)
+        {
+            //
+            // Linearize: the Jacobians are evaluated in parallel per corner, which owns
+            // its Hessian block and the blocks of its pairs.
+            //
+            concurrency::parallel_for(size_t(0), corners.size(), [&](size_t cornerIndex)
+            {
+                CornerBlock& corner = corners[cornerIndex];
+
+                corner.Hessian = corner.PriorInformation;
+                corner.Gradient = corner.PriorInformation * (positions[cornerIndex] - corner.PriorPosition);
+
+                for (uint32_t pairIndex = corner.FirstPair; pairIndex < corner.EndPair; ++pairIndex)
+                {
+                    CornerKeyframePair& pair = pairs[pairIndex];
+
+                    pair.PoseHessian.setZero();
+                    pair.PoseGradient.setZero();
+                    pair.CrossHessian.setZero();
+
+                    for (uint32_t residualIndex = pair.FirstResidual; residualIndex < pair.EndResidual; ++residualIndex)
+                    {
+                        const Residual& residual = residuals[residualIndex];
+
+                        Eigen::Vector2d error;
+                        Matrix26d poseJacobian;
+                        Matrix23d cornerJacobian;
+
+                        if (!EvaluateReprojection(
+                                poses[residual.Keyframe],
+                                viewToRig[residual.Keyframe][residual.View],
+                                positions[cornerIndex],
+                                residual.UnitPlanePoint,
+                                inverseSigma,
+                                &error,
+                                &poseJacobian,
+                                &cornerJacobian))
+                        {
+                            continue;
+                        }
+
+                        double residualCost;
+
+                        const double weight =
+                            HuberWeight(error.norm(), _settings.HuberThreshold, &residualCost);
+
+                        pair.PoseHessian.noalias() += weight * poseJacobian.transpose() * poseJacobian;
+                        pair.PoseGradient.noalias() += weight * poseJacobian.transpose() * error;
+                        pair.CrossHessian.noalias() += weight * poseJacobian.transpose() * cornerJacobian;
+
+                        corner.Hessian.noalias() += weight * cornerJacobian.transpose() * cornerJacobian;
+                        corner.Gradient.noalias() += weight * cornerJacobian.transpose() * error;
+                    }
+                }
+            });
+
+            for (size_t keyframeIndex = 0; keyframeIndex < numberOfKeyframes; ++keyframeIndex)
+            {
+                //
+                // Pose prior; its Jacobian is approximated by the identity, which holds
+                // for the small corrections to the tracking.
+                //
+                poseHessians[keyframeIndex].setZero();
+                poseHessians[keyframeIndex].diagonal() <<
+                    Eigen::Vector3d::Constant(inverseRotationSigma * inverseRotationSigma),
+                    Eigen::Vector3d::Constant(inverseTranslationSigma * inverseTranslationSigma);
+
+                poseGradients[keyframeIndex] <<
+                    RotationToVector(poses[keyframeIndex].Rotation * trackedPoses[keyframeIndex].Rotation.transpose()) *
+                    inverseRotationSigma * inverseRotationSigma,
+                    (poses[keyframeIndex].Translation - trackedPoses[keyframeIndex].Translation) *
+                    inverseTranslationSigma * inverseTranslationSigma;
+            }
+
+            for (const CornerKeyframePair& pair : pairs)
+            {
+                poseHessians[pair.Keyframe] += pair.PoseHessian;
+                poseGradients[pair.Keyframe] += pair.PoseGradient;
+            }
+
+            //
+            // Solve the damped normal equations, raising the damping until the step
+            // lowers the cost.
+            //
+            bool improved = false;
+            double newCost = cost;
+
+            std::vector<Pose> newPoses(numberOfKeyframes);
+            std::vector<Eigen::Vector3d> newPositions(corners.size());
+
+            while (!improved && damping < c_maximumDamping)
+            {
+                //
+                // Reduced camera system: eliminate the corners with the Schur complement,
+                // S = U - W V^-1 W^T and s = -g_pose + W V^-1 g_corner.
+                //
+                Eigen::MatrixXd reducedHessian =
+                    Eigen::MatrixXd::Zero(6 * numberOfKeyframes, 6 * numberOfKeyframes);
+
+                Eigen::VectorXd reducedGradient(
+                    6 * numberOfKeyframes);
+
+                for (size_t keyframeIndex = 0; keyframeIndex < numberOfKeyframes; ++keyframeIndex)
+                {
+                    Matrix66d dampedHessian =
+                        poseHessians[keyframeIndex];
+
+                    dampedHessian.diagonal() *= 1.0 + damping;
+
+                    reducedHessian.block<6, 6>(6 * keyframeIndex, 6 * keyframeIndex) = dampedHessian;
+                    reducedGradient.segment<6>(6 * keyframeIndex) = -poseGradients[keyframeIndex];
+                }
+
+                for (CornerBlock& corner : corners)
+                {
+                    Eigen::Matrix3d dampedHessian =
+                        corner.Hessian;
+
+                    dampedHessian.diagonal() *= 1.0 + damping;
+                    dampedHessian.diagonal().array() += 1e-9;
+
+                    corner.InverseHessian =
+                        dampedHessian.inverse();
+
+                    for (uint32_t a = corner.FirstPair; a < corner.EndPair; ++a)
+                    {
+                        const Matrix63d crossTimesInverse =
+                            pairs[a].CrossHessian * corner.InverseHessian;
+
+                        reducedGradient.segment<6>(6 * pairs[a].Keyframe) +=
+                            crossTimesInverse * corner.Gradient;
+
+                        for (uint32_t b = corner.FirstPair; b < corner.EndPair; ++b)
+                        {
+                            reducedHessian.block<6, 6>(6 * pairs[a].Keyframe, 6 * pairs[b].Keyframe) -=
+                                crossTimesInverse * pairs[b].CrossHessian.transpose();
+                        }
+                    }
+                }
+
+                const Eigen::LDLT<Eigen::MatrixXd> ldlt(
+                    reducedHessian);
+
+                if (Eigen::Success != ldlt.info())
+                {
+                    damping *= 10.0;
+
+                    continue;
+                }
+
+                const Eigen::VectorXd poseStep =
+                    ldlt.solve(reducedGradient);
+
+                for (size_t keyframeIndex = 0; keyframeIndex < numberOfKeyframes; ++keyframeIndex)
+                {
+                    const Vector6d step =
+                        poseStep.segment<6>(6 * keyframeIndex);
+
+                    newPoses[keyframeIndex].Rotation =
+                        RotationFromVector(step.head<3>()) * poses[keyframeIndex].Rotation;
+
+                    newPoses[keyframeIndex].Translation =
+                        poses[keyframeIndex].Translation + step.tail<3>();
+                }
+
+                //
+                // Back substitution: dX = V^-1 (-g_corner - W^T dpose), per corner.
+                //
+                concurrency::parallel_for(size_t(0), corners.size(), [&](size_t cornerIndex)
+                {
+                    const CornerBlock& corner = corners[cornerIndex];
+
+                    Eigen::Vector3d gradient =
+                        -corner.Gradient;
+
+                    for (uint32_t pairIndex = corner.FirstPair; pairIndex < corner.EndPair; ++pairIndex)
+                    {
+                        gradient -=
+                            pairs[pairIndex].CrossHessian.transpose() * poseStep.segment<6>(6 * pairs[pairIndex].Keyframe);
+                    }
+
+                    newPositions[cornerIndex] =
+                        positions[cornerIndex] + corner.InverseHessian * gradient;
+                });
+
+                newCost =
+                    computeCost(newPoses, newPositions);
+
+                if (newCost < cost)
+                {
+                    improved = true;
+                    damping = std::max(damping / 3.0, c_minimumDamping);
+                }
+                else
+                {
+                    damping *= 5.0;
+                }
+            }
+
+            if (!improved)
+            {
+                break;
+            }
+
+            const bool converged =
+                cost - newCost < c_convergenceThreshold * cost;
+
+            poses.swap(newPoses);
+            positions.swap(newPositions);
+            cost = newCost;
+
+            if (converged)
+            {
+                break;
+            }
+        }
+
+        //
+        // Merge the result back. Keyframes marginalized in the meantime are gone, and
+        // corners keep their identity, so both are matched by id.
+        //
+        {
+            std::lock_guard<std::mutex> guard(_mutex);
+
+            size_t keyframeIndex = 0;
+
+            for (Keyframe& keyframe : _keyframes)
+            {
+                while (keyframeIndex < numberOfKeyframes && keyframeIds[keyframeIndex] < keyframe.Id)
+                {
+                    ++keyframeIndex;
+                }
+
+                if (keyframeIndex < numberOfKeyframes && keyframeIds[keyframeIndex] == keyframe.Id)
+                {
+                    keyframe.OptimizedPose = poses[keyframeIndex];
+                }
+            }
+
+            for (size_t cornerIndex = 0; cornerIndex < corners.size(); ++cornerIndex)
+            {
+                Corner& corner =
+                    _corners[corners[cornerIndex].CornerId];
+
+                corner.Position = positions[cornerIndex];
+                corner.Optimized = true;
+            }
+        }
+    }
+
+    bool MarkerMap::NeedsOptimization() const
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+
+        return _lastOptimizedKeyframeId != _nextKeyframeId;
+    }
+
+    std::map<int32_t, Eigen::Vector3f> MarkerMap::GetStableCorners() const
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+
+        std::map<int32_t, Eigen::Vector3f> stableCorners;
+
+        for (const auto& cornerIterator : _corners)
+        {
+            const Corner& corner =
+                cornerIterator.second;
+
+            if (corner.Optimized &&
+                corner.NumberOfKeyframes >= _settings.MinimumKeyframesForStableCorner)
+            {
+                stableCorners[cornerIterator.first] = corner.Position.cast<float>();
+            }
+        }
+
+        return stableCorners;
+    }
+}
@@ -0,0 +1,182 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#pragma once
+
+namespace ArUcoMarkerTracker
+{
+    //
+    // A marker corner detected in a camera image.
+    //
+    struct MarkerCornerObservation
+    {
+        // Marker id * 4 + corner index
+        int32_t CornerId;
+
+        // Position on the unit plane (z = 1) of the camera
+        Eigen::Vector2d UnitPlanePoint;
+    };
+
+    typedef std::vector<MarkerCornerObservation, Eigen::aligned_allocator<MarkerCornerObservation>>
+        MarkerCornerObservations;
+
+    //
+    // The marker corners detected in the image of one camera, and the pose of the camera
+    // reported by the device tracking: X_origin = CameraToOriginRotation * X_camera +
+    // CameraToOriginTranslation.
+    //
+    struct MarkerMapView
+    {
+        Eigen::Matrix3d CameraToOriginRotation;
+        Eigen::Vector3d CameraToOriginTranslation;
+
+        MarkerCornerObservations Observations;
+    };
+
+    struct MarkerMapSettings
+    {
+        MarkerMapSettings();
+
+        // Keyframes in the optimization window; older keyframes are marginalized.
+        size_t MaximumKeyframes;
+
+        // Levenberg-Marquardt iterations per call to Optimize.
+        int32_t MaximumIterations;
+
+        // A frame becomes a keyframe when it sees a new corner, or the device moved this
+        // far since the last keyframe.
+        double KeyframeTranslationInMeters;
+        double KeyframeRotationInDegrees;
+
+        // Standard deviation of the corner detections, in pixels, and the focal length
+        // converting it to the unit plane.
+        double ObservationSigmaInPixels;
+        double FocalLengthInPixels;
+
+        // Whitened reprojection error beyond which observations are down-weighted.
+        double HuberThreshold;
+
+        // Standard deviations of the keyframe poses around the device tracking. They
+        // anchor the map in the coordinate system of the tracking and fix its gauge.
+        double PoseSigmaInMeters;
+        double PoseSigmaInDegrees;
+
+        // Keyframes a corner must be observed in before it is reported as stable.
+        uint32_t MinimumKeyframesForStableCorner;
+    };
+
+    //
+    // Persistent map of the marker corners seen by the visible light cameras.
+    //
+    // Every frame which sees a new corner, or was taken after the device moved far enough,
+    // becomes a keyframe holding its views, their poses and their corner observations.
+    // New corners are triangulated from the views of the keyframe they are first seen
+    // in. Optimize then jointly refines the corners and the poses of the keyframes in a
+    // sliding window with sparse bundle adjustment: Levenberg-Marquardt on the
+    // reprojection errors, with the corners eliminated by the Schur complement so that
+    // only the 6N x 6N reduced camera system of the N keyframes is factorized, and the
+    // Jacobians evaluated in parallel per corner.
+    //
+    // Keyframes leaving the window are marginalized into a prior on the position of each
+    // corner they observed, so that corners keep their accumulated precision, and corners
+    // which are no longer observed stay in the map at their last estimate. The cost of
+    // AddViews and Optimize is bounded by the window size, however long the map is used.
+    //
+    // AddViews and GetStableCorners can be called while Optimize runs on another thread;
+    // Optimize works on a snapshot of the window and merges its result back.
+    //
+    class MarkerMap
+    {
+    public:
+        MarkerMap(
+            _In_ const MarkerMapSettings& settings = MarkerMapSettings());
+
+        //
+        // Adds the views of the cameras of a frame, taken at (nearly) the same time.
+        // Returns true if the frame was added as a keyframe, in which case the map
+        // should be optimized.
+        //
+        bool AddViews(
+            _In_ const std::vector<MarkerMapView>& views);
+
+        //
+        // Runs up to MaximumIterations iterations of bundle adjustment over the window.
+        //
+        void Optimize();
+
+        //
+        // Whether keyframes were added since the last call to Optimize began.
+        //
+        bool NeedsOptimization() const;
+
+        //
+        // Returns the positions of the corners which were observed in enough keyframes
+        // and refined by at least one optimization, by corner id.
+        //
+        std::map<int32_t, Eigen::Vector3f> GetStableCorners() const;
+
+    public:
+        struct Pose
+        {
+            Eigen::Matrix3d Rotation;
+            Eigen::Vector3d Translation;
+        };
+
+        struct KeyframeObservation
+        {
+            uint32_t View;
+            int32_t CornerId;
+            Eigen::Vector2d UnitPlanePoint;
+        };
+
+        struct Keyframe
+        {
+            uint64_t Id;
+
+            // First camera to origin, from the device tracking and optimized
+            Pose TrackedPose;
+            Pose OptimizedPose;
+
+            // Camera to first camera, per view
+            std::vector<Pose> ViewToRig;
+
+            std::vector<KeyframeObservation, Eigen::aligned_allocator<KeyframeObservation>> Observations;
+        };
+
+        struct Corner
+        {
+            Eigen::Vector3d Position;
+
+            // Information of the observations of marginalized keyframes, as a prior on
+            // the position with mean PriorPosition.
+            Eigen::Matrix3d PriorInformation;
+            Eigen::Vector3d PriorPosition;
+
+            uint32_t NumberOfKeyframes;
+            bool Optimized;
+        };
+
+    private:
+        void MarginalizeOldestKeyframe();
+
+    private:
+        MarkerMapSettings _settings;
+
+        mutable std::mutex _mutex;
+        std::deque<Keyframe> _keyframes;
+        std::map<int32_t, Corner> _corners;
+        uint64_t _nextKeyframeId;
+        uint64_t _lastOptimizedKeyframeId;
+
+        // Serializes the optimizations
+        std::mutex _optimizeMutex;
+    };
+}
@@ -25,7 +25,9 @@
 #include <shared_mutex>
 #include <wincodec.h>
 #include <WindowsNumerics.h>
+#include <ppl.h>
 #include <ppltasks.h>
+#include <set>
 #include <stddef.h>
 #include <unordered_set>
 #include <memorybuffer.h>
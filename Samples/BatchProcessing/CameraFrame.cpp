@@ -20,6 +20,27 @@ namespace BatchProcessing
                 RecordingFolder,
                 FileName);
 
+        //
+        // The recorder stores the PV camera frames as binary PPM images, which we decode
+        // and convert to BGRA. Other files are assumed to hold the raw BGRA pixels.
+        //
+        if (imageBuffer.size() > 2 && 'P' == imageBuffer[0] && '6' == imageBuffer[1])
+        {
+            cv::Mat bgrImage =
+                cv::imdecode(
+                    imageBuffer,
+                    cv::IMREAD_COLOR);
+
+            ASSERT(!bgrImage.empty());
+
+            cv::cvtColor(
+                bgrImage,
+                Image,
+                cv::COLOR_BGR2BGRA);
+
+            return;
+        }
+
         Image = cv::Mat(
             Height /* _rows */,
             Width /* _cols */,
@@ -75,12 +96,15 @@ namespace BatchProcessing
                 tokens,
                 lineBuffer);
 
+            //
+            // Recordings starting with version 0.2 append a SequenceNumber column.
+            //
             ASSERT(
                 1 /* Timestamp */ +
                 1 /* ImageFileName */ +
                 16 /* FrameToOrigin.m(1..4)(1..4) */ +
                 16 /* CameraViewTransform.m(1..4)(1..4) */ +
-                16 /* CameraProjectionTransform.m(1..4)(1..4) */ == tokens.size());
+                16 /* CameraProjectionTransform.m(1..4)(1..4) */ <= tokens.size());
 
             //
             // Skip the CSV file header
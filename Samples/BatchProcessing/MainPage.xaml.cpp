@@ -86,6 +86,14 @@ namespace BatchProcessing
                     cameraFrame.FileName.c_str());
             }
 
+            //
+            // Browse the low-resolution proxy track if the recording has one, and only
+            // load the full-resolution frames on demand.
+            //
+            _pvProxyTrack.Open(
+                folder,
+                L"pv_proxy.bin");
+
             _currentPvCameraFrame = -1;
 
             MoveRecordingCursor(
@@ -109,46 +117,75 @@ namespace BatchProcessing
             +1 /* howMuch */);
     }
 
-    void MainPage::UpdatePreview()
+    void MainPage::Button_FullResolution(
+        Platform::Object^ sender,
+        Windows::UI::Xaml::RoutedEventArgs^ e)
+    {
+        ShowFullResolutionFrame();
+    }
+
+    void MainPage::ShowFullResolutionFrame()
     {
         if (_currentPvCameraFrame < 0)
         {
             return;
         }
 
+        auto& pvCameraFrame =
+            _pvCameraFrames[
+                _currentPvCameraFrame];
+
+        pvCameraFrame.Load();
+
+        UpdatePreview(
+            pvCameraFrame.Image,
+            true /* isFullResolution */);
+    }
+
+    void MainPage::UpdatePreview(
+        _In_ const cv::Mat& image,
+        _In_ bool isFullResolution)
+    {
+        if (_currentPvCameraFrame < 0)
+        {
+            return;
+        }
+
+        ASSERT(4 == image.elemSize() && image.isContinuous());
+
+        const int32_t currentPvCameraFrame =
+            _currentPvCameraFrame;
+
         _pvCameraImage->Dispatcher->RunAsync(
             Windows::UI::Core::CoreDispatcherPriority::Normal,
             ref new Windows::UI::Core::DispatchedHandler(
-                [this]()
+                [this, image, isFullResolution, currentPvCameraFrame]()
         {
-            const auto& pvCameraFrame =
-                _pvCameraFrames[
-                    _currentPvCameraFrame];
-
             {
                 wchar_t caption[MAX_PATH] = {};
 
                 swprintf_s(
                     caption,
-                    L"PV Camera Image: frame %i / %i",
-                    _currentPvCameraFrame + 1,
-                    static_cast<uint32_t>(_pvCameraFrames.size()));
+                    L"PV Camera Image: frame %i / %i%s",
+                    currentPvCameraFrame + 1,
+                    static_cast<uint32_t>(_pvCameraFrames.size()),
+                    isFullResolution ? L"" : L" (preview, press Enter for full resolution)");
 
                 _pvCameraImageCaption->Text =
                     ref new Platform::String(
                         caption);
             }
 
-            auto image =
+            auto bitmap =
                 ref new Windows::Graphics::Imaging::SoftwareBitmap(
                     Windows::Graphics::Imaging::BitmapPixelFormat::Bgra8,
-                    pvCameraFrame.Width,
-                    pvCameraFrame.Height,
+                    image.cols,
+                    image.rows,
                     Windows::Graphics::Imaging::BitmapAlphaMode::Ignore);
 
             {
                 auto imageBuffer =
-                    image->LockBuffer(
+                    bitmap->LockBuffer(
                         Windows::Graphics::Imaging::BitmapBufferAccessMode::Write);
 
                 auto imageBufferReference =
@@ -161,13 +198,13 @@ namespace BatchProcessing
                         imageBufferReference,
                         imageBufferDataLength);
 
-                ASSERT((int32_t)imageBufferDataLength == pvCameraFrame.Width * pvCameraFrame.Height * 4);
+                ASSERT((int32_t)imageBufferDataLength == image.cols * image.rows * 4);
 
                 ASSERT(0 == memcpy_s(
                     imageBufferData,
                     imageBufferDataLength,
-                    pvCameraFrame.Image.data,
-                    pvCameraFrame.Width * pvCameraFrame.Height * 4));
+                    image.data,
+                    image.cols * image.rows * 4));
             }
 
             auto imageSource =
@@ -175,7 +212,7 @@ namespace BatchProcessing
 
             concurrency::create_task(
                 imageSource->SetBitmapAsync(
-                    image)).then(
+                    bitmap)).then(
                         [this, imageSource]()
             {
                 _pvCameraImage->Source =
@@ -208,6 +245,10 @@ namespace BatchProcessing
             MoveRecordingCursor(
                 +10 /* howMuch */);
         }
+        else if (e->Key == Windows::System::VirtualKey::Enter)
+        {
+            ShowFullResolutionFrame();
+        }
     }
 
     void MainPage::MoveRecordingCursor(
@@ -223,12 +264,26 @@ namespace BatchProcessing
                 howMuch = -((-howMuch) % numberOfFrames);
             }
 
+            if (_currentPvCameraFrame >= 0)
+            {
+                _pvCameraFrames[_currentPvCameraFrame].Unload();
+            }
+
             _currentPvCameraFrame =
                 (_currentPvCameraFrame + numberOfFrames + howMuch) % numberOfFrames;
 
-            _pvCameraFrames[_currentPvCameraFrame].Load();
-
-            UpdatePreview();
+            if (_pvProxyTrack.IsOpen())
+            {
+                UpdatePreview(
+                    _pvProxyTrack.LoadFrame(
+                        _pvProxyTrack.FindFrame(
+                            _pvCameraFrames[_currentPvCameraFrame].Timestamp)),
+                    false /* isFullResolution */);
+            }
+            else
+            {
+                ShowFullResolutionFrame();
+            }
         }
     }
 }
@@ -33,6 +33,10 @@ namespace BatchProcessing
             Platform::Object^ sender,
             Windows::UI::Xaml::RoutedEventArgs^ e);
 
+        void Button_FullResolution(
+            Platform::Object^ sender,
+            Windows::UI::Xaml::RoutedEventArgs^ e);
+
         void Grid_KeyDown(
             Platform::Object^ sender,
             Windows::UI::Xaml::Input::KeyRoutedEventArgs^ e);
@@ -40,11 +44,16 @@ namespace BatchProcessing
         void MoveRecordingCursor(
             int32_t howMuch);
 
-        void UpdatePreview();
+        void ShowFullResolutionFrame();
+
+        void UpdatePreview(
+            _In_ const cv::Mat& image,
+            _In_ bool isFullResolution);
 
     private:
         std::vector<HoloLensCameraCalibration> _cameraCalibrations;
         std::vector<HoloLensCameraFrame> _pvCameraFrames;
+        HoloLensProxyTrack _pvProxyTrack;
         int32_t _currentPvCameraFrame = -1;
     };
 }
@@ -0,0 +1,172 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#include "pch.h"
+
+namespace BatchProcessing
+{
+    bool HoloLensProxyTrack::Open(
+        _In_ Windows::Storage::StorageFolder^ recordingFolder,
+        _In_ const std::wstring& fileName)
+    {
+        Close();
+
+        Microsoft::WRL::ComPtr<IStorageFolderHandleAccess> folderHandleAccess =
+            Io::GetStorageFolderHandleAccess(
+                recordingFolder);
+
+        HANDLE input = nullptr;
+
+        if (FAILED(folderHandleAccess->Create(
+            fileName.c_str() /* fileName */,
+            HCO_OPEN_EXISTING /* creationOptions */,
+            HAO_READ /* accessOptions */,
+            HSO_SHARE_READ /* sharingOptions */,
+            HO_NONE /* options */,
+            nullptr /* oplockBreakingHandler */,
+            &input)))
+        {
+            return false;
+        }
+
+        _file.Attach(
+            input);
+
+        ReadAt(
+            0 /* offset */,
+            &_header,
+            sizeof(_header));
+
+        ASSERT(0 == memcmp(_header.Magic, "HLPX", sizeof(_header.Magic)));
+        ASSERT(0 == _header.VersionMajor);
+
+        _index.resize(
+            _header.NumberOfFrames);
+
+        if (!_index.empty())
+        {
+            ReadAt(
+                _header.IndexOffset,
+                _index.data(),
+                static_cast<uint32_t>(_index.size() * sizeof(HoloLensProxyTrackIndexEntry)));
+        }
+
+        dbg::trace(
+            L" *** opened proxy track '%s' with %i frames of %ix%i",
+            fileName.c_str(),
+            static_cast<int32_t>(_index.size()),
+            _header.Width,
+            _header.Height);
+
+        return true;
+    }
+
+    void HoloLensProxyTrack::Close()
+    {
+        _file.Close();
+        _index.clear();
+    }
+
+    bool HoloLensProxyTrack::IsOpen() const
+    {
+        return _file.IsValid();
+    }
+
+    int32_t HoloLensProxyTrack::FindFrame(
+        _In_ uint64_t timestamp) const
+    {
+        if (_index.empty())
+        {
+            return -1;
+        }
+
+        const auto next =
+            std::lower_bound(
+                _index.begin(),
+                _index.end(),
+                timestamp,
+                [](const HoloLensProxyTrackIndexEntry& entry, uint64_t value)
+        {
+            return entry.Timestamp < value;
+        });
+
+        if (next == _index.end())
+        {
+            return static_cast<int32_t>(_index.size()) - 1;
+        }
+
+        if (next != _index.begin() &&
+            timestamp - (next - 1)->Timestamp < next->Timestamp - timestamp)
+        {
+            return static_cast<int32_t>(next - _index.begin()) - 1;
+        }
+
+        return static_cast<int32_t>(next - _index.begin());
+    }
+
+    cv::Mat HoloLensProxyTrack::LoadFrame(
+        _In_ int32_t index) const
+    {
+        REQUIRES(0 <= index && index < static_cast<int32_t>(_index.size()));
+
+        const HoloLensProxyTrackIndexEntry& entry =
+            _index[index];
+
+        std::vector<uint8_t> jpegData(
+            entry.Size);
+
+        ReadAt(
+            entry.Offset,
+            jpegData.data(),
+            entry.Size);
+
+        cv::Mat image =
+            cv::imdecode(
+                jpegData,
+                cv::IMREAD_COLOR);
+
+        ASSERT(!image.empty());
+
+        cv::Mat bgraImage;
+
+        cv::cvtColor(
+            image,
+            bgraImage,
+            cv::COLOR_BGR2BGRA);
+
+        return bgraImage;
+    }
+
+    void HoloLensProxyTrack::ReadAt(
+        _In_ uint64_t offset,
+        _Out_writes_bytes_(size) void* data,
+        _In_ uint32_t size) const
+    {
+        OVERLAPPED overlapped = {};
+
+        overlapped.Offset =
+            static_cast<DWORD>(offset);
+
+        overlapped.OffsetHigh =
+            static_cast<DWORD>(offset >> 32);
+
+        DWORD numberOfBytesRead = 0;
+
+        ASSERT(!!ReadFile(
+            _file.Get(),
+            data,
+            size,
+            &numberOfBytesRead,
+            &overlapped));
+
+        ASSERT(size == numberOfBytesRead);
+    }
+}
@@ -0,0 +1,88 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#pragma once
+
+namespace BatchProcessing
+{
+    //
+    // Layout of the proxy track files written by Samples\py\proxy_tracks.py, e.g.
+    // pv_proxy.bin: the header, the JPEG images in timestamp order and the index.
+    //
+#pragma pack(push, 1)
+    struct HoloLensProxyTrackHeader
+    {
+        char Magic[4];
+        uint8_t VersionMajor;
+        uint8_t VersionMinor;
+        uint16_t Flags;
+        uint32_t NumberOfFrames;
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t FullWidth;
+        uint32_t FullHeight;
+        uint32_t Reserved;
+        uint64_t IndexOffset;
+    };
+
+    struct HoloLensProxyTrackIndexEntry
+    {
+        uint64_t Timestamp;
+        uint64_t Offset;
+        uint32_t Size;
+        uint32_t Reserved;
+    };
+#pragma pack(pop)
+
+    //
+    // Low-resolution, compressed thumbnails of a sensor's frames, for browsing a recording
+    // without reading the full-resolution frames. Only the index is kept in memory; the
+    // thumbnails are read from the open file as they are requested.
+    //
+    class HoloLensProxyTrack
+    {
+    public:
+        //
+        // Returns false if the recording has no proxy track with this name.
+        //
+        bool Open(
+            _In_ Windows::Storage::StorageFolder^ recordingFolder,
+            _In_ const std::wstring& fileName);
+
+        void Close();
+
+        bool IsOpen() const;
+
+        //
+        // Returns the index of the thumbnail closest to the timestamp, or -1 if the
+        // track is empty.
+        //
+        int32_t FindFrame(
+            _In_ uint64_t timestamp) const;
+
+        //
+        // Returns the thumbnail as a BGRA image.
+        //
+        cv::Mat LoadFrame(
+            _In_ int32_t index) const;
+
+    private:
+        void ReadAt(
+            _In_ uint64_t offset,
+            _Out_writes_bytes_(size) void* data,
+            _In_ uint32_t size) const;
+
+    private:
+        Microsoft::WRL::Wrappers::FileHandle _file;
+        HoloLensProxyTrackHeader _header = {};
+        std::vector<HoloLensProxyTrackIndexEntry> _index;
+    };
+}
@@ -14,16 +14,22 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <algorithm>
 
 #include <collection.h>
 #include <ppltasks.h>
+#include <wrl/client.h>
+#include <wrl/wrappers/corewrappers.h>
 
 #include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
 
 #include <Debugging/All.h>
 #include <Io/All.h>
 
 #include "CameraCalibration.h"
 #include "CameraFrame.h"
+#include "ProxyTrack.h"
 
 #include "App.xaml.h"
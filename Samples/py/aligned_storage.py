@@ -0,0 +1,225 @@
+"""
+ Copyright (c) Microsoft. All rights reserved.
+
+ This code is licensed under the MIT License (MIT).
+ THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+ ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+ IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+ PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+"""
+
+""" Preallocated, aligned direct-I/O file writer for recordings, and its benchmark """
+# pylint: disable=C0103
+
+import argparse
+import concurrent.futures
+import errno
+import fcntl
+import mmap
+import os
+import time
+import numpy as np
+
+# Alignment of the buffers, write sizes and file offsets for direct I/O: a
+# multiple of the logical block size of all the storage we write to.
+ALIGNMENT = 4096
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--path", required=True,
+                        help="Folder to benchmark, e.g. on tmpfs (/dev/shm) or a disk")
+    parser.add_argument("--size_mb", type=int, default=1024)
+    parser.add_argument("--frame_size", type=int, default=450 * 1024,
+                        help="Size of the individual writes; the default is a depth frame")
+    parser.add_argument("--buffer_size_mb", type=int, default=4)
+    parser.add_argument("--num_buffers", type=int, default=4)
+    parser.add_argument("--preallocation_mb", type=int, default=256)
+    return parser.parse_args()
+
+
+class AlignedFileWriter(object):
+    """Sequential writer that gathers small writes into a ring of page-aligned
+    buffers and writes full buffers with positioned direct I/O on a background
+    thread, while the next ones fill up. The file is preallocated in large
+    extents and truncated to the number of bytes written when closed.
+
+    Falls back to buffered I/O where O_DIRECT is not supported (e.g. tmpfs on
+    older kernels) and to growing the file on demand where fallocate is not.
+
+    Direct I/O only pays off on storage slower than the page cache: on tmpfs,
+    this writer is about half as fast as per-frame buffered writes, with a
+    higher p99 latency. Run the benchmark on the target disk before using it."""
+
+    def __init__(self, path, buffer_size=4 * 1024 * 1024, num_buffers=4,
+                 preallocation_size=256 * 1024 * 1024, direct=True):
+        assert buffer_size > 0 and buffer_size % ALIGNMENT == 0
+        flags = os.O_WRONLY | os.O_CREAT | os.O_TRUNC
+        self.direct = direct and hasattr(os, "O_DIRECT")
+        self.fd = None
+        if self.direct:
+            try:
+                self.fd = os.open(path, flags | os.O_DIRECT, 0o644)
+            except OSError as e:
+                if e.errno != errno.EINVAL:
+                    raise
+                self.direct = False
+        if self.fd is None:
+            self.fd = os.open(path, flags, 0o644)
+
+        # Anonymous mappings are page-aligned, as direct I/O requires.
+        self.buffers = [mmap.mmap(-1, buffer_size) for _ in range(num_buffers)]
+        self.pending = [None] * num_buffers
+        self.buffer_size = buffer_size
+        self.current = 0
+        self.used = 0
+        self.offset = 0
+        self.size = 0
+        self.preallocation_size = preallocation_size
+        self.allocation_size = 0
+        # The writes run on one thread, in order; os.pwrite releases the GIL.
+        self.executor = concurrent.futures.ThreadPoolExecutor(1)
+
+    def write(self, data):
+        view = memoryview(data).cast("B")
+        position = 0
+        while position < len(view):
+            chunk_size = min(len(view) - position, self.buffer_size - self.used)
+            self.buffers[self.current][self.used:self.used + chunk_size] = \
+                view[position:position + chunk_size]
+            self.used += chunk_size
+            position += chunk_size
+            if self.used == self.buffer_size:
+                self._submit()
+        self.size += len(view)
+
+    def close(self):
+        if self.fd is None:
+            return
+        if self.used > 0:
+            self._submit()
+        for i in range(len(self.buffers)):
+            self._wait(i)
+        self.executor.shutdown()
+        # Drop the alignment padding of the last buffer and the unused preallocation.
+        os.ftruncate(self.fd, self.size)
+        os.close(self.fd)
+        self.fd = None
+        for buffer in self.buffers:
+            buffer.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def _submit(self):
+        # Only the last buffer can be partially filled. Direct writes must cover
+        # whole blocks, so it is padded with zeroes which close truncates again.
+        write_size = (self.used + ALIGNMENT - 1) // ALIGNMENT * ALIGNMENT
+        buffer = self.buffers[self.current]
+        buffer[self.used:write_size] = bytes(write_size - self.used)
+        self._preallocate(self.offset + write_size)
+        self.pending[self.current] = self.executor.submit(
+            self._pwrite, memoryview(buffer)[:write_size], self.offset)
+        self.offset += write_size
+        # Move on to the least recently submitted buffer, waiting for its write
+        # to complete if the storage fell behind.
+        self.current = (self.current + 1) % len(self.buffers)
+        self.used = 0
+        self._wait(self.current)
+
+    def _pwrite(self, data, offset):
+        try:
+            written = os.pwrite(self.fd, data, offset)
+        except OSError as e:
+            # Some file systems accept O_DIRECT on open but not on write.
+            if e.errno != errno.EINVAL or not self.direct:
+                raise
+            self.direct = False
+            fcntl.fcntl(self.fd, fcntl.F_SETFL,
+                        fcntl.fcntl(self.fd, fcntl.F_GETFL) & ~os.O_DIRECT)
+            written = os.pwrite(self.fd, data, offset)
+        assert written == len(data)
+
+    def _wait(self, i):
+        if self.pending[i] is not None:
+            self.pending[i].result()
+            self.pending[i] = None
+
+    def _preallocate(self, required_size):
+        if self.preallocation_size == 0 or required_size <= self.allocation_size:
+            return
+        new_allocation_size = max(required_size,
+                                  self.allocation_size + self.preallocation_size)
+        try:
+            os.posix_fallocate(self.fd, self.allocation_size,
+                               new_allocation_size - self.allocation_size)
+        except OSError:
+            self.preallocation_size = 0
+            return
+        self.allocation_size = new_allocation_size
+
+
+class BufferedFileWriter(object):
+    """The baseline: one buffered write per frame."""
+
+    def __init__(self, path):
+        self.file = open(path, "wb")
+        self.direct = False
+
+    def write(self, data):
+        self.file.write(data)
+
+    def close(self):
+        self.file.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+
+def benchmark_writer(name, create_writer, path, size, frame_size):
+    frame = np.random.randint(0, 256, frame_size, dtype=np.uint8).tobytes()
+    num_frames = max(1, size // frame_size)
+    latencies = np.empty(num_frames)
+    start = time.perf_counter()
+    with create_writer(path) as writer:
+        for i in range(num_frames):
+            write_start = time.perf_counter()
+            writer.write(frame)
+            latencies[i] = time.perf_counter() - write_start
+        direct = writer.direct
+    # Include the time to get the data to the storage, as the page cache would
+    # otherwise hide the cost of the buffered writes.
+    fd = os.open(path, os.O_RDONLY)
+    os.fsync(fd)
+    os.close(fd)
+    elapsed = time.perf_counter() - start
+    assert os.path.getsize(path) == num_frames * frame_size
+    os.remove(path)
+    print("{:>10}{:>8}{:>12.1f}{:>12.3f}{:>12.3f}{:>12.3f}".format(
+        name, "yes" if direct else "no", num_frames * frame_size / elapsed / 1e6,
+        1e3 * np.median(latencies), 1e3 * np.percentile(latencies, 99),
+        1e3 * latencies.max()))
+
+
+def main():
+    args = parse_args()
+
+    path = os.path.join(args.path, "aligned_storage_benchmark.bin")
+    size = args.size_mb * 1024 * 1024
+
+    print("{:>10}{:>8}{:>12}{:>12}{:>12}{:>12}".format(
+        "writer", "direct", "MB/s", "p50 ms", "p99 ms", "max ms"))
+    benchmark_writer("buffered", BufferedFileWriter, path, size, args.frame_size)
+    benchmark_writer("aligned", lambda path: AlignedFileWriter(
+        path, args.buffer_size_mb * 1024 * 1024, args.num_buffers,
+        args.preallocation_mb * 1024 * 1024), path, size, args.frame_size)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,362 @@
+"""
+ Copyright (c) Microsoft. All rights reserved.
+
+ This code is licensed under the MIT License (MIT).
+ THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+ ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+ IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+ PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+"""
+
+""" Processes many recordings in parallel shards which are checkpointed for resuming """
+# pylint: disable=C0103
+
+import argparse
+import concurrent.futures
+import glob
+import json
+import multiprocessing
+import os
+import socket
+import sys
+import time
+import traceback
+from collections import namedtuple
+
+from recording_catalog import CATALOG_FILE_NAME, SENSOR_NAMES, RecordingCatalog
+
+# A unit of work: a function of the recording path and the arguments, which
+# runs once all the shards named in dependencies have completed.
+Shard = namedtuple('Shard', 'recording name dependencies function arguments')
+
+DEPTH_CAMERAS = ["short_throw_depth", "long_throw_depth"]
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--workspace_path", required=True,
+                        help="Folder with the recordings, as downloaded by recorder_console.py")
+    parser.add_argument("--recording_pattern", default="*",
+                        help="Only process the recordings whose folder names match")
+    parser.add_argument("--state_path",
+                        help="Folder of the shard checkpoints, by default .batch_runner in "
+                             "the workspace. Runners on several machines can share the "
+                             "workspace and this folder to split the work.")
+    parser.add_argument("--stages", default="extract,pcloud",
+                        help="Comma-separated stages out of catalog, proxy, extract, pcloud "
+                             "and reconstruct")
+    parser.add_argument("--cameras", default="long_throw_depth",
+                        help="Comma-separated depth cameras of the pcloud stage")
+    parser.add_argument("--shard_size", type=int, default=200,
+                        help="Number of depth frames per pcloud shard")
+    parser.add_argument("--output_format", choices=["obj", "ply"], default="ply")
+    parser.add_argument("--merge_points", action="store_true",
+                        help="Merge the point clouds of each recording once all of its "
+                             "shards have completed")
+    parser.add_argument("--colmap_path", help="Path to COLMAP.bat executable")
+    parser.add_argument("--sparse", action="store_true",
+                        help="Only perform sparse reconstruction")
+    parser.add_argument("--num_workers", type=int, default=multiprocessing.cpu_count())
+    parser.add_argument("--claim_timeout", type=float, default=6 * 3600,
+                        help="Seconds after which a shard claimed by a runner that did "
+                             "not finish it is taken over")
+    parser.add_argument("--poll_interval", type=float, default=5.0)
+
+    args = parser.parse_args()
+
+    args.stages = args.stages.split(",")
+    args.cameras = args.cameras.split(",")
+    for camera in args.cameras:
+        if camera not in DEPTH_CAMERAS:
+            parser.error("Invalid depth camera: {}".format(camera))
+    if "reconstruct" in args.stages and not args.colmap_path:
+        parser.error("--colmap_path is required for the reconstruct stage")
+    if args.state_path is None:
+        args.state_path = os.path.join(args.workspace_path, ".batch_runner")
+
+    return args
+
+
+def catalog(recording_path, catalog_path):
+    recording_catalog = RecordingCatalog(catalog_path)
+    recording_catalog.index_recording(recording_path)
+    recording_catalog.close()
+
+
+def proxy(recording_path, sensor):
+    from proxy_tracks import write_proxy_track
+    write_proxy_track(recording_path, sensor)
+
+
+def extract(recording_path):
+    from recorder_console import extract_recording
+    extract_recording(recording_path)
+
+
+def pcloud_args(recording_path, output_format, **kwargs):
+    args = argparse.Namespace(
+        workspace_path=recording_path, output_path=recording_path,
+        output_suffix="", ignore_sensor_poses=False, pose_suffix="",
+        start_frame=0, max_num_frames=-1, merge_points=False, use_cache=False,
+        overwrite=True, output_format=output_format)
+    for key, value in kwargs.items():
+        setattr(args, key, value)
+    return args
+
+
+def compute_point_clouds(recording_path, camera, start_frame, num_frames,
+                         output_format):
+    from pcloud_compute import process_folder
+    process_folder(pcloud_args(recording_path, output_format,
+                               start_frame=start_frame,
+                               max_num_frames=num_frames), camera)
+
+
+def merge_point_clouds(recording_path, camera, output_format):
+    from pcloud_compute import process_folder, save_obj, save_ply
+    points, normals = process_folder(pcloud_args(
+        recording_path, output_format, merge_points=True, use_cache=True,
+        overwrite=False), camera)
+    output_filename = os.path.join(recording_path, camera + "." + output_format)
+    if output_format == "ply":
+        save_ply(output_filename, points, normals)
+    else:
+        save_obj(output_filename, points)
+
+
+def reconstruct(recording_path, colmap_path, dense):
+    from recorder_console import reconstruct_recording
+    args = argparse.Namespace(
+        colmap_path=colmap_path, ref_camera_name="vlc_ll", frame_rate=5,
+        frame_selection="frame_rate", start_frame=-1, max_num_frames=-1,
+        num_refinements=3, matcher="pose_prior", max_num_neighbors=20)
+    reconstruct_recording(args, recording_path, dense=dense)
+
+
+def run_shard(shard):
+    shard.function(shard.recording, *shard.arguments)
+
+
+def plan_recording(args, recording_path, completed):
+    """Returns the shards of a recording. The pcloud shards are only known
+    once the depth frames are extracted, so the plan grows as shards complete."""
+    shards = []
+
+    if "catalog" in args.stages:
+        shards.append(Shard(recording_path, "catalog", [], catalog,
+                            [os.path.join(args.workspace_path, CATALOG_FILE_NAME)]))
+
+    has_tarballs = len(glob.glob(os.path.join(recording_path, "*.tar"))) > 0
+
+    # The proxy tracks are read from the tarballs, so they need no extraction.
+    if "proxy" in args.stages:
+        for sensor in SENSOR_NAMES:
+            if os.path.exists(os.path.join(recording_path, sensor + ".csv")):
+                shards.append(Shard(recording_path, "proxy_" + sensor, [], proxy, [sensor]))
+    extract_dependencies = []
+    if "extract" in args.stages and has_tarballs:
+        shards.append(Shard(recording_path, "extract", [], extract, []))
+        extract_dependencies = ["extract"]
+        if (recording_path, "extract") not in completed:
+            return shards
+
+    if "pcloud" in args.stages:
+        for camera in args.cameras:
+            # The frame index of the camera: its depth frames sorted by time.
+            num_frames = len(glob.glob(os.path.join(recording_path, camera, "*.pgm")))
+            pcloud_shards = []
+            for start_frame in range(0, num_frames, args.shard_size):
+                name = "pcloud_{}_{:06d}".format(camera, start_frame)
+                pcloud_shards.append(name)
+                shards.append(Shard(recording_path, name, extract_dependencies,
+                                    compute_point_clouds,
+                                    [camera, start_frame, args.shard_size,
+                                     args.output_format]))
+            if args.merge_points and pcloud_shards:
+                shards.append(Shard(recording_path, "merge_" + camera, pcloud_shards,
+                                    merge_point_clouds, [camera, args.output_format]))
+
+    if "reconstruct" in args.stages:
+        shards.append(Shard(recording_path, "reconstruct", extract_dependencies,
+                            reconstruct, [args.colmap_path, not args.sparse]))
+
+    return shards
+
+
+class CheckpointStore(object):
+    """Records claimed and completed shards as files, so that runners can be
+    resumed and runners on several machines sharing the folder split the
+    work without any other coordination."""
+
+    def __init__(self, state_path, claim_timeout):
+        self.state_path = state_path
+        self.claim_timeout = claim_timeout
+
+    def path(self, shard, extension):
+        return os.path.join(self.state_path, os.path.basename(shard.recording),
+                            shard.name + extension)
+
+    def completed(self, recording_path):
+        paths = glob.glob(os.path.join(
+            self.state_path, os.path.basename(recording_path), "*.done"))
+        return set((recording_path, os.path.splitext(os.path.basename(path))[0])
+                   for path in paths)
+
+    def is_claimed(self, shard):
+        # Only claims of live runners count; a stale claim left by a crashed
+        # run would never be released.
+        claim_path = self.path(shard, ".claim")
+        try:
+            return not self.is_stale(claim_path)
+        except (OSError, ValueError):
+            # Released meanwhile, or still being written by its runner.
+            return os.path.exists(claim_path)
+
+    def is_stale(self, claim_path):
+        if time.time() - os.path.getmtime(claim_path) >= self.claim_timeout:
+            return True
+        # A claim of a runner on this machine which is no longer running is
+        # left over from an interrupted run.
+        with open(claim_path) as f:
+            claim = json.load(f)
+        if claim["host"] != socket.gethostname():
+            return False
+        try:
+            os.kill(claim["pid"], 0)
+        except ProcessLookupError:
+            return True
+        except OSError:
+            pass
+        return False
+
+    def claim(self, shard):
+        claim_path = self.path(shard, ".claim")
+        if not os.path.isdir(os.path.dirname(claim_path)):
+            os.makedirs(os.path.dirname(claim_path), exist_ok=True)
+        for _ in range(2):
+            try:
+                fd = os.open(claim_path, os.O_CREAT | os.O_EXCL | os.O_WRONLY)
+            except FileExistsError:
+                try:
+                    if not self.is_stale(claim_path):
+                        return False
+                    os.remove(claim_path)
+                except (OSError, ValueError):
+                    pass
+                continue
+            with os.fdopen(fd, "w") as f:
+                json.dump({"host": socket.gethostname(), "pid": os.getpid(),
+                           "time": time.time()}, f)
+            return True
+        return False
+
+    def complete(self, shard, elapsed):
+        done_path = self.path(shard, ".done")
+        with open(done_path + ".tmp", "w") as f:
+            json.dump({"host": socket.gethostname(), "elapsed": elapsed}, f)
+        os.replace(done_path + ".tmp", done_path)
+        try:
+            os.remove(self.path(shard, ".failed"))
+        except OSError:
+            pass
+        self.release(shard)
+
+    def fail(self, shard, message):
+        with open(self.path(shard, ".failed"), "w") as f:
+            f.write(message)
+        self.release(shard)
+
+    def release(self, shard):
+        try:
+            os.remove(self.path(shard, ".claim"))
+        except OSError:
+            pass
+
+
+def run_shards(args, recording_paths, store):
+    executor = concurrent.futures.ProcessPoolExecutor(args.num_workers)
+    running = {}
+    running_keys = set()
+    failed = set()
+    num_completed = 0
+    start_time = time.time()
+
+    while True:
+        completed = set()
+        for recording_path in recording_paths:
+            completed |= store.completed(recording_path)
+
+        pending = []
+        for recording_path in recording_paths:
+            for shard in plan_recording(args, recording_path, completed):
+                key = (shard.recording, shard.name)
+                if key not in completed and key not in failed and \
+                        key not in running_keys:
+                    pending.append(shard)
+
+        ready = [shard for shard in pending
+                 if all((shard.recording, dependency) in completed
+                        for dependency in shard.dependencies)]
+
+        for shard in ready:
+            if len(running) >= args.num_workers:
+                break
+            if store.claim(shard):
+                future = executor.submit(run_shard, shard)
+                running[future] = (shard, time.time())
+                running_keys.add((shard.recording, shard.name))
+
+        if not running:
+            # Wait for shards claimed by other live runners, which may unblock
+            # the remaining ones; stop once nothing can make progress.
+            if not any(store.is_claimed(shard) for shard in pending):
+                break
+            time.sleep(args.poll_interval)
+            continue
+
+        done, _ = concurrent.futures.wait(
+            running, timeout=args.poll_interval,
+            return_when=concurrent.futures.FIRST_COMPLETED)
+        for future in done:
+            shard, shard_start_time = running.pop(future)
+            running_keys.discard((shard.recording, shard.name))
+            elapsed = time.time() - shard_start_time
+            try:
+                future.result()
+            except Exception:
+                print("ERROR: {} of {} failed:".format(
+                    shard.name, os.path.basename(shard.recording)))
+                traceback.print_exc()
+                store.fail(shard, traceback.format_exc())
+                failed.add((shard.recording, shard.name))
+                continue
+            store.complete(shard, elapsed)
+            num_completed += 1
+            print("INFO: Completed {} of {} in {:.1f}s ({} shards in {:.1f}s)".format(
+                shard.name, os.path.basename(shard.recording), elapsed,
+                num_completed, time.time() - start_time))
+
+    executor.shutdown()
+
+    return num_completed, failed
+
+
+def main():
+    args = parse_args()
+
+    recording_paths = sorted(
+        path for path in glob.glob(os.path.join(args.workspace_path, args.recording_pattern))
+        if os.path.isdir(path) and not os.path.basename(path).startswith("."))
+    print("INFO: Processing {} recordings with {} workers".format(
+        len(recording_paths), args.num_workers))
+
+    store = CheckpointStore(args.state_path, args.claim_timeout)
+    num_completed, failed = run_shards(args, recording_paths, store)
+
+    print("INFO: Completed {} shards, {} failed".format(num_completed, len(failed)))
+    if failed:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
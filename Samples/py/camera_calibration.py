@@ -0,0 +1,422 @@
+"""
+ Copyright (c) Microsoft. All rights reserved.
+
+ This code is licensed under the MIT License (MIT).
+ THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+ ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+ IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+ PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+"""
+
+""" Intrinsic and stereo calibration of the PV and VLC cameras from a recording of a board """
+# pylint: disable=C0103
+
+import argparse
+import csv
+import multiprocessing
+import os
+import sys
+import tarfile
+import time
+import cv2
+import numpy as np
+
+from proxy_tracks import decode_sensor_image, sensor_archive_path, is_sensor_member
+
+# Columns of camera_calibration.csv, see CameraCalibration.h of the BatchProcessing sample
+CALIBRATION_FILE_NAME = "camera_calibration.csv"
+CALIBRATION_COLUMNS = [
+    "SensorName", "FocalLength.x", "FocalLength.y", "PrincipalPoint.x", "PrincipalPoint.y",
+    "RadialDistortion.x", "RadialDistortion.y", "RadialDistortion.z",
+    "TangentialDistortion.x", "TangentialDistortion.y"]
+
+# Transforms points from the reference camera to the camera: x = R * x_ref + T
+EXTRINSICS_FILE_NAME = "camera_extrinsics.csv"
+EXTRINSICS_COLUMNS = ["SensorName", "ReferenceSensorName"] + \
+    ["Rotation.m{}{}".format(i, j) for i in range(1, 4) for j in range(1, 4)] + \
+    ["Translation.x", "Translation.y", "Translation.z", "RmsError", "NumberOfViews"]
+
+DEFAULT_SENSORS = "pv,vlc_ll,vlc_lf,vlc_rf,vlc_rr"
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--recording_path", required=True)
+    parser.add_argument("--sensors", default=DEFAULT_SENSORS,
+                        help="Comma-separated cameras to calibrate, if recorded")
+    parser.add_argument("--reference_sensor", default="vlc_lf",
+                        help="Camera the stereo extrinsics are relative to")
+    parser.add_argument("--board", choices=["checkerboard", "charuco"], default="checkerboard")
+    parser.add_argument("--board_size", default="9x6",
+                        help="Inner corners of a checkerboard, or squares of a ChArUco board")
+    parser.add_argument("--square_size", type=float, default=0.025, help="In meters")
+    parser.add_argument("--marker_size", type=float, default=0.018,
+                        help="ChArUco marker size in meters")
+    parser.add_argument("--dictionary", default="DICT_6X6_250", help="ChArUco dictionary")
+    parser.add_argument("--frame_step", type=int, default=3,
+                        help="Only search every n-th frame for the board")
+    parser.add_argument("--min_sharpness_quantile", type=float, default=0.2,
+                        help="Skip the blurriest frames by the recorder's Sharpness score")
+    parser.add_argument("--detection_width", type=int, default=640,
+                        help="Search for the board at this width; corners are refined "
+                             "at full resolution")
+    parser.add_argument("--max_views", type=int, default=40,
+                        help="Well-distributed views used per camera and camera pair")
+    parser.add_argument("--sync_tolerance_ms", type=float, default=10.0,
+                        help="Maximum time between the views of a stereo pair")
+    parser.add_argument("--num_processes", type=int, default=multiprocessing.cpu_count())
+    return parser.parse_args()
+
+
+class Board(object):
+    """Detects a checkerboard or ChArUco board; picklable for the worker processes."""
+
+    def __init__(self, kind, size, square_size, marker_size=None, dictionary=None):
+        self.kind = kind
+        self.size = size
+        self.square_size = square_size
+        self.marker_size = marker_size
+        self.dictionary = dictionary
+        self.detector = None
+        if kind == "checkerboard":
+            columns, rows = size
+            grid = np.mgrid[0:columns, 0:rows].T.reshape(-1, 2)
+            self.object_points = np.zeros((columns * rows, 3), np.float32)
+            self.object_points[:, :2] = grid * square_size
+        else:
+            self.object_points = self._charuco_board().getChessboardCorners().astype(np.float32)
+
+    def __getstate__(self):
+        state = self.__dict__.copy()
+        state["detector"] = None
+        return state
+
+    def _charuco_board(self):
+        dictionary = cv2.aruco.getPredefinedDictionary(getattr(cv2.aruco, self.dictionary))
+        if hasattr(cv2.aruco, "CharucoBoard_create"):
+            return cv2.aruco.CharucoBoard_create(self.size[0], self.size[1], self.square_size,
+                                                 self.marker_size, dictionary)
+        return cv2.aruco.CharucoBoard(self.size, self.square_size, self.marker_size,
+                                      dictionary)
+
+    def detect(self, image):
+        """Returns the ids and image points of the detected corners, or None."""
+        if self.kind == "checkerboard":
+            found, corners = cv2.findChessboardCorners(
+                image, self.size,
+                flags=cv2.CALIB_CB_ADAPTIVE_THRESH | cv2.CALIB_CB_NORMALIZE_IMAGE |
+                cv2.CALIB_CB_FAST_CHECK)
+            if not found:
+                return None
+            return np.arange(len(corners)), corners.reshape(-1, 2)
+
+        if self.detector is None:
+            board = self._charuco_board()
+            if hasattr(cv2.aruco, "CharucoDetector"):
+                self.detector = cv2.aruco.CharucoDetector(board)
+            else:
+                self.detector = board
+        if hasattr(cv2.aruco, "CharucoDetector"):
+            corners, ids, _, _ = self.detector.detectBoard(image)
+        else:
+            marker_corners, marker_ids, _ = cv2.aruco.detectMarkers(
+                image, self.detector.dictionary)
+            if marker_ids is None:
+                return None
+            _, corners, ids = cv2.aruco.interpolateCornersCharuco(
+                marker_corners, marker_ids, image, self.detector)
+        # Fewer corners do not constrain the homography of the view well.
+        if ids is None or len(ids) < 6:
+            return None
+        return ids.reshape(-1), corners.reshape(-1, 2)
+
+
+def select_frames(recording_path, sensor, frame_step, min_sharpness_quantile):
+    """Returns the timestamps of the frames to search, every n-th frame
+    except the blurriest ones."""
+    with open(os.path.join(recording_path, sensor + ".csv")) as f:
+        rows = list(csv.DictReader(f))
+    timestamps = np.array([int(row["Timestamp"]) for row in rows], dtype=np.int64)
+    selected = np.zeros(len(rows), dtype=bool)
+    selected[::frame_step] = True
+    if len(rows) > 0 and "Sharpness" in rows[0] and min_sharpness_quantile > 0:
+        sharpness = np.array([float(row["Sharpness"]) for row in rows])
+        if np.any(sharpness > 0):
+            selected &= sharpness >= np.quantile(sharpness, min_sharpness_quantile)
+    return set(timestamps[selected].tolist())
+
+
+def iterate_frames(recording_path, sensor, timestamps):
+    """Yields the work items of the selected frames: file paths from the
+    extracted folder, so the workers read them in parallel, or the data read
+    from the tarball."""
+    folder = os.path.join(recording_path, sensor)
+    if os.path.isdir(folder):
+        for name in os.listdir(folder):
+            base, extension = os.path.splitext(name)
+            if extension in (".pgm", ".ppm") and int(base) in timestamps:
+                yield sensor, int(base), os.path.join(folder, name)
+        return
+    with tarfile.open(sensor_archive_path(recording_path, sensor)) as tar:
+        for member in tar:
+            if not is_sensor_member(member, sensor):
+                continue
+            base = os.path.splitext(os.path.basename(member.name.replace("\\", "/")))[0]
+            if int(base) in timestamps:
+                yield sensor, int(base), tar.extractfile(member).read()
+
+
+_worker_board = None
+_worker_detection_width = None
+
+
+def init_worker(board, detection_width):
+    global _worker_board, _worker_detection_width
+    _worker_board = board
+    _worker_detection_width = detection_width
+    cv2.setNumThreads(1)
+
+
+def detect_board(item):
+    """Searches a frame for the board at low resolution and refines the corners
+    at full resolution."""
+    sensor, timestamp, source = item
+    if isinstance(source, str):
+        with open(source, "rb") as f:
+            source = f.read()
+    image = decode_sensor_image(sensor, source)
+    if image.ndim == 3:
+        image = cv2.cvtColor(image, cv2.COLOR_BGR2GRAY)
+    height, width = image.shape
+    scale = min(1.0, _worker_detection_width / float(width))
+    small = image if scale == 1.0 else cv2.resize(
+        image, (int(round(width * scale)), int(round(height * scale))),
+        interpolation=cv2.INTER_AREA)
+    detection = _worker_board.detect(small)
+    if detection is None:
+        return sensor, timestamp, (width, height), None
+    ids, corners = detection
+    corners = np.ascontiguousarray(corners / scale, dtype=np.float32).reshape(-1, 1, 2)
+    window = max(3, int(round(2.0 / scale)))
+    cv2.cornerSubPix(image, corners, (window, window), (-1, -1),
+                     (cv2.TERM_CRITERIA_EPS + cv2.TERM_CRITERIA_COUNT, 30, 0.01))
+    return sensor, timestamp, (width, height), (ids, corners.reshape(-1, 2))
+
+
+def view_features(board, ids, corners, image_size):
+    """Describes a view by the position, size and tilt of the board, for
+    selecting views that cover the image and the poses well."""
+    width, height = image_size
+    center = corners.mean(axis=0) / [width, height]
+    hull_area = cv2.contourArea(cv2.convexHull(corners.astype(np.float32)))
+    scale = np.sqrt(hull_area / float(width * height))
+    homography, _ = cv2.findHomography(board.object_points[ids, :2], corners)
+    if homography is None:
+        return None
+    # The perspective terms of the normalized homography grow with the tilt of
+    # the board; scale them to the board extent to make them unitless.
+    homography /= homography[2, 2]
+    extent = np.ptp(board.object_points[:, :2], axis=0)
+    tilt = homography[2, :2] * extent
+    return np.concatenate([center, [scale], np.clip(tilt, -1.0, 1.0)])
+
+
+def select_views(features, max_views):
+    """Greedy farthest point sampling in feature space: starts with the largest
+    view and repeatedly adds the view least similar to the selected ones."""
+    if len(features) <= max_views:
+        return list(range(len(features)))
+    features = np.asarray(features)
+    selected = [int(np.argmax(features[:, 2]))]
+    distances = np.linalg.norm(features - features[selected[0]], axis=1)
+    while len(selected) < max_views:
+        i = int(np.argmax(distances))
+        selected.append(i)
+        distances = np.minimum(distances, np.linalg.norm(features - features[i], axis=1))
+    return selected
+
+
+def calibrate_intrinsics(board, detections, image_size, max_views):
+    """Returns the camera matrix, distortion coefficients, RMS error and number
+    of views, dropping views with outlier errors and calibrating once more."""
+    views = [(ids, corners) for ids, corners in detections.values()]
+    features = [view_features(board, ids, corners, image_size) for ids, corners in views]
+    views = [view for view, feature in zip(views, features) if feature is not None]
+    features = [feature for feature in features if feature is not None]
+    if len(views) < 3:
+        return None
+    views = [views[i] for i in select_views(features, max_views)]
+
+    for _ in range(2):
+        object_points = [board.object_points[ids] for ids, _ in views]
+        image_points = [corners.astype(np.float32) for _, corners in views]
+        rms, camera_matrix, distortion, rvecs, tvecs = cv2.calibrateCamera(
+            object_points, image_points, image_size, None, None)
+        errors = []
+        for points, corners, rvec, tvec in zip(object_points, image_points, rvecs, tvecs):
+            projected, _ = cv2.projectPoints(points, rvec, tvec, camera_matrix, distortion)
+            errors.append(np.sqrt(np.mean(np.sum(
+                (projected.reshape(-1, 2) - corners) ** 2, axis=1))))
+        inliers = [view for view, error in zip(views, errors)
+                   if error <= 3.0 * np.median(errors)]
+        if len(inliers) == len(views) or len(inliers) < 3:
+            break
+        views = inliers
+
+    return camera_matrix, distortion.ravel(), rms, len(views)
+
+
+def calibrate_stereo(board, reference_detections, detections, reference_intrinsics,
+                     intrinsics, image_size, sync_tolerance, max_views):
+    """Returns R, T, the RMS error and number of views of the transform from the
+    reference camera to the camera, from views of the board seen by both."""
+    reference_timestamps = np.array(sorted(reference_detections), dtype=np.int64)
+    if len(reference_timestamps) == 0:
+        return None
+    pairs = []
+    features = []
+    for timestamp, (ids, corners) in detections.items():
+        i = np.searchsorted(reference_timestamps, timestamp)
+        candidates = [j for j in (i - 1, i) if 0 <= j < len(reference_timestamps)]
+        j = min(candidates, key=lambda j: abs(reference_timestamps[j] - timestamp))
+        if abs(reference_timestamps[j] - timestamp) > sync_tolerance:
+            continue
+        reference_ids, reference_corners = reference_detections[int(reference_timestamps[j])]
+        common, in_reference, in_camera = np.intersect1d(
+            reference_ids, ids, assume_unique=True, return_indices=True)
+        if len(common) < 6:
+            continue
+        feature_reference = view_features(board, common, reference_corners[in_reference],
+                                          reference_intrinsics[2])
+        feature = view_features(board, common, corners[in_camera], image_size)
+        if feature_reference is None or feature is None:
+            continue
+        pairs.append((board.object_points[common],
+                      reference_corners[in_reference].astype(np.float32),
+                      corners[in_camera].astype(np.float32)))
+        features.append(np.concatenate([feature_reference, feature]))
+    if len(pairs) < 3:
+        return None
+    pairs = [pairs[i] for i in select_views(features, max_views)]
+
+    result = cv2.stereoCalibrate(
+        [pair[0] for pair in pairs], [pair[1] for pair in pairs], [pair[2] for pair in pairs],
+        reference_intrinsics[0], reference_intrinsics[1], intrinsics[0], intrinsics[1],
+        image_size, flags=cv2.CALIB_FIX_INTRINSIC)
+    rms, rotation, translation = result[0], result[5], result[6]
+    return rotation, translation.ravel(), rms, len(pairs)
+
+
+def write_calibrations(recording_path, intrinsics):
+    """Updates the rows of the calibrated cameras in camera_calibration.csv,
+    keeping the rows of the other cameras."""
+    path = os.path.join(recording_path, CALIBRATION_FILE_NAME)
+    rows = {}
+    if os.path.exists(path):
+        with open(path) as f:
+            for row in csv.reader(line for line in f if line.strip() and line[0] != "#"):
+                if row[0] != CALIBRATION_COLUMNS[0]:
+                    rows[row[0]] = row
+    for sensor, (camera_matrix, distortion, _, _) in intrinsics.items():
+        k1, k2, p1, p2, k3 = distortion[:5]
+        rows[sensor] = [sensor] + ["{:.9g}".format(value) for value in [
+            camera_matrix[0, 0], camera_matrix[1, 1], camera_matrix[0, 2],
+            camera_matrix[1, 2], k1, k2, k3, p1, p2]]
+    with open(path, "w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow(CALIBRATION_COLUMNS)
+        for sensor in sorted(rows):
+            writer.writerow(rows[sensor])
+
+
+def write_extrinsics(recording_path, reference_sensor, extrinsics):
+    with open(os.path.join(recording_path, EXTRINSICS_FILE_NAME), "w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow(EXTRINSICS_COLUMNS)
+        for sensor, (rotation, translation, rms, num_views) in sorted(extrinsics.items()):
+            writer.writerow([sensor, reference_sensor] +
+                            ["{:.9g}".format(value) for value in rotation.ravel()] +
+                            ["{:.9g}".format(value) for value in translation] +
+                            ["{:.4f}".format(rms), num_views])
+
+
+def main():
+    args = parse_args()
+
+    board_size = tuple(int(value) for value in args.board_size.split("x"))
+    board = Board(args.board, board_size, args.square_size, args.marker_size, args.dictionary)
+
+    sensors = [sensor for sensor in args.sensors.split(",")
+               if os.path.exists(os.path.join(args.recording_path, sensor + ".csv"))]
+    if len(sensors) == 0:
+        print("ERROR: None of the cameras {} were recorded".format(args.sensors))
+        sys.exit(1)
+
+    # Search all the cameras in one pool, so the frames of the cameras are
+    # processed in parallel as well.
+    start_time = time.time()
+    detections = {sensor: {} for sensor in sensors}
+    image_sizes = {}
+    num_frames = 0
+
+    def work_items():
+        for sensor in sensors:
+            timestamps = select_frames(args.recording_path, sensor, args.frame_step,
+                                       args.min_sharpness_quantile)
+            for item in iterate_frames(args.recording_path, sensor, timestamps):
+                yield item
+
+    pool = multiprocessing.Pool(args.num_processes, init_worker,
+                                (board, args.detection_width))
+    for sensor, timestamp, image_size, detection in pool.imap_unordered(
+            detect_board, work_items(), chunksize=4):
+        num_frames += 1
+        image_sizes[sensor] = image_size
+        if detection is not None:
+            detections[sensor][timestamp] = detection
+    pool.close()
+    pool.join()
+
+    print("Searched {} frames in {:.1f}s".format(num_frames, time.time() - start_time))
+    for sensor in sensors:
+        print("  {}: board found in {} frames".format(sensor, len(detections[sensor])))
+
+    intrinsics = {}
+    for sensor in sensors:
+        result = calibrate_intrinsics(board, detections[sensor], image_sizes.get(sensor),
+                                      args.max_views)
+        if result is None:
+            print("WARNING: Too few views to calibrate {}".format(sensor))
+            continue
+        intrinsics[sensor] = (result[0], result[1], image_sizes[sensor], result[3])
+        print("{}: RMS error {:.3f} px over {} views, f = ({:.2f}, {:.2f}), "
+              "c = ({:.2f}, {:.2f})".format(sensor, result[2], result[3], result[0][0, 0],
+                                            result[0][1, 1], result[0][0, 2], result[0][1, 2]))
+
+    extrinsics = {}
+    if args.reference_sensor in intrinsics:
+        for sensor in intrinsics:
+            if sensor == args.reference_sensor:
+                continue
+            result = calibrate_stereo(
+                board, detections[args.reference_sensor], detections[sensor],
+                intrinsics[args.reference_sensor], intrinsics[sensor], image_sizes[sensor],
+                args.sync_tolerance_ms * 1e4, args.max_views)
+            if result is None:
+                print("WARNING: Too few common views of {} and {}".format(
+                    args.reference_sensor, sensor))
+                continue
+            extrinsics[sensor] = result
+            print("{} from {}: RMS error {:.3f} px over {} views, baseline {:.4f} m".format(
+                sensor, args.reference_sensor, result[2], result[3],
+                np.linalg.norm(result[1])))
+
+    write_calibrations(args.recording_path, intrinsics)
+    if extrinsics:
+        write_extrinsics(args.recording_path, args.reference_sensor, extrinsics)
+
+    print("Calibrated in {:.1f}s".format(time.time() - start_time))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,287 @@
+"""
+ Copyright (c) Microsoft. All rights reserved.
+
+ This code is licensed under the MIT License (MIT).
+ THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+ ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+ IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+ PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+"""
+
+""" Local HTTP service serving the frames of the recordings in a workspace """
+# pylint: disable=C0103
+
+import argparse
+import collections
+import concurrent.futures
+import glob
+import http.server
+import json
+import multiprocessing
+import os
+import socketserver
+import threading
+import urllib.parse
+import cv2
+import numpy as np
+from proxy_tracks import to_display_image
+from recording_catalog import recording_sensors
+from recording_dataset import RecordingDataset
+
+IMAGE_FORMATS = {"jpg": ("image/jpeg", ".jpg"), "png": ("image/png", ".png")}
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--workspace_path", required=True)
+    parser.add_argument("--port", type=int, default=8090)
+    parser.add_argument("--num_threads", type=int, default=multiprocessing.cpu_count())
+    parser.add_argument("--frame_cache_mb", type=int, default=1024,
+                        help="Memory for decoded full-resolution frames")
+    parser.add_argument("--response_cache_mb", type=int, default=256,
+                        help="Memory for encoded responses")
+    return parser.parse_args()
+
+
+class LruCache(object):
+    """Thread-safe least recently used cache, bounded by the total size of its values."""
+
+    def __init__(self, max_size):
+        self.max_size = max_size
+        self.size = 0
+        self.entries = collections.OrderedDict()
+        self.lock = threading.Lock()
+        self.hits = 0
+        self.misses = 0
+
+    def get(self, key):
+        with self.lock:
+            entry = self.entries.get(key)
+            if entry is None:
+                self.misses += 1
+                return None
+            self.entries.move_to_end(key)
+            self.hits += 1
+            return entry[0]
+
+    def put(self, key, value, size):
+        if size > self.max_size:
+            return
+        with self.lock:
+            if key in self.entries:
+                self.size -= self.entries.pop(key)[1]
+            self.entries[key] = (value, size)
+            self.size += size
+            while self.size > self.max_size:
+                _, (_, evicted_size) = self.entries.popitem(last=False)
+                self.size -= evicted_size
+
+
+class FrameStore(object):
+    """Looks up, decodes, scales and encodes the frames of the recordings in a
+    workspace, caching both the decoded frames and the encoded responses."""
+
+    def __init__(self, workspace_path, frame_cache_size, response_cache_size):
+        self.workspace_path = workspace_path
+        self.recordings = {}
+        self.sensors = {}
+        self.lock = threading.Lock()
+        self.frames = LruCache(frame_cache_size)
+        self.responses = LruCache(response_cache_size)
+        # Decodes the frames of requested time windows ahead of their requests.
+        self.prefetch_executor = concurrent.futures.ThreadPoolExecutor(2)
+        self.scan_workspace()
+
+    def scan_workspace(self):
+        recordings = {}
+        for path in sorted(glob.glob(os.path.join(self.workspace_path, "*"))):
+            if os.path.isdir(path):
+                sensors = recording_sensors(path)
+                if sensors:
+                    recordings[os.path.basename(path)] = (path, sensors)
+        with self.lock:
+            self.recordings = recordings
+
+    def list_recordings(self):
+        self.scan_workspace()
+        with self.lock:
+            return [{"name": name, "sensors": sensors}
+                    for name, (_, sensors) in sorted(self.recordings.items())]
+
+    def sensor_frames(self, recording, sensor):
+        """Returns the frame index of a sensor, building it on first use."""
+        key = (recording, sensor)
+        with self.lock:
+            dataset = self.sensors.get(key)
+            path, sensors = self.recordings.get(recording, (None, []))
+        if dataset is None:
+            if sensor not in sensors:
+                raise KeyError("unknown recording or sensor: {}/{}".format(recording, sensor))
+            dataset = RecordingDataset(path, [sensor], copy=False)
+            with self.lock:
+                dataset = self.sensors.setdefault(key, dataset)
+        return dataset
+
+    def list_frames(self, recording, sensor, start, end, max_frames):
+        """Returns the timestamps of the frames in the time window, evenly
+        subsampled to at most max_frames, and starts decoding them."""
+        dataset = self.sensor_frames(recording, sensor)
+        timestamps = dataset.recordings[0]["timestamps"]
+        first = int(np.searchsorted(timestamps, start))
+        last = int(np.searchsorted(timestamps, end, side="right"))
+        indices = np.arange(first, last)
+        if max_frames and len(indices) > max_frames:
+            indices = indices[np.linspace(0, len(indices) - 1, max_frames).astype(np.int64)]
+        for i in indices.tolist():
+            self.prefetch_executor.submit(self.decoded_frame, recording, sensor, i)
+        return timestamps[indices].tolist()
+
+    def decoded_frame(self, recording, sensor, i):
+        dataset = self.sensor_frames(recording, sensor)
+        timestamp = int(dataset.recordings[0]["timestamps"][i])
+        key = (recording, sensor, timestamp)
+        image = self.frames.get(key)
+        if image is None:
+            image = dataset[i][sensor]["image"]
+            if image.ndim == 3:
+                image = cv2.cvtColor(image, cv2.COLOR_RGB2BGR)
+            else:
+                image = image.copy()
+            self.frames.put(key, image, image.nbytes)
+        return timestamp, image
+
+    def encoded_frame(self, recording, sensor, timestamp, width, image_format, quality):
+        """Returns the timestamp and the encoded image of the frame closest to
+        the timestamp, downscaled to the width if it is smaller."""
+        dataset = self.sensor_frames(recording, sensor)
+        i = dataset.index_of(timestamp)
+        timestamp = int(dataset.recordings[0]["timestamps"][i])
+        key = (recording, sensor, timestamp, width, image_format, quality)
+        encoded = self.responses.get(key)
+        if encoded is not None:
+            return timestamp, encoded
+
+        _, image = self.decoded_frame(recording, sensor, i)
+        height, full_width = image.shape[:2]
+        if 0 < width < full_width:
+            scaled_height = max(1, int(round(height * width / float(full_width))))
+            image = cv2.resize(image, (width, scaled_height), interpolation=cv2.INTER_AREA)
+        if image_format == "jpg":
+            ok, encoded = cv2.imencode(".jpg", to_display_image(sensor, image),
+                                       [cv2.IMWRITE_JPEG_QUALITY, quality])
+        else:
+            # PNG keeps the 16-bit depth and reflectivity values.
+            ok, encoded = cv2.imencode(".png", image, [cv2.IMWRITE_PNG_COMPRESSION, 1])
+        assert ok
+        encoded = encoded.tobytes()
+        self.responses.put(key, encoded, len(encoded))
+        return timestamp, encoded
+
+    def statistics(self):
+        return {cache_name: {"hits": cache.hits, "misses": cache.misses,
+                             "entries": len(cache.entries), "size": cache.size}
+                for cache_name, cache in [("frames", self.frames), ("responses", self.responses)]}
+
+
+class FrameRequestHandler(http.server.BaseHTTPRequestHandler):
+    """Serves:
+        GET /recordings
+        GET /recordings/<recording>/<sensor>/frames?start=<t>&end=<t>&max_frames=<n>
+        GET /recordings/<recording>/<sensor>/frame?timestamp=<t>&width=<w>&format=jpg|png&quality=<q>
+        GET /statistics
+    with the timestamps in the 100 ns ticks of the recordings."""
+
+    # Keeps the connections alive, sparing the tools a connection per frame, and
+    # sends the headers and the image without waiting for the client to ACK.
+    protocol_version = "HTTP/1.1"
+    disable_nagle_algorithm = True
+    timeout = 60
+
+    def do_GET(self):
+        url = urllib.parse.urlparse(self.path)
+        query = dict(urllib.parse.parse_qsl(url.query))
+        parts = [urllib.parse.unquote(part) for part in url.path.strip("/").split("/")]
+        store = self.server.store
+        try:
+            if parts == ["recordings"]:
+                self.send_json(store.list_recordings())
+            elif parts == ["statistics"]:
+                self.send_json(store.statistics())
+            elif len(parts) == 4 and parts[0] == "recordings" and parts[3] == "frames":
+                self.send_json(store.list_frames(
+                    parts[1], parts[2], int(query.get("start", 0)),
+                    int(query.get("end", 2 ** 63 - 1)), int(query.get("max_frames", 0))))
+            elif len(parts) == 4 and parts[0] == "recordings" and parts[3] == "frame":
+                image_format = query.get("format", "jpg")
+                if "timestamp" not in query:
+                    raise ValueError("missing timestamp")
+                if image_format not in IMAGE_FORMATS:
+                    raise ValueError("unsupported format: " + image_format)
+                timestamp, encoded = self.server.run(
+                    store.encoded_frame, parts[1], parts[2], int(query["timestamp"]),
+                    int(query.get("width", 0)), image_format, int(query.get("quality", 90)))
+                self.send_data(encoded, IMAGE_FORMATS[image_format][0],
+                               [("X-Frame-Timestamp", str(timestamp))])
+            else:
+                self.send_error(404)
+        except KeyError as e:
+            self.send_error(404, str(e))
+        except (ValueError, IndexError) as e:
+            self.send_error(400, str(e))
+
+    def send_json(self, value):
+        self.send_data(json.dumps(value).encode(), "application/json")
+
+    def send_data(self, data, content_type, headers=()):
+        self.send_response(200)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(data)))
+        for name, value in headers:
+            self.send_header(name, value)
+        self.end_headers()
+        self.wfile.write(data)
+
+    def log_message(self, format, *args):  # pylint: disable=W0622
+        pass
+
+
+class ThreadPoolHttpServer(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    """Gives each connection its own thread, which only parses the requests and
+    writes the responses, so that idle keep-alive connections never hold up the
+    requests of other clients. The frames are decoded and encoded on a fixed
+    pool of threads."""
+
+    daemon_threads = True
+
+    def __init__(self, address, handler, store, num_threads):
+        http.server.HTTPServer.__init__(self, address, handler)
+        self.store = store
+        self.executor = concurrent.futures.ThreadPoolExecutor(num_threads)
+
+    def run(self, function, *args):
+        return self.executor.submit(function, *args).result()
+
+    def server_close(self):
+        http.server.HTTPServer.server_close(self)
+        self.executor.shutdown()
+
+
+def main():
+    args = parse_args()
+
+    store = FrameStore(args.workspace_path, args.frame_cache_mb * 1024 * 1024,
+                       args.response_cache_mb * 1024 * 1024)
+    # Only serve local tools.
+    server = ThreadPoolHttpServer(("127.0.0.1", args.port), FrameRequestHandler, store,
+                                  args.num_threads)
+    print("Serving {} recordings on http://127.0.0.1:{}/recordings".format(
+        len(store.recordings), args.port))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    server.server_close()
+
+
+if __name__ == "__main__":
+    main()
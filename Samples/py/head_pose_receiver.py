@@ -0,0 +1,241 @@
+"""
+ Copyright (c) Microsoft. All rights reserved.
+
+ This code is licensed under the MIT License (MIT).
+ THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+ ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+ IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+ PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+"""
+
+""" Receiver for the HoloLens head pose stream, see HeadPoseStreamingServer """
+# pylint: disable=C0103
+
+import argparse
+import bisect
+import socket
+import struct
+import sys
+import threading
+import time
+from collections import deque, namedtuple
+import numpy as np
+
+# Packet Format
+# Cookie VersionMajor VersionMinor Flags Timestamp SequenceNumber
+# PositionX PositionY PositionZ OrientationX OrientationY OrientationZ OrientationW
+HEAD_POSE_PACKET_FORMAT = "<IBBHQQ3f4f"
+HEAD_POSE_PACKET_SIZE = struct.calcsize(HEAD_POSE_PACKET_FORMAT)
+HEAD_POSE_COOKIE = 0x484c4850
+HEAD_POSE_LOCATED_FLAG = 0x0001
+
+HEAD_POSE_PACKET = namedtuple(
+    'HeadPosePacket',
+    'Cookie VersionMajor VersionMinor Flags Timestamp SequenceNumber '
+    'Position Orientation'
+)
+
+# Port of the head pose stream of the Streamer apps
+HEAD_POSE_STREAM_PORT = 23950
+
+# Timestamps count hundreds of nanoseconds since January 1st, 1601, like the
+# sensor frame timestamps.
+TICKS_PER_SECOND = 10000000
+UNIX_EPOCH_IN_TICKS = 116444736000000000
+
+
+def unpack_packet(data):
+    fields = struct.unpack(HEAD_POSE_PACKET_FORMAT, data)
+    return HEAD_POSE_PACKET(*fields[:6], Position=np.array(fields[6:9]),
+                            Orientation=np.array(fields[9:13]))
+
+
+def pack_packet(timestamp, sequence_number, position, orientation,
+                flags=HEAD_POSE_LOCATED_FLAG):
+    return struct.pack(HEAD_POSE_PACKET_FORMAT, HEAD_POSE_COOKIE, 0, 1, flags,
+                       timestamp, sequence_number, *(list(position) +
+                                                     list(orientation)))
+
+
+def slerp(q0, q1, t):
+    dot = np.dot(q0, q1)
+    # Take the shorter arc.
+    if dot < 0.0:
+        q1 = -q1
+        dot = -dot
+    if dot > 0.9995:
+        q = q0 + t * (q1 - q0)
+        return q / np.linalg.norm(q)
+    theta = np.arccos(dot)
+    return (np.sin((1.0 - t) * theta) * q0 + np.sin(t * theta) * q1) / \
+        np.sin(theta)
+
+
+def pose_to_matrix(position, orientation):
+    """Returns the head-to-origin transform for row vectors, as used by the
+    FrameToOrigin columns of the recordings."""
+    x, y, z, w = orientation
+    rotation = np.array([
+        [1 - 2 * (y * y + z * z), 2 * (x * y - z * w), 2 * (x * z + y * w)],
+        [2 * (x * y + z * w), 1 - 2 * (x * x + z * z), 2 * (y * z - x * w)],
+        [2 * (x * z - y * w), 2 * (y * z + x * w), 1 - 2 * (x * x + y * y)]])
+    transform = np.eye(4)
+    transform[:3, :3] = rotation.T
+    transform[3, :3] = position
+    return transform
+
+
+class HeadPoseBuffer(object):
+    """Keeps the most recent poses and interpolates the pose at any timestamp
+    between them, e.g. the timestamp of a sensor frame."""
+
+    def __init__(self, max_age_in_seconds=10.0):
+        self.max_age = int(max_age_in_seconds * TICKS_PER_SECOND)
+        self.timestamps = deque()
+        self.positions = deque()
+        self.orientations = deque()
+        self.lock = threading.Lock()
+
+    def add(self, packet):
+        if not packet.Flags & HEAD_POSE_LOCATED_FLAG:
+            return
+        with self.lock:
+            if self.timestamps and packet.Timestamp <= self.timestamps[-1]:
+                return
+            self.timestamps.append(packet.Timestamp)
+            self.positions.append(packet.Position)
+            self.orientations.append(packet.Orientation)
+            while self.timestamps[-1] - self.timestamps[0] > self.max_age:
+                self.timestamps.popleft()
+                self.positions.popleft()
+                self.orientations.popleft()
+
+    def interpolate(self, timestamp):
+        """Returns the position and orientation at the timestamp, or None if it
+        is not covered by the buffered poses."""
+        with self.lock:
+            if not self.timestamps or timestamp < self.timestamps[0] or \
+                    timestamp > self.timestamps[-1]:
+                return None
+            i = bisect.bisect_left(self.timestamps, timestamp)
+            if self.timestamps[i] == timestamp:
+                return self.positions[i], self.orientations[i]
+            t0, t1 = self.timestamps[i - 1], self.timestamps[i]
+            t = float(timestamp - t0) / (t1 - t0)
+            position = (1.0 - t) * self.positions[i - 1] + \
+                t * self.positions[i]
+            orientation = slerp(self.orientations[i - 1],
+                                self.orientations[i], t)
+            return position, orientation
+
+
+def receive_packets(sock):
+    """Yields the packets received on a connected socket."""
+    buffer = b''
+    while True:
+        data = sock.recv(4096)
+        if not data:
+            return
+        buffer += data
+        num_packets = len(buffer) // HEAD_POSE_PACKET_SIZE
+        for i in range(num_packets):
+            packet = unpack_packet(buffer[i * HEAD_POSE_PACKET_SIZE:
+                                          (i + 1) * HEAD_POSE_PACKET_SIZE])
+            if packet.Cookie != HEAD_POSE_COOKIE:
+                print('ERROR: Invalid cookie, stream out of sync')
+                return
+            yield packet
+        buffer = buffer[num_packets * HEAD_POSE_PACKET_SIZE:]
+
+
+def publish_fake_poses(server_socket, poses_per_second):
+    """Stand-in for the HoloLens: sends a head moving on a circle to the first
+    client that connects."""
+    connection, _ = server_socket.accept()
+    connection.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    sequence_number = 0
+    try:
+        while True:
+            now = time.time()
+            angle = 0.5 * now
+            position = [np.cos(angle), 0.1 * np.sin(3 * angle), np.sin(angle)]
+            orientation = [0.0, np.sin(angle / 2), 0.0, np.cos(angle / 2)]
+            timestamp = UNIX_EPOCH_IN_TICKS + int(now * TICKS_PER_SECOND)
+            connection.sendall(pack_packet(
+                timestamp, sequence_number, position, orientation))
+            sequence_number += 1
+            time.sleep(1.0 / poses_per_second)
+    except socket.error:
+        pass
+    finally:
+        connection.close()
+
+
+def main(argv):
+    """Receiver main"""
+    parser = argparse.ArgumentParser()
+    parser.add_argument("-a", "--host", help="Host address to connect")
+    parser.add_argument("-p", "--port", type=int, default=HEAD_POSE_STREAM_PORT)
+    parser.add_argument("--fake_publisher", action='store_true',
+                        help="Connect to a local stand-in publisher instead of the HoloLens")
+    parser.add_argument("--fake_poses_per_second", type=int, default=100)
+    parser.add_argument("--num_poses", type=int, default=-1,
+                        help="Stop after receiving this many poses")
+    args = parser.parse_args(argv)
+
+    if args.fake_publisher:
+        server_socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        server_socket.bind(('127.0.0.1', 0))
+        server_socket.listen(1)
+        args.host, args.port = server_socket.getsockname()
+        publisher = threading.Thread(
+            target=publish_fake_poses,
+            args=(server_socket, args.fake_poses_per_second))
+        publisher.daemon = True
+        publisher.start()
+    elif args.host is None:
+        parser.error("--host is required unless --fake_publisher is used")
+
+    s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    s.connect((args.host, args.port))
+    print('INFO: Socket Connected to ' + args.host + ' on port ' + str(args.port))
+
+    pose_buffer = HeadPoseBuffer()
+
+    # Sequence numbers are assigned to every sampled pose, so gaps are poses
+    # dropped by the server.
+    expected_sequence_number = None
+    poses_received = 0
+    poses_missed = 0
+    start_time = time.time()
+
+    try:
+        for packet in receive_packets(s):
+            if expected_sequence_number is not None and \
+                    packet.SequenceNumber > expected_sequence_number:
+                poses_missed += packet.SequenceNumber - expected_sequence_number
+            expected_sequence_number = packet.SequenceNumber + 1
+            poses_received += 1
+            pose_buffer.add(packet)
+
+            if poses_received % 100 == 0:
+                # Interpolate the pose 50 ms in the past, as would be done
+                # for an image frame that arrives later than the poses.
+                timestamp = packet.Timestamp - TICKS_PER_SECOND // 20
+                pose = pose_buffer.interpolate(timestamp)
+                rate = poses_received / (time.time() - start_time)
+                print('INFO: {} poses ({:.1f}/s), {} missed, position 50 ms '
+                      'ago: {}'.format(poses_received, rate, poses_missed,
+                                       None if pose is None else
+                                       np.round(pose[0], 3)))
+
+            if poses_received == args.num_poses:
+                break
+    except KeyboardInterrupt:
+        pass
+    finally:
+        s.close()
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
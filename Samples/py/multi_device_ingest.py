@@ -0,0 +1,427 @@
+"""
+ Copyright (c) Microsoft. All rights reserved.
+
+ This code is licensed under the MIT License (MIT).
+ THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+ ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+ IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+ PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+"""
+
+""" Ingests the sensor streams of several HoloLens devices into one time-aligned store """
+# pylint: disable=C0103
+
+import argparse
+import asyncio
+import collections
+import concurrent.futures
+import csv
+import multiprocessing
+import os
+import random
+import struct
+import sys
+import time
+import zlib
+import numpy as np
+
+from aligned_storage import AlignedFileWriter
+
+# Protocol Header Format, see SensorFrameStreamHeader
+# Cookie VersionMajor VersionMinor FrameType Timestamp SequenceNumber
+# ImageWidth ImageHeight PixelStride RowStride
+SENSOR_STREAM_HEADER_FORMAT = "<IBBHqQIIII"
+SENSOR_STREAM_HEADER_SIZE = struct.calcsize(SENSOR_STREAM_HEADER_FORMAT)
+SENSOR_STREAM_COOKIE = 0x484c524d
+
+SENSOR_FRAME_STREAM_HEADER = collections.namedtuple(
+    'SensorFrameStreamHeader',
+    'Cookie VersionMajor VersionMinor FrameType Timestamp SequenceNumber '
+    'ImageWidth ImageHeight PixelStride RowStride'
+)
+
+# Stream ports of the sensors, see SensorFrameStreamer, in the order of the
+# SensorType values
+SENSOR_STREAM_PORTS = collections.OrderedDict([
+    ("pv", 23940),
+    ("short_throw_depth", 23941),
+    ("short_throw_reflectivity", 23942),
+    ("long_throw_depth", 23947),
+    ("long_throw_reflectivity", 23948),
+    ("vlc_ll", 23943),
+    ("vlc_lf", 23944),
+    ("vlc_rf", 23945),
+    ("vlc_rr", 23946),
+])
+
+# Image size and pixel stride of the sensors, used by the replay stand-ins
+SENSOR_IMAGE_FORMATS = {
+    "pv": (1280, 720, 4),
+    "short_throw_depth": (448, 450, 2),
+    "short_throw_reflectivity": (448, 450, 2),
+    "vlc_ll": (640, 480, 1),
+    "vlc_lf": (640, 480, 1),
+    "vlc_rf": (640, 480, 1),
+    "vlc_rr": (640, 480, 1),
+    "long_throw_depth": (448, 450, 2),
+    "long_throw_reflectivity": (448, 450, 2),
+}
+
+# Timestamps count hundreds of nanoseconds since January 1st, 1601.
+TICKS_PER_SECOND = 10000000
+UNIX_EPOCH_IN_TICKS = 116444736000000000
+
+INDEX_FIELDS = ["aligned_timestamp", "device", "sensor", "device_timestamp",
+                "host_timestamp", "sequence_number", "width", "height",
+                "pixel_stride", "row_stride", "offset", "size"]
+
+INDEX_ENTRY = collections.namedtuple('IndexEntry', INDEX_FIELDS)
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    subparsers = parser.add_subparsers(dest="command")
+
+    ingest_parser = subparsers.add_parser(
+        "ingest", help="Receive the streams of several devices into one store")
+    ingest_parser.add_argument(
+        "--device", action="append", required=True,
+        help="Device as name=host[:port_offset], the port offset is added "
+             "to the standard stream ports; can be repeated")
+    ingest_parser.add_argument("--sensors", default="vlc_lf,vlc_rf,long_throw_depth",
+                               help="Comma-separated sensors to receive from every device")
+    ingest_parser.add_argument("--output_path", required=True)
+    ingest_parser.add_argument("--duration", type=float, default=0,
+                               help="Stop after this many seconds, or on Ctrl+C if zero")
+    ingest_parser.add_argument("--compression_level", type=int, default=1)
+    ingest_parser.add_argument("--queue_length", type=int, default=8,
+                               help="Frames buffered per stream before frames are dropped")
+    ingest_parser.add_argument("--offset_window", type=float, default=10.0,
+                               help="Seconds over which the clock offset is estimated")
+    ingest_parser.add_argument("--num_threads", type=int,
+                               default=multiprocessing.cpu_count())
+    ingest_parser.add_argument("--direct_io", action="store_true",
+                               help="Write the data files with preallocated, aligned "
+                                    "direct I/O, see aligned_storage.py")
+
+    replay_parser = subparsers.add_parser(
+        "replay", help="Serve synthetic streams of several local stand-in devices")
+    replay_parser.add_argument("--num_devices", type=int, default=2)
+    replay_parser.add_argument("--sensors", default="vlc_lf,vlc_rf,long_throw_depth")
+    replay_parser.add_argument("--port_offset", type=int, default=100,
+                               help="Port offset of the first device; device i uses "
+                                    "(i + 1) times this offset")
+    replay_parser.add_argument("--frames_per_second", type=float, default=30)
+    replay_parser.add_argument("--max_clock_offset", type=float, default=60.0,
+                               help="Maximum offset of the device clocks in seconds")
+    replay_parser.add_argument("--max_latency", type=float, default=0.02,
+                               help="Maximum random delay between capture and send in seconds")
+    replay_parser.add_argument("--duration", type=float, default=0)
+
+    args = parser.parse_args()
+    if args.command is None:
+        parser.error("a command is required")
+    return args
+
+
+def host_ticks():
+    return UNIX_EPOCH_IN_TICKS + int(time.time() * TICKS_PER_SECOND)
+
+
+class ClockOffsetEstimator(object):
+    """Estimates the offset of a device clock to the host clock.
+
+    The host receives a frame at least the network latency after it was
+    captured, so host time minus device time is the clock offset plus a
+    non-negative delay. The lower envelope of these differences over a window
+    estimates the offset; it includes the smallest latency, which is similar
+    for devices on the same network and therefore does not affect alignment.
+    Minima are kept per second so slow clock drift is followed."""
+
+    def __init__(self, window_in_seconds):
+        self.window = max(1, int(window_in_seconds))
+        self.minimum_per_second = {}
+
+    def add(self, device_timestamp, host_timestamp):
+        second = host_timestamp // TICKS_PER_SECOND
+        difference = host_timestamp - device_timestamp
+        if difference < self.minimum_per_second.get(second, difference + 1):
+            self.minimum_per_second[second] = difference
+
+    def current(self):
+        if not self.minimum_per_second:
+            return None
+        latest = max(self.minimum_per_second)
+        return min(difference for second, difference in
+                   self.minimum_per_second.items()
+                   if second > latest - self.window)
+
+    def offsets_at(self, host_timestamps):
+        """Returns the offsets at the given host timestamps, estimated over
+        the window centered on each timestamp."""
+        seconds = np.array(sorted(self.minimum_per_second), dtype=np.int64)
+        minima = np.array([self.minimum_per_second[s] for s in seconds],
+                          dtype=np.int64)
+        queries = np.asarray(host_timestamps, dtype=np.int64) // TICKS_PER_SECOND
+        offsets = np.empty(len(queries), dtype=np.int64)
+        half_window = self.window // 2
+        begin = np.searchsorted(seconds, queries - half_window, side='left')
+        end = np.searchsorted(seconds, queries + half_window, side='right')
+        for i in range(len(queries)):
+            offsets[i] = minima[begin[i]:max(end[i], begin[i] + 1)].min()
+        return offsets
+
+    def trace(self):
+        return sorted(self.minimum_per_second.items())
+
+
+class StreamWriter(object):
+    """Appends the compressed frames of one sensor of one device to its data
+    file. Compression runs on the thread pool, where zlib releases the GIL,
+    so streams are compressed in parallel on all cores."""
+
+    def __init__(self, path, executor, compression_level, queue_length, direct_io=False):
+        if direct_io:
+            self.file = AlignedFileWriter(path, buffer_size=1024 * 1024)
+        else:
+            self.file = open(path, 'wb')
+        self.offset = 0
+        self.executor = executor
+        self.compression_level = compression_level
+        self.queue = asyncio.Queue(queue_length)
+        self.entries = []
+        self.frames_dropped = 0
+
+    def put(self, entry, payload):
+        if self.queue.full():
+            self.frames_dropped += 1
+            return
+        self.queue.put_nowait((entry, payload))
+
+    async def run(self):
+        loop = asyncio.get_event_loop()
+        while True:
+            item = await self.queue.get()
+            if item is None:
+                break
+            entry, payload = item
+            data = await loop.run_in_executor(
+                self.executor, zlib.compress, payload, self.compression_level)
+            await loop.run_in_executor(self.executor, self.file.write, data)
+            self.entries.append(entry._replace(offset=self.offset, size=len(data)))
+            self.offset += len(data)
+        self.file.close()
+
+
+async def receive_stream(device, sensor, host, port, estimator, writer, stop):
+    """Receives the frames of one stream, reconnecting until stopped."""
+    while not stop.is_set():
+        try:
+            reader, connection = await asyncio.open_connection(host, port)
+        except OSError:
+            await asyncio.sleep(1.0)
+            continue
+        print('INFO: Connected to {} {} on {}:{}'.format(device, sensor, host, port))
+        try:
+            while not stop.is_set():
+                data = await reader.readexactly(SENSOR_STREAM_HEADER_SIZE)
+                received = host_ticks()
+                header = SENSOR_FRAME_STREAM_HEADER(
+                    *struct.unpack(SENSOR_STREAM_HEADER_FORMAT, data))
+                if header.Cookie != SENSOR_STREAM_COOKIE:
+                    print('ERROR: Invalid cookie from {} {}'.format(device, sensor))
+                    break
+                payload = await reader.readexactly(
+                    header.ImageHeight * header.RowStride)
+                estimator.add(header.Timestamp, received)
+                writer.put(INDEX_ENTRY(
+                    0, device, sensor, header.Timestamp, received,
+                    header.SequenceNumber, header.ImageWidth, header.ImageHeight,
+                    header.PixelStride, header.RowStride, 0, 0), payload)
+        except (asyncio.IncompleteReadError, OSError):
+            print('WARNING: Lost connection to {} {}'.format(device, sensor))
+        finally:
+            connection.close()
+
+
+def write_store(output_path, writers, estimators):
+    """Aligns the timestamps of all devices to the host clock and writes the
+    index sorted by aligned timestamp."""
+    entries = []
+    for (device, _), writer in writers.items():
+        if not writer.entries:
+            continue
+        offsets = estimators[device].offsets_at(
+            [entry.host_timestamp for entry in writer.entries])
+        entries.extend(entry._replace(aligned_timestamp=entry.device_timestamp + offset)
+                       for entry, offset in zip(writer.entries, offsets))
+    entries.sort(key=lambda entry: (entry.aligned_timestamp, entry.device,
+                                    entry.sensor))
+
+    with open(os.path.join(output_path, "index.csv"), "w", newline="") as f:
+        index_writer = csv.writer(f)
+        index_writer.writerow(INDEX_FIELDS)
+        index_writer.writerows(entries)
+
+    with open(os.path.join(output_path, "clock_offsets.csv"), "w", newline="") as f:
+        offset_writer = csv.writer(f)
+        offset_writer.writerow(["device", "host_second", "minimum_difference"])
+        for device, estimator in sorted(estimators.items()):
+            for second, difference in estimator.trace():
+                offset_writer.writerow([device, second, difference])
+
+    return entries
+
+
+class MultiDeviceStore(object):
+    """Reads a store written by the ingest command."""
+
+    def __init__(self, path):
+        self.path = path
+        with open(os.path.join(path, "index.csv"), newline="") as f:
+            rows = list(csv.reader(f))[1:]
+        self.entries = [INDEX_ENTRY(int(row[0]), row[1], row[2], *map(int, row[3:])) for row in rows]
+        self.aligned_timestamps = np.array(
+            [entry.aligned_timestamp for entry in self.entries], dtype=np.int64)
+
+    def select(self, start=None, end=None, devices=None, sensors=None):
+        """Returns the entries in [start, end) of the aligned clock, in time order."""
+        begin = 0 if start is None else np.searchsorted(self.aligned_timestamps, start)
+        stop = len(self.entries) if end is None else \
+            np.searchsorted(self.aligned_timestamps, end)
+        return [entry for entry in self.entries[begin:stop]
+                if (devices is None or entry.device in devices) and
+                (sensors is None or entry.sensor in sensors)]
+
+    def read_image(self, entry):
+        with open(os.path.join(self.path, entry.device, entry.sensor + ".bin"), "rb") as f:
+            f.seek(entry.offset)
+            data = zlib.decompress(f.read(entry.size))
+        image = np.frombuffer(data, dtype=np.uint8).reshape(entry.height, entry.row_stride)
+        image = image[:, :entry.width * entry.pixel_stride]
+        if entry.pixel_stride == 2:
+            return image.view('<u2')
+        return image.reshape(entry.height, entry.width, entry.pixel_stride).squeeze()
+
+
+def parse_device(spec):
+    name, address = spec.split("=", 1)
+    host, _, port_offset = address.partition(":")
+    return name, host, int(port_offset or 0)
+
+
+async def ingest(args):
+    sensors = args.sensors.split(",")
+    devices = [parse_device(spec) for spec in args.device]
+
+    executor = concurrent.futures.ThreadPoolExecutor(args.num_threads)
+    stop = asyncio.Event()
+    estimators = {}
+    writers = {}
+    receivers = []
+    for device, host, port_offset in devices:
+        if not os.path.isdir(os.path.join(args.output_path, device)):
+            os.makedirs(os.path.join(args.output_path, device))
+        estimators[device] = ClockOffsetEstimator(args.offset_window)
+        for sensor in sensors:
+            writers[(device, sensor)] = StreamWriter(
+                os.path.join(args.output_path, device, sensor + ".bin"),
+                executor, args.compression_level, args.queue_length, args.direct_io)
+            receivers.append(asyncio.ensure_future(receive_stream(
+                device, sensor, host, SENSOR_STREAM_PORTS[sensor] + port_offset,
+                estimators[device], writers[(device, sensor)], stop)))
+    writer_tasks = [asyncio.ensure_future(writer.run()) for writer in writers.values()]
+
+    start_time = time.time()
+    try:
+        while args.duration <= 0 or time.time() - start_time < args.duration:
+            await asyncio.sleep(1.0)
+            for device, estimator in sorted(estimators.items()):
+                offset = estimator.current()
+                if offset is not None:
+                    print('INFO: {} clock offset {:.4f} s'.format(
+                        device, offset / float(TICKS_PER_SECOND)))
+    except asyncio.CancelledError:
+        pass
+    finally:
+        stop.set()
+        for receiver in receivers:
+            receiver.cancel()
+        await asyncio.gather(*receivers, return_exceptions=True)
+        for writer in writers.values():
+            await writer.queue.put(None)
+        await asyncio.gather(*writer_tasks)
+        executor.shutdown()
+
+    entries = write_store(args.output_path, writers, estimators)
+    for (device, sensor), writer in sorted(writers.items()):
+        print('INFO: {} {}: {} frames, {} dropped'.format(
+            device, sensor, len(writer.entries), writer.frames_dropped))
+    print('INFO: Wrote {} frames to {}'.format(len(entries), args.output_path))
+
+
+async def serve_replay_stream(sensor, port, clock_offset, args):
+    """Stand-in for the stream of one sensor of one device, which sends
+    synthetic frames timestamped by a clock that is offset from the host."""
+    width, height, pixel_stride = SENSOR_IMAGE_FORMATS[sensor]
+    row = np.arange(width * pixel_stride, dtype=np.uint8)
+
+    async def handle(reader, connection):
+        sequence_number = 0
+        try:
+            while True:
+                captured = host_ticks() + clock_offset
+                image = np.add.outer(np.arange(height, dtype=np.uint8),
+                                     row + np.uint8(sequence_number))
+                header = struct.pack(
+                    SENSOR_STREAM_HEADER_FORMAT, SENSOR_STREAM_COOKIE, 0, 2,
+                    list(SENSOR_STREAM_PORTS).index(sensor), captured,
+                    sequence_number, width, height, pixel_stride,
+                    width * pixel_stride)
+                await asyncio.sleep(random.uniform(0, args.max_latency))
+                connection.write(header + image.tobytes())
+                await connection.drain()
+                sequence_number += 1
+                await asyncio.sleep(1.0 / args.frames_per_second)
+        except (ConnectionError, OSError):
+            pass
+        finally:
+            connection.close()
+
+    return await asyncio.start_server(handle, '127.0.0.1', port)
+
+
+async def replay(args):
+    sensors = args.sensors.split(",")
+    servers = []
+    for i in range(args.num_devices):
+        port_offset = (i + 1) * args.port_offset
+        clock_offset = int(random.uniform(-args.max_clock_offset, args.max_clock_offset) *
+                           TICKS_PER_SECOND)
+        for sensor in sensors:
+            servers.append(await serve_replay_stream(
+                sensor, SENSOR_STREAM_PORTS[sensor] + port_offset, clock_offset, args))
+        print('INFO: Device {} serves on port offset {}, clock offset {:.4f} s '
+              '(ingest with --device device{}=127.0.0.1:{})'.format(
+                  i, port_offset, -clock_offset / float(TICKS_PER_SECOND), i, port_offset))
+    sys.stdout.flush()
+    start_time = time.time()
+    while args.duration <= 0 or time.time() - start_time < args.duration:
+        await asyncio.sleep(0.5)
+    for server in servers:
+        server.close()
+
+
+def main():
+    args = parse_args()
+    loop = asyncio.get_event_loop()
+    task = asyncio.ensure_future(ingest(args) if args.command == "ingest" else replay(args))
+    try:
+        loop.run_until_complete(task)
+    except KeyboardInterrupt:
+        task.cancel()
+        loop.run_until_complete(asyncio.gather(task, return_exceptions=True))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,5 +1,10 @@
 # Script to compute 3D point clouds from depth images donwloaded with recorder_console.py.
 #
+# The depth images are back-projected into organized point clouds, i.e. one 3D
+# point per pixel, so that normals can be estimated directly on the depth grid
+# from the cross product of the horizontal and vertical neighbors. Points and
+# normals can be saved as binary PLY files.
+#
 
 import argparse
 import cv2
@@ -14,6 +19,10 @@ from recorder_console import read_sensor_poses
 SHORT_THROW_RANGE = [0.02, 3.]
 LONG_THROW_RANGE = [1., 4.]
 
+# Neighbors whose depth differs by more than this fraction of the center depth
+# are considered to lie across a depth discontinuity.
+MAX_RELATIVE_DEPTH_CHANGE = 0.05
+
 
 def save_obj(output_path, points):
     with open(output_path, 'w') as f:
@@ -21,6 +30,40 @@ def save_obj(output_path, points):
         for v in points:
             f.write("v %.4f %.4f %.4f\n" % (v[0], v[1], v[2]))
 
+def save_ply(output_path, points, normals=None):
+    points = np.asarray(points, dtype=np.float32).reshape(-1, 3)
+    properties = ["x", "y", "z"]
+    data = points
+    if normals is not None:
+        normals = np.asarray(normals, dtype=np.float32).reshape(-1, 3)
+        properties += ["nx", "ny", "nz"]
+        data = np.hstack([points, normals])
+    with open(output_path, 'wb') as f:
+        f.write(b"ply\n")
+        f.write(b"format binary_little_endian 1.0\n")
+        f.write(("element vertex %d\n" % points.shape[0]).encode())
+        for name in properties:
+            f.write(("property float %s\n" % name).encode())
+        f.write(b"end_header\n")
+        f.write(np.ascontiguousarray(data, dtype='<f4').tobytes())
+
+def read_ply(path):
+    with open(path, 'rb') as f:
+        num_points = 0
+        properties = []
+        while True:
+            elem = f.readline().split()
+            if elem[0] == b'element':
+                num_points = int(elem[2])
+            elif elem[0] == b'property':
+                properties.append(elem[2])
+            elif elem[0] == b'end_header':
+                break
+        data = np.fromfile(f, dtype='<f4', count=num_points * len(properties))
+    data = data.reshape(num_points, len(properties)).astype(np.float64)
+    normals = data[:, 3:6] if len(properties) >= 6 else None
+    return data[:, :3], normals
+
 def read_obj(path):
     with open(path, 'r') as f:        
         # get lines
@@ -69,43 +112,72 @@ def parse_projection_bin(path, w, h):
 def pgm2distance(img, encoded=False):
     # See repo issue #19
     img.byteswap(inplace=True)
-    return img.astype(np.float)/1000.0
+    return img.astype(np.float64)/1000.0
 
 
-def get_points(img, us, vs, cam2world, depth_range):
+def get_organized_points(img, us, vs, depth_range):
     distance_img = pgm2distance(img, encoded=False)
 
+    # Compute Z values as described in issue #63
+    # https://github.com/Microsoft/HoloLensForCV/issues/63#issuecomment-429469425
+    valid = np.isfinite(us) & np.isfinite(vs) & \
+        (distance_img >= depth_range[0]) & (distance_img <= depth_range[1])
+    x = np.where(valid, us, 0)
+    y = np.where(valid, vs, 0)
+    z = np.where(valid, -distance_img / np.sqrt(x*x + y*y + 1), 0)
+
+    # 3D points in camera coordinate system, with z == 0 for invalid pixels
+    return np.dstack([x * z, y * z, z])
+
+
+def compute_normals(points, max_relative_depth_change=MAX_RELATIVE_DEPTH_CHANGE):
+    # Central differences on the depth grid; the border pixels have no normal.
+    normals = np.zeros_like(points)
+    z = points[:, :, 2]
+    zc = z[1:-1, 1:-1]
+    zl, zr = z[1:-1, :-2], z[1:-1, 2:]
+    zu, zd = z[:-2, 1:-1], z[2:, 1:-1]
+
+    dx = points[1:-1, 2:] - points[1:-1, :-2]
+    dy = points[2:, 1:-1] - points[:-2, 1:-1]
+
+    # Mask out pixels next to invalid measurements and depth discontinuities.
+    # The differences span two pixels, hence the factor of two.
+    threshold = 2 * max_relative_depth_change * np.abs(zc)
+    valid = (zc != 0) & (zl != 0) & (zr != 0) & (zu != 0) & (zd != 0) & \
+        (np.abs(dx[:, :, 2]) <= threshold) & (np.abs(dy[:, :, 2]) <= threshold)
+
+    n = np.cross(dx, dy)
+    length = np.linalg.norm(n, axis=2)
+    valid &= length > 0
+    n /= np.where(valid, length, 1)[:, :, np.newaxis]
+
+    # Orient the normals towards the camera.
+    flip = np.sum(n * points[1:-1, 1:-1], axis=2) > 0
+    n[flip] *= -1
+    n[~valid] = 0
+
+    normals[1:-1, 1:-1] = n
+    return normals
+
+
+def get_points(img, us, vs, cam2world, depth_range, with_normals=False):
+    points = get_organized_points(img, us, vs, depth_range)
+    normals = compute_normals(points) if with_normals else None
+
     if cam2world is not None:
         R = cam2world[:3, :3]
         t = cam2world[:3, 3]
     else:
         R, t = np.eye(3), np.zeros(3)
 
-    points = []
-    for i in np.arange(distance_img.shape[0]):
-        for j in np.arange(distance_img.shape[1]):
-            x = us[i, j]
-            y = vs[i, j]
-            
-            # Compute Z values as described in issue #63
-            # https://github.com/Microsoft/HoloLensForCV/issues/63#issuecomment-429469425
-            D = distance_img[i, j]
-            z = - float(D) / np.sqrt(x*x + y*y + 1)
-            
-            if np.isinf(x) or np.isinf(y) or \
-               D < depth_range[0] or D > depth_range[1]:
-                continue
-            
-            # 3D point in camera coordinate system
-            point = np.array([x, y, 1.]) * z
-            
-            # Camera to World
-            point = np.dot(R, point) + t
+    # Camera to World
+    valid = points[:, :, 2] != 0
+    points = points[valid].dot(R.T) + t
+    if normals is not None:
+        normals = normals[valid].dot(R.T)
 
-            # Append point
-            points.append(point)
-   
-    return np.vstack(points) if points else np.array(points)
+    return points, normals
 
 
 def get_cam2world(path, sensor_poses):
@@ -134,7 +206,8 @@ def process_folder(args, cam):
     # From frame to world coordinate system
     sensor_poses = None
     if not args.ignore_sensor_poses:
-        sensor_poses = read_sensor_poses(os.path.join(folder, cam + ".csv"), identity_camera_to_image=True)        
+        pose_suffix = "_%s" % args.pose_suffix if len(args.pose_suffix) else ""
+        sensor_poses = read_sensor_poses(os.path.join(folder, cam + pose_suffix + ".csv"), identity_camera_to_image=True)        
 
     # Get appropriate depth thresholds
     depth_range = LONG_THROW_RANGE if 'long' in cam else SHORT_THROW_RANGE
@@ -149,32 +222,42 @@ def process_folder(args, cam):
     merge_points = args.merge_points
     overwrite    = args.overwrite
     use_cache    = args.use_cache
+    with_normals = args.output_format == "ply"
     points_merged = []
+    normals_merged = []
     us = vs = None
     for i_path, path in enumerate(depth_paths):
         output_suffix = "_%s" % args.output_suffix if len(args.output_suffix) else ""
-        pcloud_output_path = os.path.join(output_folder, os.path.basename(path).replace(".pgm", "%s.obj" % output_suffix))
+        pcloud_output_path = os.path.join(output_folder, os.path.basename(path).replace(".pgm", "%s.%s" % (output_suffix, args.output_format)))
         print("Progress file (%d/%d): %s" %
               (i_path+1, len(depth_paths), pcloud_output_path))
         
         # if file exist
         output_file_exist = os.path.exists(pcloud_output_path)
         if output_file_exist and use_cache:
-            points = read_obj(pcloud_output_path)
+            if with_normals:
+                points, normals = read_ply(pcloud_output_path)
+            else:
+                points, normals = read_obj(pcloud_output_path), None
         else:
             img = cv2.imread(path, -1)
             if us is None or vs is None:
                 us, vs = parse_projection_bin(bin_path, img.shape[1], img.shape[0])
             cam2world = get_cam2world(path, sensor_poses) if sensor_poses is not None else None
-            points = get_points(img, us, vs, cam2world, depth_range)  
+            points, normals = get_points(img, us, vs, cam2world, depth_range, with_normals)
             
         if merge_points:
             points_merged.extend(points)
+            if normals is not None:
+                normals_merged.extend(normals)
         
         if not output_file_exist or overwrite:
-            save_obj(pcloud_output_path, points)
+            if with_normals:
+                save_ply(pcloud_output_path, points, normals)
+            else:
+                save_obj(pcloud_output_path, points)
         
-    return points_merged
+    return points_merged, normals_merged if with_normals else None
 
 
 def parse_args():
@@ -185,11 +268,13 @@ def parse_args():
     parser.add_argument("--short_throw", action='store_true', help="Extract point clouds from short throw frames")
     parser.add_argument("--long_throw", action='store_true', help="Extract point clouds from long throw frames")
     parser.add_argument("--ignore_sensor_poses", action='store_true', help="Drop HL pose information (point clouds will not be aligned to a common ref space)")
+    parser.add_argument("--pose_suffix", required=False, default="", help="If a suffix is specified, poses are read from [camera]_[suffix].csv, e.g. 'refined' for the output of refine_depth_poses.py")
     parser.add_argument("--start_frame", type=int, default=0)
     parser.add_argument("--max_num_frames", type=int, default=-1)
     parser.add_argument("--merge_points",  action='store_true', default=False, help="Save file with all the points (in world coordinate system)") 
     parser.add_argument("--use_cache", action='store_true', default=False, help="Load already existing files") 
     parser.add_argument("--overwrite", action='store_true', default=False, help="Write output files (overwrite if exist).")
+    parser.add_argument("--output_format", choices=["obj", "ply"], default="obj", help="Save points as OBJ, or as binary PLY together with per-point normals estimated on the depth grid")
 
     args = parser.parse_args()
 
@@ -215,15 +300,18 @@ def main():
 
     # process
     print("Processing '%s' depth folder..." % camera)
-    points = process_folder(args, camera)
+    points, normals = process_folder(args, camera)
     print('Done processing.')
     
     # save output
     if args.merge_points:
         output_folder = os.path.join(args.output_path, camera)
-        output_filename = output_folder + ".obj"
+        output_filename = output_folder + "." + args.output_format
         print("Saving file with all points: %s" % output_filename)
-        save_obj(output_filename, points)
+        if args.output_format == "ply":
+            save_ply(output_filename, points, normals)
+        else:
+            save_obj(output_filename, points)
         
     print("Done.")
 
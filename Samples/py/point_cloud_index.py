@@ -0,0 +1,469 @@
+# Script and module to build and query a spatial index over the merged point
+# clouds written by pcloud_compute.py.
+#
+# The index is a linear octree: the points are sorted by the Morton code of
+# the leaf cell they fall into, so every octree node covers a contiguous range
+# of points and only the sorted, non-empty leaf keys need to be stored. The
+# coordinates are kept as structure of arrays in that order.
+#
+#  - radius and kNN queries are processed in batches: the leaf cells around
+#    all queries of a batch are looked up with one binary search and their
+#    points are gathered and tested with vectorized numpy code, so batches
+#    can be processed in parallel by a thread pool,
+#  - box queries descend the octree and take the points of nodes that are
+#    fully inside the box without testing them,
+#  - the index is saved as one flat file with 64 byte aligned arrays, which is
+#    opened with np.memmap, so reopening a large scene does not read it.
+#
+# Query results refer to the points by their index in the input file.
+
+import os
+import argparse
+import multiprocessing
+import concurrent.futures
+import numpy as np
+
+from pcloud_compute import read_ply, read_obj
+
+
+MAGIC = b"HLPCIDX\0"
+VERSION = 1
+HEADER_SIZE = 128
+ALIGNMENT = 64
+
+# Cell coordinates are limited to 21 bits per axis, so that the leaf keys
+# fit into 63 bits.
+MAX_LEVELS = 21
+
+# Maximum number of points gathered for one batch of radius queries; larger
+# batches are split.
+MAX_BATCH_CANDIDATES = 1 << 24
+
+HEADER_DTYPE = np.dtype([
+    ("magic", "S8"),
+    ("version", "<u4"),
+    ("has_normals", "<u4"),
+    ("num_points", "<u8"),
+    ("num_leaves", "<u8"),
+    ("num_levels", "<u4"),
+    ("reserved", "<u4"),
+    ("origin", "<f8", (3,)),
+    ("leaf_size", "<f8"),
+])
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    subparsers = parser.add_subparsers(dest="command")
+    subparsers.required = True
+
+    build_parser = subparsers.add_parser(
+        "build", help="Build an index from a PLY or OBJ point cloud")
+    build_parser.add_argument("--input_path", required=True, help="Point cloud written by pcloud_compute.py")
+    build_parser.add_argument("--output_path", required=False, help="Index file, by default the input path with the .pcidx extension")
+    build_parser.add_argument("--leaf_size", type=float, default=0.05, help="Edge length of the octree leaves in meters")
+
+    query_parser = subparsers.add_parser(
+        "query", help="Query an index with the points of a text file")
+    query_parser.add_argument("--index_path", required=True)
+    query_parser.add_argument("--query_path", required=False, help="Text file with one x y z query point per line")
+    query_parser.add_argument("--output_path", required=True, help="Text file with one line of point indices per query")
+    group = query_parser.add_mutually_exclusive_group(required=True)
+    group.add_argument("--knn", type=int, help="Number of nearest neighbors")
+    group.add_argument("--radius", type=float, help="Search radius in meters")
+    group.add_argument("--box", type=float, nargs=6, metavar=("MIN_X", "MIN_Y", "MIN_Z", "MAX_X", "MAX_Y", "MAX_Z"), help="Axis aligned box, no query points needed")
+    query_parser.add_argument("--batch_size", type=int, default=4096)
+    query_parser.add_argument("--num_threads", type=int, default=multiprocessing.cpu_count())
+
+    return parser.parse_args()
+
+
+def spread_bits(values):
+    # Inserts two zero bits between the lower 21 bits of each value.
+    x = values.astype(np.uint64) & np.uint64(0x1fffff)
+    x = (x | (x << np.uint64(32))) & np.uint64(0x1f00000000ffff)
+    x = (x | (x << np.uint64(16))) & np.uint64(0x1f0000ff0000ff)
+    x = (x | (x << np.uint64(8))) & np.uint64(0x100f00f00f00f00f)
+    x = (x | (x << np.uint64(4))) & np.uint64(0x10c30c30c30c30c3)
+    x = (x | (x << np.uint64(2))) & np.uint64(0x1249249249249249)
+    return x
+
+
+def morton_keys(cells):
+    return spread_bits(cells[..., 0]) | \
+        (spread_bits(cells[..., 1]) << np.uint64(1)) | \
+        (spread_bits(cells[..., 2]) << np.uint64(2))
+
+
+def make_header(num_points, num_leaves, num_levels, origin, leaf_size,
+                has_normals):
+    header = np.zeros((), dtype=HEADER_DTYPE)
+    header["magic"] = MAGIC
+    header["version"] = VERSION
+    header["has_normals"] = has_normals
+    header["num_points"] = num_points
+    header["num_leaves"] = num_leaves
+    header["num_levels"] = num_levels
+    header["origin"] = origin
+    header["leaf_size"] = leaf_size
+    return header
+
+
+def aligned(offset):
+    return (offset + ALIGNMENT - 1) // ALIGNMENT * ALIGNMENT
+
+
+def expand_ranges(starts, ends):
+    # Concatenates np.arange(start, end) for all ranges.
+    lengths = ends - starts
+    total = int(lengths.sum())
+    if total == 0:
+        return np.zeros(0, dtype=np.int64), lengths
+    offsets = np.repeat(starts - np.cumsum(lengths) + lengths, lengths)
+    return offsets + np.arange(total), lengths
+
+
+class PointCloudIndex:
+    def __init__(self, header, arrays):
+        self.origin = header["origin"].astype(np.float64)
+        self.leaf_size = float(header["leaf_size"])
+        self.num_levels = int(header["num_levels"])
+        self.x = arrays["x"]
+        self.y = arrays["y"]
+        self.z = arrays["z"]
+        self.normals = (arrays["nx"], arrays["ny"], arrays["nz"]) \
+            if "nx" in arrays else None
+        self.point_ids = arrays["point_ids"]
+        self.leaf_keys = arrays["leaf_keys"]
+        self.leaf_starts = arrays["leaf_starts"]
+
+    @classmethod
+    def layout(cls, num_points, num_leaves, has_normals):
+        names = ["x", "y", "z"]
+        if has_normals:
+            names += ["nx", "ny", "nz"]
+        arrays = [(name, np.dtype("<f4"), num_points) for name in names]
+        arrays += [("point_ids", np.dtype("<u4"), num_points),
+                   ("leaf_keys", np.dtype("<u8"), num_leaves),
+                   ("leaf_starts", np.dtype("<u8"), num_leaves + 1)]
+        offset = HEADER_SIZE
+        layout = []
+        for name, dtype, count in arrays:
+            offset = aligned(offset)
+            layout.append((name, dtype, count, offset))
+            offset += dtype.itemsize * count
+        return layout, offset
+
+    @classmethod
+    def build(cls, points, normals=None, leaf_size=0.05):
+        points = np.asarray(points, dtype=np.float64).reshape(-1, 3)
+        if points.shape[0] == 0:
+            raise ValueError("Cannot index an empty point cloud")
+
+        origin = points.min(axis=0)
+        cells = np.floor((points - origin) / leaf_size).astype(np.int64)
+        max_cell = int(cells.max())
+        num_levels = max(1, int(max_cell).bit_length())
+        if num_levels > MAX_LEVELS:
+            raise ValueError(
+                "The leaf size is too small for the extent of the point "
+                "cloud, use a leaf size of at least %f" %
+                ((max_cell + 1) * leaf_size / (1 << MAX_LEVELS)))
+
+        keys = morton_keys(cells)
+        order = np.argsort(keys, kind="stable")
+        keys = keys[order]
+        leaf_keys, leaf_starts = np.unique(keys, return_index=True)
+
+        header = make_header(points.shape[0], leaf_keys.shape[0], num_levels,
+                             origin, leaf_size, normals is not None)
+
+        arrays = {
+            "x": points[order, 0].astype(np.float32),
+            "y": points[order, 1].astype(np.float32),
+            "z": points[order, 2].astype(np.float32),
+            "point_ids": order.astype(np.uint32),
+            "leaf_keys": leaf_keys,
+            "leaf_starts": np.append(
+                leaf_starts, points.shape[0]).astype(np.uint64),
+        }
+        if normals is not None:
+            normals = np.asarray(normals, dtype=np.float32).reshape(-1, 3)
+            for i, name in enumerate(["nx", "ny", "nz"]):
+                arrays[name] = normals[order, i]
+
+        return cls(header, arrays)
+
+    def save(self, path):
+        layout, size = self.layout(
+            self.x.shape[0], self.leaf_keys.shape[0], self.normals is not None)
+        header = make_header(self.x.shape[0], self.leaf_keys.shape[0],
+                             self.num_levels, self.origin, self.leaf_size,
+                             self.normals is not None)
+
+        arrays = {"x": self.x, "y": self.y, "z": self.z,
+                  "point_ids": self.point_ids, "leaf_keys": self.leaf_keys,
+                  "leaf_starts": self.leaf_starts}
+        if self.normals is not None:
+            arrays.update(zip(["nx", "ny", "nz"], self.normals))
+
+        with open(path, "wb") as f:
+            f.write(header.tobytes())
+            for name, dtype, _, offset in layout:
+                f.seek(offset)
+                f.write(np.ascontiguousarray(arrays[name], dtype=dtype).tobytes())
+            f.truncate(size)
+
+    @classmethod
+    def open(cls, path):
+        header = np.fromfile(path, dtype=HEADER_DTYPE, count=1)[0]
+        if header["magic"] != MAGIC.rstrip(b"\0") or \
+                header["version"] != VERSION:
+            raise ValueError("%s is not a point cloud index" % path)
+        layout, size = cls.layout(
+            int(header["num_points"]), int(header["num_leaves"]),
+            bool(header["has_normals"]))
+        if os.path.getsize(path) < size:
+            raise ValueError("%s is truncated" % path)
+        arrays = {}
+        for name, dtype, count, offset in layout:
+            arrays[name] = np.memmap(
+                path, dtype=dtype, mode="r", offset=offset, shape=(count,))
+        return cls(header, arrays)
+
+    def leaf_ranges(self, keys):
+        # Returns the point ranges of the leaves with the given keys, which
+        # are empty for leaves without points.
+        indices = np.searchsorted(self.leaf_keys, keys)
+        indices = np.minimum(indices, self.leaf_keys.shape[0] - 1)
+        found = self.leaf_keys[indices] == keys
+        starts = self.leaf_starts[indices].astype(np.int64)
+        ends = self.leaf_starts[indices + 1].astype(np.int64)
+        ends[~found] = starts[~found]
+        return starts, ends
+
+    def candidates(self, queries, radius):
+        # Gathers the points of all leaves overlapping the bounding boxes of
+        # the query spheres. Returns the query of each candidate, the point
+        # position in the index and the squared distance.
+        lower = np.floor(
+            (queries - radius - self.origin) / self.leaf_size).astype(np.int64)
+        upper = np.floor(
+            (queries + radius - self.origin) / self.leaf_size).astype(np.int64)
+        max_cell = (1 << self.num_levels) - 1
+        lower = np.clip(lower, 0, max_cell)
+        upper = np.clip(upper, -1, max_cell)
+        extents = np.maximum(upper - lower + 1, 0)
+        max_extents = extents.max(axis=0)
+
+        # Test all points instead of looking up more cells than there are
+        # leaves, and split batches that would gather too many cells.
+        num_points = self.x.shape[0]
+        num_cells = int(np.prod(max_extents))
+        test_all = num_cells > self.leaf_keys.shape[0]
+        cost = queries.shape[0] * (num_points if test_all else num_cells)
+        if cost > MAX_BATCH_CANDIDATES and queries.shape[0] > 1:
+            half = queries.shape[0] // 2
+            first = self.candidates(queries[:half], radius)
+            second = self.candidates(queries[half:], radius)
+            return np.concatenate([first[0], second[0] + half]), \
+                np.concatenate([first[1], second[1]]), \
+                np.concatenate([first[2], second[2]])
+
+        if test_all:
+            query_ids = np.repeat(np.arange(queries.shape[0]), num_points)
+            positions = np.tile(np.arange(num_points), queries.shape[0])
+        else:
+            steps = [np.arange(n) for n in max_extents]
+            offsets = np.stack(
+                np.meshgrid(*steps, indexing="ij"), -1).reshape(-1, 3)
+
+            cells = lower[:, None, :] + offsets[None, :, :]
+            valid = np.all(offsets[None, :, :] < extents[:, None, :], axis=2)
+            query_ids = np.nonzero(valid)[0]
+            starts, ends = self.leaf_ranges(morton_keys(cells[valid]))
+
+            positions, lengths = expand_ranges(starts, ends)
+            query_ids = np.repeat(query_ids, lengths)
+
+        dx = self.x[positions] - queries[query_ids, 0]
+        dy = self.y[positions] - queries[query_ids, 1]
+        dz = self.z[positions] - queries[query_ids, 2]
+        return query_ids, positions, dx * dx + dy * dy + dz * dz
+
+    def radius_batch(self, queries, radius):
+        queries = np.asarray(queries, dtype=np.float64).reshape(-1, 3)
+        if queries.shape[0] == 0:
+            return np.zeros(1, dtype=np.int64), np.zeros(0, dtype=np.int64), \
+                np.zeros(0, dtype=np.float32)
+        query_ids, positions, distances = self.candidates(queries, radius)
+        inside = distances <= radius * radius
+        query_ids = query_ids[inside]
+        positions = positions[inside]
+        distances = distances[inside]
+
+        # Group by query and sort each group by distance.
+        order = np.lexsort((distances, query_ids))
+        counts = np.bincount(query_ids, minlength=queries.shape[0])
+        offsets = np.concatenate([[0], np.cumsum(counts)])
+        return offsets, self.point_ids[positions[order]].astype(np.int64), \
+            np.sqrt(distances[order])
+
+    def knn_batch(self, queries, k):
+        queries = np.asarray(queries, dtype=np.float64).reshape(-1, 3)
+        indices = np.full((queries.shape[0], k), -1, dtype=np.int64)
+        distances = np.full((queries.shape[0], k), np.inf, dtype=np.float32)
+
+        # Grow the search radius of each query until it contains k points,
+        # then the k nearest points are within the radius as well. Beyond the
+        # distance to the farthest corner of the octree, all points are found.
+        extent = self.leaf_size * (1 << self.num_levels)
+        max_radius = np.linalg.norm(np.maximum(
+            np.abs(queries - self.origin),
+            np.abs(queries - self.origin - extent)), axis=1)
+        remaining = np.arange(queries.shape[0])
+        radius = self.leaf_size
+        while remaining.shape[0] > 0:
+            offsets, ids, dists = self.radius_batch(queries[remaining], radius)
+            counts = np.diff(offsets)
+            done = (counts >= k) | (radius >= max_radius[remaining])
+            # The neighbors of each query are sorted by distance, so take the
+            # first k of each finished query.
+            finished = np.nonzero(done)[0]
+            columns = np.arange(k)
+            found = columns[None, :] < counts[finished, None]
+            positions = offsets[finished, None] + columns[None, :]
+            rows = np.broadcast_to(remaining[finished, None], found.shape)
+            indices[rows[found], np.nonzero(found)[1]] = ids[positions[found]]
+            distances[rows[found], np.nonzero(found)[1]] = \
+                dists[positions[found]]
+            remaining = remaining[~done]
+            radius *= 2.0
+        return indices, distances
+
+    def box(self, box_min, box_max):
+        box_min = np.asarray(box_min, dtype=np.float64)
+        box_max = np.asarray(box_max, dtype=np.float64)
+        cell_min = np.floor((box_min - self.origin) / self.leaf_size)
+        cell_max = np.floor((box_max - self.origin) / self.leaf_size)
+
+        full_ranges = []
+        partial_ranges = []
+
+        def descend(cell, level):
+            # The node covers the leaf cells cell .. cell + 2^level - 1.
+            size = 1 << level
+            if np.any(cell > cell_max) or np.any(cell + size - 1 < cell_min):
+                return
+            key = int(morton_keys(np.asarray(cell, dtype=np.int64)))
+            first = np.searchsorted(self.leaf_keys, np.uint64(key))
+            last = np.searchsorted(
+                self.leaf_keys, np.uint64(key + (1 << (3 * level))))
+            if first == last:
+                return
+            ranges = (int(self.leaf_starts[first]), int(self.leaf_starts[last]))
+            if np.all(cell > cell_min) and np.all(cell + size - 1 < cell_max):
+                full_ranges.append(ranges)
+            elif level == 0:
+                partial_ranges.append(ranges)
+            else:
+                half = size // 2
+                for i in range(8):
+                    child = cell + half * np.array([i & 1, (i >> 1) & 1, i >> 2])
+                    descend(child, level - 1)
+
+        descend(np.zeros(3, dtype=np.int64), self.num_levels)
+
+        positions = [np.arange(start, end) for start, end in full_ranges]
+        if partial_ranges:
+            starts, ends = np.array(partial_ranges).T
+            candidates, _ = expand_ranges(starts, ends)
+            x = self.x[candidates]
+            y = self.y[candidates]
+            z = self.z[candidates]
+            inside = (x >= box_min[0]) & (x <= box_max[0]) & \
+                (y >= box_min[1]) & (y <= box_max[1]) & \
+                (z >= box_min[2]) & (z <= box_max[2])
+            positions.append(candidates[inside])
+        if not positions:
+            return np.zeros(0, dtype=np.int64)
+        return np.sort(self.point_ids[np.concatenate(positions)].astype(np.int64))
+
+    def radius_search(self, queries, radius, executor=None, batch_size=4096):
+        # Returns one array of point indices per query, sorted by distance.
+        queries = np.asarray(queries, dtype=np.float64).reshape(-1, 3)
+        batches = [queries[i:i + batch_size]
+                   for i in range(0, queries.shape[0], batch_size)]
+        run = lambda batch: self.radius_batch(batch, radius)
+        results = executor.map(run, batches) if executor else map(run, batches)
+        neighbors = []
+        for offsets, ids, _ in results:
+            neighbors += np.split(ids, offsets[1:-1])
+        return neighbors
+
+    def knn_search(self, queries, k, executor=None, batch_size=4096):
+        # Returns the indices and distances of the k nearest points of each
+        # query, padded with -1 and inf if the index has less than k points.
+        queries = np.asarray(queries, dtype=np.float64).reshape(-1, 3)
+        batches = [queries[i:i + batch_size]
+                   for i in range(0, queries.shape[0], batch_size)]
+        run = lambda batch: self.knn_batch(batch, k)
+        results = list(executor.map(run, batches) if executor
+                       else map(run, batches))
+        if not results:
+            return np.zeros((0, k), dtype=np.int64), \
+                np.zeros((0, k), dtype=np.float32)
+        return np.concatenate([r[0] for r in results]), \
+            np.concatenate([r[1] for r in results])
+
+
+def read_point_cloud(path):
+    if path.endswith(".ply"):
+        return read_ply(path)
+    return read_obj(path), None
+
+
+def build(args):
+    output_path = args.output_path or \
+        os.path.splitext(args.input_path)[0] + ".pcidx"
+    points, normals = read_point_cloud(args.input_path)
+    print("Indexing %d points" % points.shape[0])
+    index = PointCloudIndex.build(points, normals, args.leaf_size)
+    print("Writing %d leaves with %d levels to: %s" % (
+        index.leaf_keys.shape[0], index.num_levels, output_path))
+    index.save(output_path)
+
+
+def query(args):
+    index = PointCloudIndex.open(args.index_path)
+
+    if args.box is not None:
+        results = [index.box(args.box[:3], args.box[3:])]
+    else:
+        if args.query_path is None:
+            raise ValueError("--query_path is required for kNN and radius queries")
+        queries = np.loadtxt(args.query_path, ndmin=2)
+        with concurrent.futures.ThreadPoolExecutor(args.num_threads) as executor:
+            if args.knn is not None:
+                indices, _ = index.knn_search(
+                    queries, args.knn, executor, args.batch_size)
+                results = [row[row >= 0] for row in indices]
+            else:
+                results = index.radius_search(
+                    queries, args.radius, executor, args.batch_size)
+
+    with open(args.output_path, "w") as f:
+        for result in results:
+            f.write(" ".join(str(i) for i in result) + "\n")
+
+
+def main():
+    args = parse_args()
+    if args.command == "build":
+        build(args)
+    else:
+        query(args)
+
+
+if __name__ == "__main__":
+    main()
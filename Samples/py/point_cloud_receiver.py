@@ -0,0 +1,140 @@
+"""
+ Copyright (c) Microsoft. All rights reserved.
+
+ This code is licensed under the MIT License (MIT).
+ THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+ ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+ IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+ PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+"""
+
+""" Receiver for the HoloLens point cloud stream, see PointCloudStreamingServer """
+# pylint: disable=C0103
+
+import argparse
+import os
+import socket
+import struct
+import sys
+import time
+from collections import namedtuple
+import numpy as np
+
+from pcloud_compute import save_ply
+
+# Protocol Header Format
+# Cookie VersionMajor VersionMinor FrameType Timestamp SequenceNumber
+# NumberOfPoints CameraToOrigin (16 floats)
+POINT_CLOUD_HEADER_FORMAT = "<IBBHQQI16f"
+POINT_CLOUD_HEADER_SIZE = struct.calcsize(POINT_CLOUD_HEADER_FORMAT)
+POINT_CLOUD_COOKIE = 0x484c5043
+
+POINT_CLOUD_HEADER = namedtuple(
+    'PointCloudHeader',
+    'Cookie VersionMajor VersionMinor FrameType Timestamp SequenceNumber '
+    'NumberOfPoints CameraToOrigin'
+)
+
+# Ports of the point cloud streams
+SHORT_THROW_POINT_CLOUD_STREAM_PORT = 23951
+LONG_THROW_POINT_CLOUD_STREAM_PORT = 23952
+
+
+def recv_exactly(sock, size):
+    buffer = bytearray(size)
+    view = memoryview(buffer)
+    received = 0
+    while received < size:
+        n = sock.recv_into(view[received:])
+        if n == 0:
+            return None
+        received += n
+    return bytes(buffer)
+
+
+def receive_point_clouds(sock):
+    """Yields the header and the points in meters, in the camera space, of
+    each frame received on a connected socket."""
+    while True:
+        data = recv_exactly(sock, POINT_CLOUD_HEADER_SIZE)
+        if data is None:
+            return
+        fields = struct.unpack(POINT_CLOUD_HEADER_FORMAT, data)
+        header = POINT_CLOUD_HEADER(
+            *fields[:7], CameraToOrigin=np.array(fields[7:]).reshape(4, 4))
+        if header.Cookie != POINT_CLOUD_COOKIE:
+            print('ERROR: Invalid cookie, stream out of sync')
+            return
+        data = recv_exactly(sock, header.NumberOfPoints * 3 * 2)
+        if data is None:
+            return
+        points = np.frombuffer(data, dtype='<i2').reshape(-1, 3)
+        yield header, points.astype(np.float32) / 1000.
+
+
+def camera_to_origin(header, points):
+    """Transforms camera space points to the origin frame of reference, or
+    returns None if the frame has no pose."""
+    if not header.CameraToOrigin.any():
+        return None
+    # The transform is stored for row vectors, like the recorded poses.
+    return points.dot(header.CameraToOrigin[:3, :3]) + \
+        header.CameraToOrigin[3, :3]
+
+
+def main(argv):
+    """Receiver main"""
+    parser = argparse.ArgumentParser()
+    parser.add_argument("-a", "--host", help="Host address to connect",
+                        required=True)
+    parser.add_argument("--long_throw", action='store_true',
+                        help="Receive the long throw instead of the short throw depth points")
+    parser.add_argument("--output_path",
+                        help="Save the points of every n-th frame, in the origin frame of reference, "
+                        "as PLY files into this folder")
+    parser.add_argument("--save_every", type=int, default=30)
+    args = parser.parse_args(argv)
+
+    port = LONG_THROW_POINT_CLOUD_STREAM_PORT if args.long_throw else \
+        SHORT_THROW_POINT_CLOUD_STREAM_PORT
+
+    s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    s.connect((args.host, port))
+    print('INFO: Socket Connected to ' + args.host + ' on port ' + str(port))
+
+    if args.output_path is not None and not os.path.isdir(args.output_path):
+        os.makedirs(args.output_path)
+
+    frames_received = 0
+    bytes_received = 0
+    start_time = time.time()
+
+    try:
+        for header, points in receive_point_clouds(s):
+            frames_received += 1
+            bytes_received += POINT_CLOUD_HEADER_SIZE + points.nbytes // 2
+
+            if frames_received % 10 == 0:
+                elapsed = time.time() - start_time
+                print('INFO: {} frames ({:.1f}/s, {:.0f} KB/s), {} points in '
+                      'frame {}'.format(frames_received, frames_received / elapsed,
+                                        bytes_received / elapsed / 1024.,
+                                        len(points), header.SequenceNumber))
+
+            if args.output_path is not None and \
+                    frames_received % args.save_every == 0:
+                world_points = camera_to_origin(header, points)
+                if world_points is None:
+                    print('WARNING: Frame {} has no pose, not saved'.format(
+                        header.SequenceNumber))
+                    continue
+                save_ply(os.path.join(args.output_path, '{}.ply'.format(
+                    header.Timestamp)), world_points)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        s.close()
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
@@ -0,0 +1,235 @@
+# Script to select image pairs for feature matching in COLMAP using the camera
+# poses recorded by the HoloLens.
+#
+# Exhaustive matching compares every image against every other image, which is
+# quadratic in the number of frames and dominates the reconstruction time for
+# long recordings. Since every frame already comes with a HoloLens pose, we
+# only need to match images that can actually see the same part of the scene:
+#
+#  - candidate neighbors are found with a spatial hash over the camera centers,
+#    limited to the maximum baseline and ranked by their distance in pose space
+#    (camera center distance plus viewing direction change at the scene depth),
+#  - candidates are rejected if the viewing directions differ by more than the
+#    maximum angle or if the view frustums do not overlap sufficiently,
+#  - temporally consecutive images of the same camera are always matched to
+#    keep the view graph connected.
+#
+# The result is a list of image name pairs that can be imported into COLMAP
+# with "colmap matches_importer --match_type pairs".
+#
+# The script can either be used from recorder_console.py or standalone on a
+# COLMAP text model, e.g. the sparse_hololens model written by
+# recorder_console.py, which contains the HoloLens poses of all images.
+
+import os
+import argparse
+import numpy as np
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--model_path", required=True,
+                        help="Path to a COLMAP text model containing the "
+                             "cameras.txt and images.txt with the poses")
+    parser.add_argument("--output_path", required=True,
+                        help="Path to the output match list")
+    parser.add_argument("--max_num_neighbors", type=int, default=20)
+    parser.add_argument("--max_baseline", type=float, default=1.0,
+                        help="Maximum distance between camera centers in "
+                             "meters")
+    parser.add_argument("--max_angle", type=float, default=60.0,
+                        help="Maximum angle between viewing directions in "
+                             "degrees")
+    parser.add_argument("--min_overlap", type=float, default=0.2,
+                        help="Minimum fraction of one view frustum, sampled "
+                             "at the scene depth, visible in the other view")
+    parser.add_argument("--scene_depth", type=float, default=2.0,
+                        help="Typical distance of the scene in meters")
+    args = parser.parse_args()
+    return args
+
+
+def qvec2rotmat(qvec):
+    w, x, y, z = qvec
+    return np.array([
+        [1 - 2 * y * y - 2 * z * z, 2 * x * y - 2 * w * z,
+         2 * z * x + 2 * w * y],
+        [2 * x * y + 2 * w * z, 1 - 2 * x * x - 2 * z * z,
+         2 * y * z - 2 * w * x],
+        [2 * z * x - 2 * w * y, 2 * y * z + 2 * w * x,
+         1 - 2 * x * x - 2 * y * y]])
+
+
+def read_colmap_text_model(model_path):
+    cameras = {}
+    with open(os.path.join(model_path, "cameras.txt"), "r") as fid:
+        for line in fid:
+            line = line.strip()
+            if not line or line.startswith("#"):
+                continue
+            elems = line.split()
+            camera_id = int(elems[0])
+            width, height = int(elems[2]), int(elems[3])
+            fx, fy, cx, cy = map(float, elems[4:8])
+            cameras[camera_id] = (width, height, fx, fy, cx, cy)
+
+    names = []
+    poses = []
+    intrinsics = []
+    with open(os.path.join(model_path, "images.txt"), "r") as fid:
+        for line in fid:
+            line = line.strip()
+            if not line or line.startswith("#"):
+                continue
+            elems = line.split()
+            # Every image line is followed by a line of 2D points, which
+            # starts with a coordinate and thus never has 10 elements.
+            if len(elems) != 10:
+                continue
+            qvec = np.array(list(map(float, elems[1:5])))
+            tvec = np.array(list(map(float, elems[5:8])))
+            pose = np.eye(4)
+            pose[:3, :3] = qvec2rotmat(qvec)
+            pose[:3, 3] = tvec
+            names.append(elems[9])
+            poses.append(pose)
+            intrinsics.append(cameras[int(elems[8])])
+
+    return names, poses, intrinsics
+
+
+def compute_frustum_overlap(pose1, intrinsics1, pose2, intrinsics2,
+                            scene_depth, grid_size=5):
+    # Sample a grid of points in the first view at the scene depth and
+    # determine the fraction of them that projects into the second view.
+    width1, height1, fx1, fy1, cx1, cy1 = intrinsics1
+    width2, height2, fx2, fy2, cx2, cy2 = intrinsics2
+
+    x, y = np.meshgrid(np.linspace(0, width1, grid_size),
+                       np.linspace(0, height1, grid_size))
+    points1 = np.stack([(x.ravel() - cx1) / fx1 * scene_depth,
+                        (y.ravel() - cy1) / fy1 * scene_depth,
+                        np.full(x.size, scene_depth)])
+
+    # Transform from the first into the second camera frame.
+    R1, t1 = pose1[:3, :3], pose1[:3, 3:]
+    R2, t2 = pose2[:3, :3], pose2[:3, 3:]
+    points2 = R2.dot(R1.T.dot(points1 - t1)) + t2
+
+    in_front = points2[2] > 0
+    depth = np.where(in_front, points2[2], 1)
+    u = fx2 * points2[0] / depth + cx2
+    v = fy2 * points2[1] / depth + cy2
+    visible = in_front & (u >= 0) & (u < width2) & (v >= 0) & (v < height2)
+
+    return np.count_nonzero(visible) / float(points1.shape[1])
+
+
+def select_image_pairs(names, poses, intrinsics, max_num_neighbors=20,
+                       max_baseline=1.0, max_angle=60.0, min_overlap=0.2,
+                       scene_depth=2.0):
+    # The poses define the transformation from the world to the camera frame,
+    # where the camera looks along its positive z-axis.
+    num_images = len(names)
+    if num_images < 2:
+        return []
+
+    rotations = np.array([pose[:3, :3] for pose in poses])
+    translations = np.array([pose[:3, 3] for pose in poses])
+    centers = -np.einsum("nji,nj->ni", rotations, translations)
+    directions = rotations[:, 2, :]
+
+    # Spatial hash over the camera centers with a cell size equal to the
+    # maximum baseline, such that all neighbors within the baseline of a
+    # camera are found in the 27 cells around its own cell.
+    cells = np.floor(centers / max_baseline).astype(np.int64)
+    grid = {}
+    for idx, cell in enumerate(map(tuple, cells)):
+        grid.setdefault(cell, []).append(idx)
+    grid = {cell: np.array(idxs) for cell, idxs in grid.items()}
+    offsets = [(dx, dy, dz) for dx in (-1, 0, 1)
+               for dy in (-1, 0, 1) for dz in (-1, 0, 1)]
+
+    min_cos_angle = np.cos(np.deg2rad(max_angle))
+
+    pairs = set()
+
+    def add_pair(idx1, idx2):
+        if idx1 != idx2:
+            pairs.add((min(idx1, idx2), max(idx1, idx2)))
+
+    for idx in range(num_images):
+        cx, cy, cz = cells[idx]
+        candidates = [grid[(cx + dx, cy + dy, cz + dz)]
+                      for dx, dy, dz in offsets
+                      if (cx + dx, cy + dy, cz + dz) in grid]
+        candidates = np.concatenate(candidates)
+        candidates = candidates[candidates != idx]
+        if candidates.size == 0:
+            continue
+
+        baselines = np.linalg.norm(centers[candidates] - centers[idx], axis=1)
+        cos_angles = directions[candidates].dot(directions[idx])
+        valid = (baselines <= max_baseline) & (cos_angles >= min_cos_angle)
+        candidates = candidates[valid]
+        if candidates.size == 0:
+            continue
+
+        # Rank by the distance in pose space, where the change in viewing
+        # direction is converted to a displacement at the scene depth.
+        angles = np.arccos(np.clip(cos_angles[valid], -1, 1))
+        pose_distances = baselines[valid] + scene_depth * angles
+        order = np.argsort(pose_distances)
+
+        num_neighbors = 0
+        for candidate in candidates[order]:
+            if num_neighbors >= max_num_neighbors:
+                break
+            if (min(idx, candidate), max(idx, candidate)) in pairs:
+                num_neighbors += 1
+                continue
+            overlap = compute_frustum_overlap(
+                poses[idx], intrinsics[idx],
+                poses[candidate], intrinsics[candidate], scene_depth)
+            if overlap >= min_overlap:
+                add_pair(idx, candidate)
+                num_neighbors += 1
+
+    # Always match consecutive frames of the same camera, assuming that the
+    # image names sort by camera and then by time stamp.
+    order = sorted(range(num_images), key=lambda idx: names[idx])
+    for idx1, idx2 in zip(order[:-1], order[1:]):
+        if os.path.dirname(names[idx1]) == os.path.dirname(names[idx2]):
+            add_pair(idx1, idx2)
+
+    return sorted((names[idx1], names[idx2]) for idx1, idx2 in pairs)
+
+
+def write_image_pairs(path, image_pairs):
+    with open(path, "w") as fid:
+        for name1, name2 in image_pairs:
+            fid.write("{} {}\n".format(name1, name2))
+
+
+def main():
+    args = parse_args()
+
+    names, poses, intrinsics = read_colmap_text_model(args.model_path)
+
+    image_pairs = select_image_pairs(
+        names, poses, intrinsics,
+        max_num_neighbors=args.max_num_neighbors,
+        max_baseline=args.max_baseline,
+        max_angle=args.max_angle,
+        min_overlap=args.min_overlap,
+        scene_depth=args.scene_depth)
+
+    num_images = len(names)
+    print("Selected {} of {} possible image pairs".format(
+        len(image_pairs), num_images * (num_images - 1) // 2))
+
+    write_image_pairs(args.output_path, image_pairs)
+
+
+if __name__ == "__main__":
+    main()
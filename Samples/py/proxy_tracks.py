@@ -0,0 +1,274 @@
+"""
+ Copyright (c) Microsoft. All rights reserved.
+
+ This code is licensed under the MIT License (MIT).
+ THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+ ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+ IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+ PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+"""
+
+""" Low-resolution proxy tracks of the sensor images of a recording, for fast browsing """
+# pylint: disable=C0103
+
+import argparse
+import collections
+import concurrent.futures
+import mmap
+import multiprocessing
+import os
+import struct
+import tarfile
+import cv2
+import numpy as np
+
+from recording_catalog import SENSOR_NAMES
+
+# Proxy File Format, see ProxyTrack.h of the BatchProcessing sample
+# Header: Magic VersionMajor VersionMinor Flags NumberOfFrames Width Height
+#         FullWidth FullHeight IndexOffset (aligned to 8 bytes)
+# Data:   the JPEG images, in timestamp order
+# Index:  NumberOfFrames x (Timestamp Offset Size Reserved), at IndexOffset
+PROXY_HEADER_FORMAT = "<4sBBHIIIII4xQ"
+PROXY_HEADER_SIZE = struct.calcsize(PROXY_HEADER_FORMAT)
+PROXY_INDEX_ENTRY_FORMAT = "<QQII"
+PROXY_INDEX_ENTRY_SIZE = struct.calcsize(PROXY_INDEX_ENTRY_FORMAT)
+PROXY_MAGIC = b"HLPX"
+
+# Depth in millimeters mapped to black and white in the depth proxies
+DEPTH_DISPLAY_RANGE = {"short_throw_depth": (0, 1000), "long_throw_depth": (0, 4000)}
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--recording_path", required=True)
+    parser.add_argument("--sensors", help="Comma-separated sensors, by default all recorded ones")
+    parser.add_argument("--max_width", type=int, default=320,
+                        help="Width of the proxy images, which are never upscaled")
+    parser.add_argument("--quality", type=int, default=75, help="JPEG quality")
+    parser.add_argument("--num_threads", type=int, default=multiprocessing.cpu_count())
+    parser.add_argument("--view", help="Browse the proxy track of this sensor instead; "
+                                       "press f to load the full-resolution frame")
+    return parser.parse_args()
+
+
+def proxy_path(recording_path, sensor):
+    return os.path.join(recording_path, sensor + "_proxy.bin")
+
+
+def sensor_archive_path(recording_path, sensor):
+    """Returns the tarball of the sensor, or the archive shared by all sensors
+    if the recorder was set to write a single archive."""
+    path = os.path.join(recording_path, sensor + ".tar")
+    if os.path.exists(path):
+        return path
+    return os.path.join(recording_path, "sensors.tar")
+
+
+def is_sensor_member(member, sensor):
+    return member.isfile() and member.name.replace("\\", "/").startswith(sensor + "/")
+
+
+def iterate_sensor_frames(recording_path, sensor):
+    """Yields the timestamps and encoded images of a sensor in timestamp order,
+    from the extracted folder if there is one and from the tarball otherwise."""
+    folder = os.path.join(recording_path, sensor)
+    if os.path.isdir(folder):
+        # The folder may also hold derived files, e.g. the point clouds.
+        for name in sorted(name for name in os.listdir(folder)
+                           if name.endswith((".pgm", ".ppm"))):
+            with open(os.path.join(folder, name), "rb") as f:
+                yield int(os.path.splitext(name)[0]), f.read()
+        return
+    with tarfile.open(sensor_archive_path(recording_path, sensor)) as tar:
+        members = sorted((member for member in tar if is_sensor_member(member, sensor)),
+                         key=lambda member: member.name)
+        for member in members:
+            name = os.path.basename(member.name.replace("\\", "/"))
+            yield int(os.path.splitext(name)[0]), tar.extractfile(member).read()
+
+
+def decode_sensor_image(sensor, data):
+    """Decodes a recorded PGM or PPM image to an 8-bit image for display."""
+    image = cv2.imdecode(np.frombuffer(data, dtype=np.uint8), cv2.IMREAD_UNCHANGED)
+    if image.dtype == np.uint16:
+        # The recorder stores the 16-bit images in little endian byte order.
+        image = image.byteswap()
+    return to_display_image(sensor, image)
+
+
+def to_display_image(sensor, image):
+    """Scales a 16-bit depth or reflectivity image to 8 bits."""
+    if image.dtype == np.uint16:
+        if sensor in DEPTH_DISPLAY_RANGE:
+            low, high = DEPTH_DISPLAY_RANGE[sensor]
+        else:
+            low, high = 0, max(1, np.percentile(image, 99))
+        image = np.clip((image.astype(np.float32) - low) * (255.0 / (high - low)), 0, 255)
+        image = image.astype(np.uint8)
+    return image
+
+
+def encode_proxy_image(sensor, data, max_width, quality):
+    image = decode_sensor_image(sensor, data)
+    height, width = image.shape[:2]
+    if width > max_width:
+        image = cv2.resize(image, (max_width, int(round(height * max_width / float(width)))),
+                           interpolation=cv2.INTER_AREA)
+    ok, encoded = cv2.imencode(".jpg", image, [cv2.IMWRITE_JPEG_QUALITY, quality])
+    assert ok
+    return encoded.tobytes(), image.shape[1], image.shape[0], width, height
+
+
+def write_proxy_track(recording_path, sensor, max_width=320, quality=75, executor=None):
+    """Writes the proxy track of a sensor and returns its number of frames."""
+    own_executor = executor is None
+    if own_executor:
+        executor = concurrent.futures.ThreadPoolExecutor(multiprocessing.cpu_count())
+
+    path = proxy_path(recording_path, sensor)
+    size = (0, 0, 0, 0)
+    index = []
+
+    with open(path + ".tmp", "wb") as f:
+        data_offset = PROXY_HEADER_SIZE
+        f.seek(data_offset)
+
+        def write_frame(timestamp, future):
+            encoded, width, height, full_width, full_height = future.result()
+            index.append(struct.pack(PROXY_INDEX_ENTRY_FORMAT, timestamp, data_offset,
+                                     len(encoded), 0))
+            f.write(encoded)
+            return len(encoded), (width, height, full_width, full_height)
+
+        # OpenCV releases the GIL while decoding, resizing and encoding, so the
+        # frames are encoded in parallel while the next ones are read. Only a
+        # few frames are in flight, to bound the memory use.
+        in_flight = collections.deque()
+        max_in_flight = 4 * multiprocessing.cpu_count()
+        for timestamp, data in iterate_sensor_frames(recording_path, sensor):
+            in_flight.append((timestamp, executor.submit(
+                encode_proxy_image, sensor, data, max_width, quality)))
+            if len(in_flight) > max_in_flight:
+                num_bytes, size = write_frame(*in_flight.popleft())
+                data_offset += num_bytes
+        while in_flight:
+            num_bytes, size = write_frame(*in_flight.popleft())
+            data_offset += num_bytes
+
+        f.write(b"".join(index))
+        f.seek(0)
+        f.write(struct.pack(PROXY_HEADER_FORMAT, PROXY_MAGIC, 0, 1, 0,
+                            len(index), *(size + (data_offset,))))
+    os.replace(path + ".tmp", path)
+
+    if own_executor:
+        executor.shutdown()
+
+    return len(index)
+
+
+class ProxyTrack(object):
+    """Memory-maps a proxy track; the images are decoded on access."""
+
+    def __init__(self, path):
+        self.file = open(path, "rb")
+        self.data = mmap.mmap(self.file.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, _, _, _, num_frames, self.width, self.height, self.full_width, \
+            self.full_height, index_offset = struct.unpack_from(PROXY_HEADER_FORMAT, self.data)
+        assert magic == PROXY_MAGIC
+        index = np.frombuffer(self.data, dtype=np.dtype([
+            ("timestamp", "<u8"), ("offset", "<u8"), ("size", "<u4"), ("reserved", "<u4")]),
+                              count=num_frames, offset=index_offset)
+        self.timestamps = index["timestamp"].astype(np.int64)
+        self.offsets = index["offset"].astype(np.int64)
+        self.sizes = index["size"].astype(np.int64)
+
+    def __len__(self):
+        return len(self.timestamps)
+
+    def find_frame(self, timestamp):
+        """Returns the index of the frame closest to the timestamp."""
+        i = int(np.searchsorted(self.timestamps, timestamp))
+        if i == len(self.timestamps) or \
+                (i > 0 and timestamp - self.timestamps[i - 1] < self.timestamps[i] - timestamp):
+            i -= 1
+        return i
+
+    def image(self, i):
+        begin = self.offsets[i]
+        return cv2.imdecode(np.frombuffer(self.data, dtype=np.uint8, count=self.sizes[i],
+                                          offset=begin), cv2.IMREAD_UNCHANGED)
+
+    def close(self):
+        self.data.close()
+        self.file.close()
+
+
+def read_full_resolution_frame(recording_path, sensor, timestamp):
+    folder = os.path.join(recording_path, sensor)
+    name = "{:020d}.{}".format(timestamp, "ppm" if sensor == "pv" else "pgm")
+    if os.path.exists(os.path.join(folder, name)):
+        with open(os.path.join(folder, name), "rb") as f:
+            return decode_sensor_image(sensor, f.read())
+    with tarfile.open(sensor_archive_path(recording_path, sensor)) as tar:
+        for member in tar:
+            if is_sensor_member(member, sensor) and \
+                    member.name.replace("\\", "/").endswith("/" + name):
+                return decode_sensor_image(sensor, tar.extractfile(member).read())
+    return None
+
+
+def view_proxy_track(recording_path, sensor):
+    track = ProxyTrack(proxy_path(recording_path, sensor))
+    i = 0
+    while len(track) > 0:
+        image = track.image(i)
+        cv2.imshow(sensor, cv2.resize(image, (track.full_width, track.full_height),
+                                      interpolation=cv2.INTER_LINEAR))
+        cv2.setWindowTitle(sensor, "{} frame {} / {} ({})".format(
+            sensor, i + 1, len(track), track.timestamps[i]))
+        key = cv2.waitKey(0) & 0xFF
+        if key in (ord("q"), 27):
+            break
+        elif key in (ord("d"), 83):
+            i = min(len(track) - 1, i + 1)
+        elif key in (ord("a"), 81):
+            i = max(0, i - 1)
+        elif key in (ord("w"), 82):
+            i = min(len(track) - 1, i + 10)
+        elif key in (ord("s"), 84):
+            i = max(0, i - 10)
+        elif key == ord("f"):
+            full_image = read_full_resolution_frame(recording_path, sensor,
+                                                    int(track.timestamps[i]))
+            if full_image is not None:
+                cv2.imshow(sensor, full_image)
+                cv2.waitKey(0)
+    track.close()
+    cv2.destroyAllWindows()
+
+
+def main():
+    args = parse_args()
+
+    if args.view is not None:
+        view_proxy_track(args.recording_path, args.view)
+        return
+
+    if args.sensors is None:
+        sensors = [sensor for sensor in SENSOR_NAMES
+                   if os.path.exists(os.path.join(args.recording_path, sensor + ".csv"))]
+    else:
+        sensors = args.sensors.split(",")
+
+    with concurrent.futures.ThreadPoolExecutor(args.num_threads) as executor:
+        for sensor in sensors:
+            num_frames = write_proxy_track(args.recording_path, sensor, args.max_width,
+                                           args.quality, executor)
+            print("Wrote {} frames to {}".format(
+                num_frames, proxy_path(args.recording_path, sensor)))
+
+
+if __name__ == "__main__":
+    main()
@@ -22,6 +22,9 @@ import subprocess
 import urllib.request
 import numpy as np
 
+from pose_prior_pairs import select_image_pairs, write_image_pairs
+from recording_catalog import CATALOG_FILE_NAME, RecordingCatalog
+
 
 def parse_args():
     parser = argparse.ArgumentParser()
@@ -39,9 +42,19 @@ def parse_args():
 
     parser.add_argument("--ref_camera_name", default="vlc_ll")
     parser.add_argument("--frame_rate", type=int, default=5)
+    parser.add_argument("--frame_selection", default="frame_rate",
+                        choices=["frame_rate", "keyframes"],
+                        help="Sample the reference camera frames at a fixed "
+                             "frame rate or select keyframes based on the "
+                             "image quality and the motion of the device")
     parser.add_argument("--start_frame", type=int, default=-1)
     parser.add_argument("--max_num_frames", type=int, default=-1)
     parser.add_argument("--num_refinements", type=int, default=3)
+    parser.add_argument("--matcher", default="pose_prior",
+                        choices=["pose_prior", "exhaustive"],
+                        help="Match only image pairs selected from the "
+                             "HoloLens poses or all pairs of images")
+    parser.add_argument("--max_num_neighbors", type=int, default=20)
 
     args = parser.parse_args()
 
@@ -166,6 +179,8 @@ class DevicePortalBrowser(object):
                     self.url, self.package_full_name,
                     recording_name, file["Id"]), destination_path)
 
+        return recording_path
+
     def delete_recording(self, recording_idx):
         recording_name = self.get_recording_name(recording_idx)
         if recording_name is None:
@@ -202,7 +217,9 @@ def read_sensor_poses(path, identity_camera_to_image=False):
             if not line:
                 continue
             elems = line.split(",")
-            assert len(elems) == 50
+            # Recordings from version 0.2 on append further columns, e.g.
+            # the sequence number and image quality scores.
+            assert len(elems) >= 50
             time_stamp = int(elems[0])
             # Compose the absolute camera pose from the two relative
             # camera poses provided by the recorder application.
@@ -224,6 +241,88 @@ def read_sensor_poses(path, identity_camera_to_image=False):
     return poses
 
 
+def read_sensor_quality(path):
+    # Returns the image quality columns written by recorder versions 0.3 and
+    # later, or an empty dictionary for older recordings.
+    quality = {}
+    with open(path, "r") as fid:
+        columns = fid.readline().strip().split(",")
+        if "IsKeyframe" not in columns:
+            return quality
+        sharpness_idx = columns.index("Sharpness")
+        keyframe_idx = columns.index("IsKeyframe")
+        for line in fid:
+            line = line.strip()
+            if not line:
+                continue
+            elems = line.split(",")
+            quality[int(elems[0])] = (float(elems[sharpness_idx]),
+                                      int(elems[keyframe_idx]) == 1)
+    return quality
+
+
+def read_pgm(path):
+    with open(path, "rb") as fid:
+        tokens = []
+        while len(tokens) < 4:
+            tokens += fid.readline().split()
+        assert tokens[0] == b"P5"
+        width, height, max_value = map(int, tokens[1:4])
+        dtype = np.uint8 if max_value < 256 else np.dtype(">u2")
+        return np.fromfile(fid, dtype=dtype).reshape(height, width)
+
+
+def compute_image_sharpness(image):
+    # Variance of the 4-neighborhood Laplacian, as computed by the recorder.
+    image = image.astype(np.int32)
+    laplacian = 4 * image[1:-1, 1:-1] - image[1:-1, :-2] - \
+        image[1:-1, 2:] - image[:-2, 1:-1] - image[2:, 1:-1]
+    return np.var(laplacian)
+
+
+def select_keyframes(time_stamps, poses, sharpness,
+                     min_translation=0.1, min_rotation=10.0,
+                     max_interval=2 * 10**7, min_relative_sharpness=0.6):
+    # Mirrors the KeyframeSelector of the recorder, for recordings made
+    # before the recorder selected keyframes itself.
+    keyframes = []
+    average_sharpness = 0
+    last_time_stamp = None
+    last_pose = None
+    for time_stamp, pose, frame_sharpness in \
+            zip(time_stamps, poses, sharpness):
+        if average_sharpness == 0:
+            average_sharpness = frame_sharpness
+        else:
+            average_sharpness = \
+                0.9 * average_sharpness + 0.1 * frame_sharpness
+        sharp_enough = \
+            frame_sharpness >= min_relative_sharpness * average_sharpness
+
+        if last_time_stamp is None:
+            is_keyframe = sharp_enough
+        else:
+            rotation = pose[:3, :3].dot(last_pose[:3, :3].T)
+            translation = np.linalg.norm(
+                pose[:3, :3].T.dot(pose[:3, 3]) -
+                last_pose[:3, :3].T.dot(last_pose[:3, 3]))
+            angle = np.rad2deg(np.arccos(
+                np.clip(0.5 * (np.trace(rotation) - 1), -1, 1)))
+            moved_enough = translation >= min_translation or \
+                angle >= min_rotation
+            interval = time_stamp - last_time_stamp
+            is_keyframe = \
+                (sharp_enough and (moved_enough or interval >= max_interval)) \
+                or interval >= 2 * max_interval
+
+        if is_keyframe:
+            keyframes.append(time_stamp)
+            last_time_stamp = time_stamp
+            last_pose = pose
+
+    return set(keyframes)
+
+
 def read_sensor_images(recording_path, camera_name):
     image_poses = read_sensor_poses(os.path.join(
         recording_path, camera_name + ".csv"))
@@ -266,13 +365,34 @@ def synchronize_sensor_frames(args, recording_path, output_path, camera_names):
     time_per_frame = 10**7 / 30.0
     time_per_frame_sampled = 30.0 / args.frame_rate * time_per_frame
 
+    if args.frame_selection == "keyframes":
+        ref_quality = read_sensor_quality(os.path.join(
+            recording_path, args.ref_camera_name + ".csv"))
+        if ref_quality:
+            keyframes = set(time_stamp for time_stamp, (_, is_keyframe)
+                            in ref_quality.items() if is_keyframe)
+        else:
+            print("Scoring the frames of a recording made before the "
+                  "recorder selected keyframes...")
+            sharpness = [compute_image_sharpness(read_pgm(path))
+                         for path in ref_image_paths]
+            keyframes = select_keyframes(
+                ref_time_stamps, ref_image_poses, sharpness)
+        print("Selected {} of {} frames as keyframes".format(
+            len(keyframes), len(ref_time_stamps)))
+
     ref_image_paths_sampled = []
     ref_image_names_sampled = []
     ref_time_stamps_sampled = []
     ref_image_poses_sampled = []
     ref_prev_time_stamp = ref_time_stamps[0]
     for i in range(1, len(ref_time_stamps)):
-        if ref_time_stamps[i] - ref_prev_time_stamp >= time_per_frame_sampled:
+        if args.frame_selection == "keyframes":
+            is_sampled = ref_time_stamps[i] in keyframes
+        else:
+            is_sampled = ref_time_stamps[i] - ref_prev_time_stamp >= \
+                time_per_frame_sampled
+        if is_sampled:
             ref_image_paths_sampled.append(ref_image_paths[i])
             ref_image_names_sampled.append(ref_image_names[i])
             ref_time_stamps_sampled.append(ref_time_stamps[i])
@@ -360,6 +480,7 @@ def reconstruct_recording(args, recording_path, dense=True):
     database_path = os.path.join(reconstruction_path, "database.db")
     image_path = os.path.join(reconstruction_path, "images")
     image_list_path = os.path.join(reconstruction_path, "image_list.txt")
+    image_pairs_path = os.path.join(reconstruction_path, "image_pairs.txt")
     sparse_colmap_path = os.path.join(reconstruction_path, "sparse_colmap")
     sparse_hololens_path = \
         os.path.join(reconstruction_path, "sparse_hololens")
@@ -461,11 +582,40 @@ def reconstruct_recording(args, recording_path, dense=True):
     images_file.close()
     points_file.close()
 
-    subprocess.call([
-        args.colmap_path, "exhaustive_matcher",
-        "--database_path", database_path,
-        "--SiftMatching.guided_matching", "true",
-    ])
+    if args.matcher == "pose_prior":
+        print("Selecting image pairs from the HoloLens poses...")
+        image_names = []
+        image_poses = []
+        image_intrinsics = []
+        for frame_image_names, frame_image_poses in zip(frames, poses):
+            for image_name, image_pose in zip(frame_image_names,
+                                              frame_image_poses):
+                camera_name = os.path.dirname(image_name)
+                fx, fy, cx, cy = \
+                    map(float, camera_params[camera_name].split()[:4])
+                image_names.append(image_name)
+                image_poses.append(image_pose)
+                image_intrinsics.append(
+                    (camera_width, camera_height, fx, fy, cx, cy))
+
+        image_pairs = select_image_pairs(
+            image_names, image_poses, image_intrinsics,
+            max_num_neighbors=args.max_num_neighbors)
+        write_image_pairs(image_pairs_path, image_pairs)
+
+        subprocess.call([
+            args.colmap_path, "matches_importer",
+            "--database_path", database_path,
+            "--match_list_path", image_pairs_path,
+            "--match_type", "pairs",
+            "--SiftMatching.guided_matching", "true",
+        ])
+    else:
+        subprocess.call([
+            args.colmap_path, "exhaustive_matcher",
+            "--database_path", database_path,
+            "--SiftMatching.guided_matching", "true",
+        ])
 
     with open(rig_config_path, "w") as fid:
         fid.write("""[
@@ -627,8 +777,13 @@ def main():
         elif command.startswith("download"):
             recording_idx = parse_command_and_index(command)
             if recording_idx is not None:
-                dev_portal_browser.download_recording(
+                recording_path = dev_portal_browser.download_recording(
                     recording_idx, args.workspace_path)
+                if recording_path is not None:
+                    catalog = RecordingCatalog(os.path.join(
+                        args.workspace_path, CATALOG_FILE_NAME))
+                    catalog.index_recording(recording_path)
+                    catalog.close()
         elif command.startswith("delete"):
             if command == "delete all":
                 for _ in range(len(dev_portal_browser.recording_names)):
@@ -0,0 +1,396 @@
+"""
+ Copyright (c) Microsoft. All rights reserved.
+
+ This code is licensed under the MIT License (MIT).
+ THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+ ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+ IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+ PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+"""
+
+""" SQLite catalog of the recordings in a workspace and of their sensors """
+# pylint: disable=C0103
+
+import argparse
+import csv
+import glob
+import os
+import sqlite3
+import time
+import numpy as np
+
+CATALOG_FILE_NAME = "catalog.db"
+
+SENSOR_NAMES = ["pv", "vlc_ll", "vlc_lf", "vlc_rf", "vlc_rr",
+                "short_throw_depth", "short_throw_reflectivity",
+                "long_throw_depth", "long_throw_reflectivity"]
+
+# Timestamps count hundreds of nanoseconds.
+TICKS_PER_SECOND = 10000000
+
+# Intervals between frames longer than this many times the median interval
+# are counted as gaps.
+GAP_FACTOR = 2.5
+
+SCHEMA = """
+CREATE TABLE IF NOT EXISTS recordings (
+    recording_id INTEGER PRIMARY KEY,
+    name TEXT UNIQUE NOT NULL,
+    path TEXT NOT NULL,
+    version_major INTEGER,
+    version_minor INTEGER,
+    start_timestamp INTEGER,
+    end_timestamp INTEGER,
+    duration REAL,
+    num_sensors INTEGER,
+    num_frames INTEGER,
+    signature TEXT,
+    indexed_at REAL
+);
+
+CREATE TABLE IF NOT EXISTS sensors (
+    recording_id INTEGER NOT NULL REFERENCES recordings(recording_id) ON DELETE CASCADE,
+    sensor TEXT NOT NULL,
+    num_frames INTEGER,
+    start_timestamp INTEGER,
+    end_timestamp INTEGER,
+    duration REAL,
+    frame_rate REAL,
+    num_gaps INTEGER,
+    max_gap REAL,
+    missed_frames INTEGER,
+    num_poses INTEGER,
+    min_x REAL, min_y REAL, min_z REAL,
+    max_x REAL, max_y REAL, max_z REAL,
+    path_length REAL,
+    mean_sharpness REAL,
+    mean_intensity REAL,
+    underexposed_fraction REAL,
+    overexposed_fraction REAL,
+    num_keyframes INTEGER,
+    archive_size INTEGER,
+    PRIMARY KEY (recording_id, sensor)
+);
+
+CREATE TABLE IF NOT EXISTS gaps (
+    recording_id INTEGER NOT NULL REFERENCES recordings(recording_id) ON DELETE CASCADE,
+    sensor TEXT NOT NULL,
+    start_timestamp INTEGER NOT NULL,
+    end_timestamp INTEGER NOT NULL
+);
+
+CREATE INDEX IF NOT EXISTS sensors_by_name ON sensors(sensor);
+CREATE INDEX IF NOT EXISTS gaps_by_sensor ON gaps(recording_id, sensor, start_timestamp);
+"""
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--workspace_path", required=True)
+    parser.add_argument("--catalog_path",
+                        help="Path of the catalog, by default catalog.db in the workspace")
+    subparsers = parser.add_subparsers(dest="command")
+
+    index_parser = subparsers.add_parser(
+        "index", help="Add new or changed recordings of the workspace to the catalog")
+    index_parser.add_argument("--force", action="store_true",
+                              help="Re-index recordings that have not changed")
+
+    select_parser = subparsers.add_parser(
+        "select", help="List the recordings matching all of the given conditions")
+    select_parser.add_argument("--sensor", action="append",
+                               help="Require the sensor; can be repeated")
+    select_parser.add_argument("--min_duration", type=float)
+    select_parser.add_argument("--max_gap", type=float,
+                               help="Longest gap in seconds of the required sensors")
+    select_parser.add_argument("--min_sharpness", type=float)
+    select_parser.add_argument("--near", type=float, nargs=3,
+                               help="Require the sensor poses to pass near this point")
+    select_parser.add_argument("--near_radius", type=float, default=1.0,
+                               help="Distance in meters within which the sensor "
+                                    "poses count as passing near the point")
+    select_parser.add_argument("--ranges", type=float,
+                               help="Also list the time ranges without gaps of at least this "
+                                    "many seconds in which all the required sensors have frames")
+
+    query_parser = subparsers.add_parser("query", help="Run an SQL query")
+    query_parser.add_argument("sql")
+
+    args = parser.parse_args()
+    if args.command is None:
+        parser.error("a command is required")
+    if args.catalog_path is None:
+        args.catalog_path = os.path.join(args.workspace_path, CATALOG_FILE_NAME)
+
+    return args
+
+
+def read_sensor_csv(path):
+    """Returns the timestamps, the device positions (NaN without a pose) and
+    the quality columns, by name, of a sensor's frames."""
+    with open(path, "r") as fid:
+        reader = csv.reader(fid)
+        columns = next(reader)
+        rows = [row for row in reader if row]
+    time_stamps = np.array([int(row[0]) for row in rows], dtype=np.int64)
+    frame_to_origin = np.array([row[2:18] for row in rows], dtype=np.float64).reshape(-1, 4, 4)
+    # The transforms are stored for row vectors, with the translation in the
+    # last row; unlocated frames have a zero transform.
+    located = np.abs(np.linalg.det(frame_to_origin[:, :3, :3]) - 1) < 0.01
+    positions = np.where(located[:, None], frame_to_origin[:, 3, :3], np.nan)
+    quality = {}
+    for name in ["SequenceNumber", "Sharpness", "MeanIntensity",
+                 "UnderexposedFraction", "OverexposedFraction", "IsKeyframe"]:
+        if name in columns:
+            index = columns.index(name)
+            quality[name] = np.array([float(row[index]) for row in rows])
+    return time_stamps, positions, quality
+
+
+def summarize_sensor(recording_path, sensor):
+    time_stamps, positions, quality = read_sensor_csv(
+        os.path.join(recording_path, sensor + ".csv"))
+    order = np.argsort(time_stamps)
+    time_stamps = time_stamps[order]
+    positions = positions[order]
+
+    summary = {"sensor": sensor, "num_frames": len(time_stamps)}
+    gaps = []
+    if len(time_stamps) > 0:
+        summary["start_timestamp"] = int(time_stamps[0])
+        summary["end_timestamp"] = int(time_stamps[-1])
+        summary["duration"] = float(time_stamps[-1] - time_stamps[0]) / TICKS_PER_SECOND
+    if len(time_stamps) > 1:
+        intervals = np.diff(time_stamps)
+        median_interval = np.median(intervals)
+        summary["frame_rate"] = TICKS_PER_SECOND / float(median_interval) \
+            if median_interval > 0 else None
+        gap_indices = np.nonzero(intervals > GAP_FACTOR * median_interval)[0]
+        gaps = [(int(time_stamps[i]), int(time_stamps[i + 1])) for i in gap_indices]
+        summary["num_gaps"] = len(gaps)
+        summary["max_gap"] = float(intervals.max()) / TICKS_PER_SECOND
+
+    if "SequenceNumber" in quality and len(time_stamps) > 1:
+        sequence_numbers = np.sort(quality["SequenceNumber"].astype(np.int64))
+        summary["missed_frames"] = int(np.maximum(np.diff(sequence_numbers) - 1, 0).sum())
+
+    located = np.all(np.isfinite(positions), axis=1)
+    summary["num_poses"] = int(located.sum())
+    if located.any():
+        located_positions = positions[located]
+        for axis, name in enumerate("xyz"):
+            summary["min_" + name] = float(located_positions[:, axis].min())
+            summary["max_" + name] = float(located_positions[:, axis].max())
+        summary["path_length"] = float(np.linalg.norm(
+            np.diff(located_positions, axis=0), axis=1).sum())
+
+    for column, name in [("Sharpness", "mean_sharpness"),
+                         ("MeanIntensity", "mean_intensity"),
+                         ("UnderexposedFraction", "underexposed_fraction"),
+                         ("OverexposedFraction", "overexposed_fraction")]:
+        if column in quality and len(quality[column]) > 0:
+            summary[name] = float(quality[column].mean())
+    if "IsKeyframe" in quality:
+        summary["num_keyframes"] = int(quality["IsKeyframe"].sum())
+
+    archive_path = os.path.join(recording_path, sensor + ".tar")
+    if os.path.exists(archive_path):
+        summary["archive_size"] = os.path.getsize(archive_path)
+
+    return summary, gaps
+
+
+def recording_sensors(recording_path):
+    return [sensor for sensor in SENSOR_NAMES
+            if os.path.exists(os.path.join(recording_path, sensor + ".csv"))]
+
+
+def recording_signature(recording_path):
+    """Changes whenever a sensor CSV or archive of the recording changes."""
+    parts = []
+    for sensor in recording_sensors(recording_path):
+        for extension in [".csv", ".tar"]:
+            path = os.path.join(recording_path, sensor + extension)
+            if os.path.exists(path):
+                status = os.stat(path)
+                parts.append("{}{}:{}:{}".format(sensor, extension, status.st_size,
+                                                 int(status.st_mtime)))
+    return ";".join(parts)
+
+
+class RecordingCatalog(object):
+
+    def __init__(self, catalog_path):
+        self.connection = sqlite3.connect(catalog_path, timeout=60)
+        self.connection.execute("PRAGMA foreign_keys = ON")
+        self.connection.executescript(SCHEMA)
+
+    def close(self):
+        self.connection.close()
+
+    def index_recording(self, recording_path, force=False):
+        """Adds or updates a recording. Returns False if it is unchanged."""
+        name = os.path.basename(os.path.normpath(recording_path))
+        signature = recording_signature(recording_path)
+        row = self.connection.execute(
+            "SELECT signature FROM recordings WHERE name = ?", (name,)).fetchone()
+        if row is not None and row[0] == signature and not force:
+            return False
+
+        version = (None, None)
+        version_path = os.path.join(recording_path, "recording_version_information.csv")
+        if os.path.exists(version_path):
+            with open(version_path, "r") as fid:
+                rows = list(csv.reader(fid))
+            if len(rows) > 1:
+                version = (int(rows[1][0]), int(rows[1][1]))
+
+        summaries = [summarize_sensor(recording_path, sensor)
+                     for sensor in recording_sensors(recording_path)]
+        starts = [s["start_timestamp"] for s, _ in summaries if "start_timestamp" in s]
+        ends = [s["end_timestamp"] for s, _ in summaries if "end_timestamp" in s]
+        start_timestamp = min(starts) if starts else None
+        end_timestamp = max(ends) if ends else None
+
+        with self.connection:
+            self.connection.execute("DELETE FROM recordings WHERE name = ?", (name,))
+            cursor = self.connection.execute(
+                "INSERT INTO recordings (name, path, version_major, version_minor, "
+                "start_timestamp, end_timestamp, duration, num_sensors, num_frames, "
+                "signature, indexed_at) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+                (name, os.path.abspath(recording_path), version[0], version[1],
+                 start_timestamp, end_timestamp,
+                 None if start_timestamp is None else
+                 float(end_timestamp - start_timestamp) / TICKS_PER_SECOND,
+                 len(summaries), sum(s["num_frames"] for s, _ in summaries),
+                 signature, time.time()))
+            recording_id = cursor.lastrowid
+            for summary, gaps in summaries:
+                columns = sorted(summary)
+                self.connection.execute(
+                    "INSERT INTO sensors (recording_id, {}) VALUES (?, {})".format(
+                        ", ".join(columns), ", ".join("?" * len(columns))),
+                    [recording_id] + [summary[column] for column in columns])
+                self.connection.executemany(
+                    "INSERT INTO gaps VALUES (?, ?, ?, ?)",
+                    [(recording_id, summary["sensor"], start, end) for start, end in gaps])
+        return True
+
+    def index_workspace(self, workspace_path, force=False):
+        num_indexed = 0
+        recording_paths = [path for path in sorted(glob.glob(os.path.join(workspace_path, "*")))
+                           if os.path.isdir(path) and recording_sensors(path)]
+        for recording_path in recording_paths:
+            if self.index_recording(recording_path, force):
+                num_indexed += 1
+        # Forget the recordings which were removed from the workspace.
+        names = set(os.path.basename(path) for path in recording_paths)
+        with self.connection:
+            for (name,) in self.connection.execute("SELECT name FROM recordings").fetchall():
+                if name not in names:
+                    self.connection.execute("DELETE FROM recordings WHERE name = ?", (name,))
+        return num_indexed, len(recording_paths)
+
+    def select_recordings(self, sensors=None, min_duration=None, max_gap=None,
+                          min_sharpness=None, near=None, near_radius=1.0):
+        """Returns the names and paths of the recordings which have all of the
+        sensors and fulfill all of the conditions on each of them."""
+        sensors = sensors or []
+        conditions = []
+        parameters = []
+        if min_duration is not None:
+            conditions.append("r.duration >= ?")
+            parameters.append(min_duration)
+        sensor_conditions = []
+        sensor_parameters = []
+        if max_gap is not None:
+            sensor_conditions.append("s.max_gap <= ?")
+            sensor_parameters.append(max_gap)
+        if min_sharpness is not None:
+            sensor_conditions.append("s.mean_sharpness >= ?")
+            sensor_parameters.append(min_sharpness)
+        if near is not None:
+            # The bounding box of the sensor positions, widened by the radius, must
+            # contain the point. The box of a straight path is degenerate.
+            sensor_conditions.append(
+                "s.min_x <= ? AND s.max_x >= ? AND s.min_y <= ? AND s.max_y >= ? "
+                "AND s.min_z <= ? AND s.max_z >= ?")
+            for value in near:
+                sensor_parameters += [value + near_radius, value - near_radius]
+        for sensor in sensors:
+            conditions.append(
+                "EXISTS (SELECT 1 FROM sensors s WHERE s.recording_id = r.recording_id "
+                "AND s.sensor = ?{})".format(
+                    "".join(" AND " + c for c in sensor_conditions)))
+            parameters += [sensor] + sensor_parameters
+        if not sensors and sensor_conditions:
+            conditions.append(
+                "NOT EXISTS (SELECT 1 FROM sensors s WHERE s.recording_id = "
+                "r.recording_id AND NOT ({}))".format(" AND ".join(sensor_conditions)))
+            parameters += sensor_parameters
+        sql = "SELECT r.name, r.path FROM recordings r"
+        if conditions:
+            sql += " WHERE " + " AND ".join(conditions)
+        return self.connection.execute(sql + " ORDER BY r.name", parameters).fetchall()
+
+    def select_time_ranges(self, name, sensors, min_length=0.0):
+        """Returns the time ranges of a recording in which all the sensors
+        have frames without gaps, as (start, end) timestamps."""
+        rows = self.connection.execute(
+            "SELECT s.sensor, s.start_timestamp, s.end_timestamp FROM sensors s "
+            "JOIN recordings r ON r.recording_id = s.recording_id "
+            "WHERE r.name = ? AND s.start_timestamp IS NOT NULL", (name,)).fetchall()
+        extents = dict((row[0], row[1:]) for row in rows)
+        if not sensors or any(sensor not in extents for sensor in sensors):
+            return []
+        start = max(extents[sensor][0] for sensor in sensors)
+        end = min(extents[sensor][1] for sensor in sensors)
+        gaps = self.connection.execute(
+            "SELECT g.start_timestamp, g.end_timestamp FROM gaps g "
+            "JOIN recordings r ON r.recording_id = g.recording_id "
+            "WHERE r.name = ? AND g.sensor IN ({}) ORDER BY g.start_timestamp".format(
+                ", ".join("?" * len(sensors))), [name] + list(sensors)).fetchall()
+        ranges = []
+        for gap_start, gap_end in gaps + [(end, end)]:
+            range_end = min(gap_start, end)
+            if range_end > start and range_end - start >= min_length * TICKS_PER_SECOND:
+                ranges.append((start, range_end))
+            start = max(start, gap_end)
+            if start >= end:
+                break
+        return ranges
+
+
+def main():
+    args = parse_args()
+
+    catalog = RecordingCatalog(args.catalog_path)
+
+    if args.command == "index":
+        start_time = time.time()
+        num_indexed, num_recordings = catalog.index_workspace(
+            args.workspace_path, args.force)
+        print("Indexed {} of {} recordings in {:.2f}s".format(
+            num_indexed, num_recordings, time.time() - start_time))
+    elif args.command == "select":
+        recordings = catalog.select_recordings(
+            args.sensor, args.min_duration, args.max_gap, args.min_sharpness, args.near,
+            args.near_radius)
+        for name, path in recordings:
+            print(path)
+            if args.ranges is not None and args.sensor:
+                for start, end in catalog.select_time_ranges(name, args.sensor, args.ranges):
+                    print("  {} {} ({:.1f}s)".format(
+                        start, end, float(end - start) / TICKS_PER_SECOND))
+    elif args.command == "query":
+        cursor = catalog.connection.execute(args.sql)
+        if cursor.description is not None:
+            print("\t".join(column[0] for column in cursor.description))
+            for row in cursor:
+                print("\t".join(str(value) for value in row))
+
+    catalog.close()
+
+
+if __name__ == "__main__":
+    main()
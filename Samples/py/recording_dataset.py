@@ -0,0 +1,308 @@
+"""
+ Copyright (c) Microsoft. All rights reserved.
+
+ This code is licensed under the MIT License (MIT).
+ THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+ ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+ IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+ PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+"""
+
+""" Random access to the frames and poses of recordings for training, without extraction """
+# pylint: disable=C0103
+
+import argparse
+import collections
+import concurrent.futures
+import csv
+import mmap
+import multiprocessing
+import os
+import tarfile
+import time
+import numpy as np
+
+# Holds the frames of all the sensors of single-archive recordings
+SHARED_ARCHIVE_NAME = "sensors.tar"
+
+POSE_COLUMNS = ["FrameToOrigin", "CameraViewTransform", "CameraProjectionTransform"]
+POSE_KEYS = ["frame_to_origin", "camera_view_transform", "camera_projection_transform"]
+
+# Location of a frame: the file holding it and the offset and size of the
+# image file in it; offset 0 and the full size for extracted frames.
+FrameLocation = collections.namedtuple("FrameLocation", "path offset size")
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--recording_path", action="append", required=True,
+                        help="Can be repeated")
+    parser.add_argument("--sensors", default="vlc_lf,vlc_rf")
+    parser.add_argument("--sync_tolerance_ms", type=float, default=20.0)
+    parser.add_argument("--num_workers", type=int, default=multiprocessing.cpu_count(),
+                        help="Benchmark reading the samples with up to this many processes")
+    parser.add_argument("--num_samples", type=int, default=2000)
+    return parser.parse_args()
+
+
+def read_archive_index(archive_path):
+    """Returns the locations of the frames in a tarball, by sensor and
+    timestamp, reading only the tar headers."""
+    entries = collections.defaultdict(dict)
+    with tarfile.open(archive_path) as tar:
+        for member in tar:
+            sensor, _, name = member.name.replace("\\", "/").partition("/")
+            base, extension = os.path.splitext(name)
+            if member.isfile() and extension in (".pgm", ".ppm"):
+                entries[sensor][int(base)] = FrameLocation(archive_path, member.offset_data,
+                                                            member.size)
+    return entries
+
+
+def read_folder_index(recording_path, sensor):
+    folder = os.path.join(recording_path, sensor)
+    entries = {}
+    for name in os.listdir(folder):
+        base, extension = os.path.splitext(name)
+        if extension in (".pgm", ".ppm"):
+            path = os.path.join(folder, name)
+            entries[int(base)] = FrameLocation(path, 0, os.path.getsize(path))
+    return entries
+
+
+def read_poses(recording_path, sensor):
+    """Returns the timestamps and the 4x4 pose matrices of the frames of a
+    sensor, in the row-vector form of the recorder, for the pose columns
+    present in its CSV file."""
+    with open(os.path.join(recording_path, sensor + ".csv")) as f:
+        reader = csv.reader(f)
+        header = next(reader)
+        rows = [row for row in reader if row]
+    timestamps = np.array([int(row[0]) for row in rows], dtype=np.int64)
+    poses = {}
+    for column, key in zip(POSE_COLUMNS, POSE_KEYS):
+        if column + ".m11" not in header:
+            continue
+        first = header.index(column + ".m11")
+        poses[key] = np.array([[float(value) for value in row[first:first + 16]]
+                               for row in rows], dtype=np.float32).reshape(-1, 4, 4)
+    return timestamps, poses
+
+
+def decode_netpbm(data):
+    """Returns a view of the pixels of a binary PGM or PPM image: grayscale
+    uint8 or little-endian uint16 as written by the recorder, or RGB uint8."""
+    fields = []
+    position = 0
+    while len(fields) < 4:
+        while data[position] in b" \t\r\n":
+            position += 1
+        start = position
+        while data[position] not in b" \t\r\n":
+            position += 1
+        fields.append(bytes(data[start:position]))
+    # A single whitespace character separates the header from the pixels.
+    position += 1
+    magic, width, height, max_value = fields[0], int(fields[1]), int(fields[2]), int(fields[3])
+    channels = 3 if magic == b"P6" else 1
+    dtype = np.dtype("<u2") if max_value > 255 else np.dtype(np.uint8)
+    pixels = np.frombuffer(data, dtype=dtype, count=width * height * channels,
+                           offset=position)
+    return pixels.reshape((height, width, channels) if channels == 3 else (height, width))
+
+
+class RecordingDataset(object):
+    """Frames and poses of one or more recordings, by index or by timestamp,
+    read directly from the recording tarballs (or extracted folders).
+
+    Each sample bundles the frames of all the sensors: the frames of the first
+    sensor define the samples, and each other sensor contributes its frame
+    closest in time, within the sync tolerance; samples missing a sensor are
+    left out.
+
+    Only the index is built up front. The archives are memory-mapped once per
+    process and the images are views into the mappings, so any number of
+    data-loader worker processes share the page cache instead of each opening
+    and reading files. The dataset can be pickled to the workers, which map
+    the archives again on first access."""
+
+    def __init__(self, recording_paths, sensors, sync_tolerance_ms=20.0, copy=True):
+        if isinstance(recording_paths, str):
+            recording_paths = [recording_paths]
+        self.sensors = list(sensors)
+        self.copy = copy
+        self.recordings = []
+        sample_recordings = []
+        sample_rows = []
+        for recording_index, recording_path in enumerate(recording_paths):
+            recording = self._index_recording(recording_path, sync_tolerance_ms * 1e4)
+            self.recordings.append(recording)
+            num_samples = len(recording["rows"])
+            sample_recordings.append(np.full(num_samples, recording_index, dtype=np.int32))
+            sample_rows.append(np.arange(num_samples, dtype=np.int64))
+        self.sample_recordings = np.concatenate(sample_recordings)
+        self.sample_rows = np.concatenate(sample_rows)
+        self.mappings = {}
+        self.pid = os.getpid()
+
+    def _index_recording(self, recording_path, sync_tolerance):
+        frames = {}
+        archive_indices = {}
+        for sensor in self.sensors:
+            timestamps, poses = read_poses(recording_path, sensor)
+            archive_path = os.path.join(recording_path, sensor + ".tar")
+            if os.path.isdir(os.path.join(recording_path, sensor)):
+                locations = read_folder_index(recording_path, sensor)
+            else:
+                if not os.path.exists(archive_path):
+                    archive_path = os.path.join(recording_path, SHARED_ARCHIVE_NAME)
+                if archive_path not in archive_indices:
+                    archive_indices[archive_path] = read_archive_index(archive_path)
+                locations = archive_indices[archive_path][sensor]
+            stored = np.array([timestamp in locations for timestamp in timestamps.tolist()],
+                              dtype=bool)
+            frames[sensor] = {
+                "timestamps": timestamps[stored],
+                "locations": [locations[timestamp]
+                              for timestamp in timestamps[stored].tolist()],
+                "poses": {key: value[stored] for key, value in poses.items()}}
+
+        # Match the frames of the other sensors to those of the first sensor.
+        reference = frames[self.sensors[0]]["timestamps"]
+        rows = np.zeros((len(reference), len(self.sensors)), dtype=np.int64)
+        valid = np.ones(len(reference), dtype=bool)
+        rows[:, 0] = np.arange(len(reference))
+        for i, sensor in enumerate(self.sensors[1:], 1):
+            timestamps = frames[sensor]["timestamps"]
+            if len(timestamps) == 0:
+                valid[:] = False
+                continue
+            after = np.clip(np.searchsorted(timestamps, reference), 0, len(timestamps) - 1)
+            before = np.clip(after - 1, 0, len(timestamps) - 1)
+            closest = np.where(np.abs(timestamps[before] - reference) <
+                               np.abs(timestamps[after] - reference), before, after)
+            rows[:, i] = closest
+            valid &= np.abs(timestamps[closest] - reference) <= sync_tolerance
+        return {"path": recording_path, "frames": frames, "rows": rows[valid],
+                "timestamps": reference[valid]}
+
+    def __len__(self):
+        return len(self.sample_rows)
+
+    def __getstate__(self):
+        state = self.__dict__.copy()
+        state["mappings"] = {}
+        return state
+
+    def index_of(self, timestamp, recording_index=0):
+        """Returns the index of the sample closest to the timestamp."""
+        timestamps = self.recordings[recording_index]["timestamps"]
+        if len(timestamps) == 0:
+            raise IndexError("recording has no samples")
+        i = int(np.searchsorted(timestamps, timestamp))
+        if i == len(timestamps) or \
+                (i > 0 and timestamp - timestamps[i - 1] < timestamps[i] - timestamp):
+            i -= 1
+        return int(np.searchsorted(self.sample_recordings, recording_index)) + i
+
+    def __getitem__(self, index):
+        recording = self.recordings[self.sample_recordings[index]]
+        row = self.sample_rows[index]
+        sample = {"recording": recording["path"], "timestamp": int(recording["timestamps"][row])}
+        for i, sensor in enumerate(self.sensors):
+            frames = recording["frames"][sensor]
+            j = recording["rows"][row, i]
+            frame = {"timestamp": int(frames["timestamps"][j]),
+                     "image": self.read_image(frames["locations"][j])}
+            for key, poses in frames["poses"].items():
+                frame[key] = poses[j]
+            sample[sensor] = frame
+        return sample
+
+    def read_image(self, location):
+        mapping = self._map(location.path)
+        image = decode_netpbm(memoryview(mapping)[location.offset:location.offset +
+                                                  location.size])
+        return image.copy() if self.copy else image
+
+    def _map(self, path):
+        # Mappings do not survive fork-less process start methods, and must not
+        # be shared with forked children, so each process maps the files anew.
+        if self.pid != os.getpid():
+            self.mappings = {}
+            self.pid = os.getpid()
+        mapping = self.mappings.get(path)
+        if mapping is None:
+            with open(path, "rb") as f:
+                mapping = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+            self.mappings[path] = mapping
+        return mapping
+
+
+def prefetch(dataset, indices=None, num_threads=4, queue_length=16):
+    """Yields the samples in order while the next ones are read on a thread
+    pool in the background."""
+    if indices is None:
+        indices = range(len(dataset))
+    indices = iter(indices)
+    with concurrent.futures.ThreadPoolExecutor(num_threads) as executor:
+        pending = collections.deque()
+        for index in indices:
+            pending.append(executor.submit(dataset.__getitem__, index))
+            if len(pending) >= queue_length:
+                break
+        while pending:
+            sample = pending.popleft().result()
+            for index in indices:
+                pending.append(executor.submit(dataset.__getitem__, index))
+                break
+            yield sample
+
+
+_worker_dataset = None
+
+
+def init_worker(dataset):
+    global _worker_dataset
+    _worker_dataset = dataset
+
+
+def read_sample_bytes(index):
+    sample = _worker_dataset[index]
+    return sum(sample[sensor]["image"].nbytes for sensor in _worker_dataset.sensors)
+
+
+def main():
+    args = parse_args()
+
+    start_time = time.time()
+    dataset = RecordingDataset(args.recording_path, args.sensors.split(","),
+                               args.sync_tolerance_ms)
+    print("Indexed {} samples in {:.2f}s".format(len(dataset), time.time() - start_time))
+    if len(dataset) == 0:
+        return
+
+    indices = np.random.default_rng(0).integers(0, len(dataset), args.num_samples)
+
+    start_time = time.time()
+    num_bytes = sum(sum(sample[sensor]["image"].nbytes for sensor in dataset.sensors)
+                    for sample in prefetch(dataset, indices))
+    elapsed = time.time() - start_time
+    print("prefetch: {:.0f} samples/s, {:.0f} MB/s".format(
+        len(indices) / elapsed, num_bytes / elapsed / 1e6))
+
+    num_workers = 1
+    while num_workers <= args.num_workers:
+        pool = multiprocessing.Pool(num_workers, init_worker, (dataset,))
+        start_time = time.time()
+        num_bytes = sum(pool.imap_unordered(read_sample_bytes, indices, chunksize=16))
+        elapsed = time.time() - start_time
+        pool.close()
+        pool.join()
+        print("{} workers: {:.0f} samples/s, {:.0f} MB/s".format(
+            num_workers, len(indices) / elapsed, num_bytes / elapsed / 1e6))
+        num_workers *= 2
+
+
+if __name__ == "__main__":
+    main()
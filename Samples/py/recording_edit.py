@@ -0,0 +1,321 @@
+"""
+ Copyright (c) Microsoft. All rights reserved.
+
+ This code is licensed under the MIT License (MIT).
+ THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+ ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+ IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+ PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+"""
+
+""" Lossless trim, split and merge of recordings, copying the archived frames as byte ranges """
+# pylint: disable=C0103
+
+import argparse
+import collections
+import os
+import shutil
+import tarfile
+import time
+from recording_catalog import SENSOR_NAMES, TICKS_PER_SECOND, recording_sensors
+from recording_dataset import SHARED_ARCHIVE_NAME
+
+SHARED_ARCHIVE_INDEX_NAME = "tarball_index.csv"
+BLOCK_SIZE = tarfile.BLOCKSIZE
+COPY_CHUNK_SIZE = 64 * 1024 * 1024
+
+# An archived frame: its timestamp, name and size, and the byte range of its
+# headers and padded data in the source archive.
+ArchiveMember = collections.namedtuple(
+    "ArchiveMember", "timestamp name size path begin data_begin end")
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    subparsers = parser.add_subparsers(dest="command")
+    subparsers.required = True
+
+    trim_parser = subparsers.add_parser("trim", help="Keep a time range of a recording")
+    trim_parser.add_argument("--recording_path", required=True)
+    trim_parser.add_argument("--output_path", required=True)
+    trim_parser.add_argument("--start_seconds", type=float, default=0.0,
+                             help="Relative to the first frame of the recording")
+    trim_parser.add_argument("--end_seconds", type=float, default=float("inf"))
+
+    split_parser = subparsers.add_parser(
+        "split", help="Split a recording into parts of a maximum duration or size")
+    split_parser.add_argument("--recording_path", required=True)
+    split_parser.add_argument("--output_path", required=True,
+                              help="Folder for the parts, <recording>_000, <recording>_001, ...")
+    split_parser.add_argument("--duration_seconds", type=float)
+    split_parser.add_argument("--max_size_mb", type=float)
+
+    merge_parser = subparsers.add_parser(
+        "merge", help="Merge recordings, e.g. consecutive sessions or separately recorded sensors")
+    merge_parser.add_argument("--recording_path", action="append", required=True,
+                              help="Can be repeated; the first recording wins duplicate frames")
+    merge_parser.add_argument("--output_path", required=True)
+
+    return parser.parse_args()
+
+
+def read_archive_members(archive_path):
+    """Returns the archived frames by sensor, reading only the tar headers."""
+    members = collections.defaultdict(list)
+    with tarfile.open(archive_path) as tar:
+        for member in tar:
+            sensor, _, name = member.name.replace("\\", "/").partition("/")
+            base, extension = os.path.splitext(name)
+            if not member.isfile() or extension not in (".pgm", ".ppm") or \
+                    sensor not in SENSOR_NAMES:
+                continue
+            end = member.offset_data + \
+                (member.size + BLOCK_SIZE - 1) // BLOCK_SIZE * BLOCK_SIZE
+            members[sensor].append(ArchiveMember(
+                int(base), member.name, member.size, archive_path, member.offset,
+                member.offset_data, end))
+    return members
+
+
+def read_csv_lines(path):
+    """Returns the header line and the rows of a sensor CSV by timestamp, as the
+    original bytes."""
+    with open(path, "rb") as f:
+        lines = f.read().splitlines(True)
+    rows = {}
+    for line in lines[1:]:
+        if line.strip():
+            rows.setdefault(int(line.split(b",", 1)[0]), line)
+    return lines[0] if lines else b"", rows
+
+
+class Recording(object):
+
+    def __init__(self, path):
+        if not os.path.isdir(path):
+            raise ValueError("{} is not a recording folder".format(path))
+        self.path = path
+        self.sensors = recording_sensors(path)
+        self.single_archive = os.path.exists(os.path.join(path, SHARED_ARCHIVE_NAME))
+        self.members = {}
+        if self.single_archive:
+            self.members.update(read_archive_members(os.path.join(path, SHARED_ARCHIVE_NAME)))
+        for sensor in self.sensors:
+            archive_path = os.path.join(path, sensor + ".tar")
+            if os.path.exists(archive_path):
+                self.members.update(read_archive_members(archive_path))
+
+    def csv_path(self, sensor):
+        return os.path.join(self.path, sensor + ".csv")
+
+    def time_range(self):
+        timestamps = [member.timestamp for members in self.members.values()
+                      for member in members]
+        return (min(timestamps), max(timestamps)) if timestamps else (0, 0)
+
+    def other_files(self):
+        """Returns the recording files which do not belong to a sensor, such as
+        the version information and the calibration."""
+        sensor_files = set([SHARED_ARCHIVE_NAME])
+        for sensor in SENSOR_NAMES:
+            sensor_files.update([sensor + ".csv", sensor + ".tar", sensor + "_proxy.bin"])
+        return [name for name in sorted(os.listdir(self.path))
+                if name not in sensor_files and os.path.isfile(os.path.join(self.path, name))]
+
+
+class RangeCopier(object):
+    """Copies byte ranges of the source archives to the output archive,
+    coalescing adjacent ranges, in the kernel where copy_file_range is
+    available (which can share the extents instead on file systems that
+    support reflinks)."""
+
+    def __init__(self, output):
+        self.output = output
+        self.sources = {}
+        self.pending = None
+
+    def copy(self, path, begin, end):
+        if self.pending is not None and self.pending[0] == path and self.pending[2] == begin:
+            self.pending[2] = end
+            return
+        self.flush()
+        self.pending = [path, begin, end]
+
+    def flush(self):
+        if self.pending is None:
+            return
+        path, begin, end = self.pending
+        self.pending = None
+        source = self.sources.get(path)
+        if source is None:
+            source = open(path, "rb")
+            self.sources[path] = source
+        while begin < end:
+            size = min(end - begin, COPY_CHUNK_SIZE)
+            if hasattr(os, "copy_file_range"):
+                try:
+                    copied = os.copy_file_range(source.fileno(), self.output.fileno(), size, begin)
+                except OSError:
+                    copied = 0
+            else:
+                copied = 0
+            if copied == 0:
+                source.seek(begin)
+                data = source.read(size)
+                assert len(data) == size
+                self.output.write(data)
+                copied = size
+            begin += copied
+
+    def close(self):
+        self.flush()
+        for source in self.sources.values():
+            source.close()
+
+
+def write_archive(archive_path, members, write_index):
+    """Writes an archive of the members, copying their headers and data as is,
+    optionally followed by the index of a single-archive recording."""
+    index_lines = ["FileName,HeaderOffset,FileSize\n"]
+    # Unbuffered, so that the kernel copies and the writes share the file position.
+    with open(archive_path, "wb", buffering=0) as output:
+        copier = RangeCopier(output)
+        offset = 0
+        for member in members:
+            copier.copy(member.path, member.begin, member.end)
+            index_lines.append("{},{},{}\n".format(
+                member.name, offset + member.data_begin - member.begin - BLOCK_SIZE,
+                member.size))
+            offset += member.end - member.begin
+        copier.close()
+        if write_index:
+            data = "".join(index_lines).encode()
+            info = tarfile.TarInfo(SHARED_ARCHIVE_INDEX_NAME)
+            info.size = len(data)
+            info.mtime = int(time.time())
+            output.write(info.tobuf(tarfile.USTAR_FORMAT))
+            output.write(data)
+            output.write(bytes(-len(data) % BLOCK_SIZE))
+        output.write(bytes(2 * BLOCK_SIZE))
+
+
+def write_recording(recordings, output_path, start, end):
+    """Writes the frames of the recordings in the time range [start, end) to a
+    new recording. Frames with the same timestamp are taken from the first
+    recording which has them."""
+    if os.path.exists(output_path):
+        raise ValueError("{} already exists".format(output_path))
+    os.makedirs(output_path)
+
+    sensors = [sensor for sensor in SENSOR_NAMES
+               if any(sensor in recording.sensors for recording in recordings)]
+    single_archive = all(recording.single_archive for recording in recordings)
+    archive_members = []
+    num_frames = 0
+
+    for sensor in sensors:
+        header = None
+        rows = {}
+        members = {}
+        for recording in recordings:
+            if sensor not in recording.sensors:
+                continue
+            recording_header, recording_rows = read_csv_lines(recording.csv_path(sensor))
+            if header is None:
+                header = recording_header
+            elif recording_header != header:
+                raise ValueError("{} has different columns than the first recording".format(
+                    recording.csv_path(sensor)))
+            for timestamp, line in recording_rows.items():
+                if start <= timestamp < end:
+                    rows.setdefault(timestamp, line)
+            for member in recording.members.get(sensor, []):
+                if start <= member.timestamp < end:
+                    members.setdefault(member.timestamp, member)
+
+        with open(os.path.join(output_path, sensor + ".csv"), "wb") as f:
+            f.write(header)
+            for timestamp in sorted(rows):
+                f.write(rows[timestamp])
+
+        members = [members[timestamp] for timestamp in sorted(members)]
+        num_frames += len(members)
+        if single_archive:
+            archive_members.extend(members)
+        elif members:
+            write_archive(os.path.join(output_path, sensor + ".tar"), members, False)
+
+    if single_archive:
+        write_archive(os.path.join(output_path, SHARED_ARCHIVE_NAME), archive_members, True)
+
+    copied_files = set()
+    for recording in recordings:
+        for name in recording.other_files():
+            if name not in copied_files:
+                shutil.copyfile(os.path.join(recording.path, name),
+                                os.path.join(output_path, name))
+                copied_files.add(name)
+
+    return num_frames
+
+
+def split_time_ranges(recording, duration, max_size):
+    """Returns the time ranges of the parts of the recording, each at most the
+    duration long and at most the size in archived bytes, with at least one
+    frame."""
+    members = sorted((member for members in recording.members.values() for member in members),
+                     key=lambda member: member.timestamp)
+    if not members:
+        return []
+    boundaries = [members[0].timestamp]
+    size = 0
+    for member in members:
+        member_size = member.end - member.begin
+        if (duration is not None and member.timestamp - boundaries[-1] >= duration) or \
+                (max_size is not None and size > 0 and size + member_size > max_size):
+            boundaries.append(member.timestamp)
+            size = 0
+        size += member_size
+    boundaries.append(members[-1].timestamp + 1)
+    return list(zip(boundaries[:-1], boundaries[1:]))
+
+
+def main():
+    args = parse_args()
+
+    start_time = time.time()
+
+    if args.command == "trim":
+        recording = Recording(args.recording_path)
+        first_timestamp, _ = recording.time_range()
+        start = first_timestamp + int(args.start_seconds * TICKS_PER_SECOND)
+        end = first_timestamp + int(min(args.end_seconds, 1e9) * TICKS_PER_SECOND)
+        num_frames = write_recording([recording], args.output_path, start, end)
+        print("Wrote {} frames to {}".format(num_frames, args.output_path))
+
+    elif args.command == "split":
+        if args.duration_seconds is None and args.max_size_mb is None:
+            raise ValueError("--duration_seconds or --max_size_mb is required")
+        recording = Recording(args.recording_path)
+        time_ranges = split_time_ranges(
+            recording,
+            None if args.duration_seconds is None else
+            int(args.duration_seconds * TICKS_PER_SECOND),
+            None if args.max_size_mb is None else int(args.max_size_mb * 1024 * 1024))
+        name = os.path.basename(os.path.normpath(args.recording_path))
+        for i, (start, end) in enumerate(time_ranges):
+            part_path = os.path.join(args.output_path, "{}_{:03d}".format(name, i))
+            num_frames = write_recording([recording], part_path, start, end)
+            print("Wrote {} frames to {}".format(num_frames, part_path))
+
+    elif args.command == "merge":
+        recordings = [Recording(path) for path in args.recording_path]
+        num_frames = write_recording(recordings, args.output_path, 0, 2 ** 63 - 1)
+        print("Wrote {} frames to {}".format(num_frames, args.output_path))
+
+    print("Done in {:.1f}s; proxy tracks are not copied, see proxy_tracks.py".format(
+        time.time() - start_time))
+
+
+if __name__ == "__main__":
+    main()
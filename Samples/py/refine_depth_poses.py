@@ -0,0 +1,415 @@
+# Script to refine the poses of the depth frames of a recording downloaded with
+# recorder_console.py using point-to-plane ICP.
+#
+# The HoloLens poses drift over time, which shows as doubled surfaces when the
+# point clouds of many frames are merged with pcloud_compute.py. This script
+# aligns every depth frame to the last keyframe, starting from the relative
+# motion between the two recorded poses:
+#
+#  - the depth images are back-projected into organized point clouds and the
+#    normals are estimated on the depth grid, see pcloud_compute.py,
+#  - correspondences are found by projecting the source points into the depth
+#    grid of the keyframe (projective data association), which avoids nearest
+#    neighbor searches,
+#  - the point-to-plane distance is minimized with Gauss-Newton on a coarse to
+#    fine pyramid, where the normal equations are accumulated in parallel over
+#    bands of rows.
+#
+# The refined poses are written as <camera>_refined.csv next to the original
+# <camera>.csv, with the same columns and only FrameToOrigin updated, so they
+# can be used wherever the original file is read, e.g. with
+# "pcloud_compute.py --pose_suffix refined".
+#
+# The same algorithm is available in C++ as rmcv::PointToPlaneIcp in
+# Shared/OpenCVHelpers.
+
+import os
+import argparse
+import multiprocessing
+import concurrent.futures
+import cv2
+import numpy as np
+
+from pcloud_compute import LONG_THROW_RANGE, SHORT_THROW_RANGE, \
+    MAX_RELATIVE_DEPTH_CHANGE, parse_projection_bin, get_organized_points, \
+    compute_normals
+
+
+# Rows per band for the parallel accumulation of the normal equations.
+ROWS_PER_BAND = 16
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--workspace_path", required=True,
+                        help="Path to the recording folder with the depth "
+                             "images and the <camera>.csv pose file")
+    parser.add_argument("--short_throw", action='store_true',
+                        help="Refine the short throw depth frame poses")
+    parser.add_argument("--long_throw", action='store_true',
+                        help="Refine the long throw depth frame poses")
+    parser.add_argument("--output_suffix", default="refined",
+                        help="Refined poses are written to "
+                             "<camera>_<suffix>.csv")
+    parser.add_argument("--start_frame", type=int, default=0)
+    parser.add_argument("--max_num_frames", type=int, default=-1)
+    parser.add_argument("--num_levels", type=int, default=3,
+                        help="Number of pyramid levels")
+    parser.add_argument("--num_iterations", type=int, nargs="+",
+                        default=[10, 6, 4],
+                        help="Gauss-Newton iterations per level, starting "
+                             "with the finest level")
+    parser.add_argument("--max_correspondence_distance", type=float,
+                        default=0.1, help="In meters")
+    parser.add_argument("--max_normal_angle", type=float, default=30.0,
+                        help="In degrees")
+    parser.add_argument("--huber_threshold", type=float, default=0.01,
+                        help="In meters")
+    parser.add_argument("--min_inlier_fraction", type=float, default=0.3)
+    parser.add_argument("--keyframe_translation", type=float, default=0.1,
+                        help="Start a new keyframe after moving this far "
+                             "(in meters) from the last keyframe")
+    parser.add_argument("--keyframe_rotation", type=float, default=10.0,
+                        help="Start a new keyframe after rotating this far "
+                             "(in degrees) from the last keyframe")
+    parser.add_argument("--num_threads", type=int,
+                        default=multiprocessing.cpu_count())
+    args = parser.parse_args()
+
+    if args.short_throw == args.long_throw:
+        print("Exactly one of --short_throw and --long_throw must be set.")
+        exit()
+
+    assert len(args.num_iterations) >= args.num_levels
+
+    return args
+
+
+class DepthProjection:
+    # Maps camera space points back to depth image coordinates. The depth
+    # cameras do not follow a pinhole model, so a polynomial in the angular
+    # unit plane coordinates is fitted to the ray table for an initial guess,
+    # which is then refined with Newton steps on the ray table itself.
+
+    DEGREE = 5
+    NUM_NEWTON_STEPS = 3
+
+    def __init__(self, us, vs):
+        self.us, self.vs = us, vs
+        self.height, self.width = us.shape
+        valid = np.isfinite(us) & np.isfinite(vs)
+        rows, cols = np.nonzero(valid)
+        u, v = us[valid], vs[valid]
+        self.bounds = (u.min(), u.max(), v.min(), v.max())
+        monomials = self.monomials(u, v)
+        self.col_coeffs = np.linalg.lstsq(monomials, cols, rcond=None)[0]
+        self.row_coeffs = np.linalg.lstsq(monomials, rows, rcond=None)[0]
+
+    @classmethod
+    def monomials(cls, u, v):
+        # Scaling the unit plane coordinates to the angle from the optical
+        # axis removes most of the distortion of wide angle lenses.
+        radius = np.hypot(u, v)
+        scale = np.arctan(radius) / np.maximum(radius, 1e-9)
+        a = u * np.where(radius > 1e-9, scale, 1)
+        b = v * np.where(radius > 1e-9, scale, 1)
+        return np.stack([a ** (degree - j) * b ** j
+                         for degree in range(cls.DEGREE + 1)
+                         for j in range(degree + 1)], axis=-1)
+
+    def project(self, points):
+        # Returns the pixel coordinates, where integers denote pixel centers,
+        # and a mask of the points that fall into the image.
+        z = points[:, 2]
+        in_front = z < 0
+        z = np.where(in_front, z, -1)
+        u = points[:, 0] / z
+        v = points[:, 1] / z
+        u_min, u_max, v_min, v_max = self.bounds
+        valid = in_front & (u >= u_min) & (u <= u_max) & \
+            (v >= v_min) & (v <= v_max)
+
+        monomials = self.monomials(u, v)
+        cols = monomials.dot(self.col_coeffs)
+        rows = monomials.dot(self.row_coeffs)
+
+        for _ in range(self.NUM_NEWTON_STEPS):
+            c = np.clip(np.round(cols).astype(np.int64), 1, self.width - 2)
+            r = np.clip(np.round(rows).astype(np.int64), 1, self.height - 2)
+            du = u - self.us[r, c]
+            dv = v - self.vs[r, c]
+            u_c = (self.us[r, c + 1] - self.us[r, c - 1]) / 2
+            u_r = (self.us[r + 1, c] - self.us[r - 1, c]) / 2
+            v_c = (self.vs[r, c + 1] - self.vs[r, c - 1]) / 2
+            v_r = (self.vs[r + 1, c] - self.vs[r - 1, c]) / 2
+            with np.errstate(invalid="ignore", divide="ignore"):
+                det = u_c * v_r - u_r * v_c
+                cols = c + (v_r * du - u_r * dv) / det
+                rows = r + (u_c * dv - v_c * du) / det
+
+        # Points whose Newton steps left the valid part of the ray table are
+        # dropped, as are points that do not converge to the final pixel.
+        with np.errstate(invalid="ignore"):
+            valid &= np.isfinite(cols) & np.isfinite(rows) & \
+                (np.abs(cols - c) <= 1) & (np.abs(rows - r) <= 1) & \
+                (cols > -0.5) & (cols < self.width - 0.5) & \
+                (rows > -0.5) & (rows < self.height - 0.5)
+        cols = np.where(valid, cols, 0)
+        rows = np.where(valid, rows, 0)
+        return cols, rows, valid
+
+
+def build_pyramid(points, num_levels):
+    # Subsampling instead of averaging keeps the points on the measured
+    # surfaces and avoids mixing depths across discontinuities.
+    pyramid = []
+    for level in range(num_levels):
+        scale = 2 ** level
+        level_points = points[::scale, ::scale]
+        normals = compute_normals(level_points,
+                                  MAX_RELATIVE_DEPTH_CHANGE * scale)
+        pyramid.append((scale, level_points, normals))
+    return pyramid
+
+
+def twist_to_transform(twist):
+    transform = np.eye(4)
+    transform[:3, :3] = cv2.Rodrigues(twist[:3])[0]
+    transform[:3, 3] = twist[3:]
+    return transform
+
+
+def accumulate_band(source_points, source_normals, target_points,
+                    target_normals, scale, projection, transform, args):
+    valid = (source_points[:, :, 2] != 0) & \
+        np.any(source_normals != 0, axis=2)
+    p = source_points[valid]
+    R, t = transform[:3, :3], transform[:3, 3]
+    q = p.dot(R.T) + t
+    source_n = source_normals[valid].dot(R.T)
+
+    # Projective data association: the correspondence is the target point
+    # the transformed source point projects onto.
+    cols, rows, mask = projection.project(q)
+    cols = np.clip(np.round(cols / scale).astype(np.int64), 0,
+                   target_points.shape[1] - 1)
+    rows = np.clip(np.round(rows / scale).astype(np.int64), 0,
+                   target_points.shape[0] - 1)
+    d = target_points[rows, cols]
+    n = target_normals[rows, cols]
+    difference = q - d
+
+    mask &= np.any(n != 0, axis=1)
+    mask &= np.sum(difference * difference, axis=1) <= \
+        args.max_correspondence_distance ** 2
+    mask &= np.sum(source_n * n, axis=1) >= \
+        np.cos(np.deg2rad(args.max_normal_angle))
+
+    q, n, difference = q[mask], n[mask], difference[mask]
+    residuals = np.sum(n * difference, axis=1)
+    abs_residuals = np.abs(residuals)
+    weights = np.where(abs_residuals <= args.huber_threshold, 1.0,
+                       args.huber_threshold / np.maximum(abs_residuals, 1e-12))
+
+    # Derivative of the residual with respect to a small rotation and
+    # translation applied on the left of the current transform.
+    J = np.hstack([np.cross(q, n), n])
+    weighted_J = J * weights[:, np.newaxis]
+
+    return weighted_J.T.dot(J), weighted_J.T.dot(residuals), \
+        residuals.dot(residuals), residuals.size
+
+
+def align(source_pyramid, target_pyramid, projection, initial_transform,
+          args, executor):
+    transform = initial_transform.copy()
+    last_stats = (0.0, 0)
+    solved = True
+
+    for level in reversed(range(args.num_levels)):
+        scale, source_points, source_normals = source_pyramid[level]
+        _, target_points, target_normals = target_pyramid[level]
+        bands = range(0, source_points.shape[0], ROWS_PER_BAND)
+
+        for _ in range(args.num_iterations[level]):
+            partial = executor.map(
+                lambda row: accumulate_band(
+                    source_points[row:row + ROWS_PER_BAND],
+                    source_normals[row:row + ROWS_PER_BAND],
+                    target_points, target_normals, scale, projection,
+                    transform, args), bands)
+
+            A = np.zeros((6, 6))
+            b = np.zeros(6)
+            squared_error, num_inliers = 0.0, 0
+            for band_A, band_b, band_error, band_inliers in partial:
+                A += band_A
+                b += band_b
+                squared_error += band_error
+                num_inliers += band_inliers
+            last_stats = (squared_error, num_inliers)
+
+            if num_inliers < 6:
+                solved = False
+                break
+            try:
+                twist = np.linalg.solve(A, -b)
+            except np.linalg.LinAlgError:
+                solved = False
+                break
+
+            transform = twist_to_transform(twist).dot(transform)
+
+            if np.linalg.norm(twist) < 1e-6:
+                break
+
+        if not solved:
+            break
+
+    squared_error, num_inliers = last_stats
+    num_valid = np.count_nonzero(source_pyramid[0][1][:, :, 2])
+    inlier_fraction = num_inliers / float(max(num_valid, 1))
+    rmse = np.sqrt(squared_error / max(num_inliers, 1))
+    converged = solved and inlier_fraction >= args.min_inlier_fraction
+
+    return (transform if converged else initial_transform), converged, \
+        inlier_fraction, rmse
+
+
+def read_pose_file(path):
+    # Returns the header and the lines of the pose file, and the timestamp,
+    # image file name, frame to origin and camera view transforms of the
+    # frames with a valid pose.
+    with open(path, "r") as fid:
+        header = fid.readline()
+        lines = [line.strip() for line in fid if line.strip()]
+
+    frames = []
+    for line_idx, line in enumerate(lines):
+        elems = line.split(",")
+        assert len(elems) >= 50
+        frame_to_origin = np.array(list(map(float, elems[2:18])))
+        frame_to_origin = frame_to_origin.reshape(4, 4).T
+        camera_to_frame = np.array(list(map(float, elems[18:34])))
+        camera_to_frame = camera_to_frame.reshape(4, 4).T
+        if abs(np.linalg.det(frame_to_origin[:3, :3]) - 1) < 0.01:
+            # The recorder writes <sensor>\<timestamp>.pgm with a zero-padded
+            # timestamp, so take the file name as recorded.
+            image_name = os.path.basename(elems[1].strip().replace("\\", "/"))
+            frames.append((line_idx, int(elems[0]), image_name,
+                           frame_to_origin, camera_to_frame))
+
+    return header, lines, frames
+
+
+def write_pose_file(path, header, lines, refined_frame_to_origins):
+    with open(path, "w") as fid:
+        fid.write(header)
+        for line_idx, line in enumerate(lines):
+            if line_idx in refined_frame_to_origins:
+                elems = line.split(",")
+                elems[2:18] = ["%.9g" % value for value in
+                               refined_frame_to_origins[line_idx].T.ravel()]
+                line = ",".join(elems)
+            fid.write(line + "\n")
+
+
+def rotation_angle(transform):
+    cos_angle = (np.trace(transform[:3, :3]) - 1) / 2
+    return np.rad2deg(np.arccos(np.clip(cos_angle, -1, 1)))
+
+
+def main():
+    args = parse_args()
+
+    camera = "long_throw_depth" if args.long_throw else "short_throw_depth"
+    depth_range = LONG_THROW_RANGE if args.long_throw else SHORT_THROW_RANGE
+
+    pose_path = os.path.join(args.workspace_path, camera + ".csv")
+    header, lines, frames = read_pose_file(pose_path)
+
+    if args.max_num_frames == -1:
+        args.max_num_frames = len(frames)
+    frames = frames[args.start_frame:args.start_frame + args.max_num_frames]
+
+    bin_path = os.path.join(args.workspace_path,
+                            "%s_camera_space_projection.bin" % camera)
+
+    executor = concurrent.futures.ThreadPoolExecutor(args.num_threads)
+
+    projection = None
+    us = vs = None
+    refined_frame_to_origins = {}
+    keyframe = None
+
+    for frame_idx, (line_idx, time_stamp, image_name, frame_to_origin,
+                    camera_to_frame) in enumerate(frames):
+        depth_path = os.path.join(args.workspace_path, camera, image_name)
+        img = cv2.imread(depth_path, -1)
+        if img is None:
+            print("Frame {}/{}: could not read {}".format(
+                frame_idx + 1, len(frames), depth_path))
+            continue
+
+        if projection is None:
+            us, vs = parse_projection_bin(bin_path, img.shape[1],
+                                          img.shape[0])
+            projection = DepthProjection(us, vs)
+
+        points = get_organized_points(img, us, vs, depth_range)
+        pyramid = build_pyramid(points, args.num_levels)
+
+        # The recorded camera to world transform of the frame.
+        camera_to_world = frame_to_origin.dot(np.linalg.inv(camera_to_frame))
+
+        if keyframe is None:
+            refined_camera_to_world = camera_to_world
+            converged, inlier_fraction, rmse = True, 1.0, 0.0
+            new_keyframe = True
+        else:
+            keyframe_pyramid, keyframe_camera_to_world, \
+                keyframe_refined_camera_to_world = keyframe
+
+            # The recorded poses are accurate over short time spans, so their
+            # relative motion initializes the alignment.
+            initial_transform = np.linalg.inv(
+                keyframe_camera_to_world).dot(camera_to_world)
+            transform, converged, inlier_fraction, rmse = align(
+                pyramid, keyframe_pyramid, projection, initial_transform,
+                args, executor)
+            refined_camera_to_world = \
+                keyframe_refined_camera_to_world.dot(transform)
+
+            new_keyframe = \
+                not converged or \
+                np.linalg.norm(transform[:3, 3]) > \
+                args.keyframe_translation or \
+                rotation_angle(transform) > args.keyframe_rotation or \
+                inlier_fraction < 2 * args.min_inlier_fraction
+
+        if new_keyframe:
+            keyframe = (pyramid, camera_to_world, refined_camera_to_world)
+
+        refined_frame_to_origins[line_idx] = \
+            refined_camera_to_world.dot(camera_to_frame)
+
+        print("Frame {}/{}: {}, converged={}, inliers={:.2f}, "
+              "rmse={:.4f}m{}".format(
+                  frame_idx + 1, len(frames), time_stamp, converged,
+                  inlier_fraction, rmse, ", keyframe" if new_keyframe else ""))
+
+    executor.shutdown()
+
+    if not refined_frame_to_origins:
+        raise RuntimeError(
+            "No depth frame could be read from %s; no poses were refined."
+            % os.path.join(args.workspace_path, camera))
+
+    output_path = os.path.join(
+        args.workspace_path, "%s_%s.csv" % (camera, args.output_suffix))
+    print("Writing refined poses to: %s" % output_path)
+    write_pose_file(output_path, header, lines, refined_frame_to_origins)
+
+
+if __name__ == "__main__":
+    main()
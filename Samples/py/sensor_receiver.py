@@ -27,13 +27,14 @@ PROCESS = True
 # Definitions
 
 # Protocol Header Format
-# Cookie VersionMajor VersionMinor FrameType Timestamp ImageWidth
-# ImageHeight PixelStride RowStride
-SENSOR_STREAM_HEADER_FORMAT = "@IBBHqIIII"
+# Cookie VersionMajor VersionMinor FrameType Timestamp SequenceNumber
+# ImageWidth ImageHeight PixelStride RowStride
+SENSOR_STREAM_HEADER_FORMAT = "@IBBHqQIIII"
 
 SENSOR_FRAME_STREAM_HEADER = namedtuple(
     'SensorFrameStreamHeader',
-    'Cookie VersionMajor VersionMinor FrameType Timestamp ImageWidth ImageHeight PixelStride RowStride'
+    'Cookie VersionMajor VersionMinor FrameType Timestamp SequenceNumber '
+    'ImageWidth ImageHeight PixelStride RowStride'
 )
 
 # Each port corresponds to a single stream type
@@ -64,6 +65,11 @@ def main(argv):
 
     print('INFO: Socket Connected to ' + args.host + ' on port ' + str(PV_STREAM_PORT))
 
+    # Sequence numbers are assigned densely at capture, so gaps are frames
+    # lost by the streaming server or the network.
+    expected_sequence_number = None
+    frames_missed = 0
+
     # Try receive data
     try:
         quit = False
@@ -78,6 +84,12 @@ def main(argv):
             # Parse the header
             header = SENSOR_FRAME_STREAM_HEADER(*data)
 
+            if expected_sequence_number is not None and \
+                    header.SequenceNumber > expected_sequence_number:
+                frames_missed += header.SequenceNumber - expected_sequence_number
+                print('INFO: {} frame(s) missed so far'.format(frames_missed))
+            expected_sequence_number = header.SequenceNumber + 1
+
             # read the image in chunks
             image_size_bytes = header.ImageHeight * header.RowStride
             image_data = ''
@@ -0,0 +1,219 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#include "pch.h"
+
+namespace HoloLensForCV
+{
+    HeadPoseStreamingServer::HeadPoseStreamingServer(
+        _In_ SpatialPerception^ spatialPerception,
+        _In_ Platform::String^ serviceName,
+        _In_ uint32_t posesPerSecond)
+        : _spatialPerception(spatialPerception)
+        , _writeInProgress(false)
+        , _nextSequenceNumber(0)
+        , _posesSent(0)
+        , _posesDropped(0)
+    {
+        REQUIRES(0 < posesPerSecond);
+
+        _listener = ref new Windows::Networking::Sockets::StreamSocketListener();
+
+        _listener->ConnectionReceived +=
+            ref new Windows::Foundation::TypedEventHandler<
+                Windows::Networking::Sockets::StreamSocketListener^,
+                Windows::Networking::Sockets::StreamSocketListenerConnectionReceivedEventArgs^>(
+                    this,
+                    &HeadPoseStreamingServer::OnConnection);
+
+        _listener->Control->KeepAlive = true;
+
+        // Don't limit traffic to an address or an adapter.
+        Concurrency::create_task(_listener->BindServiceNameAsync(serviceName)).then(
+            [this](Concurrency::task<void> previousTask)
+        {
+            try
+            {
+                // Try getting an exception.
+                previousTask.get();
+            }
+            catch (Platform::Exception^ exception)
+            {
+#if DBG_ENABLE_ERROR_LOGGING
+                dbg::trace(
+                    L"HeadPoseStreamingServer::HeadPoseStreamingServer: %s",
+                    exception->Message->Data());
+#endif /* DBG_ENABLE_ERROR_LOGGING */
+            }
+        });
+
+        Windows::Foundation::TimeSpan period;
+
+        period.Duration =
+            std::chrono::duration_cast<Io::HundredsOfNanoseconds>(
+                std::chrono::seconds(1)).count() / posesPerSecond;
+
+        _timer = Windows::System::Threading::ThreadPoolTimer::CreatePeriodicTimer(
+            ref new Windows::System::Threading::TimerElapsedHandler(
+                this,
+                &HeadPoseStreamingServer::OnTimer),
+            period);
+    }
+
+    HeadPoseStreamingServer::~HeadPoseStreamingServer()
+    {
+        _timer->Cancel();
+        _timer = nullptr;
+
+        delete _listener;
+        _listener = nullptr;
+    }
+
+    void HeadPoseStreamingServer::OnConnection(
+        Windows::Networking::Sockets::StreamSocketListener^ listener,
+        Windows::Networking::Sockets::StreamSocketListenerConnectionReceivedEventArgs^ object)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        _socket = object->Socket;
+
+        //
+        // The packets are small and latency matters more than throughput.
+        //
+        _socket->Control->NoDelay = true;
+
+        _writeInProgress = false;
+
+        _writer = ref new Windows::Storage::Streams::DataWriter(
+            _socket->OutputStream);
+
+        _writer->ByteOrder =
+            Windows::Storage::Streams::ByteOrder::LittleEndian;
+    }
+
+    void HeadPoseStreamingServer::OnTimer(
+        Windows::System::Threading::ThreadPoolTimer^ timer)
+    {
+        //
+        // Skip locating the head while no client is connected. The socket is checked
+        // again below, as a client may disconnect while the pose is being located.
+        //
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            if (nullptr == _socket)
+            {
+                return;
+            }
+        }
+
+        //
+        // Sample the head pose now, using the clock the sensor frames are timestamped with.
+        //
+        LARGE_INTEGER qpc;
+
+        ASSERT(QueryPerformanceCounter(
+            &qpc));
+
+        Windows::Foundation::DateTime timestamp;
+
+        timestamp.UniversalTime =
+            _timeConverter.RelativeTicksToAbsoluteTicks(
+                _timeConverter.QpcToRelativeTicks(
+                    qpc)).count();
+
+        Windows::Perception::Spatial::SpatialLocation^ location =
+            _spatialPerception->GetSpatialLocator()->TryLocateAtTimestamp(
+                _spatialPerception->CreatePerceptionTimestamp(timestamp),
+                _spatialPerception->GetOriginFrameOfReference()->CoordinateSystem);
+
+        Windows::Foundation::Numerics::float3 position(0.0f, 0.0f, 0.0f);
+        Windows::Foundation::Numerics::quaternion orientation(0.0f, 0.0f, 0.0f, 0.0f);
+        uint16_t flags = 0;
+
+        if (nullptr != location)
+        {
+            position = location->Position;
+            orientation = location->Orientation;
+            flags |= LocatedFlag;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (nullptr == _socket)
+        {
+            return;
+        }
+
+        //
+        // Sequence numbers are assigned to every sampled pose, so the client can tell how
+        // many were dropped.
+        //
+        const uint64_t sequenceNumber =
+            _nextSequenceNumber++;
+
+        if (_writeInProgress)
+        {
+#if DBG_ENABLE_VERBOSE_LOGGING
+            dbg::trace(
+                L"HeadPoseStreamingServer::OnTimer: pose dropped -- previous StoreAsync task is still in progress!");
+#endif /* DBG_ENABLE_VERBOSE_LOGGING */
+
+            ++_posesDropped;
+
+            return;
+        }
+
+        _writeInProgress = true;
+
+        _writer->WriteUInt32(ProtocolCookie);
+        _writer->WriteByte(ProtocolVersionMajor);
+        _writer->WriteByte(ProtocolVersionMinor);
+        _writer->WriteUInt16(flags);
+        _writer->WriteUInt64(timestamp.UniversalTime);
+        _writer->WriteUInt64(sequenceNumber);
+        _writer->WriteSingle(position.x);
+        _writer->WriteSingle(position.y);
+        _writer->WriteSingle(position.z);
+        _writer->WriteSingle(orientation.x);
+        _writer->WriteSingle(orientation.y);
+        _writer->WriteSingle(orientation.z);
+        _writer->WriteSingle(orientation.w);
+
+        Concurrency::create_task(_writer->StoreAsync()).then(
+            [this](Concurrency::task<unsigned int> writeTask)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            try
+            {
+                // Try getting an exception.
+                writeTask.get();
+
+                ++_posesSent;
+
+                _writeInProgress = false;
+            }
+            catch (Platform::Exception^ exception)
+            {
+#if DBG_ENABLE_ERROR_LOGGING
+                dbg::trace(
+                    L"HeadPoseStreamingServer::OnTimer: StoreAsync call failed with error: %s",
+                    exception->Message->Data());
+#endif /* DBG_ENABLE_ERROR_LOGGING */
+
+                ++_posesDropped;
+
+                _socket = nullptr;
+            }
+        });
+    }
+}
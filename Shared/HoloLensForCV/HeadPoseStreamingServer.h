@@ -0,0 +1,121 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#pragma once
+
+namespace HoloLensForCV
+{
+    //
+    // Streams the head pose in the origin frame of reference to a connected client, sampled
+    // at a fixed rate independently of the image streams. Each pose is sent as one packet of
+    // PacketLength bytes:
+    //
+    //   Cookie (uint32), VersionMajor, VersionMinor (uint8), Flags (uint16),
+    //   Timestamp (uint64), SequenceNumber (uint64),
+    //   Position (3 x float), Orientation (4 x float, quaternion x, y, z, w)
+    //
+    // The timestamps use the same clock as the SensorFrame timestamps (hundreds of
+    // nanoseconds since January 1st, 1601), so the client can interpolate the head pose
+    // at the time of any frame.
+    //
+    public ref class HeadPoseStreamingServer sealed
+    {
+    public:
+        HeadPoseStreamingServer(
+            _In_ SpatialPerception^ spatialPerception,
+            _In_ Platform::String^ serviceName,
+            _In_ uint32_t posesPerSecond);
+
+        static property uint32_t PacketLength
+        {
+            uint32_t get()
+            {
+                return
+                    sizeof(uint32_t) /* Cookie */ +
+                    2 * sizeof(uint8_t) /* VersionMajor, VersionMinor */ +
+                    sizeof(uint16_t) /* Flags */ +
+                    sizeof(uint64_t) /* Timestamp */ +
+                    sizeof(uint64_t) /* SequenceNumber */ +
+                    7 * sizeof(float) /* Position, Orientation */;
+            }
+        }
+
+        static property uint32_t ProtocolCookie
+        {
+            uint32_t get() { return 0x484c4850; }
+        }
+
+        static property uint8_t ProtocolVersionMajor
+        {
+            uint8_t get() { return 0x00; }
+        }
+
+        static property uint8_t ProtocolVersionMinor
+        {
+            uint8_t get() { return 0x01; }
+        }
+
+        /// <summary>
+        /// Set in the packet flags if the head could be located; otherwise the position
+        /// and orientation are zero.
+        /// </summary>
+        static property uint16_t LocatedFlag
+        {
+            uint16_t get() { return 0x0001; }
+        }
+
+        /// <summary>
+        /// Number of poses written to the connected client.
+        /// </summary>
+        property uint64_t PosesSent
+        {
+            uint64_t get() { return _posesSent; }
+        }
+
+        /// <summary>
+        /// Number of poses dropped while a client was connected because the previous send
+        /// was still in flight or failed.
+        /// </summary>
+        property uint64_t PosesDropped
+        {
+            uint64_t get() { return _posesDropped; }
+        }
+
+    private:
+        ~HeadPoseStreamingServer();
+
+        void OnConnection(
+            Windows::Networking::Sockets::StreamSocketListener^ listener,
+            Windows::Networking::Sockets::StreamSocketListenerConnectionReceivedEventArgs^ object);
+
+        void OnTimer(
+            Windows::System::Threading::ThreadPoolTimer^ timer);
+
+    private:
+        SpatialPerception^ _spatialPerception;
+        Io::TimeConverter _timeConverter;
+
+        Windows::Networking::Sockets::StreamSocketListener^ _listener;
+        Windows::System::Threading::ThreadPoolTimer^ _timer;
+
+        //
+        // The timer callbacks may overlap, so the connection state is guarded.
+        //
+        std::mutex _mutex;
+        Windows::Networking::Sockets::StreamSocket^ _socket;
+        Windows::Storage::Streams::DataWriter^ _writer;
+        bool _writeInProgress;
+        uint64_t _nextSequenceNumber;
+
+        std::atomic<uint64_t> _posesSent;
+        std::atomic<uint64_t> _posesDropped;
+    };
+}
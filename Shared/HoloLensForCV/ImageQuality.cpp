@@ -0,0 +1,525 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#include "pch.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#define IMAGE_QUALITY_USE_SSE2 1
+#else
+#define IMAGE_QUALITY_USE_SSE2 0
+#endif
+
+namespace HoloLensForCV
+{
+    namespace
+    {
+        struct IntensityAccumulators
+        {
+            uint64_t Sum;
+            uint64_t SumOfSquares;
+            uint64_t Underexposed;
+            uint64_t Overexposed;
+        };
+
+        struct LaplacianAccumulators
+        {
+            int64_t Sum;
+            uint64_t SumOfSquares;
+            uint64_t Count;
+        };
+
+#if IMAGE_QUALITY_USE_SSE2
+        inline uint32_t CountBits16(
+            _In_ uint32_t mask)
+        {
+            mask = mask - ((mask >> 1) & 0x5555);
+            mask = (mask & 0x3333) + ((mask >> 2) & 0x3333);
+            mask = (mask + (mask >> 4)) & 0x0f0f;
+
+            return (mask + (mask >> 8)) & 0x1f;
+        }
+
+        inline int64_t HorizontalSumInt32(
+            _In_ __m128i value)
+        {
+            alignas(16) int32_t lanes[4];
+
+            _mm_store_si128(
+                reinterpret_cast<__m128i*>(lanes),
+                value);
+
+            return (int64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        }
+
+        inline uint64_t HorizontalSumUInt64(
+            _In_ __m128i value)
+        {
+            alignas(16) uint64_t lanes[2];
+
+            _mm_store_si128(
+                reinterpret_cast<__m128i*>(lanes),
+                value);
+
+            return lanes[0] + lanes[1];
+        }
+#endif /* IMAGE_QUALITY_USE_SSE2 */
+
+        void AccumulateIntensityRow(
+            _In_reads_(width) const uint8_t* row,
+            _In_ uint32_t width,
+            _Inout_ IntensityAccumulators* accumulators)
+        {
+            uint32_t x = 0;
+
+#if IMAGE_QUALITY_USE_SSE2
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i underexposedLimit = _mm_set1_epi8((char)ImageQualityScorer::UnderexposedIntensity);
+            const __m128i overexposedLimit = _mm_set1_epi8((char)ImageQualityScorer::OverexposedIntensity);
+
+            __m128i sum = zero;
+            __m128i sumOfSquares = zero;
+
+            //
+            // Each 32-bit lane of sumOfSquares grows by at most 4 * 255^2 per iteration, so
+            // the row is processed in blocks that cannot overflow.
+            //
+            const uint32_t c_maximumBlockIterations = 1024;
+
+            while (x + 16 <= width)
+            {
+                __m128i blockSumOfSquares = zero;
+                uint32_t blockIterations = 0;
+
+                for (; x + 16 <= width && blockIterations < c_maximumBlockIterations; x += 16, ++blockIterations)
+                {
+                    const __m128i pixels =
+                        _mm_loadu_si128(
+                            reinterpret_cast<const __m128i*>(row + x));
+
+                    sum = _mm_add_epi64(
+                        sum,
+                        _mm_sad_epu8(pixels, zero));
+
+                    const __m128i low = _mm_unpacklo_epi8(pixels, zero);
+                    const __m128i high = _mm_unpackhi_epi8(pixels, zero);
+
+                    blockSumOfSquares = _mm_add_epi32(
+                        blockSumOfSquares,
+                        _mm_add_epi32(
+                            _mm_madd_epi16(low, low),
+                            _mm_madd_epi16(high, high)));
+
+                    //
+                    // Saturating subtraction leaves a non-zero byte exactly where the pixel
+                    // is below (resp. above) the limit.
+                    //
+                    const uint32_t notUnderexposed =
+                        _mm_movemask_epi8(
+                            _mm_cmpeq_epi8(
+                                _mm_subs_epu8(underexposedLimit, pixels),
+                                zero));
+
+                    const uint32_t notOverexposed =
+                        _mm_movemask_epi8(
+                            _mm_cmpeq_epi8(
+                                _mm_subs_epu8(pixels, overexposedLimit),
+                                zero));
+
+                    accumulators->Underexposed += 16 - CountBits16(notUnderexposed);
+                    accumulators->Overexposed += 16 - CountBits16(notOverexposed);
+                }
+
+                sumOfSquares = _mm_add_epi64(
+                    sumOfSquares,
+                    _mm_add_epi64(
+                        _mm_unpacklo_epi32(blockSumOfSquares, zero),
+                        _mm_unpackhi_epi32(blockSumOfSquares, zero)));
+            }
+
+            accumulators->Sum += HorizontalSumUInt64(sum);
+            accumulators->SumOfSquares += HorizontalSumUInt64(sumOfSquares);
+#endif /* IMAGE_QUALITY_USE_SSE2 */
+
+            for (; x < width; ++x)
+            {
+                const uint32_t pixel = row[x];
+
+                accumulators->Sum += pixel;
+                accumulators->SumOfSquares += pixel * pixel;
+
+                if (pixel < ImageQualityScorer::UnderexposedIntensity)
+                {
+                    ++accumulators->Underexposed;
+                }
+                else if (pixel > ImageQualityScorer::OverexposedIntensity)
+                {
+                    ++accumulators->Overexposed;
+                }
+            }
+        }
+
+        //
+        // Accumulates the Laplacian 4 * c - l - r - u - d over the interior pixels of a row.
+        //
+        void AccumulateLaplacianRow(
+            _In_reads_(width) const uint8_t* up,
+            _In_reads_(width) const uint8_t* center,
+            _In_reads_(width) const uint8_t* down,
+            _In_ uint32_t width,
+            _Inout_ LaplacianAccumulators* accumulators)
+        {
+            if (width < 3)
+            {
+                return;
+            }
+
+            uint32_t x = 1;
+
+#if IMAGE_QUALITY_USE_SSE2
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i ones = _mm_set1_epi16(1);
+
+            //
+            // The Laplacian is in [-1020..1020], so each 32-bit lane of the sum of squares
+            // grows by at most 2 * 1020^2 per iteration.
+            //
+            const uint32_t c_maximumBlockIterations = 512;
+
+            while (x + 9 <= width)
+            {
+                __m128i blockSum = zero;
+                __m128i blockSumOfSquares = zero;
+                uint32_t blockIterations = 0;
+
+                for (; x + 9 <= width && blockIterations < c_maximumBlockIterations; x += 8, ++blockIterations)
+                {
+                    const __m128i c = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(center + x)), zero);
+                    const __m128i l = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(center + x - 1)), zero);
+                    const __m128i r = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(center + x + 1)), zero);
+                    const __m128i u = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(up + x)), zero);
+                    const __m128i d = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(down + x)), zero);
+
+                    const __m128i laplacian =
+                        _mm_sub_epi16(
+                            _mm_slli_epi16(c, 2),
+                            _mm_add_epi16(
+                                _mm_add_epi16(l, r),
+                                _mm_add_epi16(u, d)));
+
+                    blockSum = _mm_add_epi32(
+                        blockSum,
+                        _mm_madd_epi16(laplacian, ones));
+
+                    blockSumOfSquares = _mm_add_epi32(
+                        blockSumOfSquares,
+                        _mm_madd_epi16(laplacian, laplacian));
+                }
+
+                accumulators->Sum += HorizontalSumInt32(blockSum);
+                accumulators->SumOfSquares += (uint64_t)HorizontalSumInt32(blockSumOfSquares);
+                accumulators->Count += 8 * blockIterations;
+            }
+#endif /* IMAGE_QUALITY_USE_SSE2 */
+
+            for (; x + 1 < width; ++x)
+            {
+                const int32_t laplacian =
+                    4 * center[x] - center[x - 1] - center[x + 1] - up[x] - down[x];
+
+                accumulators->Sum += laplacian;
+                accumulators->SumOfSquares += (uint64_t)(laplacian * laplacian);
+                ++accumulators->Count;
+            }
+        }
+
+        void ExtractGreenChannel(
+            _In_reads_(width * 4) const uint8_t* bgra,
+            _In_ uint32_t width,
+            _Out_writes_(width) uint8_t* gray)
+        {
+            uint32_t x = 0;
+
+#if IMAGE_QUALITY_USE_SSE2
+            const __m128i lowByteMask = _mm_set1_epi32(0xff);
+
+            for (; x + 8 <= width; x += 8)
+            {
+                const __m128i first =
+                    _mm_and_si128(
+                        _mm_srli_epi32(
+                            _mm_loadu_si128(reinterpret_cast<const __m128i*>(bgra + 4 * x)),
+                            8),
+                        lowByteMask);
+
+                const __m128i second =
+                    _mm_and_si128(
+                        _mm_srli_epi32(
+                            _mm_loadu_si128(reinterpret_cast<const __m128i*>(bgra + 4 * x + 16)),
+                            8),
+                        lowByteMask);
+
+                const __m128i packed =
+                    _mm_packus_epi16(
+                        _mm_packs_epi32(first, second),
+                        _mm_setzero_si128());
+
+                _mm_storel_epi64(
+                    reinterpret_cast<__m128i*>(gray + x),
+                    packed);
+            }
+#endif /* IMAGE_QUALITY_USE_SSE2 */
+
+            for (; x < width; ++x)
+            {
+                gray[x] = bgra[4 * x + 1];
+            }
+        }
+    }
+
+    _Use_decl_annotations_
+    bool IsPoseValid(
+        const Windows::Foundation::Numerics::float4x4& frameToOrigin)
+    {
+        return 0.0f != frameToOrigin.m44;
+    }
+
+    _Use_decl_annotations_
+    void ComputePoseDelta(
+        const Windows::Foundation::Numerics::float4x4& frameToOrigin,
+        const Windows::Foundation::Numerics::float4x4& otherFrameToOrigin,
+        float* translation,
+        float* rotationInDegrees)
+    {
+        const float dx = frameToOrigin.m41 - otherFrameToOrigin.m41;
+        const float dy = frameToOrigin.m42 - otherFrameToOrigin.m42;
+        const float dz = frameToOrigin.m43 - otherFrameToOrigin.m43;
+
+        *translation =
+            sqrtf(dx * dx + dy * dy + dz * dz);
+
+        //
+        // The angle of the relative rotation follows from trace(R1 * R2^T), which is the
+        // sum of the element-wise products of the two rotation matrices.
+        //
+        const float trace =
+            frameToOrigin.m11 * otherFrameToOrigin.m11 + frameToOrigin.m12 * otherFrameToOrigin.m12 + frameToOrigin.m13 * otherFrameToOrigin.m13 +
+            frameToOrigin.m21 * otherFrameToOrigin.m21 + frameToOrigin.m22 * otherFrameToOrigin.m22 + frameToOrigin.m23 * otherFrameToOrigin.m23 +
+            frameToOrigin.m31 * otherFrameToOrigin.m31 + frameToOrigin.m32 * otherFrameToOrigin.m32 + frameToOrigin.m33 * otherFrameToOrigin.m33;
+
+        const float cosAngle =
+            std::min(1.0f, std::max(-1.0f, 0.5f * (trace - 1.0f)));
+
+        *rotationInDegrees =
+            acosf(cosAngle) * 180.0f / DirectX::XM_PI;
+    }
+
+    _Use_decl_annotations_
+    void ImageQualityScorer::ScoreGray8(
+        const uint8_t* pixels,
+        uint32_t width,
+        uint32_t height,
+        uint32_t rowStride,
+        ImageQualityScores* scores)
+    {
+        memset(
+            scores,
+            0 /* _Val */,
+            sizeof(*scores));
+
+        if (0 == width || 0 == height)
+        {
+            return;
+        }
+
+        IntensityAccumulators intensity = {};
+        LaplacianAccumulators laplacian = {};
+
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            const uint8_t* row =
+                pixels + (size_t)y * rowStride;
+
+            AccumulateIntensityRow(
+                row,
+                width,
+                &intensity);
+
+            if (0 < y && y + 1 < height)
+            {
+                AccumulateLaplacianRow(
+                    row - rowStride,
+                    row,
+                    row + rowStride,
+                    width,
+                    &laplacian);
+            }
+        }
+
+        const double pixelCount =
+            (double)width * height;
+
+        const double mean =
+            intensity.Sum / pixelCount;
+
+        scores->Valid = true;
+        scores->MeanIntensity = (float)mean;
+        scores->IntensityStdDev = (float)sqrt(std::max(0.0, intensity.SumOfSquares / pixelCount - mean * mean));
+        scores->UnderexposedFraction = (float)(intensity.Underexposed / pixelCount);
+        scores->OverexposedFraction = (float)(intensity.Overexposed / pixelCount);
+
+        if (0 < laplacian.Count)
+        {
+            const double laplacianMean =
+                (double)laplacian.Sum / laplacian.Count;
+
+            scores->Sharpness = (float)std::max(
+                0.0,
+                (double)laplacian.SumOfSquares / laplacian.Count - laplacianMean * laplacianMean);
+        }
+    }
+
+    _Use_decl_annotations_
+    void ImageQualityScorer::ScoreBgra8(
+        const uint8_t* pixels,
+        uint32_t width,
+        uint32_t height,
+        uint32_t rowStride,
+        ImageQualityScores* scores)
+    {
+        _grayScratch.resize(
+            (size_t)width * height);
+
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            ExtractGreenChannel(
+                pixels + (size_t)y * rowStride,
+                width,
+                _grayScratch.data() + (size_t)y * width);
+        }
+
+        ScoreGray8(
+            _grayScratch.data(),
+            width,
+            height,
+            width /* rowStride */,
+            scores);
+    }
+
+    _Use_decl_annotations_
+    KeyframeSelector::KeyframeSelector(
+        float minimumTranslationInMeters,
+        float minimumRotationInDegrees,
+        Io::HundredsOfNanoseconds maximumInterval,
+        float minimumRelativeSharpness,
+        float maximumClippedFraction)
+        : _minimumTranslationInMeters(minimumTranslationInMeters)
+        , _minimumRotationInDegrees(minimumRotationInDegrees)
+        , _maximumInterval(maximumInterval)
+        , _minimumRelativeSharpness(minimumRelativeSharpness)
+        , _maximumClippedFraction(maximumClippedFraction)
+    {
+        Reset();
+    }
+
+    void KeyframeSelector::Reset()
+    {
+        _averageSharpness = 0.0f;
+        _keyframeSeen = false;
+        _lastKeyframeTimestamp = 0;
+        _lastKeyframePoseValid = false;
+
+        memset(
+            &_lastKeyframeToOrigin,
+            0 /* _Val */,
+            sizeof(_lastKeyframeToOrigin));
+    }
+
+    _Use_decl_annotations_
+    bool KeyframeSelector::Evaluate(
+        const Windows::Foundation::DateTime& timestamp,
+        const Windows::Foundation::Numerics::float4x4& frameToOrigin,
+        const ImageQualityScores& scores,
+        float* poseDeltaTranslation,
+        float* poseDeltaRotationInDegrees)
+    {
+        *poseDeltaTranslation = 0.0f;
+        *poseDeltaRotationInDegrees = 0.0f;
+
+        const bool poseValid =
+            IsPoseValid(frameToOrigin);
+
+        if (poseValid && _lastKeyframePoseValid)
+        {
+            ComputePoseDelta(
+                frameToOrigin,
+                _lastKeyframeToOrigin,
+                poseDeltaTranslation,
+                poseDeltaRotationInDegrees);
+        }
+
+        //
+        // Judge the sharpness relative to the recent frames, as the absolute values depend
+        // heavily on the sensor and the scene.
+        //
+        bool qualityAcceptable = true;
+
+        if (scores.Valid)
+        {
+            if (0.0f == _averageSharpness)
+            {
+                _averageSharpness = scores.Sharpness;
+            }
+            else
+            {
+                _averageSharpness = 0.9f * _averageSharpness + 0.1f * scores.Sharpness;
+            }
+
+            qualityAcceptable =
+                scores.Sharpness >= _minimumRelativeSharpness * _averageSharpness &&
+                scores.UnderexposedFraction + scores.OverexposedFraction <= _maximumClippedFraction;
+        }
+
+        bool isKeyframe = false;
+
+        if (!_keyframeSeen)
+        {
+            isKeyframe = qualityAcceptable;
+        }
+        else
+        {
+            const Io::HundredsOfNanoseconds sinceLastKeyframe(
+                timestamp.UniversalTime - _lastKeyframeTimestamp);
+
+            const bool movedEnough =
+                *poseDeltaTranslation >= _minimumTranslationInMeters ||
+                *poseDeltaRotationInDegrees >= _minimumRotationInDegrees;
+
+            //
+            // Without a usable pose we fall back to sampling in time. Past twice the maximum
+            // interval we accept the frame regardless of its quality to avoid long gaps.
+            //
+            isKeyframe =
+                (qualityAcceptable && (movedEnough || sinceLastKeyframe >= _maximumInterval)) ||
+                sinceLastKeyframe >= 2 * _maximumInterval;
+        }
+
+        if (isKeyframe)
+        {
+            _keyframeSeen = true;
+            _lastKeyframeTimestamp = timestamp.UniversalTime;
+            _lastKeyframePoseValid = poseValid;
+            _lastKeyframeToOrigin = frameToOrigin;
+        }
+
+        return isKeyframe;
+    }
+}
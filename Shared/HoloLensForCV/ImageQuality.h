@@ -0,0 +1,124 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#pragma once
+
+namespace HoloLensForCV
+{
+    //
+    // Per-frame image quality measures. Only intensity images are scored; for other
+    // frames (e.g. depth) Valid is false and all measures are zero.
+    //
+    struct ImageQualityScores
+    {
+        bool Valid;
+
+        // Variance of the 4-neighborhood Laplacian; low values indicate blur.
+        float Sharpness;
+
+        // Intensity statistics in the [0..255] range.
+        float MeanIntensity;
+        float IntensityStdDev;
+
+        // Fractions of pixels at the dark and bright ends of the histogram.
+        float UnderexposedFraction;
+        float OverexposedFraction;
+    };
+
+    //
+    // Scores 8-bit intensity images cheaply enough to run in the recorder path. The
+    // inner loops use SSE2 on x86/x64 and fall back to scalar code on ARM.
+    //
+    class ImageQualityScorer
+    {
+    public:
+        void ScoreGray8(
+            _In_reads_(rowStride * height) const uint8_t* pixels,
+            _In_ uint32_t width,
+            _In_ uint32_t height,
+            _In_ uint32_t rowStride,
+            _Out_ ImageQualityScores* scores);
+
+        //
+        // Scores the green channel of a BGRA image, a good approximation of luma.
+        //
+        void ScoreBgra8(
+            _In_reads_(rowStride * height) const uint8_t* pixels,
+            _In_ uint32_t width,
+            _In_ uint32_t height,
+            _In_ uint32_t rowStride,
+            _Out_ ImageQualityScores* scores);
+
+        static const uint8_t UnderexposedIntensity = 16;
+        static const uint8_t OverexposedIntensity = 239;
+
+    private:
+        std::vector<uint8_t> _grayScratch;
+    };
+
+    //
+    // Returns false for the zeroed transform MediaFrameReaderContext reports when no pose
+    // is available.
+    //
+    bool IsPoseValid(
+        _In_ const Windows::Foundation::Numerics::float4x4& frameToOrigin);
+
+    //
+    // Distance (in meters) and rotation angle (in degrees) between two device poses.
+    //
+    void ComputePoseDelta(
+        _In_ const Windows::Foundation::Numerics::float4x4& frameToOrigin,
+        _In_ const Windows::Foundation::Numerics::float4x4& otherFrameToOrigin,
+        _Out_ float* translation,
+        _Out_ float* rotationInDegrees);
+
+    //
+    // Decides whether a frame should be kept as a keyframe, based on its quality relative
+    // to the recent frames and on how far the device moved since the last keyframe.
+    //
+    class KeyframeSelector
+    {
+    public:
+        KeyframeSelector(
+            _In_ float minimumTranslationInMeters = 0.1f,
+            _In_ float minimumRotationInDegrees = 10.0f,
+            _In_ Io::HundredsOfNanoseconds maximumInterval = std::chrono::seconds(2),
+            _In_ float minimumRelativeSharpness = 0.6f,
+            _In_ float maximumClippedFraction = 0.5f);
+
+        void Reset();
+
+        //
+        // Returns true if the frame is selected as a keyframe. The pose deltas are
+        // relative to the last keyframe and zero if either pose is unknown.
+        //
+        bool Evaluate(
+            _In_ const Windows::Foundation::DateTime& timestamp,
+            _In_ const Windows::Foundation::Numerics::float4x4& frameToOrigin,
+            _In_ const ImageQualityScores& scores,
+            _Out_ float* poseDeltaTranslation,
+            _Out_ float* poseDeltaRotationInDegrees);
+
+    private:
+        float _minimumTranslationInMeters;
+        float _minimumRotationInDegrees;
+        Io::HundredsOfNanoseconds _maximumInterval;
+        float _minimumRelativeSharpness;
+        float _maximumClippedFraction;
+
+        float _averageSharpness;
+
+        bool _keyframeSeen;
+        int64_t _lastKeyframeTimestamp;
+        bool _lastKeyframePoseValid;
+        Windows::Foundation::Numerics::float4x4 _lastKeyframeToOrigin;
+    };
+}
@@ -20,6 +20,11 @@ namespace HoloLensForCV
         : _sensorType(sensorType)
         , _spatialPerception(spatialPerception)
         , _sensorFrameSink(sensorFrameSink)
+        , _nextSequenceNumber(0)
+        , _previousRelativeTimestamp(0)
+        , _framesCaptured(0)
+        , _framesMissed(0)
+        , _framesLate(0)
     {
     }
 
@@ -36,6 +41,73 @@ namespace HoloLensForCV
         return latestSensorFrame;
     }
 
+    void MediaFrameReaderContext::UpdateCaptureCounters(
+        _In_ Windows::Media::Capture::Frames::MediaFrameReference^ frame)
+    {
+        const int64_t relativeTimestamp =
+            frame->SystemRelativeTime->Value.Duration;
+
+        //
+        // Determine the nominal frame period in hundreds of nanoseconds. Some of the
+        // research mode streams do not report a frame rate, in which case we can neither
+        // estimate missed frames nor judge lateness.
+        //
+        int64_t framePeriod = 0;
+
+        if (nullptr != frame->Format &&
+            nullptr != frame->Format->FrameRate &&
+            0 != frame->Format->FrameRate->Numerator)
+        {
+            framePeriod =
+                (10000000ll * frame->Format->FrameRate->Denominator) /
+                frame->Format->FrameRate->Numerator;
+        }
+
+        if (0 < framePeriod && 0 != _previousRelativeTimestamp)
+        {
+            const int64_t exposureDelta =
+                relativeTimestamp - _previousRelativeTimestamp;
+
+            //
+            // Round to the nearest whole number of frame periods; anything beyond one period
+            // corresponds to frames that the reader discarded before we got to acquire them.
+            //
+            const int64_t framePeriodsElapsed =
+                (exposureDelta + framePeriod / 2) / framePeriod;
+
+            if (1 < framePeriodsElapsed)
+            {
+                _framesMissed += framePeriodsElapsed - 1;
+
+#if DBG_ENABLE_VERBOSE_LOGGING
+                dbg::trace(
+                    L"MediaFrameReaderContext::UpdateCaptureCounters: _sensorType=%s (%i), missed %lli frame(s)",
+                    _sensorType.ToString()->Data(),
+                    (int32_t)_sensorType,
+                    framePeriodsElapsed - 1);
+#endif /* DBG_ENABLE_VERBOSE_LOGGING */
+            }
+        }
+
+        _previousRelativeTimestamp = relativeTimestamp;
+
+        if (0 < framePeriod)
+        {
+            LARGE_INTEGER qpc;
+
+            ASSERT(QueryPerformanceCounter(
+                &qpc));
+
+            const int64_t arrivalLatency =
+                _timeConverter.QpcToRelativeTicks(qpc).count() - relativeTimestamp;
+
+            if (arrivalLatency > LateFrameThresholdInFrames * framePeriod)
+            {
+                ++_framesLate;
+            }
+        }
+    }
+
     void MediaFrameReaderContext::FrameArrived(
         Windows::Media::Capture::Frames::MediaFrameReader^ sender,
         Windows::Media::Capture::Frames::MediaFrameArrivedEventArgs^ args)
@@ -120,6 +192,15 @@ namespace HoloLensForCV
         SensorFrame^ sensorFrame =
             ref new SensorFrame(_sensorType, timestamp, softwareBitmap);
 
+        //
+        // Assign the sequence number and account for any frames we have not seen.
+        //
+        sensorFrame->SequenceNumber =
+            _nextSequenceNumber++;
+
+        UpdateCaptureCounters(
+            frame);
+
         //
         // Extract the frame-to-origin transform, if the MFT exposed it:
         //
@@ -305,6 +386,8 @@ namespace HoloLensForCV
                 frame->VideoMediaFrame->CameraIntrinsics;
         }
 
+        ++_framesCaptured;
+
         if (nullptr != _sensorFrameSink)
         {
             _sensorFrameSink->Send(
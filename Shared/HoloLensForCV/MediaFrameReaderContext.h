@@ -27,6 +27,37 @@ namespace HoloLensForCV
 
         SensorFrame^ GetLatestSensorFrame();
 
+        /// <summary>
+        /// Number of frames acquired from the MediaFrameReader and handed to the sink.
+        /// </summary>
+        property uint64_t FramesCaptured
+        {
+            uint64_t get() { return _framesCaptured; }
+        }
+
+        /// <summary>
+        /// Estimated number of frames the media frame reader skipped before we could
+        /// acquire them, derived from exposure timestamp gaps and the nominal frame rate.
+        /// </summary>
+        property uint64_t FramesMissed
+        {
+            uint64_t get() { return _framesMissed; }
+        }
+
+        /// <summary>
+        /// Number of frames which arrived more than LateFrameThresholdInFrames frame
+        /// periods after their exposure.
+        /// </summary>
+        property uint64_t FramesLate
+        {
+            uint64_t get() { return _framesLate; }
+        }
+
+        static property uint32_t LateFrameThresholdInFrames
+        {
+            uint32_t get() { return 2; }
+        }
+
         /// <summary>
         /// Handler for frames which arrive from the MediaFrameReader.
         /// </summary>
@@ -34,6 +65,10 @@ namespace HoloLensForCV
             Windows::Media::Capture::Frames::MediaFrameReader^ sender,
             Windows::Media::Capture::Frames::MediaFrameArrivedEventArgs^ args);
 
+    private:
+        void UpdateCaptureCounters(
+            _In_ Windows::Media::Capture::Frames::MediaFrameReference^ frame);
+
     private:
         SensorType _sensorType;
         SpatialPerception^ _spatialPerception;
@@ -43,5 +78,17 @@ namespace HoloLensForCV
 
         std::mutex _latestSensorFrameMutex;
         SensorFrame^ _latestSensorFrame;
+
+        //
+        // FrameArrived is serialized per reader, so the sequence number and the previous
+        // exposure time are only touched on that path. The counters are read from other
+        // threads, hence atomic.
+        //
+        uint64_t _nextSequenceNumber;
+        int64_t _previousRelativeTimestamp;
+
+        std::atomic<uint64_t> _framesCaptured;
+        std::atomic<uint64_t> _framesMissed;
+        std::atomic<uint64_t> _framesLate;
     };
 }
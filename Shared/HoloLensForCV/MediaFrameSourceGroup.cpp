@@ -112,6 +112,19 @@ namespace HoloLensForCV
         return _frameReaders[sensorTypeAsIndex]->GetLatestSensorFrame();
     }
 
+    MediaFrameReaderContext^ MediaFrameSourceGroup::GetMediaFrameReaderContext(
+        SensorType sensorType)
+    {
+        const int32_t sensorTypeAsIndex =
+            (int32_t)sensorType;
+
+        REQUIRES(
+            0 <= sensorTypeAsIndex &&
+            sensorTypeAsIndex < (int32_t)_frameReaders.size());
+
+        return _frameReaders[sensorTypeAsIndex];
+    }
+
     Concurrency::task<void> MediaFrameSourceGroup::InitializeMediaSourceWorkerAsync()
     {
         return CleanupMediaCaptureAsync()
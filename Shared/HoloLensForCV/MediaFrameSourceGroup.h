@@ -36,6 +36,13 @@ namespace HoloLensForCV
         SensorFrame^ GetLatestSensorFrame(
             SensorType sensorType);
 
+        /// <summary>
+        /// Returns the frame reader context for the sensor, exposing the capture-side
+        /// frame counters, or null if the sensor is not streaming.
+        /// </summary>
+        MediaFrameReaderContext^ GetMediaFrameReaderContext(
+            SensorType sensorType);
+
     private:
         /// <summary>
         /// Returns true if the sensor was explicitly enabled by the user.
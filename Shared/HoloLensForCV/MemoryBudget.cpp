@@ -0,0 +1,524 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#include "pch.h"
+
+namespace HoloLensForCV
+{
+    namespace
+    {
+        //
+        // The pools hold a part of the memory of the app only, so the default limits of
+        // the budget leave room for everything else.
+        //
+        const uint64_t c_softLimitPercentOfAppLimit = 25;
+        const uint64_t c_hardLimitPercentOfAppLimit = 40;
+
+        // Used when the system does not report a limit
+        const uint64_t c_defaultSoftLimit = 256ull * 1024 * 1024;
+        const uint64_t c_defaultHardLimit = 512ull * 1024 * 1024;
+    }
+
+    _Use_decl_annotations_
+    MemoryPool::MemoryPool(
+        MemoryBudget^ budget,
+        const std::wstring& name,
+        MemoryPoolPriority priority,
+        uint64_t softLimit,
+        uint64_t hardLimit,
+        const MemoryPoolReleaseCallback& releaseCallback)
+        : _budget(budget)
+        , _name(name)
+        , _priority(priority)
+        , _softLimit(softLimit)
+        , _hardLimit(hardLimit)
+        , _releaseCallback(releaseCallback)
+        , _usage(0)
+    {
+        REQUIRES(nullptr != budget);
+        REQUIRES(softLimit <= hardLimit);
+
+        _budget->RegisterPool(
+            this);
+    }
+
+    MemoryPool::~MemoryPool()
+    {
+        _budget->UnregisterPool(
+            this);
+
+        _budget->Release(
+            _usage);
+    }
+
+    _Use_decl_annotations_
+    bool MemoryPool::TryReserve(
+        uint64_t size)
+    {
+        const uint64_t usage =
+            _usage.fetch_add(size) + size;
+
+        if (usage > _hardLimit)
+        {
+            _usage.fetch_sub(size);
+
+            _budget->CountRefusedReservation();
+            _budget->RequestRelease();
+
+            return false;
+        }
+
+        if (!_budget->TryReserve(size, _priority))
+        {
+            _usage.fetch_sub(size);
+
+            return false;
+        }
+
+        if (usage > _softLimit)
+        {
+            _budget->RequestRelease();
+        }
+
+        return true;
+    }
+
+    _Use_decl_annotations_
+    void MemoryPool::Reserve(
+        uint64_t size)
+    {
+        const uint64_t usage =
+            _usage.fetch_add(size) + size;
+
+        _budget->Reserve(
+            size);
+
+        if (usage > _softLimit)
+        {
+            _budget->RequestRelease();
+        }
+    }
+
+    _Use_decl_annotations_
+    void MemoryPool::Release(
+        uint64_t size)
+    {
+        ASSERT(size <= _usage);
+
+        _usage.fetch_sub(size);
+
+        _budget->Release(
+            size);
+    }
+
+    uint64_t MemoryPool::GetUsage() const
+    {
+        return _usage;
+    }
+
+    const std::wstring& MemoryPool::GetName() const
+    {
+        return _name;
+    }
+
+    MemoryPoolPriority MemoryPool::GetPriority() const
+    {
+        return _priority;
+    }
+
+    uint64_t MemoryPool::GetSoftLimit() const
+    {
+        return _softLimit;
+    }
+
+    _Use_decl_annotations_
+    void MemoryPool::ReleaseUnderPressure(
+        uint64_t size)
+    {
+        if (_releaseCallback)
+        {
+            _releaseCallback(
+                size);
+        }
+    }
+
+    MemoryBudget::MemoryBudget()
+        : _softLimit(c_defaultSoftLimit)
+        , _hardLimit(c_defaultHardLimit)
+        , _limitsSet(false)
+        , _usage(0)
+        , _peakUsage(0)
+        , _reservationsRefused(0)
+        , _bytesReleased(0)
+        , _systemPressure(false)
+        , _releasePending(false)
+    {
+        SetDefaultLimits(
+            Windows::System::MemoryManager::AppMemoryUsageLimit);
+
+        Windows::System::MemoryManager::AppMemoryUsageIncreased +=
+            ref new Windows::Foundation::EventHandler<Platform::Object^>(
+                this,
+                &MemoryBudget::OnAppMemoryUsageChanged);
+
+        Windows::System::MemoryManager::AppMemoryUsageDecreased +=
+            ref new Windows::Foundation::EventHandler<Platform::Object^>(
+                this,
+                &MemoryBudget::OnAppMemoryUsageChanged);
+
+        Windows::System::MemoryManager::AppMemoryUsageLimitChanging +=
+            ref new Windows::Foundation::EventHandler<Windows::System::AppMemoryUsageLimitChangingEventArgs^>(
+                this,
+                &MemoryBudget::OnAppMemoryUsageLimitChanging);
+    }
+
+    MemoryBudget^ MemoryBudget::Default::get()
+    {
+        static MemoryBudget^ s_default =
+            ref new MemoryBudget();
+
+        return s_default;
+    }
+
+    _Use_decl_annotations_
+    void MemoryBudget::SetLimits(
+        uint64_t softLimit,
+        uint64_t hardLimit)
+    {
+        REQUIRES(softLimit <= hardLimit);
+
+        _limitsSet = true;
+        _softLimit = softLimit;
+        _hardLimit = hardLimit;
+
+        if (_usage > softLimit)
+        {
+            RequestRelease();
+        }
+    }
+
+    _Use_decl_annotations_
+    void MemoryBudget::SetDefaultLimits(
+        uint64_t appMemoryUsageLimit)
+    {
+        if (_limitsSet || 0 == appMemoryUsageLimit)
+        {
+            return;
+        }
+
+        _softLimit = appMemoryUsageLimit / 100 * c_softLimitPercentOfAppLimit;
+        _hardLimit = appMemoryUsageLimit / 100 * c_hardLimitPercentOfAppLimit;
+
+#if DBG_ENABLE_INFORMATIONAL_LOGGING
+        dbg::trace(
+            L"MemoryBudget::SetDefaultLimits: app limit %llu MB, soft limit %llu MB, hard limit %llu MB",
+            appMemoryUsageLimit / (1024 * 1024),
+            _softLimit / (1024 * 1024),
+            _hardLimit / (1024 * 1024));
+#endif /* DBG_ENABLE_INFORMATIONAL_LOGGING */
+    }
+
+    MemoryPressureLevel MemoryBudget::PressureLevel::get()
+    {
+        const uint64_t usage = _usage;
+
+        if (_systemPressure || usage > _hardLimit)
+        {
+            return MemoryPressureLevel::Hard;
+        }
+
+        if (usage > _softLimit)
+        {
+            return MemoryPressureLevel::Soft;
+        }
+
+        return MemoryPressureLevel::Normal;
+    }
+
+    Windows::Foundation::Collections::IMapView<Platform::String^, uint64_t>^ MemoryBudget::GetPoolUsage()
+    {
+        std::map<std::wstring, uint64_t> poolUsage;
+
+        {
+            std::lock_guard<std::mutex> guard(_poolsMutex);
+
+            for (const MemoryPool* pool : _pools)
+            {
+                poolUsage[pool->GetName()] += pool->GetUsage();
+            }
+        }
+
+        Platform::Collections::Map<Platform::String^, uint64_t>^ poolUsageMap =
+            ref new Platform::Collections::Map<Platform::String^, uint64_t>();
+
+        for (const auto& poolUsageIterator : poolUsage)
+        {
+            poolUsageMap->Insert(
+                ref new Platform::String(poolUsageIterator.first.c_str()),
+                poolUsageIterator.second);
+        }
+
+        return poolUsageMap->GetView();
+    }
+
+    _Use_decl_annotations_
+    void MemoryBudget::RegisterPool(
+        MemoryPool* pool)
+    {
+        std::lock_guard<std::mutex> guard(_poolsMutex);
+
+        _pools.push_back(
+            pool);
+    }
+
+    _Use_decl_annotations_
+    void MemoryBudget::UnregisterPool(
+        MemoryPool* pool)
+    {
+        std::lock_guard<std::mutex> guard(_poolsMutex);
+
+        _pools.erase(
+            std::remove(_pools.begin(), _pools.end(), pool),
+            _pools.end());
+    }
+
+    _Use_decl_annotations_
+    bool MemoryBudget::TryReserve(
+        uint64_t size,
+        MemoryPoolPriority priority)
+    {
+        const uint64_t usage =
+            _usage.fetch_add(size) + size;
+
+        if (MemoryPoolPriority::High != priority && (usage > _hardLimit || _systemPressure))
+        {
+            _usage.fetch_sub(size);
+
+            CountRefusedReservation();
+            RequestRelease();
+
+            return false;
+        }
+
+        UpdatePeakUsage(
+            usage);
+
+        if (usage > _softLimit)
+        {
+            RequestRelease();
+        }
+
+        return true;
+    }
+
+    _Use_decl_annotations_
+    void MemoryBudget::Reserve(
+        uint64_t size)
+    {
+        const uint64_t usage =
+            _usage.fetch_add(size) + size;
+
+        UpdatePeakUsage(
+            usage);
+
+        if (usage > _softLimit)
+        {
+            RequestRelease();
+        }
+    }
+
+    _Use_decl_annotations_
+    void MemoryBudget::Release(
+        uint64_t size)
+    {
+        _usage.fetch_sub(size);
+    }
+
+    void MemoryBudget::CountRefusedReservation()
+    {
+        ++_reservationsRefused;
+    }
+
+    _Use_decl_annotations_
+    void MemoryBudget::UpdatePeakUsage(
+        uint64_t usage)
+    {
+        uint64_t peakUsage = _peakUsage;
+
+        while (usage > peakUsage && !_peakUsage.compare_exchange_weak(peakUsage, usage))
+        {
+        }
+    }
+
+    void MemoryBudget::RequestRelease()
+    {
+        //
+        // The pools are usually over their limits while the caller holds their locks, so
+        // the release callbacks, which take the same locks, run on a background thread.
+        //
+        if (_releasePending.exchange(true))
+        {
+            return;
+        }
+
+        concurrency::create_task([this]()
+        {
+            ReleaseUnderPressure();
+
+            _releasePending = false;
+        });
+    }
+
+    void MemoryBudget::ReleaseUnderPressure()
+    {
+        std::lock_guard<std::mutex> guard(_poolsMutex);
+
+        std::vector<MemoryPool*> pools =
+            _pools;
+
+        std::stable_sort(
+            pools.begin(),
+            pools.end(),
+            [](const MemoryPool* a, const MemoryPool* b)
+        {
+            return a->GetPriority() < b->GetPriority();
+        });
+
+        const bool systemPressure =
+            _systemPressure;
+
+        const uint64_t usage =
+            _usage;
+
+        int64_t excessUsage =
+            systemPressure ? static_cast<int64_t>(usage) : static_cast<int64_t>(usage) - static_cast<int64_t>(_softLimit.load());
+
+        for (MemoryPool* pool : pools)
+        {
+            const uint64_t poolUsage =
+                pool->GetUsage();
+
+            const uint64_t poolExcessUsage =
+                poolUsage > pool->GetSoftLimit() ? poolUsage - pool->GetSoftLimit() : 0;
+
+            const uint64_t size =
+                std::max(poolExcessUsage, excessUsage > 0 ? std::min(poolUsage, static_cast<uint64_t>(excessUsage)) : 0);
+
+            if (0 == size)
+            {
+                continue;
+            }
+
+            pool->ReleaseUnderPressure(
+                size);
+
+            const uint64_t newPoolUsage =
+                pool->GetUsage();
+
+            if (newPoolUsage < poolUsage)
+            {
+                _bytesReleased += poolUsage - newPoolUsage;
+                excessUsage -= static_cast<int64_t>(poolUsage - newPoolUsage);
+            }
+
+#if DBG_ENABLE_VERBOSE_LOGGING
+            dbg::trace(
+                L"MemoryBudget::ReleaseUnderPressure: asked %s for %llu bytes, released %llu bytes",
+                pool->GetName().c_str(),
+                size,
+                newPoolUsage < poolUsage ? poolUsage - newPoolUsage : 0);
+#endif /* DBG_ENABLE_VERBOSE_LOGGING */
+        }
+
+#if DBG_ENABLE_INFORMATIONAL_LOGGING
+        if (excessUsage > 0 && !systemPressure)
+        {
+            dbg::trace(
+                L"MemoryBudget::ReleaseUnderPressure: still %lld bytes over the soft limit",
+                excessUsage);
+        }
+#endif /* DBG_ENABLE_INFORMATIONAL_LOGGING */
+    }
+
+    _Use_decl_annotations_
+    void MemoryBudget::OnAppMemoryUsageChanged(
+        Platform::Object^ /* sender */,
+        Platform::Object^ /* args */)
+    {
+        const Windows::System::AppMemoryUsageLevel level =
+            Windows::System::MemoryManager::AppMemoryUsageLevel;
+
+        const bool systemPressure =
+            Windows::System::AppMemoryUsageLevel::High == level ||
+            Windows::System::AppMemoryUsageLevel::OverLimit == level;
+
+        if (systemPressure != _systemPressure.exchange(systemPressure))
+        {
+#if DBG_ENABLE_INFORMATIONAL_LOGGING
+            dbg::trace(
+                L"MemoryBudget::OnAppMemoryUsageChanged: system memory pressure %s, app usage %llu MB",
+                systemPressure ? L"raised" : L"cleared",
+                Windows::System::MemoryManager::AppMemoryUsage / (1024 * 1024));
+#endif /* DBG_ENABLE_INFORMATIONAL_LOGGING */
+
+            if (systemPressure)
+            {
+                RequestRelease();
+            }
+        }
+    }
+
+    _Use_decl_annotations_
+    void MemoryBudget::OnAppMemoryUsageLimitChanging(
+        Platform::Object^ /* sender */,
+        Windows::System::AppMemoryUsageLimitChangingEventArgs^ args)
+    {
+        SetDefaultLimits(
+            args->NewLimit);
+
+        if (_usage > _softLimit)
+        {
+            RequestRelease();
+        }
+    }
+
+    _Use_decl_annotations_
+    uint64_t GetSensorFrameMemorySize(
+        SensorFrame^ sensorFrame)
+    {
+        Windows::Graphics::Imaging::SoftwareBitmap^ softwareBitmap =
+            sensorFrame->SoftwareBitmap;
+
+        if (nullptr == softwareBitmap)
+        {
+            return 0;
+        }
+
+        const uint64_t numberOfPixels =
+            static_cast<uint64_t>(softwareBitmap->PixelWidth) * softwareBitmap->PixelHeight;
+
+        switch (softwareBitmap->BitmapPixelFormat)
+        {
+        case Windows::Graphics::Imaging::BitmapPixelFormat::Gray8:
+            return numberOfPixels;
+
+        case Windows::Graphics::Imaging::BitmapPixelFormat::Gray16:
+        case Windows::Graphics::Imaging::BitmapPixelFormat::Yuy2:
+            return numberOfPixels * 2;
+
+        case Windows::Graphics::Imaging::BitmapPixelFormat::Nv12:
+            return numberOfPixels * 3 / 2;
+
+        default:
+            return numberOfPixels * 4;
+        }
+    }
+}
@@ -0,0 +1,290 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#pragma once
+
+namespace HoloLensForCV
+{
+    /// <summary>
+    /// The order in which memory pools give up memory under pressure.
+    /// </summary>
+    public enum class MemoryPoolPriority
+    {
+        /// <summary>
+        /// Caches of data which can be dropped or recomputed. Released first, and refused
+        /// reservations over the hard limit of the budget.
+        /// </summary>
+        Low,
+
+        /// <summary>
+        /// Buffers and queues whose loss drops frames, e.g. of a live stream. Released
+        /// after the Low pools, and refused reservations over the hard limit of the budget.
+        /// </summary>
+        Normal,
+
+        /// <summary>
+        /// Data which must not be lost, e.g. frames being recorded. Released last, and only
+        /// limited by the hard limit of the pool itself.
+        /// </summary>
+        High
+    };
+
+    /// <summary>
+    /// How close the usage of the memory budget is to its limits.
+    /// </summary>
+    public enum class MemoryPressureLevel
+    {
+        /// <summary>
+        /// The usage is below the soft limit of the budget.
+        /// </summary>
+        Normal,
+
+        /// <summary>
+        /// The usage is over the soft limit of the budget; the pools are asked to release
+        /// memory.
+        /// </summary>
+        Soft,
+
+        /// <summary>
+        /// The usage is over the hard limit of the budget, or the system reports that the
+        /// app is close to its memory limit; reservations of Low and Normal priority pools
+        /// are refused.
+        /// </summary>
+        Hard
+    };
+
+    ref class MemoryBudget;
+
+    //
+    // Releases up to the given number of bytes of a pool, e.g. by evicting cache entries,
+    // calling MemoryPool::Release for what it frees. Runs on a background thread.
+    //
+    typedef std::function<void(uint64_t size)> MemoryPoolReleaseCallback;
+
+    //
+    // The memory a component accounts to the budget, e.g. for a cache, a frame buffer or
+    // a send queue. Reservations and releases only update atomic counters.
+    //
+    // Components reserve memory before allocating it, and release it after freeing it.
+    // A refused reservation is back-pressure: the component should skip or shrink the
+    // work (e.g. drop the frame) instead of allocating. Above its soft limit, or above the
+    // soft limit of the budget, the release callback of the pool is invoked to bring the
+    // usage back down.
+    //
+    // Destroying the pool unregisters it and returns its remaining usage to the budget,
+    // waiting for a release callback in progress to return; declare it after the state
+    // its release callback uses, so that it is destroyed first.
+    //
+    class MemoryPool
+    {
+    public:
+        MemoryPool(
+            _In_ MemoryBudget^ budget,
+            _In_ const std::wstring& name,
+            _In_ MemoryPoolPriority priority,
+            _In_ uint64_t softLimit,
+            _In_ uint64_t hardLimit,
+            _In_ const MemoryPoolReleaseCallback& releaseCallback);
+
+        ~MemoryPool();
+
+        //
+        // Accounts for an allocation the caller is about to make. Returns false, without
+        // accounting for it, when the allocation would exceed the hard limit of the pool,
+        // or the hard limit of the budget for Low and Normal priority pools.
+        //
+        bool TryReserve(
+            _In_ uint64_t size);
+
+        //
+        // Accounts for an allocation which cannot be refused.
+        //
+        void Reserve(
+            _In_ uint64_t size);
+
+        void Release(
+            _In_ uint64_t size);
+
+        uint64_t GetUsage() const;
+
+        const std::wstring& GetName() const;
+
+        MemoryPoolPriority GetPriority() const;
+
+        uint64_t GetSoftLimit() const;
+
+        //
+        // Invokes the release callback, if any. Called by the budget.
+        //
+        void ReleaseUnderPressure(
+            _In_ uint64_t size);
+
+    private:
+        MemoryBudget^ _budget;
+        std::wstring _name;
+        MemoryPoolPriority _priority;
+        uint64_t _softLimit;
+        uint64_t _hardLimit;
+        MemoryPoolReleaseCallback _releaseCallback;
+
+        std::atomic<uint64_t> _usage;
+    };
+
+    /// <summary>
+    /// Central account of the memory held by the buffers, caches and queues of the
+    /// component, so that a spike in one of them does not get the app terminated. Pools
+    /// register with a priority and soft and hard limits. Over the soft limit of the budget,
+    /// pools release memory in priority order on a background thread; over the hard limit,
+    /// or when the system reports that the app is close to its memory limit, reservations
+    /// of Low and Normal priority pools are refused, which makes them drop work upstream.
+    /// </summary>
+    public ref class MemoryBudget sealed
+    {
+    public:
+        /// <summary>
+        /// The budget shared by all the components. Its limits default to a fraction of
+        /// the memory usage limit of the app.
+        /// </summary>
+        static property MemoryBudget^ Default
+        {
+            MemoryBudget^ get();
+        }
+
+        /// <summary>
+        /// Overrides the default limits, in bytes.
+        /// </summary>
+        void SetLimits(
+            _In_ uint64_t softLimit,
+            _In_ uint64_t hardLimit);
+
+        property uint64_t SoftLimit
+        {
+            uint64_t get() { return _softLimit; }
+        }
+
+        property uint64_t HardLimit
+        {
+            uint64_t get() { return _hardLimit; }
+        }
+
+        /// <summary>
+        /// Bytes currently accounted to all the pools.
+        /// </summary>
+        property uint64_t Usage
+        {
+            uint64_t get() { return _usage; }
+        }
+
+        property uint64_t PeakUsage
+        {
+            uint64_t get() { return _peakUsage; }
+        }
+
+        property MemoryPressureLevel PressureLevel
+        {
+            MemoryPressureLevel get();
+        }
+
+        /// <summary>
+        /// Number of reservations refused since startup.
+        /// </summary>
+        property uint64_t ReservationsRefused
+        {
+            uint64_t get() { return _reservationsRefused; }
+        }
+
+        /// <summary>
+        /// Bytes released by the pools under pressure since startup.
+        /// </summary>
+        property uint64_t BytesReleased
+        {
+            uint64_t get() { return _bytesReleased; }
+        }
+
+        /// <summary>
+        /// Bytes currently accounted to each pool, by pool name.
+        /// </summary>
+        Windows::Foundation::Collections::IMapView<Platform::String^, uint64_t>^ GetPoolUsage();
+
+    internal:
+        void RegisterPool(
+            _In_ MemoryPool* pool);
+
+        void UnregisterPool(
+            _In_ MemoryPool* pool);
+
+        bool TryReserve(
+            _In_ uint64_t size,
+            _In_ MemoryPoolPriority priority);
+
+        void Reserve(
+            _In_ uint64_t size);
+
+        void Release(
+            _In_ uint64_t size);
+
+        void CountRefusedReservation();
+
+        //
+        // Schedules a release pass on a background thread, unless one is pending.
+        //
+        void RequestRelease();
+
+    private:
+        MemoryBudget();
+
+        void SetDefaultLimits(
+            _In_ uint64_t appMemoryUsageLimit);
+
+        void UpdatePeakUsage(
+            _In_ uint64_t usage);
+
+        //
+        // Asks the pools, lowest priority first, to release their usage over their own
+        // soft limits and the usage over the soft limit of the budget (or, under system
+        // pressure, all they can).
+        //
+        void ReleaseUnderPressure();
+
+        void OnAppMemoryUsageChanged(
+            _In_ Platform::Object^ sender,
+            _In_ Platform::Object^ args);
+
+        void OnAppMemoryUsageLimitChanging(
+            _In_ Platform::Object^ sender,
+            _In_ Windows::System::AppMemoryUsageLimitChangingEventArgs^ args);
+
+    private:
+        std::atomic<uint64_t> _softLimit;
+        std::atomic<uint64_t> _hardLimit;
+        std::atomic<bool> _limitsSet;
+
+        std::atomic<uint64_t> _usage;
+        std::atomic<uint64_t> _peakUsage;
+        std::atomic<uint64_t> _reservationsRefused;
+        std::atomic<uint64_t> _bytesReleased;
+
+        // Set while the system reports high memory usage for the app
+        std::atomic<bool> _systemPressure;
+
+        std::atomic<bool> _releasePending;
+
+        // Held while the release callbacks run, so that pools are not destroyed under them
+        std::mutex _poolsMutex;
+        std::vector<MemoryPool*> _pools;
+    };
+
+    //
+    // Approximate memory held by the image of a sensor frame.
+    //
+    uint64_t GetSensorFrameMemorySize(
+        _In_ SensorFrame^ sensorFrame);
+}
@@ -0,0 +1,604 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#include "pch.h"
+
+namespace HoloLensForCV
+{
+    namespace
+    {
+        //
+        // Adds the sums of consecutive groups of BlockSize pixels of an 8-bit row to the
+        // block sums.
+        //
+        void AccumulateGray8BlockSums(
+            _In_reads_(numberOfBlocks * MotionDetector::BlockSize) const uint8_t* row,
+            _In_ uint32_t numberOfBlocks,
+            _Inout_updates_(numberOfBlocks) uint32_t* blockSums)
+        {
+            static_assert(
+                8 == MotionDetector::BlockSize,
+                "The SSE2 code sums the blocks with one 8-byte sum of absolute differences each.");
+
+            uint32_t block = 0;
+
+#if HOLOLENSFORCV_USE_SSE2
+            const __m128i zero = _mm_setzero_si128();
+
+            for (; block + 2 <= numberOfBlocks; block += 2)
+            {
+                const __m128i sums =
+                    _mm_sad_epu8(
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + 8 * block)),
+                        zero);
+
+                blockSums[block] += (uint32_t)_mm_cvtsi128_si32(sums);
+                blockSums[block + 1] += (uint32_t)_mm_extract_epi16(sums, 4);
+            }
+#endif /* HOLOLENSFORCV_USE_SSE2 */
+
+            for (; block < numberOfBlocks; ++block)
+            {
+                const uint8_t* pixels =
+                    row + 8 * block;
+
+                blockSums[block] +=
+                    pixels[0] + pixels[1] + pixels[2] + pixels[3] +
+                    pixels[4] + pixels[5] + pixels[6] + pixels[7];
+            }
+        }
+
+        //
+        // Same for the green channel of a BGRA row, a good approximation of luma.
+        //
+        void AccumulateBgra8GreenBlockSums(
+            _In_reads_(numberOfBlocks * MotionDetector::BlockSize * 4) const uint8_t* row,
+            _In_ uint32_t numberOfBlocks,
+            _Inout_updates_(numberOfBlocks) uint32_t* blockSums)
+        {
+            uint32_t block = 0;
+
+#if HOLOLENSFORCV_USE_SSE2
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i greenMask = _mm_set1_epi32(0x0000ff00);
+
+            for (; block < numberOfBlocks; ++block)
+            {
+                const uint8_t* pixels =
+                    row + 32 * block;
+
+                const __m128i sums =
+                    _mm_add_epi64(
+                        _mm_sad_epu8(
+                            _mm_and_si128(
+                                _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels)),
+                                greenMask),
+                            zero),
+                        _mm_sad_epu8(
+                            _mm_and_si128(
+                                _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + 16)),
+                                greenMask),
+                            zero));
+
+                blockSums[block] +=
+                    (uint32_t)_mm_cvtsi128_si32(sums) + (uint32_t)_mm_extract_epi16(sums, 4);
+            }
+#endif /* HOLOLENSFORCV_USE_SSE2 */
+
+            for (; block < numberOfBlocks; ++block)
+            {
+                const uint8_t* pixels =
+                    row + 32 * block;
+
+                for (uint32_t x = 0; x < 8; ++x)
+                {
+                    blockSums[block] += pixels[4 * x + 1];
+                }
+            }
+        }
+
+        uint64_t SumOfAbsoluteDifferences(
+            _In_reads_(count) const uint8_t* first,
+            _In_reads_(count) const uint8_t* second,
+            _In_ size_t count)
+        {
+            uint64_t sum = 0;
+            size_t i = 0;
+
+#if HOLOLENSFORCV_USE_SSE2
+            __m128i sums = _mm_setzero_si128();
+
+            for (; i + 16 <= count; i += 16)
+            {
+                sums = _mm_add_epi64(
+                    sums,
+                    _mm_sad_epu8(
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + i)),
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + i))));
+            }
+
+            sum +=
+                (uint64_t)_mm_cvtsi128_si32(sums) +
+                (uint64_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+#endif /* HOLOLENSFORCV_USE_SSE2 */
+
+            for (; i < count; ++i)
+            {
+                sum += (uint64_t)std::abs((int32_t)first[i] - (int32_t)second[i]);
+            }
+
+            return sum;
+        }
+    }
+
+    _Use_decl_annotations_
+    MotionDetector::MotionDetector(
+        SensorType sensorType,
+        float translationThresholdInMeters,
+        float rotationThresholdInDegrees,
+        float frameDifferenceThreshold,
+        Io::HundredsOfNanoseconds holdTime)
+        : _sensorType(sensorType)
+        , _translationThresholdInMeters(translationThresholdInMeters)
+        , _rotationThresholdInDegrees(rotationThresholdInDegrees)
+        , _frameDifferenceThreshold(frameDifferenceThreshold)
+        , _holdTime(holdTime)
+    {
+        Reset();
+    }
+
+    void MotionDetector::Reset()
+    {
+        _thumbnailWidth = 0;
+        _thumbnailHeight = 0;
+        _thumbnailSum = 0;
+
+        _referenceSeen = false;
+        _referencePoseValid = false;
+
+        memset(
+            &_referenceFrameToOrigin,
+            0 /* _Val */,
+            sizeof(_referenceFrameToOrigin));
+
+        _referenceThumbnailValid = false;
+        _referenceThumbnailWidth = 0;
+        _referenceThumbnailHeight = 0;
+        _referenceThumbnailSum = 0;
+
+        _motionSeen = false;
+        _lastMotionTimestamp = 0;
+    }
+
+    _Use_decl_annotations_
+    bool MotionDetector::Evaluate(
+        SensorFrame^ sensorFrame,
+        MotionMeasures* measures)
+    {
+        memset(
+            measures,
+            0 /* _Val */,
+            sizeof(*measures));
+
+        const int64_t timestamp =
+            sensorFrame->Timestamp.UniversalTime;
+
+        const Windows::Foundation::Numerics::float4x4 frameToOrigin =
+            sensorFrame->FrameToOrigin;
+
+        const bool poseValid =
+            IsPoseValid(frameToOrigin);
+
+        const bool thumbnailValid =
+            nullptr != sensorFrame->SoftwareBitmap &&
+            Downsample(sensorFrame->SoftwareBitmap);
+
+        bool motionDetected = true;
+
+        if (_referenceSeen)
+        {
+            bool motionMeasured = false;
+
+            motionDetected = false;
+
+            if (poseValid && _referencePoseValid)
+            {
+                ComputePoseDelta(
+                    frameToOrigin,
+                    _referenceFrameToOrigin,
+                    &measures->PoseDeltaTranslation,
+                    &measures->PoseDeltaRotationInDegrees);
+
+                motionMeasured = true;
+
+                motionDetected =
+                    measures->PoseDeltaTranslation >= _translationThresholdInMeters ||
+                    measures->PoseDeltaRotationInDegrees >= _rotationThresholdInDegrees;
+            }
+
+            if (thumbnailValid && _referenceThumbnailValid &&
+                _thumbnailWidth == _referenceThumbnailWidth &&
+                _thumbnailHeight == _referenceThumbnailHeight)
+            {
+                const double count =
+                    (double)_thumbnail.size();
+
+                const double meanAbsoluteDifference =
+                    SumOfAbsoluteDifferences(
+                        _thumbnail.data(),
+                        _referenceThumbnail.data(),
+                        _thumbnail.size()) / count;
+
+                const double meanDifference =
+                    ((double)_thumbnailSum - (double)_referenceThumbnailSum) / count;
+
+                measures->FrameDifferenceValid = true;
+                measures->FrameDifference =
+                    (float)std::max(0.0, meanAbsoluteDifference - std::abs(meanDifference));
+
+                motionMeasured = true;
+
+                motionDetected =
+                    motionDetected ||
+                    measures->FrameDifference >= _frameDifferenceThreshold;
+            }
+
+            //
+            // Without anything to compare, assume motion rather than withhold the frames.
+            //
+            motionDetected =
+                motionDetected || !motionMeasured;
+        }
+
+        if (motionDetected)
+        {
+            _referenceSeen = true;
+            _referencePoseValid = poseValid;
+            _referenceFrameToOrigin = frameToOrigin;
+            _referenceThumbnailValid = thumbnailValid;
+
+            if (thumbnailValid)
+            {
+                _referenceThumbnail.swap(
+                    _thumbnail);
+
+                _referenceThumbnailWidth = _thumbnailWidth;
+                _referenceThumbnailHeight = _thumbnailHeight;
+                _referenceThumbnailSum = _thumbnailSum;
+            }
+
+            _motionSeen = true;
+            _lastMotionTimestamp = timestamp;
+        }
+        else if (poseValid && !_referencePoseValid)
+        {
+            //
+            // The pose became available while static; compare the next poses to it.
+            //
+            _referencePoseValid = true;
+            _referenceFrameToOrigin = frameToOrigin;
+        }
+
+        return
+            _motionSeen &&
+            Io::HundredsOfNanoseconds(timestamp - _lastMotionTimestamp) <= _holdTime;
+    }
+
+    _Use_decl_annotations_
+    bool MotionDetector::Downsample(
+        Windows::Graphics::Imaging::SoftwareBitmap^ softwareBitmap)
+    {
+        bool bgra = false;
+        uint32_t width = softwareBitmap->PixelWidth;
+
+        switch (softwareBitmap->BitmapPixelFormat)
+        {
+        case Windows::Graphics::Imaging::BitmapPixelFormat::Gray8:
+            break;
+
+        case Windows::Graphics::Imaging::BitmapPixelFormat::Bgra8:
+            if ((_sensorType == SensorType::VisibleLightLeftFront) ||
+                (_sensorType == SensorType::VisibleLightLeftLeft) ||
+                (_sensorType == SensorType::VisibleLightRightFront) ||
+                (_sensorType == SensorType::VisibleLightRightRight))
+            {
+                //
+                // The visible light cameras pack four 8-bit pixels into each BGRA pixel.
+                //
+                width *= 4;
+            }
+            else
+            {
+                bgra = true;
+            }
+            break;
+
+        default:
+            return false;
+        }
+
+        _thumbnailWidth = width / BlockSize;
+        _thumbnailHeight = softwareBitmap->PixelHeight / BlockSize;
+
+        if (0 == _thumbnailWidth || 0 == _thumbnailHeight)
+        {
+            return false;
+        }
+
+        Windows::Graphics::Imaging::BitmapBuffer^ bitmapBuffer =
+            softwareBitmap->LockBuffer(
+                Windows::Graphics::Imaging::BitmapBufferAccessMode::Read);
+
+        const Windows::Graphics::Imaging::BitmapPlaneDescription plane =
+            bitmapBuffer->GetPlaneDescription(0);
+
+        uint32_t pixelBufferDataLength = 0;
+
+        const uint8_t* pixelBufferData =
+            Io::GetTypedPointerToMemoryBuffer<uint8_t>(
+                bitmapBuffer->CreateReference(),
+                pixelBufferDataLength);
+
+        _blockSums.resize(
+            _thumbnailWidth);
+
+        _thumbnail.resize(
+            (size_t)_thumbnailWidth * _thumbnailHeight);
+
+        _thumbnailSum = 0;
+
+        for (uint32_t blockY = 0; blockY < _thumbnailHeight; ++blockY)
+        {
+            std::fill(
+                _blockSums.begin(),
+                _blockSums.end(),
+                0u /* _Val */);
+
+            for (uint32_t rowInBlock = 0; rowInBlock < BlockSize; ++rowInBlock)
+            {
+                const uint8_t* row =
+                    pixelBufferData + plane.StartIndex +
+                    (size_t)(blockY * BlockSize + rowInBlock) * plane.Stride;
+
+                if (bgra)
+                {
+                    AccumulateBgra8GreenBlockSums(
+                        row,
+                        _thumbnailWidth,
+                        _blockSums.data());
+                }
+                else
+                {
+                    AccumulateGray8BlockSums(
+                        row,
+                        _thumbnailWidth,
+                        _blockSums.data());
+                }
+            }
+
+            uint8_t* thumbnailRow =
+                _thumbnail.data() + (size_t)blockY * _thumbnailWidth;
+
+            for (uint32_t blockX = 0; blockX < _thumbnailWidth; ++blockX)
+            {
+                thumbnailRow[blockX] =
+                    (uint8_t)(_blockSums[blockX] / (BlockSize * BlockSize));
+
+                _thumbnailSum += thumbnailRow[blockX];
+            }
+        }
+
+        return true;
+    }
+
+    _Use_decl_annotations_
+    MotionGatedSink::MotionGatedSink(
+        SensorType sensorType,
+        ISensorFrameSink^ sink,
+        MotionGatePolicy policy,
+        Io::HundredsOfNanoseconds staticInterval)
+        : _sink(sink)
+        , _policy(policy)
+        , _staticInterval(staticInterval)
+        , _motionDetector(sensorType)
+        , _frameForwarded(false)
+        , _lastForwardedTimestamp(0)
+        , _isMoving(false)
+        , _framesForwarded(0)
+        , _framesGated(0)
+    {
+    }
+
+    bool MotionGatedSink::IsMoving()
+    {
+        return _isMoving;
+    }
+
+    uint64_t MotionGatedSink::GetFramesForwarded()
+    {
+        return _framesForwarded;
+    }
+
+    uint64_t MotionGatedSink::GetFramesGated()
+    {
+        return _framesGated;
+    }
+
+    void MotionGatedSink::Send(
+        SensorFrame^ sensorFrame)
+    {
+        MotionMeasures motionMeasures;
+
+        const bool isMoving =
+            _motionDetector.Evaluate(
+                sensorFrame,
+                &motionMeasures);
+
+        _isMoving = isMoving;
+
+        const int64_t timestamp =
+            sensorFrame->Timestamp.UniversalTime;
+
+        bool forward = true;
+
+        switch (_policy)
+        {
+        case MotionGatePolicy::OnlyWhenMoving:
+            forward = isMoving;
+            break;
+
+        case MotionGatePolicy::ReducedRateWhenStatic:
+            forward =
+                isMoving ||
+                !_frameForwarded ||
+                Io::HundredsOfNanoseconds(timestamp - _lastForwardedTimestamp) >= _staticInterval;
+            break;
+
+        default:
+            break;
+        }
+
+#if DBG_ENABLE_VERBOSE_LOGGING
+        dbg::trace(
+            L"MotionGatedSink::Send: %s frame, translation %f m, rotation %f degrees, frame difference %f",
+            forward ? L"forwarding" : L"gating",
+            motionMeasures.PoseDeltaTranslation,
+            motionMeasures.PoseDeltaRotationInDegrees,
+            motionMeasures.FrameDifference);
+#endif /* DBG_ENABLE_VERBOSE_LOGGING */
+
+        if (!forward)
+        {
+            ++_framesGated;
+
+            return;
+        }
+
+        _frameForwarded = true;
+        _lastForwardedTimestamp = timestamp;
+
+        ++_framesForwarded;
+
+        _sink->Send(
+            sensorFrame);
+    }
+
+    MotionGatedSinkGroup::MotionGatedSinkGroup(
+        _In_ ISensorFrameSinkGroup^ sinkGroup,
+        _In_ MotionGatePolicy policy,
+        _In_ float staticFramesPerSecond)
+        : _sinkGroup(sinkGroup)
+        , _policy(policy)
+        , _staticInterval(0)
+    {
+        REQUIRES(nullptr != sinkGroup);
+
+        if (MotionGatePolicy::ReducedRateWhenStatic == policy)
+        {
+            REQUIRES(0.0f < staticFramesPerSecond);
+
+            _staticInterval =
+                Io::HundredsOfNanoseconds(
+                    (int64_t)(10'000'000.0f / staticFramesPerSecond));
+        }
+    }
+
+    ISensorFrameSink^ MotionGatedSinkGroup::GetSensorFrameSink(
+        _In_ SensorType sensorType)
+    {
+        const int32_t sensorTypeAsIndex =
+            (int32_t)sensorType;
+
+        REQUIRES(
+            0 <= sensorTypeAsIndex &&
+            sensorTypeAsIndex < (int32_t)_sinks.size());
+
+        ISensorFrameSink^ sink =
+            _sinkGroup->GetSensorFrameSink(
+                sensorType);
+
+        if (nullptr == sink)
+        {
+            return nullptr;
+        }
+
+        MotionGatedSink^ motionGatedSink =
+            ref new MotionGatedSink(
+                sensorType,
+                sink,
+                _policy,
+                _staticInterval);
+
+        {
+            std::lock_guard<std::mutex> lockGuard(
+                _sinksMutex);
+
+            _sinks[sensorTypeAsIndex] =
+                motionGatedSink;
+        }
+
+        return motionGatedSink;
+    }
+
+    bool MotionGatedSinkGroup::IsMoving(
+        _In_ SensorType sensorType)
+    {
+        const int32_t sensorTypeAsIndex =
+            (int32_t)sensorType;
+
+        REQUIRES(
+            0 <= sensorTypeAsIndex &&
+            sensorTypeAsIndex < (int32_t)_sinks.size());
+
+        std::lock_guard<std::mutex> lockGuard(
+            _sinksMutex);
+
+        return
+            nullptr != _sinks[sensorTypeAsIndex] &&
+            _sinks[sensorTypeAsIndex]->IsMoving();
+    }
+
+    uint64_t MotionGatedSinkGroup::FramesForwarded::get()
+    {
+        std::lock_guard<std::mutex> lockGuard(
+            _sinksMutex);
+
+        uint64_t framesForwarded = 0;
+
+        for (MotionGatedSink^ sink : _sinks)
+        {
+            if (nullptr != sink)
+            {
+                framesForwarded += sink->GetFramesForwarded();
+            }
+        }
+
+        return framesForwarded;
+    }
+
+    uint64_t MotionGatedSinkGroup::FramesGated::get()
+    {
+        std::lock_guard<std::mutex> lockGuard(
+            _sinksMutex);
+
+        uint64_t framesGated = 0;
+
+        for (MotionGatedSink^ sink : _sinks)
+        {
+            if (nullptr != sink)
+            {
+                framesGated += sink->GetFramesGated();
+            }
+        }
+
+        return framesGated;
+    }
+}
@@ -0,0 +1,212 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#pragma once
+
+namespace HoloLensForCV
+{
+    /// <summary>
+    /// Which frames a motion-gated sink receives.
+    /// </summary>
+    public enum class MotionGatePolicy
+    {
+        /// <summary>
+        /// All frames.
+        /// </summary>
+        Always,
+
+        /// <summary>
+        /// Only the frames taken while the device or the scene moves.
+        /// </summary>
+        OnlyWhenMoving,
+
+        /// <summary>
+        /// The frames taken while moving, and frames at a reduced rate while static.
+        /// </summary>
+        ReducedRateWhenStatic
+    };
+
+    //
+    // Motion of a frame relative to the reference frame of its sensor.
+    //
+    struct MotionMeasures
+    {
+        // Zero if either pose is unknown.
+        float PoseDeltaTranslation;
+        float PoseDeltaRotationInDegrees;
+
+        //
+        // Mean absolute difference of the block means of the two images, in the [0..255]
+        // range, less the difference of their overall means so that exposure changes are
+        // not mistaken for motion. Only computed for 8-bit and BGRA images.
+        //
+        bool FrameDifferenceValid;
+        float FrameDifference;
+    };
+
+    //
+    // Decides cheaply whether a sensor frame was taken while the device or the scene moved,
+    // from the change of the device pose and of a downsampled image relative to a reference
+    // frame. The reference frame is replaced whenever motion is detected, so that slow
+    // motion accumulates until it crosses the thresholds, and frames are reported as moving
+    // for a hold time after the last detected motion, so that the gated sinks do not
+    // flicker between the two states.
+    //
+    // The images are downsampled to the means of BlockSize x BlockSize blocks, using SSE2
+    // sums of absolute differences on x86/x64 and scalar code on ARM. Frames with neither
+    // a pose nor an 8-bit image (e.g. depth frames without a pose) are always reported as
+    // moving, so that the gate fails open.
+    //
+    class MotionDetector
+    {
+    public:
+        static const uint32_t BlockSize = 8;
+
+        MotionDetector(
+            _In_ SensorType sensorType,
+            _In_ float translationThresholdInMeters = 0.02f,
+            _In_ float rotationThresholdInDegrees = 1.0f,
+            _In_ float frameDifferenceThreshold = 3.0f,
+            _In_ Io::HundredsOfNanoseconds holdTime = std::chrono::milliseconds(500));
+
+        void Reset();
+
+        bool Evaluate(
+            _In_ SensorFrame^ sensorFrame,
+            _Out_ MotionMeasures* measures);
+
+    private:
+        //
+        // Downsamples the image of the frame to _thumbnail. Returns false for formats
+        // without an 8-bit intensity channel.
+        //
+        bool Downsample(
+            _In_ Windows::Graphics::Imaging::SoftwareBitmap^ softwareBitmap);
+
+    private:
+        SensorType _sensorType;
+        float _translationThresholdInMeters;
+        float _rotationThresholdInDegrees;
+        float _frameDifferenceThreshold;
+        Io::HundredsOfNanoseconds _holdTime;
+
+        std::vector<uint32_t> _blockSums;
+        std::vector<uint8_t> _thumbnail;
+        uint32_t _thumbnailWidth;
+        uint32_t _thumbnailHeight;
+        uint64_t _thumbnailSum;
+
+        bool _referenceSeen;
+        bool _referencePoseValid;
+        Windows::Foundation::Numerics::float4x4 _referenceFrameToOrigin;
+        bool _referenceThumbnailValid;
+        std::vector<uint8_t> _referenceThumbnail;
+        uint32_t _referenceThumbnailWidth;
+        uint32_t _referenceThumbnailHeight;
+        uint64_t _referenceThumbnailSum;
+
+        bool _motionSeen;
+        int64_t _lastMotionTimestamp;
+    };
+
+    //
+    // Runs the motion detector of a sensor and forwards the frames selected by the policy.
+    //
+    ref class MotionGatedSink sealed
+        : public ISensorFrameSink
+    {
+    internal:
+        MotionGatedSink(
+            _In_ SensorType sensorType,
+            _In_ ISensorFrameSink^ sink,
+            _In_ MotionGatePolicy policy,
+            _In_ Io::HundredsOfNanoseconds staticInterval);
+
+        bool IsMoving();
+
+        uint64_t GetFramesForwarded();
+
+        uint64_t GetFramesGated();
+
+    public:
+        virtual void Send(
+            SensorFrame^ sensorFrame);
+
+    private:
+        ISensorFrameSink^ _sink;
+        MotionGatePolicy _policy;
+        Io::HundredsOfNanoseconds _staticInterval;
+
+        //
+        // Send is serialized per sensor by the media frame reader; the state below is
+        // read from other threads, hence atomic.
+        //
+        MotionDetector _motionDetector;
+        bool _frameForwarded;
+        int64_t _lastForwardedTimestamp;
+
+        std::atomic<bool> _isMoving;
+        std::atomic<uint64_t> _framesForwarded;
+        std::atomic<uint64_t> _framesGated;
+    };
+
+    /// <summary>
+    /// Puts a motion gate in front of the sinks of another sink group, such as the recorder,
+    /// the streamer or a MultiFrameBuffer feeding computer vision stages, so that they stop
+    /// receiving (or receive fewer) frames while the wearer is stationary and the scene is
+    /// static. Each subscriber can use its own group and policy.
+    /// </summary>
+    /// <remarks>
+    /// Gated frames leave gaps in the sequence numbers seen by the sinks, which they report
+    /// as missed frames; FramesGated tells the two apart.
+    /// </remarks>
+    public ref class MotionGatedSinkGroup sealed
+        : public ISensorFrameSinkGroup
+    {
+    public:
+        /// <summary>
+        /// With ReducedRateWhenStatic, staticFramesPerSecond frames per second are forwarded
+        /// while static; it is ignored by the other policies.
+        /// </summary>
+        MotionGatedSinkGroup(
+            _In_ ISensorFrameSinkGroup^ sinkGroup,
+            _In_ MotionGatePolicy policy,
+            _In_ float staticFramesPerSecond);
+
+        virtual ISensorFrameSink^ GetSensorFrameSink(
+            _In_ SensorType sensorType);
+
+        /// <summary>
+        /// Whether the last frame of the sensor was taken while moving. Lets computer vision
+        /// stages which poll for frames skip their work while static.
+        /// </summary>
+        bool IsMoving(
+            _In_ SensorType sensorType);
+
+        property uint64_t FramesForwarded
+        {
+            uint64_t get();
+        }
+
+        property uint64_t FramesGated
+        {
+            uint64_t get();
+        }
+
+    private:
+        ISensorFrameSinkGroup^ _sinkGroup;
+        MotionGatePolicy _policy;
+        Io::HundredsOfNanoseconds _staticInterval;
+
+        std::mutex _sinksMutex;
+        std::array<MotionGatedSink^, (size_t)SensorType::NumberOfSensorTypes> _sinks;
+    };
+}
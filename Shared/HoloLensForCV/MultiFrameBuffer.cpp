@@ -13,6 +13,11 @@
 
 namespace HoloLensForCV
 {
+    static const size_t c_maximumFramesPerSensor = 5;
+
+    static const uint64_t c_memorySoftLimit = 64ull * 1024 * 1024;
+    static const uint64_t c_memoryHardLimit = 128ull * 1024 * 1024;
+
     static double TimeDeltaAMinusB(
         Windows::Foundation::DateTime a,
         Windows::Foundation::DateTime b)
@@ -22,6 +27,22 @@ namespace HoloLensForCV
         return timeDiff100ns * 1e-7;
     }
 
+    MultiFrameBuffer::MultiFrameBuffer()
+    {
+        _memoryPool.reset(
+            new MemoryPool(
+                MemoryBudget::Default,
+                L"MultiFrameBuffer",
+                MemoryPoolPriority::Low,
+                c_memorySoftLimit,
+                c_memoryHardLimit,
+                [this](uint64_t size)
+        {
+            ReleaseFrames(
+                size);
+        }));
+    }
+
     ISensorFrameSink^ MultiFrameBuffer::GetSensorFrameSink(
         _In_ SensorType /* sensorType */)
     {
@@ -31,18 +52,84 @@ namespace HoloLensForCV
     void MultiFrameBuffer::Send(
         SensorFrame^ sensorFrame)
     {
+        const uint64_t frameSize =
+            GetSensorFrameMemorySize(sensorFrame);
+
         std::lock_guard<std::mutex> lock(_framesMutex);
         
         auto& buffer = _frames[sensorFrame->FrameType];
+
+        //
+        // When the memory budget refuses the frame, make room by dropping the oldest
+        // frames of the sensor. The latest frame is always kept.
+        //
+        while (!_memoryPool->TryReserve(frameSize))
+        {
+            if (buffer.empty())
+            {
+                _memoryPool->Reserve(
+                    frameSize);
+
+                break;
+            }
+
+            _memoryPool->Release(
+                GetSensorFrameMemorySize(buffer.front()));
+
+            buffer.pop_front();
+        }
         
         buffer.push_back(sensorFrame);
         
-        while (buffer.size() > 5)
+        while (buffer.size() > c_maximumFramesPerSensor)
         {
+            _memoryPool->Release(
+                GetSensorFrameMemorySize(buffer.front()));
+
             buffer.pop_front();
         }
     }
 
+    void MultiFrameBuffer::ReleaseFrames(
+        _In_ uint64_t size)
+    {
+        std::lock_guard<std::mutex> lock(_framesMutex);
+
+        uint64_t released = 0;
+
+        while (released < size)
+        {
+            std::deque<SensorFrame^>* oldestBuffer = nullptr;
+
+            for (auto& bufferIterator : _frames)
+            {
+                auto& buffer = bufferIterator.second;
+
+                if (buffer.size() > 1 &&
+                    (nullptr == oldestBuffer ||
+                     buffer.front()->Timestamp.UniversalTime < oldestBuffer->front()->Timestamp.UniversalTime))
+                {
+                    oldestBuffer = &buffer;
+                }
+            }
+
+            if (nullptr == oldestBuffer)
+            {
+                break;
+            }
+
+            const uint64_t frameSize =
+                GetSensorFrameMemorySize(oldestBuffer->front());
+
+            _memoryPool->Release(
+                frameSize);
+
+            oldestBuffer->pop_front();
+
+            released += frameSize;
+        }
+    }
+
     SensorFrame^ MultiFrameBuffer::GetLatestFrame(
         SensorType sensor)
     {
@@ -13,11 +13,19 @@
 
 namespace HoloLensForCV
 {
+    /// <summary>
+    /// Keeps the latest frames of each sensor, up to five, for computer vision stages
+    /// which poll for frames. The frames are accounted to the default memory budget as a
+    /// Low priority pool: under memory pressure, older frames are dropped, down to the
+    /// latest frame of each sensor.
+    /// </summary>
     public ref class MultiFrameBuffer sealed
         : public ISensorFrameSink
         , public ISensorFrameSinkGroup
     {
     public:
+        MultiFrameBuffer();
+
         virtual void Send(
             SensorFrame^ sensorFrame);
 
@@ -37,8 +45,18 @@ namespace HoloLensForCV
             SensorType b,
             float toleranceInSeconds);
 
+    private:
+        //
+        // Drops the oldest frames, keeping the latest frame of each sensor, until at least
+        // size bytes were released or only the latest frames are left.
+        //
+        void ReleaseFrames(
+            _In_ uint64_t size);
+
     private:
         std::map<SensorType, std::deque<SensorFrame^>> _frames;
         std::mutex _framesMutex;
+
+        std::unique_ptr<MemoryPool> _memoryPool;
     };
 }
@@ -0,0 +1,465 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#include "pch.h"
+
+namespace HoloLensForCV
+{
+    namespace
+    {
+        const uint64_t c_sendBufferMemoryLimit = 64ull * 1024 * 1024;
+
+        //
+        // Back-projects one row of depths in millimeters into int16 camera space points in
+        // millimeters. Depths outside of [minimumDepth, maximumDepth] yield Z == 0.
+        //
+        void BackprojectDepthRow(
+            _In_ const uint16_t* depth,
+            _In_ const float* rayX,
+            _In_ const float* rayY,
+            _In_ const float* rayZ,
+            _In_ int32_t width,
+            _In_ uint16_t minimumDepth,
+            _In_ uint16_t maximumDepth,
+            _Out_ int16_t* pointX,
+            _Out_ int16_t* pointY,
+            _Out_ int16_t* pointZ)
+        {
+            int32_t x = 0;
+
+#if HOLOLENSFORCV_USE_SSE2
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i minimum = _mm_set1_epi32(minimumDepth - 1);
+            const __m128i maximum = _mm_set1_epi32(maximumDepth + 1);
+
+            for (; x + 4 <= width; x += 4)
+            {
+                const __m128i depthAsInt32 =
+                    _mm_unpacklo_epi16(
+                        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(depth + x)),
+                        zero);
+
+                const __m128i valid =
+                    _mm_and_si128(
+                        _mm_cmpgt_epi32(depthAsInt32, minimum),
+                        _mm_cmplt_epi32(depthAsInt32, maximum));
+
+                const __m128 distance =
+                    _mm_cvtepi32_ps(
+                        _mm_and_si128(depthAsInt32, valid));
+
+                //
+                // Round to the nearest millimeter and saturate to int16.
+                //
+                const __m128i xyLow = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(rayX + x), distance));
+                const __m128i xyHigh = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(rayY + x), distance));
+                const __m128i z = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(rayZ + x), distance));
+
+                const __m128i xy = _mm_packs_epi32(xyLow, xyHigh);
+
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(pointX + x), xy);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(pointY + x), _mm_unpackhi_epi64(xy, xy));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(pointZ + x), _mm_packs_epi32(z, z));
+            }
+#endif /* HOLOLENSFORCV_USE_SSE2 */
+
+            for (; x < width; ++x)
+            {
+                const float distance =
+                    depth[x] < minimumDepth || depth[x] > maximumDepth ? 0.0f : depth[x];
+
+                pointX[x] = static_cast<int16_t>(std::max(-32768.0f, std::min(32767.0f, std::round(rayX[x] * distance))));
+                pointY[x] = static_cast<int16_t>(std::max(-32768.0f, std::min(32767.0f, std::round(rayY[x] * distance))));
+                pointZ[x] = static_cast<int16_t>(std::max(-32768.0f, std::min(32767.0f, std::round(rayZ[x] * distance))));
+            }
+        }
+    }
+
+    PointCloudStreamingServer::PointCloudStreamingServer(
+        _In_ Platform::String^ serviceName,
+        _In_ float minimumDistance,
+        _In_ float maximumDistance,
+        _In_ float voxelSize)
+        : _writeInProgress(false)
+        , _rayTableWidth(0)
+        , _rayTableHeight(0)
+        , _framesSent(0)
+        , _framesDropped(0)
+    {
+        REQUIRES(0.0f < minimumDistance && minimumDistance <= maximumDistance);
+        REQUIRES(maximumDistance < 32.0f);
+        REQUIRES(0.0f <= voxelSize);
+
+        _minimumDepth = static_cast<uint16_t>(minimumDistance * 1000.0f);
+        _maximumDepth = static_cast<uint16_t>(maximumDistance * 1000.0f);
+        _voxelSize = static_cast<int32_t>(voxelSize * 1000.0f);
+
+        _memoryPool.reset(
+            new MemoryPool(
+                MemoryBudget::Default,
+                std::wstring(L"PointCloudStreamingServer ") + serviceName->Data(),
+                MemoryPoolPriority::Normal,
+                c_sendBufferMemoryLimit /* softLimit */,
+                c_sendBufferMemoryLimit /* hardLimit */,
+                nullptr /* releaseCallback */));
+
+        _listener = ref new Windows::Networking::Sockets::StreamSocketListener();
+
+        _listener->ConnectionReceived +=
+            ref new Windows::Foundation::TypedEventHandler<
+                Windows::Networking::Sockets::StreamSocketListener^,
+                Windows::Networking::Sockets::StreamSocketListenerConnectionReceivedEventArgs^>(
+                    this,
+                    &PointCloudStreamingServer::OnConnection);
+
+        _listener->Control->KeepAlive = true;
+
+        // Don't limit traffic to an address or an adapter.
+        Concurrency::create_task(_listener->BindServiceNameAsync(serviceName)).then(
+            [this](Concurrency::task<void> previousTask)
+        {
+            try
+            {
+                // Try getting an exception.
+                previousTask.get();
+            }
+            catch (Platform::Exception^ exception)
+            {
+#if DBG_ENABLE_ERROR_LOGGING
+                dbg::trace(
+                    L"PointCloudStreamingServer::PointCloudStreamingServer: %s",
+                    exception->Message->Data());
+#endif /* DBG_ENABLE_ERROR_LOGGING */
+            }
+        });
+    }
+
+    PointCloudStreamingServer::~PointCloudStreamingServer()
+    {
+        delete _listener;
+        _listener = nullptr;
+    }
+
+    void PointCloudStreamingServer::OnConnection(
+        Windows::Networking::Sockets::StreamSocketListener^ listener,
+        Windows::Networking::Sockets::StreamSocketListenerConnectionReceivedEventArgs^ object)
+    {
+        _socket = object->Socket;
+
+        _writeInProgress = false;
+
+        _writer = ref new Windows::Storage::Streams::DataWriter(
+            _socket->OutputStream);
+
+        _writer->ByteOrder =
+            Windows::Storage::Streams::ByteOrder::LittleEndian;
+    }
+
+    void PointCloudStreamingServer::UpdateRayTable(
+        _In_ CameraIntrinsics^ cameraIntrinsics)
+    {
+        const int32_t width = (int32_t)cameraIntrinsics->ImageWidth;
+        const int32_t height = (int32_t)cameraIntrinsics->ImageHeight;
+
+        if (width == _rayTableWidth && height == _rayTableHeight)
+        {
+            return;
+        }
+
+        _rayX.resize(width * height);
+        _rayY.resize(width * height);
+        _rayZ.resize(width * height);
+
+        for (int32_t y = 0; y < height; ++y)
+        {
+            for (int32_t x = 0; x < width; ++x)
+            {
+                const int32_t i = y * width + x;
+
+                //
+                // Sample at integer pixel coordinates, as the recorder does for the
+                // <sensor>_camera_space_projection.bin table read by pcloud_compute.py, so
+                // that on-device and offline back-projections of a frame agree.
+                //
+                Windows::Foundation::Point uv;
+                uv.X = static_cast<float>(x);
+                uv.Y = static_cast<float>(y);
+
+                Windows::Foundation::Point xy;
+
+                if (!cameraIntrinsics->MapImagePointToCameraUnitPlane(uv, &xy))
+                {
+                    //
+                    // A zero ray yields Z == 0, i.e. an invalid point, for any depth.
+                    //
+                    _rayX[i] = _rayY[i] = _rayZ[i] = 0.0f;
+                    continue;
+                }
+
+                //
+                // The unit plane point (x, y, 1) is scaled to unit length and flipped to the
+                // negative Z axis the camera looks down, as in pcloud_compute.py.
+                //
+                const float scale =
+                    -1.0f / sqrtf(xy.X * xy.X + xy.Y * xy.Y + 1.0f);
+
+                _rayX[i] = xy.X * scale;
+                _rayY[i] = xy.Y * scale;
+                _rayZ[i] = scale;
+            }
+        }
+
+        _rowX.resize(width);
+        _rowY.resize(width);
+        _rowZ.resize(width);
+
+        _rayTableWidth = width;
+        _rayTableHeight = height;
+    }
+
+    void PointCloudStreamingServer::BackprojectDepthImage(
+        _In_ const uint16_t* depthImage,
+        _In_ int32_t imageWidth,
+        _In_ int32_t imageHeight)
+    {
+        _points.clear();
+        _occupiedVoxels.clear();
+
+        for (int32_t y = 0; y < imageHeight; ++y)
+        {
+            const int32_t rowOffset = y * imageWidth;
+
+            BackprojectDepthRow(
+                depthImage + rowOffset,
+                _rayX.data() + rowOffset,
+                _rayY.data() + rowOffset,
+                _rayZ.data() + rowOffset,
+                imageWidth,
+                _minimumDepth,
+                _maximumDepth,
+                _rowX.data(),
+                _rowY.data(),
+                _rowZ.data());
+
+            for (int32_t x = 0; x < imageWidth; ++x)
+            {
+                if (0 == _rowZ[x])
+                {
+                    continue;
+                }
+
+                if (0 < _voxelSize)
+                {
+                    //
+                    // Keep the first point of each voxel. The voxel coordinates fit into
+                    // 16 bits each since the points do.
+                    //
+                    const auto voxelCoordinate = [&](int16_t value)
+                    {
+                        return static_cast<uint64_t>(static_cast<uint16_t>(
+                            static_cast<int16_t>(
+                                (value >= 0 ? value : value - _voxelSize + 1) / _voxelSize)));
+                    };
+
+                    const uint64_t voxelKey =
+                        voxelCoordinate(_rowX[x]) |
+                        (voxelCoordinate(_rowY[x]) << 16) |
+                        (voxelCoordinate(_rowZ[x]) << 32);
+
+                    if (!_occupiedVoxels.insert(voxelKey).second)
+                    {
+                        continue;
+                    }
+                }
+
+                _points.push_back(_rowX[x]);
+                _points.push_back(_rowY[x]);
+                _points.push_back(_rowZ[x]);
+            }
+        }
+    }
+
+    void PointCloudStreamingServer::Send(
+        SensorFrame^ sensorFrame)
+    {
+        if (nullptr == _socket)
+        {
+#if DBG_ENABLE_VERBOSE_LOGGING
+            dbg::trace(
+                L"PointCloudStreamingServer::Send: frame dropped -- no connection!");
+#endif /* DBG_ENABLE_VERBOSE_LOGGING */
+
+            return;
+        }
+
+        if (_writeInProgress)
+        {
+#if DBG_ENABLE_INFORMATIONAL_LOGGING
+            dbg::trace(
+                L"PointCloudStreamingServer::Send: frame dropped -- previous StoreAsync task is still in progress!");
+#endif /* DBG_ENABLE_INFORMATIONAL_LOGGING */
+
+            ++_framesDropped;
+
+            return;
+        }
+
+        Windows::Graphics::Imaging::SoftwareBitmap^ bitmap =
+            sensorFrame->SoftwareBitmap;
+
+        if (nullptr == sensorFrame->SensorStreamingCameraIntrinsics ||
+            Windows::Graphics::Imaging::BitmapPixelFormat::Gray16 != bitmap->BitmapPixelFormat)
+        {
+#if DBG_ENABLE_ERROR_LOGGING
+            dbg::trace(
+                L"PointCloudStreamingServer::Send: frame dropped -- not a depth frame with camera intrinsics!");
+#endif /* DBG_ENABLE_ERROR_LOGGING */
+
+            ++_framesDropped;
+
+            return;
+        }
+
+        {
+#if DBG_ENABLE_INFORMATIONAL_LOGGING
+            dbg::TimerGuard timerGuard(
+                L"PointCloudStreamingServer::Send: back-projection",
+                4.0 /* minimum_time_elapsed_in_milliseconds */);
+#endif /* DBG_ENABLE_INFORMATIONAL_LOGGING */
+
+            UpdateRayTable(
+                sensorFrame->SensorStreamingCameraIntrinsics);
+
+            REQUIRES(
+                bitmap->PixelWidth == _rayTableWidth &&
+                bitmap->PixelHeight == _rayTableHeight);
+
+            Windows::Graphics::Imaging::BitmapBuffer^ bitmapBuffer =
+                bitmap->LockBuffer(
+                    Windows::Graphics::Imaging::BitmapBufferAccessMode::Read);
+
+            Windows::Foundation::IMemoryBufferReference^ bitmapBufferReference =
+                bitmapBuffer->CreateReference();
+
+            uint32_t bitmapBufferDataSize = 0;
+
+            const uint16_t* depthImage =
+                Io::GetTypedPointerToMemoryBuffer<uint16_t>(
+                    bitmapBufferReference,
+                    bitmapBufferDataSize);
+
+            ASSERT(
+                bitmapBufferDataSize == _rayTableWidth * _rayTableHeight * sizeof(uint16_t));
+
+            BackprojectDepthImage(
+                depthImage,
+                _rayTableWidth,
+                _rayTableHeight);
+        }
+
+        //
+        // The points are in the camera space, whose transform to the origin is the inverse
+        // of the camera view transform followed by the frame-to-origin transform. Frames
+        // without a pose have a zero frame-to-origin transform, which we pass on.
+        //
+        Windows::Foundation::Numerics::float4x4 cameraToOrigin;
+
+        memset(
+            &cameraToOrigin,
+            0 /* _Val */,
+            sizeof(cameraToOrigin));
+
+        Windows::Foundation::Numerics::float4x4 cameraToFrame;
+
+        if (Windows::Foundation::Numerics::invert(sensorFrame->CameraViewTransform, &cameraToFrame))
+        {
+            cameraToOrigin =
+                cameraToFrame * sensorFrame->FrameToOrigin;
+        }
+
+        const uint32_t numberOfPoints =
+            static_cast<uint32_t>(_points.size() / 3);
+
+        //
+        // The writer holds a copy of the points until the send completes. Under memory
+        // pressure, drop the frame rather than buffer it.
+        //
+        const uint64_t sendBufferSize =
+            ProtocolHeaderLength + numberOfPoints * 3 * sizeof(int16_t);
+
+        if (!_memoryPool->TryReserve(sendBufferSize))
+        {
+#if DBG_ENABLE_INFORMATIONAL_LOGGING
+            dbg::trace(
+                L"PointCloudStreamingServer::Send: frame dropped -- over the memory budget!");
+#endif /* DBG_ENABLE_INFORMATIONAL_LOGGING */
+
+            ++_framesDropped;
+
+            return;
+        }
+
+        _writeInProgress = true;
+
+        _writer->WriteUInt32(ProtocolCookie);
+        _writer->WriteByte(ProtocolVersionMajor);
+        _writer->WriteByte(ProtocolVersionMinor);
+        _writer->WriteUInt16((uint16_t)sensorFrame->FrameType);
+        _writer->WriteUInt64(sensorFrame->Timestamp.UniversalTime);
+        _writer->WriteUInt64(sensorFrame->SequenceNumber);
+        _writer->WriteUInt32(numberOfPoints);
+
+        const float* cameraToOriginAsArray =
+            &cameraToOrigin.m11;
+
+        for (int32_t i = 0; i < 16; ++i)
+        {
+            _writer->WriteSingle(cameraToOriginAsArray[i]);
+        }
+
+        if (0 < numberOfPoints)
+        {
+            _writer->WriteBytes(
+                ref new Platform::Array<uint8_t>(
+                    reinterpret_cast<uint8_t*>(_points.data()),
+                    numberOfPoints * 3 * sizeof(int16_t)));
+        }
+
+        Concurrency::create_task(_writer->StoreAsync()).then(
+            [this, sendBufferSize](Concurrency::task<unsigned int> writeTask)
+        {
+            _memoryPool->Release(
+                sendBufferSize);
+
+            try
+            {
+                // Try getting an exception.
+                writeTask.get();
+
+                ++_framesSent;
+
+                _writeInProgress = false;
+            }
+            catch (Platform::Exception^ exception)
+            {
+#if DBG_ENABLE_ERROR_LOGGING
+                dbg::trace(
+                    L"PointCloudStreamingServer::Send: StoreAsync call failed with error: %s",
+                    exception->Message->Data());
+#endif /* DBG_ENABLE_ERROR_LOGGING */
+
+                ++_framesDropped;
+
+                _socket = nullptr;
+            }
+        });
+    }
+}
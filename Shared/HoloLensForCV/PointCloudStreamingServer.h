@@ -0,0 +1,141 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#pragma once
+
+namespace HoloLensForCV
+{
+    //
+    // Streams the depth frames of a ToF sensor as point clouds instead of raw images. Each
+    // frame is back-projected on the device with a ray table cached from the sensor's camera
+    // intrinsics, clipped to a distance range and optionally thinned out to one point per
+    // voxel. A frame is sent as:
+    //
+    //   Cookie (uint32), VersionMajor, VersionMinor (uint8), FrameType (uint16),
+    //   Timestamp (uint64), SequenceNumber (uint64), NumberOfPoints (uint32),
+    //   CameraToOrigin (4x4 float, row-major, for row vectors; zero if unknown),
+    //   NumberOfPoints x (X, Y, Z) (int16, camera space, in millimeters)
+    //
+    public ref class PointCloudStreamingServer sealed
+        : public ISensorFrameSink
+    {
+    public:
+        /// <summary>
+        /// Distances are in meters. A voxel size of zero disables the downsampling.
+        /// </summary>
+        PointCloudStreamingServer(
+            _In_ Platform::String^ serviceName,
+            _In_ float minimumDistance,
+            _In_ float maximumDistance,
+            _In_ float voxelSize);
+
+        virtual void Send(
+            SensorFrame^ sensorFrame);
+
+        static property uint32_t ProtocolHeaderLength
+        {
+            uint32_t get()
+            {
+                return
+                    sizeof(uint32_t) /* Cookie */ +
+                    2 * sizeof(uint8_t) /* VersionMajor, VersionMinor */ +
+                    sizeof(uint16_t) /* FrameType */ +
+                    sizeof(uint64_t) /* Timestamp */ +
+                    sizeof(uint64_t) /* SequenceNumber */ +
+                    sizeof(uint32_t) /* NumberOfPoints */ +
+                    16 * sizeof(float) /* CameraToOrigin */;
+            }
+        }
+
+        static property uint32_t ProtocolCookie
+        {
+            uint32_t get() { return 0x484c5043; }
+        }
+
+        static property uint8_t ProtocolVersionMajor
+        {
+            uint8_t get() { return 0x00; }
+        }
+
+        static property uint8_t ProtocolVersionMinor
+        {
+            uint8_t get() { return 0x01; }
+        }
+
+        /// <summary>
+        /// Number of frames written to the connected client.
+        /// </summary>
+        property uint64_t FramesSent
+        {
+            uint64_t get() { return _framesSent; }
+        }
+
+        /// <summary>
+        /// Number of frames dropped by the server while a client was connected, either
+        /// because the previous send was still in flight, because the memory budget
+        /// refused the send buffer, because the send failed or because the frame had no
+        /// camera intrinsics.
+        /// </summary>
+        property uint64_t FramesDropped
+        {
+            uint64_t get() { return _framesDropped; }
+        }
+
+    private:
+        ~PointCloudStreamingServer();
+
+        void OnConnection(
+            Windows::Networking::Sockets::StreamSocketListener^ listener,
+            Windows::Networking::Sockets::StreamSocketListenerConnectionReceivedEventArgs^ object);
+
+        void UpdateRayTable(
+            _In_ CameraIntrinsics^ cameraIntrinsics);
+
+        void BackprojectDepthImage(
+            _In_ const uint16_t* depthImage,
+            _In_ int32_t imageWidth,
+            _In_ int32_t imageHeight);
+
+    private:
+        Windows::Networking::Sockets::StreamSocketListener^ _listener;
+        Windows::Networking::Sockets::StreamSocket^ _socket;
+        Windows::Storage::Streams::DataWriter^ _writer;
+        bool _writeInProgress;
+
+        uint16_t _minimumDepth;
+        uint16_t _maximumDepth;
+        int32_t _voxelSize;
+
+        //
+        // Unit length rays of the pixels, pointing down the negative Z axis.
+        //
+        int32_t _rayTableWidth;
+        int32_t _rayTableHeight;
+        std::vector<float> _rayX;
+        std::vector<float> _rayY;
+        std::vector<float> _rayZ;
+
+        //
+        // Per-row scratch buffers and the interleaved points of the current frame.
+        //
+        std::vector<int16_t> _rowX;
+        std::vector<int16_t> _rowY;
+        std::vector<int16_t> _rowZ;
+        std::vector<int16_t> _points;
+        std::unordered_set<uint64_t> _occupiedVoxels;
+
+        std::atomic<uint64_t> _framesSent;
+        std::atomic<uint64_t> _framesDropped;
+
+        // Accounts for the frame held by the writer until it is sent
+        std::unique_ptr<MemoryPool> _memoryPool;
+    };
+}
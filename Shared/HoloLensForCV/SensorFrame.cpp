@@ -20,6 +20,7 @@ namespace HoloLensForCV
     {
         FrameType = frameType;
         Timestamp = timestamp;
+        SequenceNumber = 0;
         SoftwareBitmap = softwareBitmap;
     }
 }
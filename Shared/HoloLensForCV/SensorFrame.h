@@ -26,6 +26,15 @@ namespace HoloLensForCV
 
         property SensorType FrameType;
         property Windows::Foundation::DateTime Timestamp;
+
+        //
+        // Per-sensor, monotonically increasing number assigned at capture. Every frame
+        // acquired from the media frame reader consumes exactly one sequence number, so
+        // gaps observed by a sink or a remote receiver indicate frames lost downstream
+        // of the capture (e.g. dropped by the network or storage layers).
+        //
+        property uint64_t SequenceNumber;
+
         property Windows::Graphics::Imaging::SoftwareBitmap^ SoftwareBitmap;
 
         property Windows::Media::Devices::Core::CameraIntrinsics^ CoreCameraIntrinsics;
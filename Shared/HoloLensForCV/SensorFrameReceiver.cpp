@@ -16,6 +16,9 @@ namespace HoloLensForCV
     SensorFrameReceiver::SensorFrameReceiver(
         _In_ Windows::Networking::Sockets::StreamSocket^ streamSocket)
         : _streamSocket(streamSocket)
+        , _sequenceNumberValid(false)
+        , _expectedSequenceNumber(0)
+        , _framesMissed(0)
     {
         _reader = ref new Windows::Storage::Streams::DataReader(
             _streamSocket->InputStream);
@@ -79,13 +82,28 @@ namespace HoloLensForCV
 
 #if DBG_ENABLE_INFORMATIONAL_LOGGING
             dbg::trace(
-                L"SensorFrameReceiver::ReceiveAsync: seeing a %ix%i image with pixel stride %i at timestamp %llu",
+                L"SensorFrameReceiver::ReceiveAsync: seeing a %ix%i image with pixel stride %i at timestamp %llu (sequence number %llu)",
                 header->ImageWidth,
                 header->ImageHeight,
                 header->PixelStride,
-                header->Timestamp);
+                header->Timestamp,
+                header->SequenceNumber);
 #endif /* DBG_ENABLE_INFORMATIONAL_LOGGING */
 
+            //
+            // Sequence numbers are dense at capture, so any gap was introduced by the
+            // streaming server or the network.
+            //
+            if (_sequenceNumberValid &&
+                header->SequenceNumber > _expectedSequenceNumber)
+            {
+                _framesMissed +=
+                    header->SequenceNumber - _expectedSequenceNumber;
+            }
+
+            _sequenceNumberValid = true;
+            _expectedSequenceNumber = header->SequenceNumber + 1;
+
             return header;
         });
     }
@@ -180,6 +198,9 @@ namespace HoloLensForCV
                     frameTimestamp,
                     frameAsSoftwareBitmap);
 
+            sensorFrame->SequenceNumber =
+                header->SequenceNumber;
+
             //TODO: add support for sending and receiving camera intrinsics and extrinsics
 
             return sensorFrame;
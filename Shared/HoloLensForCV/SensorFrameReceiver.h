@@ -28,6 +28,15 @@ namespace HoloLensForCV
 
         Windows::Foundation::IAsyncOperation<SensorFrame^>^ ReceiveAsync();
 
+        /// <summary>
+        /// Number of frames lost between the capture on the device and this receiver,
+        /// as indicated by gaps in the sequence numbers carried by the stream header.
+        /// </summary>
+        property uint64_t FramesMissed
+        {
+            uint64_t get() { return _framesMissed; }
+        }
+
     private:
         Concurrency::task<SensorFrameStreamHeader^> ReceiveSensorFrameStreamHeaderAsync();
 
@@ -37,5 +46,9 @@ namespace HoloLensForCV
     private:
         Windows::Networking::Sockets::StreamSocket^ _streamSocket;
         Windows::Storage::Streams::DataReader^ _reader;
+
+        bool _sequenceNumberValid;
+        uint64_t _expectedSequenceNumber;
+        std::atomic<uint64_t> _framesMissed;
     };
 }
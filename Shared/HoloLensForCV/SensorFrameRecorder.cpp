@@ -14,6 +14,7 @@
 namespace HoloLensForCV
 {
     SensorFrameRecorder::SensorFrameRecorder()
+        : _singleArchive(false)
     {
     }
 
@@ -62,6 +63,14 @@ namespace HoloLensForCV
             sensorFrameSink;
     }
 
+    void SensorFrameRecorder::EnableSingleArchive()
+    {
+        std::lock_guard<std::mutex> recorderLockGuard(
+            _recorderMutex);
+
+        _singleArchive = true;
+    }
+
     Windows::Foundation::IAsyncAction^ SensorFrameRecorder::StartAsync()
     {
         return concurrency::create_async(
@@ -80,6 +89,20 @@ namespace HoloLensForCV
 
                     _archiveSourceFolder = archiveSourceFolder;
 
+                    if (_singleArchive)
+                    {
+                        wchar_t fileName[MAX_PATH] = {};
+
+                        swprintf_s(
+                            fileName,
+                            L"%s\\sensors.tar",
+                            _archiveSourceFolder->Path->Data());
+
+                        _sharedTarball =
+                            std::make_shared<Io::ConcurrentTarball>(
+                                fileName);
+                    }
+
                     for (SensorFrameRecorderSink^ sensorFrameSink : _sensorFrameSinks)
                     {
                         if (nullptr == sensorFrameSink)
@@ -87,7 +110,9 @@ namespace HoloLensForCV
                             continue;
                         }
 
-                        sensorFrameSink->Start(_archiveSourceFolder);
+                        sensorFrameSink->StartInSharedArchive(
+                            _archiveSourceFolder,
+                            _sharedTarball);
                     }
                 });
         });
@@ -114,6 +139,15 @@ namespace HoloLensForCV
 
 		}
 
+        //
+        // All the sinks stopped adding files, so the shared archive can be finalized.
+        //
+        if (nullptr != _sharedTarball)
+        {
+            _sharedTarball->Close();
+            _sharedTarball.reset();
+        }
+
 		for (SensorFrameRecorderSink^ sensorFrameSink : _sensorFrameSinks)
 		{
 			if (nullptr == sensorFrameSink)
@@ -237,6 +271,11 @@ namespace HoloLensForCV
 
             sourceFiles.push_back(fileName);
 
+            //
+            // The table is sampled at integer pixel coordinates. The ray tables of
+            // OpenCVHelpers::CreateDepthRayTable and PointCloudStreamingServer follow the
+            // same convention.
+            //
             std::vector<Windows::Foundation::Point> pointList;
             pointList.resize(cameraIntrinsics->ImageWidth * cameraIntrinsics->ImageHeight);
             size_t index = 0;
@@ -33,7 +33,7 @@ namespace HoloLensForCV
 
         static property uint8_t RecordingVersionMinor
         {
-            uint8_t get() { return 0x01; }
+            uint8_t get() { return 0x03; }
         }
 
         void EnableAll();
@@ -41,6 +41,13 @@ namespace HoloLensForCV
         void Enable(
             _In_ SensorType sensorType);
 
+        /// <summary>
+        /// Makes the following recordings add the images of all sensors to a single
+        /// archive, sensors.tar, written to concurrently by the sensors, instead of
+        /// to one tarball per sensor. The file names inside the archive do not change.
+        /// </summary>
+        void EnableSingleArchive();
+
         Windows::Foundation::IAsyncAction^ StartAsync();
 
         void Stop();
@@ -65,6 +72,9 @@ namespace HoloLensForCV
 
         Windows::Storage::StorageFolder^ _archiveSourceFolder;
 
+        bool _singleArchive;
+        std::shared_ptr<Io::ConcurrentTarball> _sharedTarball;
+
         std::array<SensorFrameRecorderSink^, (size_t)SensorType::NumberOfSensorTypes> _sensorFrameSinks;
     };
 }
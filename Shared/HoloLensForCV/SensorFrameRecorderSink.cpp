@@ -17,6 +17,10 @@ namespace HoloLensForCV
 		_In_ SensorType sensorType,
 		_In_ Platform::String^ sensorName)
 		: _sensorType(sensorType), _sensorName(sensorName)
+		, _sequenceNumberValid(false), _expectedSequenceNumber(0)
+		, _framesRecorded(0), _framesMissed(0)
+		, _bitmapPathTimestampOffset(0)
+		, _bitmapHeaderWidth(0), _bitmapHeaderHeight(0), _bitmapHeaderMaxValue(0)
 	{
 	}
 
@@ -27,6 +31,15 @@ namespace HoloLensForCV
 
 	void SensorFrameRecorderSink::Start(
 		_In_ Windows::Storage::StorageFolder^ archiveSourceFolder)
+	{
+		StartInSharedArchive(
+			archiveSourceFolder,
+			nullptr /* sharedTarball */);
+	}
+
+	void SensorFrameRecorderSink::StartInSharedArchive(
+		_In_ Windows::Storage::StorageFolder^ archiveSourceFolder,
+		_In_ const std::shared_ptr<Io::ConcurrentTarball>& sharedTarball)
 	{
 		std::lock_guard<std::mutex> guard(_sinkMutex);
 
@@ -34,8 +47,39 @@ namespace HoloLensForCV
 		REQUIRES(nullptr == _archiveSourceFolder);
 		_archiveSourceFolder = archiveSourceFolder;
 
-		// Create the tarball for the bitmap files.
-		
+		// Reset the frame accounting for this recording.
+		_sequenceNumberValid = false;
+		_expectedSequenceNumber = 0;
+		_framesRecorded = 0;
+		_framesMissed = 0;
+		_keyframeSelector.Reset();
+
+		// Prepare the bitmap file names, <sensor>\<timestamp>.pgm (or .ppm for the PV
+		// camera), and their tar header; Send only patches the timestamp and size.
+
+		{
+			const std::wstring bitmapPathPrefix =
+				std::wstring(_sensorName->Data()) + L"\\";
+			const std::wstring bitmapPathSuffix =
+				(_sensorType == SensorType::PhotoVideo) ? L".ppm" : L".pgm";
+
+			_bitmapPath =
+				bitmapPathPrefix +
+				std::wstring(Io::TarHeaderTemplate::FileNumberDigits, L'0') +
+				bitmapPathSuffix;
+			_bitmapPathTimestampOffset = bitmapPathPrefix.size();
+
+			_bitmapTarHeader.reset(
+				new Io::TarHeaderTemplate(bitmapPathPrefix, bitmapPathSuffix));
+
+			_bitmapHeader.clear();
+		}
+
+		// Create the tarball for the bitmap files, unless they go to the shared archive.
+
+		_sharedTarball = sharedTarball;
+
+		if (nullptr == _sharedTarball)
 		{
 			wchar_t fileName[MAX_PATH] = {};
 			swprintf_s(
@@ -82,6 +126,19 @@ namespace HoloLensForCV
 			columns.push_back(L"CameraProjectionTransform.m31"); columns.push_back(L"CameraProjectionTransform.m32"); columns.push_back(L"CameraProjectionTransform.m33"); columns.push_back(L"CameraProjectionTransform.m34");
 			columns.push_back(L"CameraProjectionTransform.m41"); columns.push_back(L"CameraProjectionTransform.m42"); columns.push_back(L"CameraProjectionTransform.m43"); columns.push_back(L"CameraProjectionTransform.m44");
 
+			// Appended last to keep the column indices of earlier recordings valid.
+			columns.push_back(L"SequenceNumber");
+
+			// Image quality scores and keyframe selection, see ImageQuality.h.
+			columns.push_back(L"Sharpness");
+			columns.push_back(L"MeanIntensity");
+			columns.push_back(L"IntensityStdDev");
+			columns.push_back(L"UnderexposedFraction");
+			columns.push_back(L"OverexposedFraction");
+			columns.push_back(L"PoseDeltaTranslation");
+			columns.push_back(L"PoseDeltaRotation");
+			columns.push_back(L"IsKeyframe");
+
 			_csvWriter->WriteHeader(columns);
 		}
 	}
@@ -90,6 +147,7 @@ namespace HoloLensForCV
 	{
 		std::lock_guard<std::mutex> guard(_sinkMutex);
 		_bitmapTarball.reset();
+		_sharedTarball.reset();
 		_csvWriter.reset();
 		_archiveSourceFolder = nullptr;
 	}
@@ -144,16 +202,20 @@ namespace HoloLensForCV
 
 		_prevFrameTimestamp = sensorFrame->Timestamp;
 
+		// Account for frames lost between the capture and the storage.
+		if (_sequenceNumberValid &&
+			sensorFrame->SequenceNumber > _expectedSequenceNumber)
+		{
+			_framesMissed += sensorFrame->SequenceNumber - _expectedSequenceNumber;
+		}
+
+		_sequenceNumberValid = true;
+		_expectedSequenceNumber = sensorFrame->SequenceNumber + 1;
+
 		//
 		// Write the sensor frame as a bitmap to the archive.
 		//
 
-#if DBG_ENABLE_VERBOSE_LOGGING
-		dbg::trace(
-			L"SensorFrameRecorderSink::Send: saving sensor frame to %s",
-			bitmapPath);
-#endif /* DBG_ENABLE_VERBOSE_LOGGING */
-
 		Windows::Graphics::Imaging::SoftwareBitmap^ softwareBitmap =
 			sensorFrame->SoftwareBitmap;
 
@@ -204,35 +266,43 @@ namespace HoloLensForCV
 			break;
 		}
 
-        // Determine which bitmap format to use.
-        std::string bitmapFormat;
-        std::wstring bitmapFileExtension;
-        if (_sensorType == SensorType::PhotoVideo)
-        {
-            bitmapFormat = "P6";
-            bitmapFileExtension = L"ppm";
-        }
-        else 
-        {
-            bitmapFormat = "P5";
-            bitmapFileExtension = L"pgm";
-        }
+		// Patch the timestamp into the output file name.
+		{
+			uint64_t timestamp = sensorFrame->Timestamp.UniversalTime;
+
+			for (size_t i = Io::TarHeaderTemplate::FileNumberDigits; i-- > 0;)
+			{
+				_bitmapPath[_bitmapPathTimestampOffset + i] =
+					static_cast<wchar_t>(L'0' + timestamp % 10);
+				timestamp /= 10;
+			}
+		}
 
-        // Compose the output file name.
-        wchar_t bitmapPath[MAX_PATH];
-        swprintf_s(
-            bitmapPath, L"%s\\%020llu.%s",
-            _sensorName->Data(),
-            sensorFrame->Timestamp.UniversalTime,
-            bitmapFileExtension.c_str());
-
-		// Compose PGM header string.
-		std::stringstream header;
-		header << bitmapFormat << "\n"
-			<< actualBitmapWidth << " "
-			<< softwareBitmap->PixelHeight << "\n"
-			<< maxBitmapValue << "\n";
-		const std::string headerString = header.str();
+#if DBG_ENABLE_VERBOSE_LOGGING
+		dbg::trace(
+			L"SensorFrameRecorderSink::Send: saving sensor frame to %s",
+			_bitmapPath.c_str());
+#endif /* DBG_ENABLE_VERBOSE_LOGGING */
+
+		// Compose the PGM (or PPM for the PV camera) header string, which only changes
+		// with the image format.
+		if (_bitmapHeader.empty() ||
+			_bitmapHeaderWidth != actualBitmapWidth ||
+			_bitmapHeaderHeight != softwareBitmap->PixelHeight ||
+			_bitmapHeaderMaxValue != maxBitmapValue)
+		{
+			std::stringstream header;
+			header << ((_sensorType == SensorType::PhotoVideo) ? "P6" : "P5") << "\n"
+				<< actualBitmapWidth << " "
+				<< softwareBitmap->PixelHeight << "\n"
+				<< maxBitmapValue << "\n";
+			_bitmapHeader = header.str();
+			_bitmapHeaderWidth = actualBitmapWidth;
+			_bitmapHeaderHeight = softwareBitmap->PixelHeight;
+			_bitmapHeaderMaxValue = maxBitmapValue;
+		}
+
+		const std::string& headerString = _bitmapHeader;
 
 		// Get bitmap buffer object of the frame.
 		Windows::Graphics::Imaging::BitmapBuffer^ bitmapBuffer =
@@ -246,25 +316,70 @@ namespace HoloLensForCV
 				bitmapBuffer->CreateReference(),
 				pixelBufferDataLength);
 
-        // Convert the software bitmap to raw bytes.
-        std::vector<uint8_t> bitmapData;
+		// Score the image quality and decide whether this is a keyframe.
+		ImageQualityScores imageQualityScores;
+
+		if (_sensorType == SensorType::PhotoVideo)
+		{
+			_imageQualityScorer.ScoreBgra8(
+				pixelBufferData,
+				softwareBitmap->PixelWidth,
+				softwareBitmap->PixelHeight,
+				softwareBitmap->PixelWidth * 4 /* rowStride */,
+				&imageQualityScores);
+		}
+		else if (255 == maxBitmapValue)
+		{
+			_imageQualityScorer.ScoreGray8(
+				pixelBufferData,
+				actualBitmapWidth,
+				softwareBitmap->PixelHeight,
+				actualBitmapWidth /* rowStride */,
+				&imageQualityScores);
+		}
+		else
+		{
+			// Depth images are not scored.
+			memset(
+				&imageQualityScores,
+				0 /* _Val */,
+				sizeof(imageQualityScores));
+		}
+
+		float poseDeltaTranslation = 0.0f;
+		float poseDeltaRotation = 0.0f;
+
+		const bool isKeyframe =
+			_keyframeSelector.Evaluate(
+				sensorFrame->Timestamp,
+				sensorFrame->FrameToOrigin,
+				imageQualityScores,
+				&poseDeltaTranslation,
+				&poseDeltaRotation);
+
+        // Convert the software bitmap to raw bytes, reusing the buffer of the
+        // previous frame.
+        std::vector<uint8_t>& bitmapData = _bitmapData;
+        bitmapData.clear();
         if (_sensorType == SensorType::PhotoVideo)
         {
             const uint32_t numPixels = softwareBitmap->PixelWidth * softwareBitmap->PixelHeight;
 
             // Allocate data for PGM bitmap file.
-            bitmapData.reserve(headerString.size() + numPixels * 3);
+            bitmapData.resize(headerString.size() + numPixels * 3);
 
             // Add PGM header data.
-            bitmapData.insert(
-                bitmapData.end(),
-                headerString.c_str(), headerString.c_str() + headerString.size());
+            std::copy(
+                headerString.begin(), headerString.end(), bitmapData.begin());
+
+            // Add the pixel data, BGRA to RGB.
+            uint8_t* rgbData = bitmapData.data() + headerString.size();
 
             for (uint32_t i = 0; i < numPixels; ++i)
             {
                 for (uint32_t j = 0; j < 3; ++j)
                 {
-                    bitmapData.push_back(pixelBufferData[i * 4 + 2 - j]);
+                    rgbData[i * 3 + j] = pixelBufferData[i * 4 + 2 - j];
                 }
             }
         }
@@ -284,8 +399,20 @@ namespace HoloLensForCV
                 pixelBufferData, pixelBufferData + pixelBufferDataLength);
         }
 
-		// Add the bitmap to the tarball.
-		_bitmapTarball->AddFile(bitmapPath, bitmapData.data(), bitmapData.size());
+		// Add the bitmap to the tarball. The shared archive needs no lock, so the sinks
+		// of all sensors write to it concurrently.
+		if (nullptr != _sharedTarball)
+		{
+			_sharedTarball->AddFile(
+				*_bitmapTarHeader, sensorFrame->Timestamp.UniversalTime,
+				bitmapData.data(), bitmapData.size());
+		}
+		else
+		{
+			_bitmapTarball->AddFile(
+				*_bitmapTarHeader, sensorFrame->Timestamp.UniversalTime,
+				bitmapData.data(), bitmapData.size());
+		}
 
 		//
 		// Record the sensor frame meta data to the csv file.
@@ -298,7 +425,7 @@ namespace HoloLensForCV
 
 		{
 			_csvWriter->WriteText(
-				bitmapPath, &writeComma);
+				_bitmapPath, &writeComma);
 		}
 
 		_csvWriter->WriteFloat4x4(
@@ -310,6 +437,35 @@ namespace HoloLensForCV
 		_csvWriter->WriteFloat4x4(
 			sensorFrame->CameraProjectionTransform, &writeComma);
 
+		_csvWriter->WriteUInt64(
+			sensorFrame->SequenceNumber, &writeComma);
+
+		_csvWriter->WriteFloat(
+			imageQualityScores.Sharpness, &writeComma);
+
+		_csvWriter->WriteFloat(
+			imageQualityScores.MeanIntensity, &writeComma);
+
+		_csvWriter->WriteFloat(
+			imageQualityScores.IntensityStdDev, &writeComma);
+
+		_csvWriter->WriteFloat(
+			imageQualityScores.UnderexposedFraction, &writeComma);
+
+		_csvWriter->WriteFloat(
+			imageQualityScores.OverexposedFraction, &writeComma);
+
+		_csvWriter->WriteFloat(
+			poseDeltaTranslation, &writeComma);
+
+		_csvWriter->WriteFloat(
+			poseDeltaRotation, &writeComma);
+
+		_csvWriter->WriteInt32(
+			isKeyframe ? 1 : 0, &writeComma);
+
 		_csvWriter->EndLine();
+
+		++_framesRecorded;
 	}
 }
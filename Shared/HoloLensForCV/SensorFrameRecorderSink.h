@@ -34,7 +34,32 @@ namespace HoloLensForCV
 
 		virtual void Send(_In_ SensorFrame^ sensorFrame);
 
+		/// <summary>
+		/// Number of frames written to the archive since the last call to Start.
+		/// </summary>
+		property uint64_t FramesRecorded
+		{
+			uint64_t get() { return _framesRecorded; }
+		}
+
+		/// <summary>
+		/// Number of frames that were captured but never reached this sink since the
+		/// last call to Start, as indicated by gaps in the frame sequence numbers.
+		/// </summary>
+		property uint64_t FramesMissed
+		{
+			uint64_t get() { return _framesMissed; }
+		}
+
 	internal:
+		//
+		// Like Start, but adds the bitmap files to an archive shared with the sinks of
+		// the other sensors instead of creating a tarball for this sensor.
+		//
+		void StartInSharedArchive(
+			_In_ Windows::Storage::StorageFolder^ archiveSourceFolder,
+			_In_ const std::shared_ptr<Io::ConcurrentTarball>& sharedTarball);
+
 		Platform::String^ GetSensorName();
 
 		CameraIntrinsics^ GetCameraIntrinsics();
@@ -54,10 +79,31 @@ namespace HoloLensForCV
 		Windows::Storage::StorageFolder^ _archiveSourceFolder;
 
 		std::unique_ptr<Io::Tarball> _bitmapTarball;
+		std::shared_ptr<Io::ConcurrentTarball> _sharedTarball;
+
+		// Per-frame file name, tar header and PGM header, patched rather than rebuilt
+		// for every frame.
+		std::wstring _bitmapPath;
+		size_t _bitmapPathTimestampOffset;
+		std::unique_ptr<Io::TarHeaderTemplate> _bitmapTarHeader;
+		std::string _bitmapHeader;
+		int _bitmapHeaderWidth;
+		int _bitmapHeaderHeight;
+		int _bitmapHeaderMaxValue;
+		std::vector<uint8_t> _bitmapData;
 		std::unique_ptr<CsvWriter> _csvWriter;
 
 		CameraIntrinsics^ _cameraIntrinsics;
 
 		Windows::Foundation::DateTime _prevFrameTimestamp;
+
+		bool _sequenceNumberValid;
+		uint64_t _expectedSequenceNumber;
+
+		std::atomic<uint64_t> _framesRecorded;
+		std::atomic<uint64_t> _framesMissed;
+
+		ImageQualityScorer _imageQualityScorer;
+		KeyframeSelector _keyframeSelector;
 	};
 }
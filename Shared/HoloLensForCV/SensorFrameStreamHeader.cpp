@@ -20,6 +20,7 @@ namespace HoloLensForCV
         VersionMinor = ProtocolVersionMinor;
         FrameType = SensorType::Undefined;
         Timestamp = 0;
+        SequenceNumber = 0;
         ImageWidth = 0;
         ImageHeight = 0;
         PixelStride = 0;
@@ -38,6 +39,7 @@ namespace HoloLensForCV
         header->VersionMinor = dataReader->ReadByte();
         header->FrameType = (SensorType)dataReader->ReadUInt16();
         header->Timestamp = dataReader->ReadUInt64();
+        header->SequenceNumber = dataReader->ReadUInt64();
         header->ImageWidth = dataReader->ReadUInt32();
         header->ImageHeight = dataReader->ReadUInt32();
         header->PixelStride = dataReader->ReadUInt32();
@@ -55,6 +57,7 @@ namespace HoloLensForCV
         dataWriter->WriteByte(header->VersionMinor);
         dataWriter->WriteUInt16((uint16_t)header->FrameType);
         dataWriter->WriteUInt64(header->Timestamp);
+        dataWriter->WriteUInt64(header->SequenceNumber);
         dataWriter->WriteUInt32(header->ImageWidth);
         dataWriter->WriteUInt32(header->ImageHeight);
         dataWriter->WriteUInt32(header->PixelStride);
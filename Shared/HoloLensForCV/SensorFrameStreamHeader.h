@@ -30,6 +30,7 @@ namespace HoloLensForCV
                     2 * sizeof(uint8_t) /* VersionMajor, VersionMinor */ +
                     sizeof(uint16_t) /* FrameType */ +
                     sizeof(uint64_t) /* Timestamp */ +
+                    sizeof(uint64_t) /* SequenceNumber */ +
                     4 * sizeof(uint32_t) /* ImageWidth, ImageHeight, PixelStride, RowStride */;
             }
         }
@@ -46,7 +47,7 @@ namespace HoloLensForCV
 
         static property uint8_t ProtocolVersionMinor
         {
-            uint8_t get() { return 0x01; }
+            uint8_t get() { return 0x02; }
         }
 
         property uint32_t Cookie;
@@ -54,6 +55,7 @@ namespace HoloLensForCV
         property uint8_t VersionMinor;
         property SensorType FrameType;
         property uint64_t Timestamp;
+        property uint64_t SequenceNumber;
         property uint32_t ImageWidth;
         property uint32_t ImageHeight;
         property uint32_t PixelStride;
@@ -17,6 +17,21 @@ namespace HoloLensForCV
     {
     }
 
+    SensorFrameSinkPair::SensorFrameSinkPair(
+        _In_ ISensorFrameSink^ first,
+        _In_ ISensorFrameSink^ second)
+        : _first(first)
+        , _second(second)
+    {
+    }
+
+    void SensorFrameSinkPair::Send(
+        SensorFrame^ sensorFrame)
+    {
+        _first->Send(sensorFrame);
+        _second->Send(sensorFrame);
+    }
+
     void SensorFrameStreamer::EnableAll()
     {
         Enable(SensorType::PhotoVideo);
@@ -87,6 +102,42 @@ namespace HoloLensForCV
         }
     }
 
+    void SensorFrameStreamer::EnablePointCloud(
+        _In_ SensorType sensorType,
+        _In_ float voxelSize)
+    {
+        switch (sensorType)
+        {
+#if ENABLE_HOLOLENS_RESEARCH_MODE_SENSORS
+        case SensorType::ShortThrowToFDepth:
+            _pointCloudStreamingServers[(int32_t)SensorType::ShortThrowToFDepth] =
+                ref new PointCloudStreamingServer(
+                    L"23951",
+                    0.02f /* minimumDistance */,
+                    3.0f /* maximumDistance */,
+                    voxelSize);
+            break;
+
+        case SensorType::LongThrowToFDepth:
+            _pointCloudStreamingServers[(int32_t)SensorType::LongThrowToFDepth] =
+                ref new PointCloudStreamingServer(
+                    L"23952",
+                    1.0f /* minimumDistance */,
+                    4.0f /* maximumDistance */,
+                    voxelSize);
+            break;
+#endif /* ENABLE_HOLOLENS_RESEARCH_MODE_SENSORS */
+
+        default:
+#if DBG_ENABLE_ERROR_LOGGING
+            dbg::trace(
+                L"SensorFrameStreamer::EnablePointCloud: sensor type %i has no depth",
+                (int32_t)sensorType);
+#endif /* DBG_ENABLE_ERROR_LOGGING */
+            break;
+        }
+    }
+
     ISensorFrameSink^ SensorFrameStreamer::GetSensorFrameSink(
         _In_ SensorType sensorType)
     {
@@ -97,7 +148,23 @@ namespace HoloLensForCV
             0 <= sensorTypeAsIndex &&
             sensorTypeAsIndex < (int32_t)_sensorFrameStreamingServers.size());
 
-        return _sensorFrameStreamingServers[
-            sensorTypeAsIndex];
+        ISensorFrameSink^ sensorFrameStreamingServer =
+            _sensorFrameStreamingServers[sensorTypeAsIndex];
+
+        ISensorFrameSink^ pointCloudStreamingServer =
+            _pointCloudStreamingServers[sensorTypeAsIndex];
+
+        if (nullptr == pointCloudStreamingServer)
+        {
+            return sensorFrameStreamingServer;
+        }
+        else if (nullptr == sensorFrameStreamingServer)
+        {
+            return pointCloudStreamingServer;
+        }
+
+        return ref new SensorFrameSinkPair(
+            sensorFrameStreamingServer,
+            pointCloudStreamingServer);
     }
 }
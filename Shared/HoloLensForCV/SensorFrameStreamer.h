@@ -13,6 +13,27 @@
 
 namespace HoloLensForCV
 {
+    //
+    // Forwards the sensor frames to two sinks, e.g. to stream the depth images and the
+    // point clouds computed from them.
+    //
+    ref class SensorFrameSinkPair sealed
+        : public ISensorFrameSink
+    {
+    internal:
+        SensorFrameSinkPair(
+            _In_ ISensorFrameSink^ first,
+            _In_ ISensorFrameSink^ second);
+
+    public:
+        virtual void Send(
+            SensorFrame^ sensorFrame);
+
+    private:
+        ISensorFrameSink^ _first;
+        ISensorFrameSink^ _second;
+    };
+
     //
     // Collects sensor frames for all the enabled sensors. Opens a stream socket for each
     // of the sensors and streams the sensor images to connected clients.
@@ -28,10 +49,20 @@ namespace HoloLensForCV
         void Enable(
             _In_ SensorType sensorType);
 
+        /// <summary>
+        /// Additionally streams the frames of a ToF depth sensor as point clouds, see
+        /// PointCloudStreamingServer. At most one point is sent per cube of the voxel size
+        /// (in meters); a voxel size of zero sends all of the points.
+        /// </summary>
+        void EnablePointCloud(
+            _In_ SensorType sensorType,
+            _In_ float voxelSize);
+
         virtual ISensorFrameSink^ GetSensorFrameSink(
             _In_ SensorType sensorType);
 
     private:
         std::array<SensorFrameStreamingServer^, (size_t)SensorType::NumberOfSensorTypes> _sensorFrameStreamingServers;
+        std::array<PointCloudStreamingServer^, (size_t)SensorType::NumberOfSensorTypes> _pointCloudStreamingServers;
     };
 }
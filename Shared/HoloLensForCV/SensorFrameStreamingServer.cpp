@@ -13,10 +13,23 @@
 
 namespace HoloLensForCV
 {
+    static const uint64_t c_sendBufferMemoryLimit = 64ull * 1024 * 1024;
+
     SensorFrameStreamingServer::SensorFrameStreamingServer(
         _In_ Platform::String^ serviceName)
         : _writeInProgress(false)
+        , _framesSent(0)
+        , _framesDropped(0)
     {
+        _memoryPool.reset(
+            new MemoryPool(
+                MemoryBudget::Default,
+                std::wstring(L"SensorFrameStreamingServer ") + serviceName->Data(),
+                MemoryPoolPriority::Normal,
+                c_sendBufferMemoryLimit /* softLimit */,
+                c_sendBufferMemoryLimit /* hardLimit */,
+                nullptr /* releaseCallback */));
+
         _listener = ref new Windows::Networking::Sockets::StreamSocketListener();
 
         _listener->ConnectionReceived +=
@@ -96,6 +109,8 @@ namespace HoloLensForCV
                 L"SensorFrameStreamingServer::Send: image dropped -- previous send operation is in progress!");
 #endif /* DBG_ENABLE_INFORMATIONAL_LOGGING */
 
+            ++_framesDropped;
+
             return;
         }
 
@@ -181,6 +196,7 @@ namespace HoloLensForCV
 
         header->FrameType = sensorFrame->FrameType;
         header->Timestamp = sensorFrame->Timestamp.UniversalTime;
+        header->SequenceNumber = sensorFrame->SequenceNumber;
         header->ImageWidth = imageWidth;
         header->ImageHeight = imageHeight;
         header->PixelStride = pixelStride;
@@ -212,6 +228,27 @@ namespace HoloLensForCV
                 L"SensorFrameStreamingServer::SendImage: image dropped -- previous StoreAsync task is still in progress!");
 #endif /* DBG_ENABLE_INFORMATIONAL_LOGGING */
 
+            ++_framesDropped;
+
+            return;
+        }
+
+        //
+        // The writer holds a copy of the frame until the send completes. Under memory
+        // pressure, drop the frame rather than buffer it.
+        //
+        const uint64_t sendBufferSize =
+            SensorFrameStreamHeader::ProtocolHeaderLength + data->Length;
+
+        if (!_memoryPool->TryReserve(sendBufferSize))
+        {
+#if DBG_ENABLE_INFORMATIONAL_LOGGING
+            dbg::trace(
+                L"SensorFrameStreamingServer::SendImage: image dropped -- over the memory budget!");
+#endif /* DBG_ENABLE_INFORMATIONAL_LOGGING */
+
+            ++_framesDropped;
+
             return;
         }
 
@@ -239,13 +276,18 @@ namespace HoloLensForCV
 #endif /* DBG_ENABLE_INFORMATIONAL_LOGGING */
 
         Concurrency::create_task(_writer->StoreAsync()).then(
-            [&](Concurrency::task<unsigned int> writeTask)
+            [this, sendBufferSize](Concurrency::task<unsigned int> writeTask)
         {
+            _memoryPool->Release(
+                sendBufferSize);
+
             try
             {
                 // Try getting an exception.
                 writeTask.get();
 
+                ++_framesSent;
+
                 _writeInProgress = false;
             }
             catch (Platform::Exception^ exception)
@@ -256,6 +298,8 @@ namespace HoloLensForCV
                     exception->Message->Data());
 #endif /* DBG_ENABLE_ERROR_LOGGING */
 
+                ++_framesDropped;
+
                 _socket = nullptr;
             }
         });
@@ -23,6 +23,24 @@ namespace HoloLensForCV
         virtual void Send(
             SensorFrame^ sensorFrame);
 
+        /// <summary>
+        /// Number of frames written to the connected client.
+        /// </summary>
+        property uint64_t FramesSent
+        {
+            uint64_t get() { return _framesSent; }
+        }
+
+        /// <summary>
+        /// Number of frames dropped by the server while a client was connected, either
+        /// because the previous send was still in flight, because the memory budget
+        /// refused the send buffer or because the send failed.
+        /// </summary>
+        property uint64_t FramesDropped
+        {
+            uint64_t get() { return _framesDropped; }
+        }
+
     private:
         ~SensorFrameStreamingServer();
 
@@ -39,5 +57,11 @@ namespace HoloLensForCV
         Windows::Networking::Sockets::StreamSocket^ _socket;
         Windows::Storage::Streams::DataWriter^ _writer;
         bool _writeInProgress;
+
+        std::atomic<uint64_t> _framesSent;
+        std::atomic<uint64_t> _framesDropped;
+
+        // Accounts for the frame held by the writer until it is sent
+        std::unique_ptr<MemoryPool> _memoryPool;
     };
 }
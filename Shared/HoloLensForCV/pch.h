@@ -15,6 +15,7 @@
 #include <array>
 #include <memory>
 #include <mutex>
+#include <atomic>
 #include <ctime>
 #include <deque>
 #include <chrono>
@@ -24,6 +25,13 @@
 #include <stdexcept>
 #include <shared_mutex>
 #include <unordered_set>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+
+#if !defined(NOMINMAX)
+#define NOMINMAX
+#endif /* !defined(NOMINMAX) */
 
 #include <agile.h>
 #include <collection.h>
@@ -36,6 +44,16 @@
 
 #include <DirectXMath.h>
 
+//
+// The point cloud back-projection uses SSE2 on x86/x64 and falls back to scalar code on ARM.
+//
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#define HOLOLENSFORCV_USE_SSE2 1
+#else
+#define HOLOLENSFORCV_USE_SSE2 0
+#endif /* defined(_M_IX86) || defined(_M_X64) */
+
 #define DBG_ENABLE_ERROR_LOGGING 1
 #define DBG_ENABLE_INFORMATIONAL_LOGGING 1
 #define DBG_ENABLE_VERBOSE_LOGGING 0
@@ -56,11 +74,16 @@
 #include "ISensorFrameSink.h"
 #include "ISensorFrameSinkGroup.h"
 
+#include "MemoryBudget.h"
+
 #include "SensorFrameStreamHeader.h"
 #include "SensorFrameStreamingServer.h"
+#include "PointCloudStreamingServer.h"
 #include "SensorFrameStreamer.h"
 #include "SensorFrameReceiver.h"
+#include "HeadPoseStreamingServer.h"
 
+#include "ImageQuality.h"
 #include "SensorFrameRecorderSink.h"
 #include "SensorFrameRecorder.h"
 
@@ -69,3 +92,4 @@
 #include "MediaFrameSourceGroup.h"
 
 #include "MultiFrameBuffer.h"
+#include "MotionGate.h"
@@ -0,0 +1,382 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#include "pch.h"
+
+namespace Io
+{
+    AlignedFileWriter::AlignedFileWriter(
+        _In_ const std::wstring& fileName,
+        _In_ const size_t bufferSize,
+        _In_ const int32_t numberOfBuffers,
+        _In_ const uint64_t preallocationSize)
+        : _fileName(fileName)
+        , _file(INVALID_HANDLE_VALUE)
+        , _unbuffered(true)
+        , _bufferSize(bufferSize)
+        , _currentBuffer(0)
+        , _currentBufferUsed(0)
+        , _bufferOffset(0)
+        , _size(0)
+        , _preallocationSize(preallocationSize)
+        , _allocationSize(0)
+    {
+        REQUIRES(0 < bufferSize && 0 == bufferSize % Alignment);
+        REQUIRES(0 < numberOfBuffers);
+
+        CREATEFILE2_EXTENDED_PARAMETERS parameters = {};
+
+        parameters.dwSize =
+            sizeof(parameters);
+
+        parameters.dwFileAttributes =
+            FILE_ATTRIBUTE_NORMAL;
+
+        parameters.dwFileFlags =
+            FILE_FLAG_OVERLAPPED | FILE_FLAG_NO_BUFFERING;
+
+        _file =
+            CreateFile2(
+                fileName.c_str(),
+                GENERIC_WRITE /* dwDesiredAccess */,
+                FILE_SHARE_READ /* dwShareMode */,
+                CREATE_ALWAYS /* dwCreationDisposition */,
+                &parameters);
+
+        if (INVALID_HANDLE_VALUE == _file)
+        {
+#if DBG_ENABLE_INFORMATIONAL_LOGGING
+            dbg::trace(
+                L"AlignedFileWriter::AlignedFileWriter: unbuffered I/O failed with error %i, falling back to buffered I/O",
+                GetLastError());
+#endif /* DBG_ENABLE_INFORMATIONAL_LOGGING */
+
+            _unbuffered = false;
+
+            parameters.dwFileFlags =
+                FILE_FLAG_OVERLAPPED;
+
+            _file =
+                CreateFile2(
+                    fileName.c_str(),
+                    GENERIC_WRITE /* dwDesiredAccess */,
+                    FILE_SHARE_READ /* dwShareMode */,
+                    CREATE_ALWAYS /* dwCreationDisposition */,
+                    &parameters);
+        }
+
+        ASSERT(INVALID_HANDLE_VALUE != _file);
+
+        _buffers.resize(
+            numberOfBuffers);
+
+        for (WriteBuffer& buffer : _buffers)
+        {
+            buffer.Data =
+                static_cast<uint8_t*>(
+                    _aligned_malloc(
+                        _bufferSize,
+                        Alignment));
+
+            ASSERT(nullptr != buffer.Data);
+
+            memset(
+                &buffer.Overlapped,
+                0 /* _Val */,
+                sizeof(buffer.Overlapped));
+
+            buffer.Overlapped.hEvent =
+                CreateEventEx(
+                    nullptr /* lpEventAttributes */,
+                    nullptr /* lpName */,
+                    CREATE_EVENT_MANUAL_RESET /* dwFlags */,
+                    EVENT_ALL_ACCESS /* dwDesiredAccess */);
+
+            ASSERT(nullptr != buffer.Overlapped.hEvent);
+
+            buffer.Pending = false;
+        }
+    }
+
+    AlignedFileWriter::~AlignedFileWriter()
+    {
+        Close();
+
+        for (WriteBuffer& buffer : _buffers)
+        {
+            ASSERT(!!CloseHandle(
+                buffer.Overlapped.hEvent));
+
+            _aligned_free(
+                buffer.Data);
+        }
+    }
+
+    void AlignedFileWriter::Write(
+        _In_reads_bytes_(size) const void* data,
+        _In_ const size_t size)
+    {
+        ASSERT(IsOpen());
+
+        const uint8_t* source =
+            static_cast<const uint8_t*>(data);
+
+        size_t remaining =
+            size;
+
+        while (remaining > 0)
+        {
+            const size_t chunkSize =
+                (std::min)(
+                    remaining,
+                    _bufferSize - _currentBufferUsed);
+
+            memcpy(
+                _buffers[_currentBuffer].Data + _currentBufferUsed,
+                source,
+                chunkSize);
+
+            _currentBufferUsed += chunkSize;
+            source += chunkSize;
+            remaining -= chunkSize;
+
+            if (_bufferSize == _currentBufferUsed)
+            {
+                SubmitCurrentBuffer();
+            }
+        }
+
+        _size += size;
+    }
+
+    void AlignedFileWriter::Close()
+    {
+        if (!IsOpen())
+        {
+            return;
+        }
+
+        if (0 != _currentBufferUsed)
+        {
+            SubmitCurrentBuffer();
+        }
+
+        for (WriteBuffer& buffer : _buffers)
+        {
+            WaitForBuffer(
+                buffer);
+        }
+
+        //
+        // Drop the alignment padding of the last buffer and the unused preallocation.
+        //
+        FILE_END_OF_FILE_INFO endOfFileInfo = {};
+
+        endOfFileInfo.EndOfFile.QuadPart =
+            static_cast<LONGLONG>(_size);
+
+        ASSERT(!!SetFileInformationByHandle(
+            _file,
+            FileEndOfFileInfo,
+            &endOfFileInfo,
+            sizeof(endOfFileInfo)));
+
+        ASSERT(!!CloseHandle(
+            _file));
+
+        _file = INVALID_HANDLE_VALUE;
+    }
+
+    bool AlignedFileWriter::IsOpen() const
+    {
+        return INVALID_HANDLE_VALUE != _file;
+    }
+
+    bool AlignedFileWriter::IsUnbuffered() const
+    {
+        return _unbuffered;
+    }
+
+    uint64_t AlignedFileWriter::GetSize() const
+    {
+        return _size;
+    }
+
+    void AlignedFileWriter::SubmitCurrentBuffer()
+    {
+        WriteBuffer& buffer =
+            _buffers[_currentBuffer];
+
+        //
+        // Only the last buffer can be partially filled. Unbuffered writes must cover
+        // whole sectors, so it is padded with zeroes which Close truncates again.
+        //
+        const size_t writeSize =
+            (_currentBufferUsed + Alignment - 1) / Alignment * Alignment;
+
+        memset(
+            buffer.Data + _currentBufferUsed,
+            0 /* _Val */,
+            writeSize - _currentBufferUsed);
+
+        Preallocate(
+            _bufferOffset + writeSize);
+
+        buffer.Overlapped.Offset =
+            static_cast<DWORD>(_bufferOffset);
+
+        buffer.Overlapped.OffsetHigh =
+            static_cast<DWORD>(_bufferOffset >> 32);
+
+        if (!WriteFile(
+            _file,
+            buffer.Data,
+            static_cast<DWORD>(writeSize),
+            nullptr /* lpNumberOfBytesWritten */,
+            &buffer.Overlapped) &&
+            ERROR_IO_PENDING != GetLastError())
+        {
+            //
+            // Some volumes open for unbuffered I/O but reject the unbuffered writes,
+            // e.g. with ERROR_INVALID_PARAMETER on a sector size mismatch. Continue
+            // with buffered I/O rather than failing the recording.
+            //
+            ASSERT(_unbuffered);
+
+#if DBG_ENABLE_INFORMATIONAL_LOGGING
+            dbg::trace(
+                L"AlignedFileWriter::SubmitCurrentBuffer: unbuffered write failed with error %i, falling back to buffered I/O",
+                GetLastError());
+#endif /* DBG_ENABLE_INFORMATIONAL_LOGGING */
+
+            ReopenBuffered();
+
+            if (!WriteFile(
+                _file,
+                buffer.Data,
+                static_cast<DWORD>(writeSize),
+                nullptr /* lpNumberOfBytesWritten */,
+                &buffer.Overlapped))
+            {
+                ASSERT(ERROR_IO_PENDING == GetLastError());
+            }
+        }
+
+        buffer.Pending = true;
+
+        _bufferOffset += writeSize;
+
+        //
+        // Move on to the least recently submitted buffer, waiting for its write to
+        // complete if the storage fell behind.
+        //
+        _currentBuffer =
+            (_currentBuffer + 1) % _buffers.size();
+
+        _currentBufferUsed = 0;
+
+        WaitForBuffer(
+            _buffers[_currentBuffer]);
+    }
+
+    void AlignedFileWriter::ReopenBuffered()
+    {
+        for (WriteBuffer& buffer : _buffers)
+        {
+            WaitForBuffer(
+                buffer);
+        }
+
+        ASSERT(!!CloseHandle(
+            _file));
+
+        _unbuffered = false;
+
+        CREATEFILE2_EXTENDED_PARAMETERS parameters = {};
+
+        parameters.dwSize =
+            sizeof(parameters);
+
+        parameters.dwFileAttributes =
+            FILE_ATTRIBUTE_NORMAL;
+
+        parameters.dwFileFlags =
+            FILE_FLAG_OVERLAPPED;
+
+        //
+        // Keep what was written so far, and the preallocated extent.
+        //
+        _file =
+            CreateFile2(
+                _fileName.c_str(),
+                GENERIC_WRITE /* dwDesiredAccess */,
+                FILE_SHARE_READ /* dwShareMode */,
+                OPEN_EXISTING /* dwCreationDisposition */,
+                &parameters);
+
+        ASSERT(INVALID_HANDLE_VALUE != _file);
+    }
+
+    void AlignedFileWriter::WaitForBuffer(
+        _Inout_ WriteBuffer& buffer)
+    {
+        if (!buffer.Pending)
+        {
+            return;
+        }
+
+        DWORD numberOfBytesWritten = 0;
+
+        ASSERT(!!GetOverlappedResult(
+            _file,
+            &buffer.Overlapped,
+            &numberOfBytesWritten,
+            TRUE /* bWait */));
+
+        buffer.Pending = false;
+    }
+
+    void AlignedFileWriter::Preallocate(
+        _In_ const uint64_t requiredSize)
+    {
+        if (0 == _preallocationSize || requiredSize <= _allocationSize)
+        {
+            return;
+        }
+
+        FILE_ALLOCATION_INFO allocationInfo = {};
+
+        allocationInfo.AllocationSize.QuadPart =
+            static_cast<LONGLONG>(
+                (std::max)(requiredSize, _allocationSize + _preallocationSize));
+
+        if (!SetFileInformationByHandle(
+            _file,
+            FileAllocationInfo,
+            &allocationInfo,
+            sizeof(allocationInfo)))
+        {
+#if DBG_ENABLE_INFORMATIONAL_LOGGING
+            dbg::trace(
+                L"AlignedFileWriter::Preallocate: preallocation failed with error %i, growing the file on demand",
+                GetLastError());
+#endif /* DBG_ENABLE_INFORMATIONAL_LOGGING */
+
+            _preallocationSize = 0;
+
+            return;
+        }
+
+        _allocationSize =
+            static_cast<uint64_t>(
+                allocationInfo.AllocationSize.QuadPart);
+    }
+}
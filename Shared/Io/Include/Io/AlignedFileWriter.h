@@ -0,0 +1,104 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#pragma once
+
+namespace Io
+{
+    //
+    // Sequential file writer for recordings. Small writes are gathered into a ring of
+    // page-aligned buffers, and full buffers are written with overlapped, unbuffered
+    // I/O while the next ones fill up, so the storage sees a few large sequential writes
+    // instead of many small ones. The file is preallocated in large extents to keep it
+    // from growing (and fragmenting) one write at a time, and truncated to the number of
+    // bytes written when closed.
+    //
+    // Falls back to buffered overlapped I/O if the file system does not support
+    // unbuffered I/O, either when the file is opened or on the first write it rejects
+    // (e.g. with a sector size the alignment does not cover), and to growing the file
+    // on demand if it cannot preallocate.
+    //
+    // Unbuffered I/O pays off on storage which is slower than the page cache; where the
+    // page cache keeps up (e.g. a RAM disk), buffered writes are faster.
+    //
+    class AlignedFileWriter
+    {
+    public:
+        //
+        // Alignment of the buffers, write sizes and file offsets required by unbuffered
+        // I/O: a multiple of the sector size of all the storage we write to.
+        //
+        static const size_t Alignment = 4096;
+
+        AlignedFileWriter(
+            _In_ const std::wstring& fileName,
+            _In_ const size_t bufferSize = 256 * 1024,
+            _In_ const int32_t numberOfBuffers = 4,
+            _In_ const uint64_t preallocationSize = 64 * 1024 * 1024);
+
+        ~AlignedFileWriter();
+
+        void Write(
+            _In_reads_bytes_(size) const void* data,
+            _In_ const size_t size);
+
+        //
+        // Waits for all writes to complete and truncates the file to its actual size.
+        //
+        void Close();
+
+        bool IsOpen() const;
+
+        bool IsUnbuffered() const;
+
+        uint64_t GetSize() const;
+
+    private:
+        struct WriteBuffer
+        {
+            uint8_t* Data;
+            OVERLAPPED Overlapped;
+            bool Pending;
+        };
+
+        void SubmitCurrentBuffer();
+
+        //
+        // Waits for the pending writes and reopens the file for buffered I/O.
+        //
+        void ReopenBuffered();
+
+        void WaitForBuffer(
+            _Inout_ WriteBuffer& buffer);
+
+        void Preallocate(
+            _In_ const uint64_t requiredSize);
+
+    private:
+        std::wstring _fileName;
+        HANDLE _file;
+        bool _unbuffered;
+
+        size_t _bufferSize;
+        std::vector<WriteBuffer> _buffers;
+        size_t _currentBuffer;
+        size_t _currentBufferUsed;
+
+        //
+        // File offset of the current buffer, and number of bytes written so far.
+        //
+        uint64_t _bufferOffset;
+        uint64_t _size;
+
+        uint64_t _preallocationSize;
+        uint64_t _allocationSize;
+    };
+}
@@ -15,6 +15,7 @@
 #include <Io/TimeConverter.h>
 #include <Io/Timer.h>
 #include <Io/StorageHandleAccess.h>
+#include <Io/AlignedFileWriter.h>
 #include <Io/Tar.h>
 #include <Io/BufferHelpers.h>
 #include <Io/StringHelpers.h>
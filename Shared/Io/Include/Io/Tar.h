@@ -11,6 +11,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <fstream>
 
 namespace Io
@@ -21,6 +22,51 @@ namespace Io
         _In_ Windows::Storage::StorageFolder^ tarballFolder,
         _In_ const std::wstring& tarballFileName);
 
+    //
+    // Tar header of a series of files named <prefix><number><suffix>, with the number
+    // written as FileNumberDigits decimal digits, e.g. the frames of one sensor. Only
+    // the number, size and modification time change from file to file, so Update
+    // patches just those fields and adjusts the checksum by the difference of the
+    // changed bytes instead of formatting and summing a whole new header.
+    //
+    class TarHeaderTemplate
+    {
+    public:
+        static const size_t Size = 512;
+
+        static const size_t FileNumberDigits = 20;
+
+        TarHeaderTemplate(
+            _In_ const std::wstring& fileNamePrefix,
+            _In_ const std::wstring& fileNameSuffix);
+
+        void Update(
+            _In_ const uint64_t fileNumber,
+            _In_ const uint64_t fileSize,
+            _In_ const uint64_t lastModificationTime);
+
+        const uint8_t* GetData() const;
+
+        std::string GetFileName() const;
+
+    private:
+        void PatchDigits(
+            _In_ const size_t offset,
+            _In_ const size_t numberOfDigits,
+            _In_ const uint64_t radix,
+            _In_ uint64_t value);
+
+    private:
+        uint8_t _header[Size];
+
+        //
+        // Sum of the header bytes, counting the checksum field as spaces.
+        //
+        uint64_t _checksum;
+
+        size_t _fileNumberOffset;
+    };
+
 	// Class to create tarball, which allows for incremental
 	// streaming of files into the archive.
 	class Tarball
@@ -38,8 +84,107 @@ namespace Io
 			_In_ const uint8_t* fileData,
 			_In_ const size_t fileSize);
 
+		// Add the next file of a series to the tarball, see TarHeaderTemplate.
+		void AddFile(
+			_Inout_ TarHeaderTemplate& headerTemplate,
+			_In_ const uint64_t fileNumber,
+			_In_ const uint8_t* fileData,
+			_In_ const size_t fileSize);
+
 	private:
-		// The file handler to the tarball.
-		std::ofstream _tarballFile;
+		// The tarball, written with large aligned writes.
+		AlignedFileWriter _tarballFile;
 	};
+
+    //
+    // Tarball that many threads can add files to at the same time, e.g. the recorder
+    // sinks of all sensors sharing a single archive. Each AddFile call atomically
+    // reserves the 512-byte aligned extent of its file at the end of the archive and
+    // fills it with positioned writes on an overlapped handle, each thread waiting on
+    // its own event, so writers never wait for each other's writes. Completed
+    // files are published to a lock-free index, which Close writes as the last file of
+    // the archive (see IndexFileName).
+    //
+    // The archive is only valid once Close was called after all AddFile calls returned.
+    //
+    class ConcurrentTarball
+    {
+    public:
+        ConcurrentTarball(
+            _In_ const std::wstring& tarballFileName);
+
+        ~ConcurrentTarball();
+
+        //
+        // Name of the CSV file listing the name, header offset and size of all the other
+        // files in the archive, for random access without scanning the archive.
+        //
+        static const wchar_t* IndexFileName;
+
+        void Close();
+
+        //
+        // Safe to call from any number of threads at the same time.
+        //
+        void AddFile(
+            _In_ const std::wstring& fileName,
+            _In_ const uint8_t* fileData,
+            _In_ const size_t fileSize);
+
+        //
+        // Adds the next file of a series, see TarHeaderTemplate. Each thread needs its
+        // own template.
+        //
+        void AddFile(
+            _Inout_ TarHeaderTemplate& headerTemplate,
+            _In_ const uint64_t fileNumber,
+            _In_ const uint8_t* fileData,
+            _In_ const size_t fileSize);
+
+    private:
+        struct IndexEntry
+        {
+            std::string FileName;
+            uint64_t HeaderOffset;
+            uint64_t FileSize;
+            IndexEntry* Next;
+        };
+
+        void AddFile(
+            _In_ IndexEntry* entry,
+            _In_reads_bytes_(TarHeaderTemplate::Size) const void* header,
+            _In_ const uint8_t* fileData);
+
+        uint64_t ReserveExtent(
+            _In_ const size_t fileSize);
+
+        void WriteFileAt(
+            _In_ const uint64_t headerOffset,
+            _In_reads_bytes_(TarHeaderTemplate::Size) const void* header,
+            _In_ const uint8_t* fileData,
+            _In_ const size_t fileSize);
+
+        void WriteAt(
+            _In_ const uint64_t offset,
+            _In_ const void* data,
+            _In_ const size_t size);
+
+    private:
+        HANDLE _tarballFile;
+
+        //
+        // Offset of the next free extent, i.e. the current end of the archive.
+        //
+        std::atomic<uint64_t> _endOfArchive;
+
+        //
+        // Number of AddFile calls that reserved an extent but did not fill it yet.
+        //
+        std::atomic<int32_t> _pendingWrites;
+
+        //
+        // Completed files, most recent first.
+        //
+        std::atomic<IndexEntry*> _index;
+    };
 }
@@ -56,15 +56,33 @@ namespace Io
 std::wstring Utf8ToUtf16(
     _In_z_ const char* text)
 {
-    wchar_t buffer[1024];
-
-    swprintf_s(
-        buffer,
-        L"%S",
-        text);
-
-    return std::wstring(
-        buffer);
+    //
+    // The lengths include the terminating null character.
+    //
+    const int32_t length =
+        MultiByteToWideChar(
+            CP_UTF8,
+            0 /* dwFlags */,
+            text,
+            -1 /* cbMultiByte */,
+            nullptr /* lpWideCharStr */,
+            0 /* cchWideChar */);
+
+    ASSERT(0 < length);
+
+    std::wstring result(
+        length - 1,
+        L'\0');
+
+    ASSERT(length == MultiByteToWideChar(
+        CP_UTF8,
+        0 /* dwFlags */,
+        text,
+        -1 /* cbMultiByte */,
+        &result[0],
+        length));
+
+    return result;
 }
 
 std::wstring Utf8ToUtf16(
@@ -77,15 +95,37 @@ std::wstring Utf8ToUtf16(
 std::string Utf16ToUtf8(
     _In_z_ const wchar_t* text)
 {
-    char buffer[1024];
-
-    sprintf_s(
-        buffer,
-        "%S",
-        text);
-
-    return std::string(
-        buffer);
+    //
+    // The lengths include the terminating null character.
+    //
+    const int32_t length =
+        WideCharToMultiByte(
+            CP_UTF8,
+            0 /* dwFlags */,
+            text,
+            -1 /* cchWideChar */,
+            nullptr /* lpMultiByteStr */,
+            0 /* cbMultiByte */,
+            nullptr /* lpDefaultChar */,
+            nullptr /* lpUsedDefaultChar */);
+
+    ASSERT(0 < length);
+
+    std::string result(
+        length - 1,
+        '\0');
+
+    ASSERT(length == WideCharToMultiByte(
+        CP_UTF8,
+        0 /* dwFlags */,
+        text,
+        -1 /* cchWideChar */,
+        &result[0],
+        length,
+        nullptr /* lpDefaultChar */,
+        nullptr /* lpUsedDefaultChar */));
+
+    return result;
 }
 
 std::string Utf16ToUtf8(
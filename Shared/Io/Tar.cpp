@@ -101,6 +101,49 @@ namespace Io
     };
 #pragma pack (pop)
 
+    //
+    // Tar files are padded to the 512-byte block size, and the archive ends with two
+    // blocks of zeroes.
+    //
+    static const uint8_t c_tarZeroBlock[512] = {};
+
+    //
+    // Event the writes of a thread to a ConcurrentTarball wait on. Each writer has its
+    // own, so that the writes of different threads are in flight at the same time.
+    //
+    class WriterEvent
+    {
+    public:
+        WriterEvent()
+        {
+            _event =
+                CreateEventEx(
+                    nullptr /* lpEventAttributes */,
+                    nullptr /* lpName */,
+                    CREATE_EVENT_MANUAL_RESET /* dwFlags */,
+                    EVENT_ALL_ACCESS /* dwDesiredAccess */);
+
+            ASSERT(nullptr != _event);
+        }
+
+        ~WriterEvent()
+        {
+            CloseHandle(
+                _event);
+        }
+
+        HANDLE Get() const
+        {
+            return _event;
+        }
+
+    private:
+        WriterEvent(const WriterEvent&) = delete;
+        WriterEvent& operator=(const WriterEvent&) = delete;
+
+        HANDLE _event;
+    };
+
     template <size_t N>
     void CopyStringToTarHeader(
         _In_ const std::string& input,
@@ -150,6 +193,173 @@ namespace Io
         }
     }
 
+    void FillTarHeader(
+        _In_ const std::string& fileName,
+        _In_ const uint64_t fileSize,
+        _In_ const uint64_t lastModificationTime,
+        _Inout_ TarHeader& header)
+    {
+        static_assert(
+            512 == sizeof(TarHeader),
+            "Size of the TarHeader structure must be equal to 512 bytes.");
+
+        CopyStringToTarHeader<100>(
+            fileName,
+            header.FileName);
+
+        CopyUInt64ToTarHeaderAsOctets<12>(
+            fileSize,
+            header.FileSize);
+
+        CopyUInt64ToTarHeaderAsOctets<12>(
+            lastModificationTime,
+            header.LastModificationTime);
+
+        uint64_t checksum = 0;
+
+        for (size_t i = 0; i < sizeof(header); ++i)
+        {
+            checksum +=
+                reinterpret_cast<uint8_t*>(&header)[i];
+        }
+
+        CopyUInt64ToTarHeaderAsOctets<7>(
+            checksum,
+            header.Checksum);
+    }
+
+    uint64_t GetCurrentTarTime()
+    {
+        return std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    TarHeaderTemplate::TarHeaderTemplate(
+        _In_ const std::wstring& fileNamePrefix,
+        _In_ const std::wstring& fileNameSuffix)
+        : _checksum(0)
+    {
+        static_assert(
+            sizeof(TarHeader) == Size,
+            "Size of the TarHeader structure must be equal to the template size.");
+
+        const std::string prefix =
+            Utf16ToUtf8(
+                fileNamePrefix);
+
+        TarHeader header;
+
+        CopyStringToTarHeader<100>(
+            prefix + std::string(FileNumberDigits, '0') + Utf16ToUtf8(fileNameSuffix),
+            header.FileName);
+
+        //
+        // Unlike CopyUInt64ToTarHeaderAsOctets, always write all the digits so that
+        // patching a field never changes its length.
+        //
+        for (size_t i = 0; i < 11; ++i)
+        {
+            header.FileSize[i] = '0';
+            header.LastModificationTime[i] = '0';
+        }
+
+        memcpy(
+            _header,
+            &header,
+            sizeof(header));
+
+        for (size_t i = 0; i < sizeof(_header); ++i)
+        {
+            _checksum += _header[i];
+        }
+
+        _fileNumberOffset =
+            prefix.size();
+
+        Update(
+            0 /* fileNumber */,
+            0 /* fileSize */,
+            0 /* lastModificationTime */);
+    }
+
+    void TarHeaderTemplate::Update(
+        _In_ const uint64_t fileNumber,
+        _In_ const uint64_t fileSize,
+        _In_ const uint64_t lastModificationTime)
+    {
+        PatchDigits(
+            _fileNumberOffset,
+            FileNumberDigits,
+            10 /* radix */,
+            fileNumber);
+
+        PatchDigits(
+            offsetof(TarHeader, FileSize),
+            11 /* numberOfDigits */,
+            8 /* radix */,
+            fileSize);
+
+        PatchDigits(
+            offsetof(TarHeader, LastModificationTime),
+            11 /* numberOfDigits */,
+            8 /* radix */,
+            lastModificationTime);
+
+        //
+        // The checksum field itself is summed as spaces, so writing it does not change
+        // the checksum.
+        //
+        uint64_t checksum =
+            _checksum;
+
+        for (size_t i = 6; i-- > 0;)
+        {
+            _header[offsetof(TarHeader, Checksum) + i] =
+                static_cast<uint8_t>('0' + checksum % 8);
+
+            checksum /= 8;
+        }
+
+        _header[offsetof(TarHeader, Checksum) + 6] = '\0';
+    }
+
+    const uint8_t* TarHeaderTemplate::GetData() const
+    {
+        return _header;
+    }
+
+    std::string TarHeaderTemplate::GetFileName() const
+    {
+        const char* fileName =
+            reinterpret_cast<const char*>(_header);
+
+        return std::string(
+            fileName,
+            strnlen(fileName, sizeof(TarHeader::FileName)));
+    }
+
+    void TarHeaderTemplate::PatchDigits(
+        _In_ const size_t offset,
+        _In_ const size_t numberOfDigits,
+        _In_ const uint64_t radix,
+        _In_ uint64_t value)
+    {
+        for (size_t i = numberOfDigits; i-- > 0;)
+        {
+            const uint8_t digit =
+                static_cast<uint8_t>('0' + value % radix);
+
+            _checksum += digit;
+            _checksum -= _header[offset + i];
+
+            _header[offset + i] = digit;
+
+            value /= radix;
+        }
+
+        ASSERT(0 == value);
+    }
+
     void CreateTarball(
         _In_ Windows::Storage::StorageFolder^ sourceFolder,
         _In_ const std::vector<std::wstring>& sourceFileNames,
@@ -172,7 +382,12 @@ namespace Io
             &output));
 
         std::vector<uint8_t> alignmentBuffer(512);
-        std::vector<uint8_t> sourceFileBuffer;
+
+        //
+        // The source files are copied in chunks, rather than read into memory whole,
+        // so that archiving a long recording does not need memory for its largest file.
+        //
+        std::vector<uint8_t> sourceFileBuffer(1024 * 1024);
 
         std::fill(
             alignmentBuffer.begin(),
@@ -213,18 +428,6 @@ namespace Io
                 nullptr /* lpLastAccessTime */,
                 &lastWriteTime));
 
-            sourceFileBuffer.resize(
-                static_cast<size_t>(fileSize.QuadPart));
-
-            ASSERT(!!ReadFile(
-                input,
-                &sourceFileBuffer[0],
-                static_cast<DWORD>(sourceFileBuffer.size()),
-                &numberOfBytesRead,
-                nullptr /* lpOverlapped */));
-
-            ASSERT(sourceFileBuffer.size() == numberOfBytesRead);
-
             TarHeader header;
 
             static_assert(
@@ -265,14 +468,37 @@ namespace Io
 
             ASSERT(sizeof(header) == numberOfBytesWritten);
 
-            ASSERT(!!WriteFile(
-                output,
-                &sourceFileBuffer[0],
-                static_cast<DWORD>(fileSize.QuadPart),
-                &numberOfBytesWritten,
-                nullptr /* lpOverlapped */));
+            uint64_t remainingSize =
+                static_cast<uint64_t>(fileSize.QuadPart);
 
-            ASSERT(fileSize.QuadPart == numberOfBytesWritten);
+            while (remainingSize > 0)
+            {
+                const DWORD chunkSize =
+                    static_cast<DWORD>(
+                        (std::min)(
+                            remainingSize,
+                            static_cast<uint64_t>(sourceFileBuffer.size())));
+
+                ASSERT(!!ReadFile(
+                    input,
+                    &sourceFileBuffer[0],
+                    chunkSize,
+                    &numberOfBytesRead,
+                    nullptr /* lpOverlapped */));
+
+                ASSERT(chunkSize == numberOfBytesRead);
+
+                ASSERT(!!WriteFile(
+                    output,
+                    &sourceFileBuffer[0],
+                    chunkSize,
+                    &numberOfBytesWritten,
+                    nullptr /* lpOverlapped */));
+
+                ASSERT(chunkSize == numberOfBytesWritten);
+
+                remainingSize -= chunkSize;
+            }
 
             const size_t lastBlockSize =
                 fileSize.QuadPart % alignmentBuffer.size();
@@ -317,9 +543,8 @@ namespace Io
             output));
     }
 
-	Tarball::Tarball(_In_ const std::wstring& tarballFileName) {
-		_tarballFile.open(tarballFileName, std::ios::binary);
-		ASSERT(_tarballFile.is_open());
+	Tarball::Tarball(_In_ const std::wstring& tarballFileName)
+		: _tarballFile(tarballFileName) {
 	}
 
 	Tarball::~Tarball() {
@@ -327,12 +552,11 @@ namespace Io
 	}
 
 	void Tarball::Close() {
-		if (_tarballFile.is_open()) {
+		if (_tarballFile.IsOpen()) {
 			// The tarball always ends with two 512 byte blocks of zeros.
-			std::vector<char> alignmentData(512, 0);
-			_tarballFile.write(alignmentData.data(), alignmentData.size());
-			_tarballFile.write(alignmentData.data(), alignmentData.size());
-			_tarballFile.close();
+			_tarballFile.Write(c_tarZeroBlock, sizeof(c_tarZeroBlock));
+			_tarballFile.Write(c_tarZeroBlock, sizeof(c_tarZeroBlock));
+			_tarballFile.Close();
 		}
 	}
 
@@ -341,7 +565,7 @@ namespace Io
 		_In_ const uint8_t* fileData,
 		_In_ const size_t fileSize) {
 
-		ASSERT(_tarballFile.is_open());
+		ASSERT(_tarballFile.IsOpen());
 
 		static_assert(
 			sizeof(TarHeader) == 512,
@@ -351,27 +575,16 @@ namespace Io
 
 		TarHeader header;
 
-		CopyStringToTarHeader<100>(Utf16ToUtf8(fileName), header.FileName);
-		CopyUInt64ToTarHeaderAsOctets<12>(fileSize, header.FileSize);
-		CopyUInt64ToTarHeaderAsOctets<12>(
-			std::chrono::duration_cast<std::chrono::seconds>(
-				std::chrono::system_clock::now().time_since_epoch()).count(),
-			header.LastModificationTime);
-
-		uint64_t headerChecksum = 0;
-		for (size_t i = 0; i < sizeof(header); ++i)
-		{
-			headerChecksum += reinterpret_cast<uint8_t*>(&header)[i];
-		}
-
-		CopyUInt64ToTarHeaderAsOctets<7>(headerChecksum, header.Checksum);
+		FillTarHeader(
+			Utf16ToUtf8(fileName),
+			fileSize,
+			GetCurrentTarTime(),
+			header);
 
 		// Write the header and the data to the tarball.
 
-		_tarballFile.write(
-			reinterpret_cast<const char*>(&header), sizeof(header));
-		_tarballFile.write(
-			reinterpret_cast<const char*>(fileData), fileSize);
+		_tarballFile.Write(&header, sizeof(header));
+		_tarballFile.Write(fileData, fileSize);
 		
 		// Make sure the file is aligned to 512 byes, otherwise
 		// pad the file with zeros.
@@ -382,8 +595,310 @@ namespace Io
 			const size_t lastBlockPadding = 512 - lastBlockSize;
 			ASSERT(lastBlockPadding < 512);
 
-			_tarballFile.write(
-				std::vector<char>(lastBlockPadding, 0).data(), lastBlockPadding);
+			_tarballFile.Write(c_tarZeroBlock, lastBlockPadding);
 		}
 	}
+
+	void Tarball::AddFile(
+		_Inout_ TarHeaderTemplate& headerTemplate,
+		_In_ const uint64_t fileNumber,
+		_In_ const uint8_t* fileData,
+		_In_ const size_t fileSize) {
+
+		ASSERT(_tarballFile.IsOpen());
+
+		headerTemplate.Update(fileNumber, fileSize, GetCurrentTarTime());
+
+		_tarballFile.Write(headerTemplate.GetData(), TarHeaderTemplate::Size);
+		_tarballFile.Write(fileData, fileSize);
+
+		const size_t lastBlockSize = fileSize % 512;
+		if (lastBlockSize != 0)
+		{
+			_tarballFile.Write(c_tarZeroBlock, 512 - lastBlockSize);
+		}
+	}
+
+    const wchar_t* ConcurrentTarball::IndexFileName =
+        L"tarball_index.csv";
+
+    ConcurrentTarball::ConcurrentTarball(
+        _In_ const std::wstring& tarballFileName)
+        : _tarballFile(INVALID_HANDLE_VALUE)
+        , _endOfArchive(0)
+        , _pendingWrites(0)
+        , _index(nullptr)
+    {
+        //
+        // A synchronous handle would serialize all writes to the file object; with an
+        // overlapped handle, the positioned writes of the sensors proceed in parallel.
+        //
+        CREATEFILE2_EXTENDED_PARAMETERS parameters = {};
+
+        parameters.dwSize =
+            sizeof(parameters);
+
+        parameters.dwFileAttributes =
+            FILE_ATTRIBUTE_NORMAL;
+
+        parameters.dwFileFlags =
+            FILE_FLAG_OVERLAPPED;
+
+        _tarballFile =
+            CreateFile2(
+                tarballFileName.c_str(),
+                GENERIC_WRITE /* dwDesiredAccess */,
+                FILE_SHARE_READ /* dwShareMode */,
+                CREATE_ALWAYS /* dwCreationDisposition */,
+                &parameters);
+
+        ASSERT(INVALID_HANDLE_VALUE != _tarballFile);
+    }
+
+    ConcurrentTarball::~ConcurrentTarball()
+    {
+        Close();
+    }
+
+    void ConcurrentTarball::Close()
+    {
+        if (INVALID_HANDLE_VALUE == _tarballFile)
+        {
+            return;
+        }
+
+        //
+        // A reserved extent that was never filled would end the archive early.
+        //
+        ASSERT(0 == _pendingWrites);
+
+        std::vector<IndexEntry*> entries;
+
+        for (IndexEntry* entry = _index.exchange(nullptr); nullptr != entry; entry = entry->Next)
+        {
+            entries.push_back(entry);
+        }
+
+        std::sort(
+            entries.begin(),
+            entries.end(),
+            [](const IndexEntry* lhs, const IndexEntry* rhs)
+        {
+            return lhs->HeaderOffset < rhs->HeaderOffset;
+        });
+
+        std::string indexData =
+            "FileName,HeaderOffset,FileSize\n";
+
+        for (IndexEntry* entry : entries)
+        {
+            indexData += entry->FileName;
+            indexData += ",";
+            indexData += std::to_string(entry->HeaderOffset);
+            indexData += ",";
+            indexData += std::to_string(entry->FileSize);
+            indexData += "\n";
+
+            delete entry;
+        }
+
+        TarHeader indexHeader;
+
+        FillTarHeader(
+            Utf16ToUtf8(IndexFileName),
+            indexData.size(),
+            GetCurrentTarTime(),
+            indexHeader);
+
+        WriteFileAt(
+            ReserveExtent(indexData.size()),
+            &indexHeader,
+            reinterpret_cast<const uint8_t*>(indexData.data()),
+            indexData.size());
+
+        for (size_t terminatorBlock = 0; terminatorBlock < 2; ++terminatorBlock)
+        {
+            WriteAt(
+                _endOfArchive + terminatorBlock * sizeof(c_tarZeroBlock),
+                c_tarZeroBlock,
+                sizeof(c_tarZeroBlock));
+        }
+
+        ASSERT(!!CloseHandle(
+            _tarballFile));
+
+        _tarballFile = INVALID_HANDLE_VALUE;
+    }
+
+    void ConcurrentTarball::AddFile(
+        _In_ const std::wstring& fileName,
+        _In_ const uint8_t* fileData,
+        _In_ const size_t fileSize)
+    {
+        IndexEntry* entry =
+            new IndexEntry();
+
+        entry->FileName =
+            Utf16ToUtf8(
+                fileName);
+
+        entry->FileSize =
+            fileSize;
+
+        TarHeader header;
+
+        FillTarHeader(
+            entry->FileName,
+            fileSize,
+            GetCurrentTarTime(),
+            header);
+
+        AddFile(
+            entry,
+            &header,
+            fileData);
+    }
+
+    void ConcurrentTarball::AddFile(
+        _Inout_ TarHeaderTemplate& headerTemplate,
+        _In_ const uint64_t fileNumber,
+        _In_ const uint8_t* fileData,
+        _In_ const size_t fileSize)
+    {
+        headerTemplate.Update(
+            fileNumber,
+            fileSize,
+            GetCurrentTarTime());
+
+        IndexEntry* entry =
+            new IndexEntry();
+
+        entry->FileName =
+            headerTemplate.GetFileName();
+
+        entry->FileSize =
+            fileSize;
+
+        AddFile(
+            entry,
+            headerTemplate.GetData(),
+            fileData);
+    }
+
+    void ConcurrentTarball::AddFile(
+        _In_ IndexEntry* entry,
+        _In_reads_bytes_(TarHeaderTemplate::Size) const void* header,
+        _In_ const uint8_t* fileData)
+    {
+        ASSERT(INVALID_HANDLE_VALUE != _tarballFile);
+
+        entry->HeaderOffset =
+            ReserveExtent(
+                entry->FileSize);
+
+        WriteFileAt(
+            entry->HeaderOffset,
+            header,
+            fileData,
+            entry->FileSize);
+
+        //
+        // Publish the file to the index. This is a lock-free push to the front of the
+        // list; the entries are sorted by their offsets when the index is written.
+        //
+        entry->Next =
+            _index.load();
+
+        while (!_index.compare_exchange_weak(
+            entry->Next,
+            entry))
+        {
+        }
+
+        --_pendingWrites;
+    }
+
+    uint64_t ConcurrentTarball::ReserveExtent(
+        _In_ const size_t fileSize)
+    {
+        const uint64_t extentSize =
+            sizeof(TarHeader) +
+            (fileSize + sizeof(c_tarZeroBlock) - 1) / sizeof(c_tarZeroBlock) * sizeof(c_tarZeroBlock);
+
+        ++_pendingWrites;
+
+        return _endOfArchive.fetch_add(
+            extentSize);
+    }
+
+    void ConcurrentTarball::WriteFileAt(
+        _In_ const uint64_t headerOffset,
+        _In_reads_bytes_(TarHeaderTemplate::Size) const void* header,
+        _In_ const uint8_t* fileData,
+        _In_ const size_t fileSize)
+    {
+        WriteAt(
+            headerOffset,
+            header,
+            TarHeaderTemplate::Size);
+
+        WriteAt(
+            headerOffset + TarHeaderTemplate::Size,
+            fileData,
+            fileSize);
+
+        const size_t lastBlockSize =
+            fileSize % sizeof(c_tarZeroBlock);
+
+        if (0 != lastBlockSize)
+        {
+            WriteAt(
+                headerOffset + TarHeaderTemplate::Size + fileSize,
+                c_tarZeroBlock,
+                sizeof(c_tarZeroBlock) - lastBlockSize);
+        }
+    }
+
+    void ConcurrentTarball::WriteAt(
+        _In_ const uint64_t offset,
+        _In_ const void* data,
+        _In_ const size_t size)
+    {
+        //
+        // Overlapped writes have no file pointer to race on. Each thread waits for its
+        // own write on its own event, without waiting for the writes of the others.
+        //
+        static thread_local WriterEvent writerEvent;
+
+        OVERLAPPED overlapped = {};
+
+        overlapped.Offset =
+            static_cast<DWORD>(offset);
+
+        overlapped.OffsetHigh =
+            static_cast<DWORD>(offset >> 32);
+
+        overlapped.hEvent =
+            writerEvent.Get();
+
+        if (!WriteFile(
+            _tarballFile,
+            data,
+            static_cast<DWORD>(size),
+            nullptr /* lpNumberOfBytesWritten */,
+            &overlapped))
+        {
+            ASSERT(ERROR_IO_PENDING == GetLastError());
+        }
+
+        DWORD numberOfBytesWritten = 0;
+
+        ASSERT(!!GetOverlappedResult(
+            _tarballFile,
+            &overlapped,
+            &numberOfBytesWritten,
+            TRUE /* bWait */));
+
+        ASSERT(size == numberOfBytesWritten);
+    }
 }
@@ -13,3 +13,8 @@
 
 #include <OpenCVHelpers/OpenCVHelpers.h>
 #include <OpenCVHelpers/OpenCVTexture2D.h>
+#include <OpenCVHelpers/OrganizedPointCloud.h>
+#include <OpenCVHelpers/PointToPlaneIcp.h>
+#include <OpenCVHelpers/PlaneDetection.h>
+#include <OpenCVHelpers/StereoMatching.h>
+#include <OpenCVHelpers/OccupancyMap.h>
@@ -0,0 +1,140 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#pragma once
+
+namespace rmcv
+{
+    struct OccupancyMapSettings
+    {
+        /// <summary>
+        /// Edge length of the voxels in meters. Voxels are allocated in blocks of 8x8x8.
+        /// </summary>
+        float VoxelSize = 0.1f;
+
+        /// <summary>
+        /// Log-odds added to the voxel a depth measurement ends in, and to the voxels its
+        /// ray passes through.
+        /// </summary>
+        float HitLogOdds = 0.85f;
+        float MissLogOdds = -0.4f;
+
+        /// <summary>
+        /// Clamping bounds of the log-odds, which keep the map responsive to changes.
+        /// </summary>
+        float MinimumLogOdds = -2.0f;
+        float MaximumLogOdds = 3.5f;
+
+        /// <summary>
+        /// Voxels above the occupied and below the free threshold are reported as occupied
+        /// and free, respectively; all others are unknown.
+        /// </summary>
+        float OccupiedLogOdds = 0.85f;
+        float FreeLogOdds = -0.4f;
+
+        /// <summary>
+        /// Only every n-th pixel in each direction of the depth frames is integrated.
+        /// </summary>
+        int32_t PixelStride = 4;
+
+        /// <summary>
+        /// Rays longer than this distance are only integrated as free space up to it.
+        /// </summary>
+        float MaximumRayLength = 4.0f;
+
+        /// <summary>
+        /// Blocks farther than this distance from the current camera position are evicted,
+        /// which bounds the memory used by the map.
+        /// </summary>
+        float WindowRadius = 8.0f;
+    };
+
+    enum class VoxelState : uint8_t
+    {
+        Unknown,
+        Free,
+        Occupied
+    };
+
+    /// <summary>
+    /// A voxel whose state changed, given by its integer coordinates; its center is at
+    /// (X + 0.5, Y + 0.5, Z + 0.5) * VoxelSize in world space.
+    /// </summary>
+    struct OccupancyDelta
+    {
+        int32_t X;
+        int32_t Y;
+        int32_t Z;
+        VoxelState State;
+    };
+
+    /// <summary>
+    /// Probabilistic occupancy map around the wearer, built incrementally from depth frames
+    /// and their camera-to-world transforms (e.g. FrameToOrigin). The voxels are stored in
+    /// blocks of a hash map which are allocated on demand and evicted once they leave the
+    /// window around the camera. The rays of the sampled pixels are traversed in parallel
+    /// and every voxel is updated at most once per frame, a hit taking precedence.
+    /// </summary>
+    class OccupancyMap
+    {
+    public:
+        OccupancyMap(
+            _In_ const OccupancyMapSettings& settings = OccupancyMapSettings());
+
+        void Reset();
+
+        /// <summary>
+        /// Integrates an organized point cloud in camera space, see BackprojectDepthImage.
+        /// </summary>
+        void Integrate(
+            _In_ const OrganizedPointCloud& pointCloud,
+            _In_ const cv::Matx44f& cameraToWorld);
+
+        VoxelState GetState(
+            _In_ const cv::Vec3f& worldPoint) const;
+
+        /// <summary>
+        /// Returns the voxels whose state changed since the last call, including the known
+        /// voxels of evicted blocks, which become unknown.
+        /// </summary>
+        void GetChangedVoxels(
+            _Out_ std::vector<OccupancyDelta>& changedVoxels);
+
+        size_t GetNumberOfBlocks() const;
+
+    private:
+        struct Block
+        {
+            std::array<float, 512> LogOdds;
+        };
+
+        VoxelState Classify(
+            _In_ float logOdds) const;
+
+        void TraverseRay(
+            _In_ const cv::Vec3f& origin,
+            _In_ const cv::Vec3f& end,
+            _In_ bool hit,
+            _Inout_ std::vector<uint64_t>& updates) const;
+
+        void EvictBlocks(
+            _In_ const cv::Vec3f& cameraPosition);
+
+        OccupancyMapSettings _settings;
+
+        std::unordered_map<uint64_t, std::unique_ptr<Block>> _blocks;
+
+        //
+        // Latest state of each voxel that changed since the last GetChangedVoxels call.
+        //
+        std::unordered_map<uint64_t, VoxelState> _changedVoxels;
+    };
+}
@@ -0,0 +1,147 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#pragma once
+
+namespace rmcv
+{
+    /// <summary>
+    /// Per-pixel unit length viewing rays of a depth camera, such that the camera space
+    /// point of a pixel is its measured distance times its ray. Following the HoloLens
+    /// convention the camera looks down the negative Z axis. The table only depends on
+    /// the camera, so it should be built once per sensor and reused for all frames.
+    /// </summary>
+    struct DepthRayTable
+    {
+        cv::Mat X;
+        cv::Mat Y;
+        cv::Mat Z;
+    };
+
+    /// <summary>
+    /// Organized point cloud in camera space (meters), stored as one CV_32FC1 plane per
+    /// coordinate to keep the per-pixel loops vectorizable. Pixels without a valid
+    /// measurement have Z == 0.
+    /// </summary>
+    struct OrganizedPointCloud
+    {
+        cv::Mat X;
+        cv::Mat Y;
+        cv::Mat Z;
+    };
+
+    /// <summary>
+    /// Per-pixel unit normals of an organized point cloud, oriented towards the camera.
+    /// Pixels without a reliable normal have a zero vector.
+    /// </summary>
+    struct OrganizedNormals
+    {
+        cv::Mat X;
+        cv::Mat Y;
+        cv::Mat Z;
+    };
+
+    /// <summary>
+    /// Builds the ray table from the sensor streaming camera intrinsics.
+    /// </summary>
+    void CreateDepthRayTable(
+        _In_ HoloLensForCV::CameraIntrinsics^ cameraIntrinsics,
+        _Out_ DepthRayTable& rayTable);
+
+    /// <summary>
+    /// Builds the ray table from a CV_32FC2 image holding the Z=1 plane coordinates of
+    /// each pixel, e.g. as stored in the recordings' <sensor>_camera_space_projection.bin.
+    /// Pixels that do not map to the unit plane are expected to be non-finite.
+    /// </summary>
+    void CreateDepthRayTable(
+        _In_ const cv::Mat& unitPlaneCoordinates,
+        _Out_ DepthRayTable& rayTable);
+
+    /// <summary>
+    /// Maps camera space points back to depth image coordinates. The depth cameras do not
+    /// follow a pinhole model, so a bivariate polynomial of degree five in the angular
+    /// unit plane coordinates is fitted to the ray table for an initial guess, which is
+    /// then refined with a few Newton steps on the table itself.
+    /// </summary>
+    struct DepthProjection
+    {
+        static const int32_t NumberOfCoefficients = 21;
+        static const int32_t NumberOfNewtonSteps = 3;
+
+        int32_t ImageWidth;
+        int32_t ImageHeight;
+
+        // Bounds of the unit plane area covered by the image; the polynomial is not
+        // evaluated outside of them.
+        float MinimumX;
+        float MaximumX;
+        float MinimumY;
+        float MaximumY;
+
+        std::array<float, NumberOfCoefficients> ColumnCoefficients;
+        std::array<float, NumberOfCoefficients> RowCoefficients;
+
+        // Unit plane coordinates of the pixels (CV_32FC1), non-finite where invalid.
+        cv::Mat UnitPlaneX;
+        cv::Mat UnitPlaneY;
+    };
+
+    /// <summary>
+    /// Fits the projection to the pixel centers of the ray table.
+    /// </summary>
+    void CreateDepthProjection(
+        _In_ const DepthRayTable& rayTable,
+        _Out_ DepthProjection& projection);
+
+    /// <summary>
+    /// Projects a camera space point to (sub-)pixel coordinates, where integer coordinates
+    /// denote pixel centers. Returns false if the point is behind the camera or does not
+    /// fall into the image.
+    /// </summary>
+    bool ProjectToDepthImage(
+        _In_ const DepthProjection& projection,
+        _In_ float x,
+        _In_ float y,
+        _In_ float z,
+        _Out_ float* column,
+        _Out_ float* row);
+
+    /// <summary>
+    /// Reads the unit plane coordinates written by the recorder for the given image size.
+    /// </summary>
+    void ReadCameraSpaceProjection(
+        _In_ const std::wstring& fileName,
+        _In_ int32_t imageWidth,
+        _In_ int32_t imageHeight,
+        _Out_ cv::Mat& unitPlaneCoordinates);
+
+    /// <summary>
+    /// Back-projects a CV_16UC1 depth image holding distances in millimeters, keeping only
+    /// the pixels whose distance falls into [minimumDistance, maximumDistance] meters.
+    /// </summary>
+    void BackprojectDepthImage(
+        _In_ const cv::Mat& depthImage,
+        _In_ const DepthRayTable& rayTable,
+        _In_ float minimumDistance,
+        _In_ float maximumDistance,
+        _Out_ OrganizedPointCloud& pointCloud);
+
+    /// <summary>
+    /// Estimates normals from the cross product of the horizontal and vertical central
+    /// differences on the depth grid. Pixels next to invalid measurements or to a depth
+    /// discontinuity, i.e. a depth change above maximumRelativeDepthChange times the
+    /// pixel's depth, are masked out. Rows are processed in parallel.
+    /// </summary>
+    void EstimateOrganizedNormals(
+        _In_ const OrganizedPointCloud& pointCloud,
+        _In_ float maximumRelativeDepthChange,
+        _Out_ OrganizedNormals& normals);
+}
@@ -0,0 +1,186 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#pragma once
+
+namespace rmcv
+{
+    struct DetectedPlane
+    {
+        /// <summary>
+        /// Plane equation Normal.dot(p) + Offset == 0 in the camera space of the frame the
+        /// plane was detected in. The normal points towards the camera, so Offset > 0.
+        /// </summary>
+        cv::Vec3f Normal;
+        float Offset;
+
+        cv::Vec3f Centroid;
+        int32_t NumberOfInliers;
+
+        /// <summary>
+        /// Identity assigned by the PlaneTracker, or -1 if the plane is not tracked.
+        /// </summary>
+        int32_t Id;
+    };
+
+    struct PlaneDetectionSettings
+    {
+        /// <summary>
+        /// Size in pixels of the square cells that are tested for planarity and grown into
+        /// the seed regions for RANSAC.
+        /// </summary>
+        int32_t CellSize = 8;
+
+        /// <summary>
+        /// Maximum root mean square distance (in meters) of the points of a planar cell to
+        /// the cell's plane.
+        /// </summary>
+        float MaximumCellRootMeanSquareError = 0.01f;
+
+        /// <summary>
+        /// Maximum angle between neighboring cells of a region, and between the normals of
+        /// the inliers and their plane.
+        /// </summary>
+        float MaximumNormalAngleInDegrees = 15.0f;
+
+        /// <summary>
+        /// Maximum distance (in meters) of an inlier to its plane.
+        /// </summary>
+        float InlierDistance = 0.02f;
+
+        int32_t NumberOfHypotheses = 64;
+        int32_t MinimumNumberOfInliers = 2000;
+        int32_t MaximumNumberOfPlanes = 8;
+
+        /// <summary>
+        /// Hypotheses are scored on every n-th point in each direction.
+        /// </summary>
+        int32_t ScoringStride = 2;
+    };
+
+    /// <summary>
+    /// Extracts the dominant planes from organized depth frames. Planar cells of the depth
+    /// grid are grown into regions, which seed RANSAC hypotheses; the hypotheses are scored
+    /// in parallel against all remaining points, counting inliers with SSE2 on x86/x64.
+    /// The best hypothesis is refined by least squares and its inliers are removed before
+    /// looking for the next plane.
+    /// </summary>
+    class PlaneDetector
+    {
+    public:
+        PlaneDetector(
+            _In_ const PlaneDetectionSettings& settings = PlaneDetectionSettings());
+
+        /// <summary>
+        /// Detects planes in descending order of their support. The labels are a CV_8UC1
+        /// image holding the one-based index of the plane each pixel belongs to, or zero.
+        /// </summary>
+        void Detect(
+            _In_ const OrganizedPointCloud& pointCloud,
+            _In_ const OrganizedNormals& normals,
+            _Out_ std::vector<DetectedPlane>& planes,
+            _Out_ cv::Mat& labels);
+
+    private:
+        struct Cell
+        {
+            bool Planar;
+            int32_t Region;
+            cv::Vec3f Normal;
+            cv::Vec3f Centroid;
+        };
+
+        void ComputeCells(
+            _In_ const OrganizedPointCloud& pointCloud,
+            _In_ const OrganizedNormals& normals);
+
+        void GrowRegions();
+
+        void CollectScoringPoints(
+            _In_ const OrganizedPointCloud& pointCloud,
+            _In_ const OrganizedNormals& normals,
+            _In_ const cv::Mat& labels);
+
+        bool FitPlane(
+            _In_ const OrganizedPointCloud& pointCloud,
+            _In_ const OrganizedNormals& normals,
+            _In_ int32_t region,
+            _In_ uint8_t label,
+            _Inout_ cv::Mat& labels,
+            _Out_ DetectedPlane* plane);
+
+        PlaneDetectionSettings _settings;
+        cv::RNG _rng;
+
+        int32_t _cellColumns;
+        int32_t _cellRows;
+        std::vector<Cell> _cells;
+        std::vector<std::vector<int32_t>> _regions;
+
+        //
+        // Remaining points used to score the hypotheses, stored as structure of arrays.
+        //
+        std::vector<float> _scoringX;
+        std::vector<float> _scoringY;
+        std::vector<float> _scoringZ;
+        std::vector<float> _scoringNormalX;
+        std::vector<float> _scoringNormalY;
+        std::vector<float> _scoringNormalZ;
+    };
+
+    struct TrackedPlane
+    {
+        int32_t Id;
+
+        /// <summary>
+        /// Plane equation and centroid in world space.
+        /// </summary>
+        cv::Vec3f Normal;
+        float Offset;
+        cv::Vec3f Centroid;
+
+        int32_t NumberOfObservations;
+        int32_t FramesSinceLastObservation;
+    };
+
+    /// <summary>
+    /// Assigns stable identities to the planes detected in consecutive frames by matching
+    /// them in world space against the planes seen so far.
+    /// </summary>
+    class PlaneTracker
+    {
+    public:
+        PlaneTracker(
+            _In_ float maximumNormalAngleInDegrees = 10.0f,
+            _In_ float maximumOffsetDifference = 0.05f,
+            _In_ int32_t maximumFramesWithoutObservation = 15);
+
+        void Reset();
+
+        /// <summary>
+        /// Matches the planes of a frame, given the transform from the frame's camera space
+        /// to world space, and sets their Id.
+        /// </summary>
+        void Update(
+            _In_ const cv::Matx44f& cameraToWorld,
+            _Inout_ std::vector<DetectedPlane>& planes);
+
+        const std::vector<TrackedPlane>& GetTrackedPlanes() const;
+
+    private:
+        float _minimumNormalCosine;
+        float _maximumOffsetDifference;
+        int32_t _maximumFramesWithoutObservation;
+
+        int32_t _nextId;
+        std::vector<TrackedPlane> _trackedPlanes;
+    };
+}
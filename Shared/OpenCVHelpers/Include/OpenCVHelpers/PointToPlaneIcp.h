@@ -0,0 +1,121 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#pragma once
+
+namespace rmcv
+{
+    struct PointToPlaneIcpSettings
+    {
+        /// <summary>
+        /// Number of pyramid levels; each level halves the resolution of the previous one.
+        /// </summary>
+        int32_t PyramidLevels = 3;
+
+        /// <summary>
+        /// Gauss-Newton iterations per level, starting with the finest level.
+        /// </summary>
+        std::array<int32_t, 3> Iterations = { { 10, 6, 4 } };
+
+        /// <summary>
+        /// Correspondences further apart than this (in meters) are rejected.
+        /// </summary>
+        float MaximumCorrespondenceDistance = 0.1f;
+
+        /// <summary>
+        /// Correspondences whose normals differ by more than this angle are rejected.
+        /// </summary>
+        float MaximumNormalAngleInDegrees = 30.0f;
+
+        /// <summary>
+        /// Point-to-plane residuals above this threshold (in meters) are down-weighted.
+        /// </summary>
+        float HuberThreshold = 0.01f;
+
+        /// <summary>
+        /// Minimum fraction of the valid source points that need a correspondence for the
+        /// alignment to be considered successful.
+        /// </summary>
+        float MinimumInlierFraction = 0.3f;
+
+        /// <summary>
+        /// Depth discontinuity threshold used for the normal estimation.
+        /// </summary>
+        float MaximumRelativeDepthChange = 0.05f;
+    };
+
+    struct PointToPlaneIcpResult
+    {
+        /// <summary>
+        /// Transforms points from the source to the target camera space.
+        /// </summary>
+        cv::Matx44f SourceToTarget;
+
+        bool Converged;
+        int32_t NumberOfInliers;
+        float InlierFraction;
+        float RootMeanSquareError;
+    };
+
+    /// <summary>
+    /// Aligns depth frames to a target depth frame of the same camera by minimizing the
+    /// point-to-plane distance. Correspondences are found by projecting the source points
+    /// into the target depth grid, so no nearest neighbor search is needed. Gauss-Newton
+    /// runs coarse to fine on a pyramid, and the normal equations are accumulated in
+    /// parallel over bands of rows.
+    /// </summary>
+    class PointToPlaneIcp
+    {
+    public:
+        PointToPlaneIcp(
+            _In_ const DepthRayTable& rayTable,
+            _In_ const PointToPlaneIcpSettings& settings = PointToPlaneIcpSettings());
+
+        void SetTarget(
+            _In_ const cv::Mat& depthImage,
+            _In_ float minimumDistance,
+            _In_ float maximumDistance);
+
+        /// <summary>
+        /// Refines the initial source-to-target transform, typically derived from the
+        /// poses recorded by the HoloLens. Returns false if the alignment failed, in which
+        /// case the result holds the initial transform.
+        /// </summary>
+        bool Align(
+            _In_ const cv::Mat& depthImage,
+            _In_ float minimumDistance,
+            _In_ float maximumDistance,
+            _In_ const cv::Matx44f& initialSourceToTarget,
+            _Out_ PointToPlaneIcpResult* result);
+
+    private:
+        struct PyramidLevel
+        {
+            int32_t Scale;
+            OrganizedPointCloud Points;
+            OrganizedNormals Normals;
+        };
+
+        void BuildPyramid(
+            _In_ const cv::Mat& depthImage,
+            _In_ float minimumDistance,
+            _In_ float maximumDistance,
+            _Inout_ std::vector<PyramidLevel>& pyramid);
+
+        PointToPlaneIcpSettings _settings;
+
+        DepthRayTable _rayTable;
+        DepthProjection _projection;
+
+        std::vector<PyramidLevel> _target;
+        std::vector<PyramidLevel> _source;
+    };
+}
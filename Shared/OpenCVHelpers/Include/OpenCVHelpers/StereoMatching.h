@@ -0,0 +1,137 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#pragma once
+
+namespace rmcv
+{
+    /// <summary>
+    /// Maps that resample a stereo pair of cameras, e.g. the front visible light cameras,
+    /// into a pair of virtual pinhole cameras with parallel optical axes and the baseline
+    /// along the image rows. The rectified cameras look down the negative Z axis of the
+    /// rectified frame, which is rotated relative to the left camera.
+    /// </summary>
+    struct StereoRectification
+    {
+        int32_t Width;
+        int32_t Height;
+
+        float FocalLength;
+        float PrincipalPointX;
+        float PrincipalPointY;
+
+        /// <summary>
+        /// Distance between the camera centers, in meters.
+        /// </summary>
+        float Baseline;
+
+        /// <summary>
+        /// Rotates directions from the left camera space into the rectified frame.
+        /// </summary>
+        cv::Matx33f LeftToRectified;
+
+        /// <summary>
+        /// Fixed point maps for cv::remap, see cv::convertMaps.
+        /// </summary>
+        cv::Mat LeftMap1;
+        cv::Mat LeftMap2;
+        cv::Mat RightMap1;
+        cv::Mat RightMap2;
+    };
+
+    /// <summary>
+    /// Builds the rectification maps from the unit plane coordinates of both cameras (e.g.
+    /// from CameraIntrinsics or the recordings' camera_space_projection.bin files, see
+    /// CreateDepthRayTable) and the transform from the left to the right camera space.
+    /// The maps only depend on the calibration, so they should be built once and reused.
+    /// </summary>
+    void CreateStereoRectification(
+        _In_ const cv::Mat& leftUnitPlaneCoordinates,
+        _In_ const cv::Mat& rightUnitPlaneCoordinates,
+        _In_ const cv::Matx44f& leftToRight,
+        _In_ int32_t rectifiedWidth,
+        _In_ int32_t rectifiedHeight,
+        _Out_ StereoRectification& rectification);
+
+    struct StereoMatchingSettings
+    {
+        /// <summary>
+        /// Size of the disparity search range; must be a multiple of 8.
+        /// </summary>
+        int32_t NumberOfDisparities = 64;
+
+        /// <summary>
+        /// Semi-global matching penalties for disparity changes of one and of more than
+        /// one pixel between neighbors, in units of the census Hamming distance.
+        /// </summary>
+        int32_t SmallPenalty = 3;
+        int32_t LargePenalty = 20;
+
+        /// <summary>
+        /// The best matching cost must be lower than any other non-adjacent disparity's
+        /// cost by this margin in percent.
+        /// </summary>
+        int32_t UniquenessRatio = 10;
+
+        /// <summary>
+        /// Maximum difference between the left and the right disparity of a match.
+        /// </summary>
+        int32_t MaximumLeftRightDifference = 1;
+    };
+
+    /// <summary>
+    /// Dense stereo matching with a 5x5 census transform and semi-global aggregation of
+    /// the Hamming distances along four paths. The horizontal paths are processed in
+    /// parallel over rows and the vertical paths in parallel over bands of columns, with
+    /// the cost computation and aggregation vectorized using SSE2 on x86/x64.
+    /// </summary>
+    class StereoMatcher
+    {
+    public:
+        StereoMatcher(
+            _In_ const StereoRectification& rectification,
+            _In_ const StereoMatchingSettings& settings = StereoMatchingSettings());
+
+        /// <summary>
+        /// Rectifies and matches a pair of CV_8UC1 images. The disparity is a CV_32FC1 image
+        /// in the rectified left camera, with negative values where no match was found.
+        /// </summary>
+        void Compute(
+            _In_ const cv::Mat& leftImage,
+            _In_ const cv::Mat& rightImage,
+            _Out_ cv::Mat& disparity);
+
+        const cv::Mat& GetRectifiedLeftImage() const;
+
+    private:
+        StereoRectification _rectification;
+        StereoMatchingSettings _settings;
+
+        cv::Mat _rectifiedLeft;
+        cv::Mat _rectifiedRight;
+        cv::Mat _leftCensus;
+        cv::Mat _rightCensus;
+
+        std::vector<int16_t> _costs;
+        std::vector<uint16_t> _aggregatedCosts;
+    };
+
+    /// <summary>
+    /// Converts a disparity image into an organized point cloud in the left camera space,
+    /// keeping only the points within the given distance range in meters.
+    /// </summary>
+    void ReprojectDisparity(
+        _In_ const cv::Mat& disparity,
+        _In_ const StereoRectification& rectification,
+        _In_ float minimumDistance,
+        _In_ float maximumDistance,
+        _Out_ OrganizedPointCloud& pointCloud);
+}
@@ -0,0 +1,378 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#include "pch.h"
+
+namespace rmcv
+{
+    namespace
+    {
+        //
+        // Voxel and block coordinates are packed into 21 bits per axis, offset so that
+        // negative coordinates are representable.
+        //
+        const int32_t c_coordinateBits = 21;
+        const int32_t c_coordinateOffset = 1 << (c_coordinateBits - 1);
+        const uint64_t c_coordinateMask = (1ull << c_coordinateBits) - 1;
+
+        const int32_t c_blockBits = 3;
+        const int32_t c_blockSize = 1 << c_blockBits;
+
+        uint64_t PackCoordinates(
+            _In_ int32_t x,
+            _In_ int32_t y,
+            _In_ int32_t z)
+        {
+            return
+                (static_cast<uint64_t>(x + c_coordinateOffset) & c_coordinateMask) |
+                ((static_cast<uint64_t>(y + c_coordinateOffset) & c_coordinateMask) << c_coordinateBits) |
+                ((static_cast<uint64_t>(z + c_coordinateOffset) & c_coordinateMask) << (2 * c_coordinateBits));
+        }
+
+        void UnpackCoordinates(
+            _In_ uint64_t key,
+            _Out_ int32_t* x,
+            _Out_ int32_t* y,
+            _Out_ int32_t* z)
+        {
+            *x = static_cast<int32_t>(key & c_coordinateMask) - c_coordinateOffset;
+            *y = static_cast<int32_t>((key >> c_coordinateBits) & c_coordinateMask) - c_coordinateOffset;
+            *z = static_cast<int32_t>((key >> (2 * c_coordinateBits)) & c_coordinateMask) - c_coordinateOffset;
+        }
+
+        //
+        // Splits a voxel key into the key of its block and its index within the block.
+        //
+        uint64_t GetBlockKey(
+            _In_ uint64_t voxelKey,
+            _Out_ int32_t* index)
+        {
+            int32_t x, y, z;
+
+            UnpackCoordinates(voxelKey, &x, &y, &z);
+
+            *index =
+                (x & (c_blockSize - 1)) |
+                ((y & (c_blockSize - 1)) << c_blockBits) |
+                ((z & (c_blockSize - 1)) << (2 * c_blockBits));
+
+            return PackCoordinates(
+                x >> c_blockBits,
+                y >> c_blockBits,
+                z >> c_blockBits);
+        }
+    }
+
+    OccupancyMap::OccupancyMap(
+        _In_ const OccupancyMapSettings& settings)
+        : _settings(settings)
+    {
+        REQUIRES(_settings.VoxelSize > 0.0f);
+        REQUIRES(_settings.PixelStride > 0);
+    }
+
+    void OccupancyMap::Reset()
+    {
+        _blocks.clear();
+        _changedVoxels.clear();
+    }
+
+    VoxelState OccupancyMap::Classify(
+        _In_ float logOdds) const
+    {
+        if (logOdds >= _settings.OccupiedLogOdds)
+        {
+            return VoxelState::Occupied;
+        }
+        else if (logOdds <= _settings.FreeLogOdds)
+        {
+            return VoxelState::Free;
+        }
+
+        return VoxelState::Unknown;
+    }
+
+    void OccupancyMap::TraverseRay(
+        _In_ const cv::Vec3f& origin,
+        _In_ const cv::Vec3f& end,
+        _In_ bool hit,
+        _Inout_ std::vector<uint64_t>& updates) const
+    {
+        //
+        // Walks the voxels between the origin and the end of the ray (Amanatides and Woo).
+        // The updates are encoded as the voxel key shifted left by one, with the lowest
+        // bit set for hits, so a hit sorts after the misses of the same voxel.
+        //
+        const cv::Vec3f start = origin * (1.0f / _settings.VoxelSize);
+        const cv::Vec3f stop = end * (1.0f / _settings.VoxelSize);
+        const cv::Vec3f direction = stop - start;
+
+        int32_t voxel[3];
+        int32_t endVoxel[3];
+        int32_t step[3];
+        float nextBoundary[3];
+        float boundaryDistance[3];
+        int32_t numberOfSteps = 0;
+
+        for (int32_t i = 0; i < 3; ++i)
+        {
+            voxel[i] = static_cast<int32_t>(std::floor(start[i]));
+            endVoxel[i] = static_cast<int32_t>(std::floor(stop[i]));
+            numberOfSteps += std::abs(endVoxel[i] - voxel[i]);
+
+            if (direction[i] != 0.0f)
+            {
+                step[i] = direction[i] > 0.0f ? 1 : -1;
+                nextBoundary[i] = ((voxel[i] + (step[i] > 0 ? 1 : 0)) - start[i]) / direction[i];
+                boundaryDistance[i] = step[i] / direction[i];
+            }
+            else
+            {
+                step[i] = 0;
+                nextBoundary[i] = std::numeric_limits<float>::infinity();
+                boundaryDistance[i] = std::numeric_limits<float>::infinity();
+            }
+        }
+
+        //
+        // The number of steps is fixed by the end voxel, so rounding errors cannot make
+        // the traversal run away.
+        //
+        for (int32_t i = 0; i < numberOfSteps; ++i)
+        {
+            updates.push_back(PackCoordinates(voxel[0], voxel[1], voxel[2]) << 1);
+
+            const int32_t axis =
+                nextBoundary[0] < nextBoundary[1] ?
+                    (nextBoundary[0] < nextBoundary[2] ? 0 : 2) :
+                    (nextBoundary[1] < nextBoundary[2] ? 1 : 2);
+
+            voxel[axis] += step[axis];
+            nextBoundary[axis] += boundaryDistance[axis];
+        }
+
+        updates.push_back(
+            (PackCoordinates(endVoxel[0], endVoxel[1], endVoxel[2]) << 1) | (hit ? 1 : 0));
+    }
+
+    void OccupancyMap::Integrate(
+        _In_ const OrganizedPointCloud& pointCloud,
+        _In_ const cv::Matx44f& cameraToWorld)
+    {
+        REQUIRES(CV_32FC1 == pointCloud.X.type());
+        REQUIRES(pointCloud.X.size() == pointCloud.Y.size() && pointCloud.X.size() == pointCloud.Z.size());
+
+        const cv::Matx33f rotation = cameraToWorld.get_minor<3, 3>(0, 0);
+        const cv::Vec3f cameraPosition(cameraToWorld(0, 3), cameraToWorld(1, 3), cameraToWorld(2, 3));
+
+        const int32_t stride = _settings.PixelStride;
+        const int32_t sampledRows = (pointCloud.Z.rows + stride - 1) / stride;
+
+        concurrency::combinable<std::vector<uint64_t>> updates;
+
+        concurrency::parallel_for(0, sampledRows, [&](int32_t sampledRow)
+        {
+            const int32_t y = sampledRow * stride;
+
+            const float* pointX = pointCloud.X.ptr<float>(y);
+            const float* pointY = pointCloud.Y.ptr<float>(y);
+            const float* pointZ = pointCloud.Z.ptr<float>(y);
+
+            std::vector<uint64_t>& localUpdates = updates.local();
+
+            for (int32_t x = 0; x < pointCloud.Z.cols; x += stride)
+            {
+                if (0.0f == pointZ[x])
+                {
+                    continue;
+                }
+
+                cv::Vec3f point(pointX[x], pointY[x], pointZ[x]);
+
+                const float rayLength =
+                    static_cast<float>(cv::norm(point));
+
+                const bool hit =
+                    rayLength <= _settings.MaximumRayLength;
+
+                if (!hit)
+                {
+                    point *= _settings.MaximumRayLength / rayLength;
+                }
+
+                TraverseRay(
+                    cameraPosition,
+                    rotation * point + cameraPosition,
+                    hit,
+                    localUpdates);
+            }
+        });
+
+        std::vector<uint64_t> frameUpdates;
+
+        updates.combine_each([&](const std::vector<uint64_t>& localUpdates)
+        {
+            frameUpdates.insert(frameUpdates.end(), localUpdates.begin(), localUpdates.end());
+        });
+
+        std::sort(frameUpdates.begin(), frameUpdates.end());
+
+        uint64_t cachedBlockKey = std::numeric_limits<uint64_t>::max();
+        Block* cachedBlock = nullptr;
+
+        for (size_t i = 0; i < frameUpdates.size(); ++i)
+        {
+            const uint64_t voxelKey = frameUpdates[i] >> 1;
+
+            //
+            // Only the last update of each voxel is applied, which is a hit if there is one.
+            //
+            if (i + 1 < frameUpdates.size() && (frameUpdates[i + 1] >> 1) == voxelKey)
+            {
+                continue;
+            }
+
+            const bool hit = 0 != (frameUpdates[i] & 1);
+
+            int32_t index;
+
+            const uint64_t blockKey = GetBlockKey(voxelKey, &index);
+
+            if (blockKey != cachedBlockKey)
+            {
+                std::unique_ptr<Block>& block = _blocks[blockKey];
+
+                if (nullptr == block)
+                {
+                    block.reset(new Block());
+                    block->LogOdds.fill(0.0f);
+                }
+
+                cachedBlockKey = blockKey;
+                cachedBlock = block.get();
+            }
+
+            float& logOdds = cachedBlock->LogOdds[index];
+
+            const VoxelState previousState = Classify(logOdds);
+
+            logOdds = std::min(
+                std::max(logOdds + (hit ? _settings.HitLogOdds : _settings.MissLogOdds), _settings.MinimumLogOdds),
+                _settings.MaximumLogOdds);
+
+            const VoxelState state = Classify(logOdds);
+
+            if (state != previousState)
+            {
+                _changedVoxels[voxelKey] = state;
+            }
+        }
+
+        EvictBlocks(cameraPosition);
+    }
+
+    void OccupancyMap::EvictBlocks(
+        _In_ const cv::Vec3f& cameraPosition)
+    {
+        const float blockSize = c_blockSize * _settings.VoxelSize;
+
+        //
+        // Keep every block that may still overlap the window.
+        //
+        const float maximumDistance =
+            _settings.WindowRadius + 0.5f * std::sqrt(3.0f) * blockSize;
+
+        for (auto it = _blocks.begin(); it != _blocks.end();)
+        {
+            int32_t blockX, blockY, blockZ;
+
+            UnpackCoordinates(it->first, &blockX, &blockY, &blockZ);
+
+            const cv::Vec3f blockCenter =
+                (cv::Vec3f(
+                    static_cast<float>(blockX),
+                    static_cast<float>(blockY),
+                    static_cast<float>(blockZ)) + cv::Vec3f(0.5f, 0.5f, 0.5f)) * blockSize;
+
+            if (cv::norm(blockCenter - cameraPosition) <= maximumDistance)
+            {
+                ++it;
+                continue;
+            }
+
+            for (int32_t index = 0; index < c_blockSize * c_blockSize * c_blockSize; ++index)
+            {
+                if (VoxelState::Unknown == Classify(it->second->LogOdds[index]))
+                {
+                    continue;
+                }
+
+                const uint64_t voxelKey = PackCoordinates(
+                    blockX * c_blockSize + (index & (c_blockSize - 1)),
+                    blockY * c_blockSize + ((index >> c_blockBits) & (c_blockSize - 1)),
+                    blockZ * c_blockSize + (index >> (2 * c_blockBits)));
+
+                _changedVoxels[voxelKey] = VoxelState::Unknown;
+            }
+
+            it = _blocks.erase(it);
+        }
+    }
+
+    VoxelState OccupancyMap::GetState(
+        _In_ const cv::Vec3f& worldPoint) const
+    {
+        const cv::Vec3f voxel =
+            worldPoint * (1.0f / _settings.VoxelSize);
+
+        int32_t index;
+
+        const uint64_t blockKey = GetBlockKey(
+            PackCoordinates(
+                static_cast<int32_t>(std::floor(voxel[0])),
+                static_cast<int32_t>(std::floor(voxel[1])),
+                static_cast<int32_t>(std::floor(voxel[2]))),
+            &index);
+
+        const auto block = _blocks.find(blockKey);
+
+        if (_blocks.end() == block)
+        {
+            return VoxelState::Unknown;
+        }
+
+        return Classify(block->second->LogOdds[index]);
+    }
+
+    void OccupancyMap::GetChangedVoxels(
+        _Out_ std::vector<OccupancyDelta>& changedVoxels)
+    {
+        changedVoxels.clear();
+        changedVoxels.reserve(_changedVoxels.size());
+
+        for (const auto& changedVoxel : _changedVoxels)
+        {
+            OccupancyDelta delta;
+
+            UnpackCoordinates(changedVoxel.first, &delta.X, &delta.Y, &delta.Z);
+            delta.State = changedVoxel.second;
+
+            changedVoxels.push_back(delta);
+        }
+
+        _changedVoxels.clear();
+    }
+
+    size_t OccupancyMap::GetNumberOfBlocks() const
+    {
+        return _blocks.size();
+    }
+}
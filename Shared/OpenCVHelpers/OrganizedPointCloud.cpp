@@ -0,0 +1,696 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#include "pch.h"
+
+namespace rmcv
+{
+    namespace
+    {
+        //
+        // Rows are handed to the thread pool in bands to amortize the scheduling overhead.
+        //
+        const int32_t c_rowsPerBand = 16;
+
+        //
+        // Evaluates the monomials of the depth projection polynomial, ordered by degree.
+        // Scaling the unit plane coordinates to the angle from the optical axis removes
+        // most of the distortion of the wide angle depth cameras.
+        //
+        void EvaluateMonomials(
+            _In_ float x,
+            _In_ float y,
+            _Out_ float* monomials)
+        {
+            const float radius =
+                sqrtf(x * x + y * y);
+
+            if (radius > 1e-9f)
+            {
+                const float scale = atanf(radius) / radius;
+
+                x *= scale;
+                y *= scale;
+            }
+
+            float xPowers[6] = { 1.0f };
+            float yPowers[6] = { 1.0f };
+
+            for (int32_t i = 1; i < 6; ++i)
+            {
+                xPowers[i] = xPowers[i - 1] * x;
+                yPowers[i] = yPowers[i - 1] * y;
+            }
+
+            int32_t k = 0;
+
+            for (int32_t degree = 0; degree < 6; ++degree)
+            {
+                for (int32_t j = 0; j <= degree; ++j)
+                {
+                    monomials[k++] = xPowers[degree - j] * yPowers[j];
+                }
+            }
+        }
+
+        void BackprojectDepthRow(
+            _In_ const uint16_t* depth,
+            _In_ const float* rayX,
+            _In_ const float* rayY,
+            _In_ const float* rayZ,
+            _In_ int32_t width,
+            _In_ float minimumDistance,
+            _In_ float maximumDistance,
+            _Out_ float* pointX,
+            _Out_ float* pointY,
+            _Out_ float* pointZ)
+        {
+            int32_t x = 0;
+
+#if RMCV_USE_SSE2
+            const __m128i zero = _mm_setzero_si128();
+            const __m128 millimetersToMeters = _mm_set1_ps(0.001f);
+            const __m128 minimum = _mm_set1_ps(minimumDistance);
+            const __m128 maximum = _mm_set1_ps(maximumDistance);
+
+            for (; x + 4 <= width; x += 4)
+            {
+                const __m128 distance =
+                    _mm_mul_ps(
+                        _mm_cvtepi32_ps(
+                            _mm_unpacklo_epi16(
+                                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(depth + x)),
+                                zero)),
+                        millimetersToMeters);
+
+                const __m128 valid =
+                    _mm_and_ps(
+                        _mm_cmpge_ps(distance, minimum),
+                        _mm_cmple_ps(distance, maximum));
+
+                const __m128 validDistance =
+                    _mm_and_ps(distance, valid);
+
+                _mm_storeu_ps(pointX + x, _mm_mul_ps(_mm_loadu_ps(rayX + x), validDistance));
+                _mm_storeu_ps(pointY + x, _mm_mul_ps(_mm_loadu_ps(rayY + x), validDistance));
+                _mm_storeu_ps(pointZ + x, _mm_mul_ps(_mm_loadu_ps(rayZ + x), validDistance));
+            }
+#endif /* RMCV_USE_SSE2 */
+
+            for (; x < width; ++x)
+            {
+                float distance =
+                    depth[x] * 0.001f;
+
+                if (distance < minimumDistance || distance > maximumDistance)
+                {
+                    distance = 0.0f;
+                }
+
+                pointX[x] = rayX[x] * distance;
+                pointY[x] = rayY[x] * distance;
+                pointZ[x] = rayZ[x] * distance;
+            }
+        }
+
+        void EstimateNormalsRow(
+            _In_ const OrganizedPointCloud& pointCloud,
+            _In_ int32_t y,
+            _In_ float maximumRelativeDepthChange,
+            _Inout_ OrganizedNormals& normals)
+        {
+            const int32_t width =
+                pointCloud.Z.cols;
+
+            const float* x0 = pointCloud.X.ptr<float>(y);
+            const float* y0 = pointCloud.Y.ptr<float>(y);
+            const float* z0 = pointCloud.Z.ptr<float>(y);
+
+            const float* xu = pointCloud.X.ptr<float>(y - 1);
+            const float* yu = pointCloud.Y.ptr<float>(y - 1);
+            const float* zu = pointCloud.Z.ptr<float>(y - 1);
+
+            const float* xd = pointCloud.X.ptr<float>(y + 1);
+            const float* yd = pointCloud.Y.ptr<float>(y + 1);
+            const float* zd = pointCloud.Z.ptr<float>(y + 1);
+
+            float* nx = normals.X.ptr<float>(y);
+            float* ny = normals.Y.ptr<float>(y);
+            float* nz = normals.Z.ptr<float>(y);
+
+            nx[0] = ny[0] = nz[0] = 0.0f;
+            nx[width - 1] = ny[width - 1] = nz[width - 1] = 0.0f;
+
+            //
+            // The central differences span two pixels, hence the factor of two on the
+            // depth change threshold.
+            //
+            const float discontinuityScale =
+                2.0f * maximumRelativeDepthChange;
+
+            int32_t x = 1;
+
+#if RMCV_USE_SSE2
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 signMask = _mm_set1_ps(-0.0f);
+            const __m128 scale = _mm_set1_ps(discontinuityScale);
+
+            for (; x + 4 <= width - 1; x += 4)
+            {
+                const __m128 zc = _mm_loadu_ps(z0 + x);
+                const __m128 zl = _mm_loadu_ps(z0 + x - 1);
+                const __m128 zr = _mm_loadu_ps(z0 + x + 1);
+                const __m128 zup = _mm_loadu_ps(zu + x);
+                const __m128 zdown = _mm_loadu_ps(zd + x);
+
+                const __m128 dxZ = _mm_sub_ps(zr, zl);
+                const __m128 dyZ = _mm_sub_ps(zdown, zup);
+
+                const __m128 threshold =
+                    _mm_mul_ps(_mm_andnot_ps(signMask, zc), scale);
+
+                __m128 valid =
+                    _mm_and_ps(
+                        _mm_and_ps(
+                            _mm_and_ps(_mm_cmpneq_ps(zc, zero), _mm_cmpneq_ps(zl, zero)),
+                            _mm_and_ps(_mm_cmpneq_ps(zr, zero), _mm_cmpneq_ps(zup, zero))),
+                        _mm_cmpneq_ps(zdown, zero));
+
+                valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_andnot_ps(signMask, dxZ), threshold));
+                valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_andnot_ps(signMask, dyZ), threshold));
+
+                const __m128 dxX = _mm_sub_ps(_mm_loadu_ps(x0 + x + 1), _mm_loadu_ps(x0 + x - 1));
+                const __m128 dxY = _mm_sub_ps(_mm_loadu_ps(y0 + x + 1), _mm_loadu_ps(y0 + x - 1));
+                const __m128 dyX = _mm_sub_ps(_mm_loadu_ps(xd + x), _mm_loadu_ps(xu + x));
+                const __m128 dyY = _mm_sub_ps(_mm_loadu_ps(yd + x), _mm_loadu_ps(yu + x));
+
+                __m128 normalX = _mm_sub_ps(_mm_mul_ps(dxY, dyZ), _mm_mul_ps(dxZ, dyY));
+                __m128 normalY = _mm_sub_ps(_mm_mul_ps(dxZ, dyX), _mm_mul_ps(dxX, dyZ));
+                __m128 normalZ = _mm_sub_ps(_mm_mul_ps(dxX, dyY), _mm_mul_ps(dxY, dyX));
+
+                const __m128 squaredLength =
+                    _mm_add_ps(
+                        _mm_add_ps(_mm_mul_ps(normalX, normalX), _mm_mul_ps(normalY, normalY)),
+                        _mm_mul_ps(normalZ, normalZ));
+
+                valid = _mm_and_ps(valid, _mm_cmpgt_ps(squaredLength, zero));
+
+                //
+                // Orient the normals towards the camera, i.e. against the viewing ray.
+                //
+                const __m128 alongRay =
+                    _mm_add_ps(
+                        _mm_add_ps(
+                            _mm_mul_ps(normalX, _mm_loadu_ps(x0 + x)),
+                            _mm_mul_ps(normalY, _mm_loadu_ps(y0 + x))),
+                        _mm_mul_ps(normalZ, zc));
+
+                const __m128 flip =
+                    _mm_and_ps(_mm_cmpgt_ps(alongRay, zero), signMask);
+
+                const __m128 inverseLength =
+                    _mm_and_ps(
+                        _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(squaredLength, _mm_set1_ps(1e-30f)))),
+                        valid);
+
+                normalX = _mm_mul_ps(_mm_xor_ps(normalX, flip), inverseLength);
+                normalY = _mm_mul_ps(_mm_xor_ps(normalY, flip), inverseLength);
+                normalZ = _mm_mul_ps(_mm_xor_ps(normalZ, flip), inverseLength);
+
+                _mm_storeu_ps(nx + x, normalX);
+                _mm_storeu_ps(ny + x, normalY);
+                _mm_storeu_ps(nz + x, normalZ);
+            }
+#endif /* RMCV_USE_SSE2 */
+
+            for (; x < width - 1; ++x)
+            {
+                nx[x] = ny[x] = nz[x] = 0.0f;
+
+                const float zc = z0[x];
+
+                if (0.0f == zc ||
+                    0.0f == z0[x - 1] || 0.0f == z0[x + 1] ||
+                    0.0f == zu[x] || 0.0f == zd[x])
+                {
+                    continue;
+                }
+
+                const float dxZ = z0[x + 1] - z0[x - 1];
+                const float dyZ = zd[x] - zu[x];
+                const float threshold = fabsf(zc) * discontinuityScale;
+
+                if (fabsf(dxZ) > threshold || fabsf(dyZ) > threshold)
+                {
+                    continue;
+                }
+
+                const float dxX = x0[x + 1] - x0[x - 1];
+                const float dxY = y0[x + 1] - y0[x - 1];
+                const float dyX = xd[x] - xu[x];
+                const float dyY = yd[x] - yu[x];
+
+                float normalX = dxY * dyZ - dxZ * dyY;
+                float normalY = dxZ * dyX - dxX * dyZ;
+                float normalZ = dxX * dyY - dxY * dyX;
+
+                const float squaredLength =
+                    normalX * normalX + normalY * normalY + normalZ * normalZ;
+
+                if (squaredLength <= 0.0f)
+                {
+                    continue;
+                }
+
+                float inverseLength =
+                    1.0f / sqrtf(squaredLength);
+
+                if (normalX * x0[x] + normalY * y0[x] + normalZ * zc > 0.0f)
+                {
+                    inverseLength = -inverseLength;
+                }
+
+                nx[x] = normalX * inverseLength;
+                ny[x] = normalY * inverseLength;
+                nz[x] = normalZ * inverseLength;
+            }
+        }
+    }
+
+    void CreateDepthRayTable(
+        _In_ HoloLensForCV::CameraIntrinsics^ cameraIntrinsics,
+        _Out_ DepthRayTable& rayTable)
+    {
+        REQUIRES(nullptr != cameraIntrinsics);
+
+        const int32_t width = (int32_t)cameraIntrinsics->ImageWidth;
+        const int32_t height = (int32_t)cameraIntrinsics->ImageHeight;
+
+        cv::Mat unitPlaneCoordinates(
+            height,
+            width,
+            CV_32FC2);
+
+        for (int32_t y = 0; y < height; ++y)
+        {
+            cv::Vec2f* row =
+                unitPlaneCoordinates.ptr<cv::Vec2f>(y);
+
+            for (int32_t x = 0; x < width; ++x)
+            {
+                //
+                // Sample at integer pixel coordinates, as the recorder does for the
+                // <sensor>_camera_space_projection.bin table read by pcloud_compute.py, so
+                // that on-device and offline back-projections of a frame agree.
+                //
+                Windows::Foundation::Point uv;
+                uv.X = static_cast<float>(x);
+                uv.Y = static_cast<float>(y);
+
+                Windows::Foundation::Point xy;
+
+                if (cameraIntrinsics->MapImagePointToCameraUnitPlane(uv, &xy))
+                {
+                    row[x] = cv::Vec2f(xy.X, xy.Y);
+                }
+                else
+                {
+                    row[x] = cv::Vec2f(
+                        std::numeric_limits<float>::infinity(),
+                        std::numeric_limits<float>::infinity());
+                }
+            }
+        }
+
+        CreateDepthRayTable(
+            unitPlaneCoordinates,
+            rayTable);
+    }
+
+    void CreateDepthRayTable(
+        _In_ const cv::Mat& unitPlaneCoordinates,
+        _Out_ DepthRayTable& rayTable)
+    {
+        REQUIRES(CV_32FC2 == unitPlaneCoordinates.type());
+
+        rayTable.X.create(unitPlaneCoordinates.size(), CV_32FC1);
+        rayTable.Y.create(unitPlaneCoordinates.size(), CV_32FC1);
+        rayTable.Z.create(unitPlaneCoordinates.size(), CV_32FC1);
+
+        for (int32_t y = 0; y < unitPlaneCoordinates.rows; ++y)
+        {
+            const cv::Vec2f* unitPlaneRow = unitPlaneCoordinates.ptr<cv::Vec2f>(y);
+
+            float* rayX = rayTable.X.ptr<float>(y);
+            float* rayY = rayTable.Y.ptr<float>(y);
+            float* rayZ = rayTable.Z.ptr<float>(y);
+
+            for (int32_t x = 0; x < unitPlaneCoordinates.cols; ++x)
+            {
+                const float u = unitPlaneRow[x][0];
+                const float v = unitPlaneRow[x][1];
+
+                if (!std::isfinite(u) || !std::isfinite(v))
+                {
+                    //
+                    // A zero ray yields Z == 0, i.e. an invalid point, for any distance.
+                    //
+                    rayX[x] = rayY[x] = rayZ[x] = 0.0f;
+                    continue;
+                }
+
+                //
+                // The unit plane point (u, v, 1) is scaled to unit length and flipped to
+                // the negative Z axis the camera looks down, see also pcloud_compute.py.
+                //
+                const float scale =
+                    -1.0f / sqrtf(u * u + v * v + 1.0f);
+
+                rayX[x] = u * scale;
+                rayY[x] = v * scale;
+                rayZ[x] = scale;
+            }
+        }
+    }
+
+    void CreateDepthProjection(
+        _In_ const DepthRayTable& rayTable,
+        _Out_ DepthProjection& projection)
+    {
+        const int32_t numberOfCoefficients =
+            DepthProjection::NumberOfCoefficients;
+
+        REQUIRES(3 <= rayTable.Z.rows && 3 <= rayTable.Z.cols);
+
+        projection.ImageWidth = rayTable.Z.cols;
+        projection.ImageHeight = rayTable.Z.rows;
+
+        projection.MinimumX = projection.MinimumY = std::numeric_limits<float>::max();
+        projection.MaximumX = projection.MaximumY = -std::numeric_limits<float>::max();
+
+        projection.UnitPlaneX.create(rayTable.Z.size(), CV_32FC1);
+        projection.UnitPlaneY.create(rayTable.Z.size(), CV_32FC1);
+
+        std::vector<float> samples;
+        std::vector<float> columns;
+        std::vector<float> rows;
+
+        float monomials[numberOfCoefficients];
+
+        for (int32_t y = 0; y < rayTable.Z.rows; ++y)
+        {
+            const float* rayX = rayTable.X.ptr<float>(y);
+            const float* rayY = rayTable.Y.ptr<float>(y);
+            const float* rayZ = rayTable.Z.ptr<float>(y);
+
+            float* unitPlaneX = projection.UnitPlaneX.ptr<float>(y);
+            float* unitPlaneY = projection.UnitPlaneY.ptr<float>(y);
+
+            for (int32_t x = 0; x < rayTable.Z.cols; ++x)
+            {
+                if (0.0f == rayZ[x])
+                {
+                    unitPlaneX[x] = unitPlaneY[x] = std::numeric_limits<float>::infinity();
+                    continue;
+                }
+
+                const float u = rayX[x] / rayZ[x];
+                const float v = rayY[x] / rayZ[x];
+
+                unitPlaneX[x] = u;
+                unitPlaneY[x] = v;
+
+                projection.MinimumX = std::min(projection.MinimumX, u);
+                projection.MaximumX = std::max(projection.MaximumX, u);
+                projection.MinimumY = std::min(projection.MinimumY, v);
+                projection.MaximumY = std::max(projection.MaximumY, v);
+
+                EvaluateMonomials(
+                    u,
+                    v,
+                    monomials);
+
+                samples.insert(
+                    samples.end(),
+                    monomials,
+                    monomials + numberOfCoefficients);
+
+                columns.push_back(static_cast<float>(x));
+                rows.push_back(static_cast<float>(y));
+            }
+        }
+
+        const int32_t numberOfSamples =
+            static_cast<int32_t>(columns.size());
+
+        ASSERT(numberOfSamples >= numberOfCoefficients);
+
+        cv::Mat coefficients;
+
+        ASSERT(cv::solve(
+            cv::Mat(numberOfSamples, numberOfCoefficients, CV_32F, samples.data()),
+            cv::Mat(numberOfSamples, 1, CV_32F, columns.data()),
+            coefficients,
+            cv::DECOMP_QR));
+
+        std::copy(
+            coefficients.ptr<float>(),
+            coefficients.ptr<float>() + numberOfCoefficients,
+            projection.ColumnCoefficients.begin());
+
+        ASSERT(cv::solve(
+            cv::Mat(numberOfSamples, numberOfCoefficients, CV_32F, samples.data()),
+            cv::Mat(numberOfSamples, 1, CV_32F, rows.data()),
+            coefficients,
+            cv::DECOMP_QR));
+
+        std::copy(
+            coefficients.ptr<float>(),
+            coefficients.ptr<float>() + numberOfCoefficients,
+            projection.RowCoefficients.begin());
+    }
+
+    bool ProjectToDepthImage(
+        _In_ const DepthProjection& projection,
+        _In_ float x,
+        _In_ float y,
+        _In_ float z,
+        _Out_ float* column,
+        _Out_ float* row)
+    {
+        //
+        // The camera looks down the negative Z axis.
+        //
+        if (z >= 0.0f)
+        {
+            return false;
+        }
+
+        const float u = x / z;
+        const float v = y / z;
+
+        if (u < projection.MinimumX || u > projection.MaximumX ||
+            v < projection.MinimumY || v > projection.MaximumY)
+        {
+            return false;
+        }
+
+        float monomials[DepthProjection::NumberOfCoefficients];
+
+        EvaluateMonomials(
+            u,
+            v,
+            monomials);
+
+        float c = 0.0f;
+        float r = 0.0f;
+
+        for (int32_t i = 0; i < DepthProjection::NumberOfCoefficients; ++i)
+        {
+            c += projection.ColumnCoefficients[i] * monomials[i];
+            r += projection.RowCoefficients[i] * monomials[i];
+        }
+
+        //
+        // Refine the polynomial's estimate with Newton steps, using central differences
+        // on the ray table as the local Jacobian.
+        //
+        int32_t pixelColumn = 0;
+        int32_t pixelRow = 0;
+
+        for (int32_t step = 0; step < DepthProjection::NumberOfNewtonSteps; ++step)
+        {
+            pixelColumn = std::min(std::max(cvRound(c), 1), projection.ImageWidth - 2);
+            pixelRow = std::min(std::max(cvRound(r), 1), projection.ImageHeight - 2);
+
+            const float* unitPlaneX = projection.UnitPlaneX.ptr<float>(pixelRow);
+            const float* unitPlaneY = projection.UnitPlaneY.ptr<float>(pixelRow);
+
+            const float uc = 0.5f * (unitPlaneX[pixelColumn + 1] - unitPlaneX[pixelColumn - 1]);
+            const float vc = 0.5f * (unitPlaneY[pixelColumn + 1] - unitPlaneY[pixelColumn - 1]);
+
+            const float ur = 0.5f * (
+                projection.UnitPlaneX.at<float>(pixelRow + 1, pixelColumn) -
+                projection.UnitPlaneX.at<float>(pixelRow - 1, pixelColumn));
+
+            const float vr = 0.5f * (
+                projection.UnitPlaneY.at<float>(pixelRow + 1, pixelColumn) -
+                projection.UnitPlaneY.at<float>(pixelRow - 1, pixelColumn));
+
+            const float determinant =
+                uc * vr - ur * vc;
+
+            const float du = u - unitPlaneX[pixelColumn];
+            const float dv = v - unitPlaneY[pixelColumn];
+
+            //
+            // Also catches steps next to invalid pixels, which are non-finite.
+            //
+            if (!std::isfinite(determinant) || 0.0f == determinant ||
+                !std::isfinite(du) || !std::isfinite(dv))
+            {
+                return false;
+            }
+
+            c = pixelColumn + (vr * du - ur * dv) / determinant;
+            r = pixelRow + (uc * dv - vc * du) / determinant;
+        }
+
+        //
+        // Points that did not converge to the last pixel are dropped.
+        //
+        if (fabsf(c - pixelColumn) > 1.0f || fabsf(r - pixelRow) > 1.0f)
+        {
+            return false;
+        }
+
+        *column = c;
+        *row = r;
+
+        return
+            c > -0.5f && c < projection.ImageWidth - 0.5f &&
+            r > -0.5f && r < projection.ImageHeight - 0.5f;
+    }
+
+    void ReadCameraSpaceProjection(
+        _In_ const std::wstring& fileName,
+        _In_ int32_t imageWidth,
+        _In_ int32_t imageHeight,
+        _Out_ cv::Mat& unitPlaneCoordinates)
+    {
+        std::ifstream file(
+            fileName,
+            std::ios::binary);
+
+        ASSERT(file);
+
+        //
+        // The recorder iterates over the columns in the outer loop, so the file holds the
+        // transpose of the image.
+        //
+        cv::Mat transposed(
+            imageWidth,
+            imageHeight,
+            CV_32FC2);
+
+        ASSERT(transposed.isContinuous());
+
+        file.read(
+            reinterpret_cast<char*>(transposed.data),
+            transposed.total() * transposed.elemSize());
+
+        ASSERT(file);
+
+        cv::transpose(
+            transposed,
+            unitPlaneCoordinates);
+    }
+
+    void BackprojectDepthImage(
+        _In_ const cv::Mat& depthImage,
+        _In_ const DepthRayTable& rayTable,
+        _In_ float minimumDistance,
+        _In_ float maximumDistance,
+        _Out_ OrganizedPointCloud& pointCloud)
+    {
+        REQUIRES(CV_16UC1 == depthImage.type());
+        REQUIRES(depthImage.size() == rayTable.Z.size());
+
+        pointCloud.X.create(depthImage.size(), CV_32FC1);
+        pointCloud.Y.create(depthImage.size(), CV_32FC1);
+        pointCloud.Z.create(depthImage.size(), CV_32FC1);
+
+        const int32_t bandCount =
+            (depthImage.rows + c_rowsPerBand - 1) / c_rowsPerBand;
+
+        concurrency::parallel_for(0, bandCount, [&](int32_t band)
+        {
+            const int32_t endRow =
+                std::min(depthImage.rows, (band + 1) * c_rowsPerBand);
+
+            for (int32_t y = band * c_rowsPerBand; y < endRow; ++y)
+            {
+                BackprojectDepthRow(
+                    depthImage.ptr<uint16_t>(y),
+                    rayTable.X.ptr<float>(y),
+                    rayTable.Y.ptr<float>(y),
+                    rayTable.Z.ptr<float>(y),
+                    depthImage.cols,
+                    minimumDistance,
+                    maximumDistance,
+                    pointCloud.X.ptr<float>(y),
+                    pointCloud.Y.ptr<float>(y),
+                    pointCloud.Z.ptr<float>(y));
+            }
+        });
+    }
+
+    void EstimateOrganizedNormals(
+        _In_ const OrganizedPointCloud& pointCloud,
+        _In_ float maximumRelativeDepthChange,
+        _Out_ OrganizedNormals& normals)
+    {
+        REQUIRES(CV_32FC1 == pointCloud.Z.type());
+        REQUIRES(3 <= pointCloud.Z.rows && 3 <= pointCloud.Z.cols);
+
+        normals.X.create(pointCloud.Z.size(), CV_32FC1);
+        normals.Y.create(pointCloud.Z.size(), CV_32FC1);
+        normals.Z.create(pointCloud.Z.size(), CV_32FC1);
+
+        //
+        // The first and last rows lack a vertical neighbor.
+        //
+        const int32_t lastRow = pointCloud.Z.rows - 1;
+
+        normals.X.row(0).setTo(0.0f); normals.X.row(lastRow).setTo(0.0f);
+        normals.Y.row(0).setTo(0.0f); normals.Y.row(lastRow).setTo(0.0f);
+        normals.Z.row(0).setTo(0.0f); normals.Z.row(lastRow).setTo(0.0f);
+
+        const int32_t bandCount =
+            (lastRow - 1 + c_rowsPerBand - 1) / c_rowsPerBand;
+
+        concurrency::parallel_for(0, bandCount, [&](int32_t band)
+        {
+            const int32_t endRow =
+                std::min(lastRow, 1 + (band + 1) * c_rowsPerBand);
+
+            for (int32_t y = 1 + band * c_rowsPerBand; y < endRow; ++y)
+            {
+                EstimateNormalsRow(
+                    pointCloud,
+                    y,
+                    maximumRelativeDepthChange,
+                    normals);
+            }
+        });
+    }
+}
@@ -0,0 +1,847 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#include "pch.h"
+
+namespace rmcv
+{
+    namespace
+    {
+        bool HasNormal(
+            _In_ const OrganizedNormals& normals,
+            _In_ int32_t x,
+            _In_ int32_t y)
+        {
+            return
+                0.0f != normals.X.at<float>(y, x) ||
+                0.0f != normals.Y.at<float>(y, x) ||
+                0.0f != normals.Z.at<float>(y, x);
+        }
+
+        cv::Vec3f GetPoint(
+            _In_ const OrganizedPointCloud& pointCloud,
+            _In_ int32_t x,
+            _In_ int32_t y)
+        {
+            return cv::Vec3f(
+                pointCloud.X.at<float>(y, x),
+                pointCloud.Y.at<float>(y, x),
+                pointCloud.Z.at<float>(y, x));
+        }
+
+        cv::Vec3f GetNormal(
+            _In_ const OrganizedNormals& normals,
+            _In_ int32_t x,
+            _In_ int32_t y)
+        {
+            return cv::Vec3f(
+                normals.X.at<float>(y, x),
+                normals.Y.at<float>(y, x),
+                normals.Z.at<float>(y, x));
+        }
+
+        //
+        // Counts the points within the inlier distance of the plane whose normals agree
+        // with the plane's normal.
+        //
+        int32_t CountInliers(
+            _In_ const float* x,
+            _In_ const float* y,
+            _In_ const float* z,
+            _In_ const float* nx,
+            _In_ const float* ny,
+            _In_ const float* nz,
+            _In_ int32_t count,
+            _In_ const cv::Vec4f& plane,
+            _In_ float inlierDistance,
+            _In_ float minimumNormalCosine)
+        {
+            int32_t i = 0;
+            int32_t inliers = 0;
+
+#if RMCV_USE_SSE2
+            const __m128 a = _mm_set1_ps(plane[0]);
+            const __m128 b = _mm_set1_ps(plane[1]);
+            const __m128 c = _mm_set1_ps(plane[2]);
+            const __m128 d = _mm_set1_ps(plane[3]);
+            const __m128 signMask = _mm_set1_ps(-0.0f);
+            const __m128 distanceThreshold = _mm_set1_ps(inlierDistance);
+            const __m128 cosineThreshold = _mm_set1_ps(minimumNormalCosine);
+
+            //
+            // The comparison masks are -1 in each lane that passes, so subtracting them
+            // counts the inliers per lane.
+            //
+            __m128i laneInliers = _mm_setzero_si128();
+
+            for (; i + 4 <= count; i += 4)
+            {
+                const __m128 distance =
+                    _mm_andnot_ps(
+                        signMask,
+                        _mm_add_ps(
+                            _mm_add_ps(
+                                _mm_mul_ps(a, _mm_loadu_ps(x + i)),
+                                _mm_mul_ps(b, _mm_loadu_ps(y + i))),
+                            _mm_add_ps(
+                                _mm_mul_ps(c, _mm_loadu_ps(z + i)),
+                                d)));
+
+                const __m128 cosine =
+                    _mm_add_ps(
+                        _mm_add_ps(
+                            _mm_mul_ps(a, _mm_loadu_ps(nx + i)),
+                            _mm_mul_ps(b, _mm_loadu_ps(ny + i))),
+                        _mm_mul_ps(c, _mm_loadu_ps(nz + i)));
+
+                const __m128 inlier =
+                    _mm_and_ps(
+                        _mm_cmple_ps(distance, distanceThreshold),
+                        _mm_cmpge_ps(cosine, cosineThreshold));
+
+                laneInliers =
+                    _mm_sub_epi32(
+                        laneInliers,
+                        _mm_castps_si128(inlier));
+            }
+
+            int32_t lanes[4];
+
+            _mm_storeu_si128(
+                reinterpret_cast<__m128i*>(lanes),
+                laneInliers);
+
+            inliers = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif /* RMCV_USE_SSE2 */
+
+            for (; i < count; ++i)
+            {
+                const float distance =
+                    fabsf(plane[0] * x[i] + plane[1] * y[i] + plane[2] * z[i] + plane[3]);
+
+                const float cosine =
+                    plane[0] * nx[i] + plane[1] * ny[i] + plane[2] * nz[i];
+
+                if (distance <= inlierDistance && cosine >= minimumNormalCosine)
+                {
+                    ++inliers;
+                }
+            }
+
+            return inliers;
+        }
+
+        //
+        // Sums over the points of a plane, used for the least squares refinement.
+        //
+        struct PlaneMoments
+        {
+            cv::Vec3d Sum;
+            cv::Matx33d SumOfProducts;
+            int32_t Count;
+
+            PlaneMoments()
+                : Sum(0.0, 0.0, 0.0)
+                , SumOfProducts(cv::Matx33d::zeros())
+                , Count(0)
+            {
+            }
+
+            void Add(
+                _In_ const cv::Vec3f& point)
+            {
+                const cv::Vec3d p(point[0], point[1], point[2]);
+
+                Sum += p;
+                SumOfProducts += p * p.t();
+                ++Count;
+            }
+
+            void Merge(
+                _In_ const PlaneMoments& other)
+            {
+                Sum += other.Sum;
+                SumOfProducts += other.SumOfProducts;
+                Count += other.Count;
+            }
+        };
+    }
+
+    PlaneDetector::PlaneDetector(
+        _In_ const PlaneDetectionSettings& settings)
+        : _settings(settings)
+        , _rng(0x12345678)
+        , _cellColumns(0)
+        , _cellRows(0)
+    {
+        REQUIRES(_settings.CellSize >= 2);
+        REQUIRES(_settings.ScoringStride >= 1);
+        REQUIRES(_settings.MaximumNumberOfPlanes <= 255);
+    }
+
+    void PlaneDetector::ComputeCells(
+        _In_ const OrganizedPointCloud& pointCloud,
+        _In_ const OrganizedNormals& normals)
+    {
+        const int32_t cellSize = _settings.CellSize;
+
+        _cellColumns = pointCloud.Z.cols / cellSize;
+        _cellRows = pointCloud.Z.rows / cellSize;
+
+        _cells.resize(
+            _cellColumns * _cellRows);
+
+        const float minimumNormalCosine =
+            cosf(_settings.MaximumNormalAngleInDegrees * static_cast<float>(CV_PI) / 180.0f);
+
+        const float maximumSquaredError =
+            _settings.MaximumCellRootMeanSquareError * _settings.MaximumCellRootMeanSquareError;
+
+        const int32_t minimumCount =
+            cellSize * cellSize * 3 / 4;
+
+        concurrency::parallel_for(0, _cellRows, [&](int32_t cellRow)
+        {
+            for (int32_t cellColumn = 0; cellColumn < _cellColumns; ++cellColumn)
+            {
+                Cell& cell =
+                    _cells[cellRow * _cellColumns + cellColumn];
+
+                cell.Planar = false;
+                cell.Region = -1;
+
+                cv::Vec3f sumOfPoints(0.0f, 0.0f, 0.0f);
+                cv::Vec3f sumOfNormals(0.0f, 0.0f, 0.0f);
+                int32_t count = 0;
+
+                for (int32_t y = cellRow * cellSize; y < (cellRow + 1) * cellSize; ++y)
+                {
+                    for (int32_t x = cellColumn * cellSize; x < (cellColumn + 1) * cellSize; ++x)
+                    {
+                        if (HasNormal(normals, x, y))
+                        {
+                            sumOfPoints += GetPoint(pointCloud, x, y);
+                            sumOfNormals += GetNormal(normals, x, y);
+                            ++count;
+                        }
+                    }
+                }
+
+                //
+                // The mean of unit normals is shorter than one when they disagree.
+                //
+                if (count < minimumCount ||
+                    cv::norm(sumOfNormals) < minimumNormalCosine * count)
+                {
+                    continue;
+                }
+
+                cell.Normal = cv::normalize(sumOfNormals);
+                cell.Centroid = sumOfPoints * (1.0f / count);
+
+                float squaredError = 0.0f;
+
+                for (int32_t y = cellRow * cellSize; y < (cellRow + 1) * cellSize; ++y)
+                {
+                    for (int32_t x = cellColumn * cellSize; x < (cellColumn + 1) * cellSize; ++x)
+                    {
+                        if (HasNormal(normals, x, y))
+                        {
+                            const float distance =
+                                cell.Normal.dot(GetPoint(pointCloud, x, y) - cell.Centroid);
+
+                            squaredError += distance * distance;
+                        }
+                    }
+                }
+
+                cell.Planar =
+                    squaredError <= maximumSquaredError * count;
+            }
+        });
+    }
+
+    void PlaneDetector::GrowRegions()
+    {
+        const float minimumNormalCosine =
+            cosf(_settings.MaximumNormalAngleInDegrees * static_cast<float>(CV_PI) / 180.0f);
+
+        _regions.clear();
+
+        std::vector<int32_t> queue;
+
+        for (int32_t seed = 0; seed < static_cast<int32_t>(_cells.size()); ++seed)
+        {
+            if (!_cells[seed].Planar || _cells[seed].Region >= 0)
+            {
+                continue;
+            }
+
+            const int32_t region =
+                static_cast<int32_t>(_regions.size());
+
+            _regions.emplace_back();
+
+            std::vector<int32_t>& regionCells =
+                _regions.back();
+
+            cv::Vec3f regionNormal = _cells[seed].Normal;
+            cv::Vec3f sumOfNormals = _cells[seed].Normal;
+            cv::Vec3f sumOfCentroids = _cells[seed].Centroid;
+            int32_t numberOfCells = 1;
+
+            _cells[seed].Region = region;
+
+            queue.assign(1, seed);
+
+            while (!queue.empty())
+            {
+                const int32_t current = queue.back();
+                queue.pop_back();
+
+                regionCells.push_back(current);
+
+                const cv::Vec3f regionCentroid =
+                    sumOfCentroids * (1.0f / numberOfCells);
+
+                const int32_t cellColumn = current % _cellColumns;
+                const int32_t cellRow = current / _cellColumns;
+
+                const int32_t neighbors[4][2] =
+                {
+                    { cellColumn - 1, cellRow },
+                    { cellColumn + 1, cellRow },
+                    { cellColumn, cellRow - 1 },
+                    { cellColumn, cellRow + 1 }
+                };
+
+                for (const auto& neighbor : neighbors)
+                {
+                    if (neighbor[0] < 0 || neighbor[0] >= _cellColumns ||
+                        neighbor[1] < 0 || neighbor[1] >= _cellRows)
+                    {
+                        continue;
+                    }
+
+                    const int32_t index =
+                        neighbor[1] * _cellColumns + neighbor[0];
+
+                    Cell& cell = _cells[index];
+
+                    if (!cell.Planar || cell.Region >= 0 ||
+                        cell.Normal.dot(regionNormal) < minimumNormalCosine ||
+                        fabsf(regionNormal.dot(cell.Centroid - regionCentroid)) > _settings.InlierDistance)
+                    {
+                        continue;
+                    }
+
+                    cell.Region = region;
+
+                    sumOfNormals += cell.Normal;
+                    sumOfCentroids += cell.Centroid;
+                    ++numberOfCells;
+                    regionNormal = cv::normalize(sumOfNormals);
+
+                    queue.push_back(index);
+                }
+            }
+        }
+
+        //
+        // Try the largest regions first; single cells are too small to seed a plane.
+        //
+        _regions.erase(
+            std::remove_if(
+                _regions.begin(),
+                _regions.end(),
+                [](const std::vector<int32_t>& cells) { return cells.size() < 2; }),
+            _regions.end());
+
+        std::sort(
+            _regions.begin(),
+            _regions.end(),
+            [](const std::vector<int32_t>& a, const std::vector<int32_t>& b)
+        {
+            return a.size() > b.size();
+        });
+    }
+
+    void PlaneDetector::CollectScoringPoints(
+        _In_ const OrganizedPointCloud& pointCloud,
+        _In_ const OrganizedNormals& normals,
+        _In_ const cv::Mat& labels)
+    {
+        _scoringX.clear();
+        _scoringY.clear();
+        _scoringZ.clear();
+        _scoringNormalX.clear();
+        _scoringNormalY.clear();
+        _scoringNormalZ.clear();
+
+        for (int32_t y = 0; y < pointCloud.Z.rows; y += _settings.ScoringStride)
+        {
+            const uint8_t* labelRow = labels.ptr<uint8_t>(y);
+
+            for (int32_t x = 0; x < pointCloud.Z.cols; x += _settings.ScoringStride)
+            {
+                if (0 != labelRow[x] || !HasNormal(normals, x, y))
+                {
+                    continue;
+                }
+
+                _scoringX.push_back(pointCloud.X.at<float>(y, x));
+                _scoringY.push_back(pointCloud.Y.at<float>(y, x));
+                _scoringZ.push_back(pointCloud.Z.at<float>(y, x));
+                _scoringNormalX.push_back(normals.X.at<float>(y, x));
+                _scoringNormalY.push_back(normals.Y.at<float>(y, x));
+                _scoringNormalZ.push_back(normals.Z.at<float>(y, x));
+            }
+        }
+    }
+
+    bool PlaneDetector::FitPlane(
+        _In_ const OrganizedPointCloud& pointCloud,
+        _In_ const OrganizedNormals& normals,
+        _In_ int32_t region,
+        _In_ uint8_t label,
+        _Inout_ cv::Mat& labels,
+        _Out_ DetectedPlane* plane)
+    {
+        const int32_t cellSize = _settings.CellSize;
+
+        const float minimumNormalCosine =
+            cosf(_settings.MaximumNormalAngleInDegrees * static_cast<float>(CV_PI) / 180.0f);
+
+        //
+        // Sample the hypotheses from the pixels of the seed region that are not yet
+        // assigned to a plane.
+        //
+        std::vector<cv::Point> samplePool;
+
+        for (int32_t cell : _regions[region])
+        {
+            const int32_t cellColumn = cell % _cellColumns;
+            const int32_t cellRow = cell / _cellColumns;
+
+            for (int32_t y = cellRow * cellSize; y < (cellRow + 1) * cellSize; ++y)
+            {
+                for (int32_t x = cellColumn * cellSize; x < (cellColumn + 1) * cellSize; ++x)
+                {
+                    if (0 == labels.at<uint8_t>(y, x) && HasNormal(normals, x, y))
+                    {
+                        samplePool.emplace_back(x, y);
+                    }
+                }
+            }
+        }
+
+        if (static_cast<int32_t>(samplePool.size()) < 2 * cellSize * cellSize)
+        {
+            return false;
+        }
+
+        std::vector<cv::Vec4f> hypotheses;
+
+        for (int32_t i = 0; i < _settings.NumberOfHypotheses; ++i)
+        {
+            cv::Vec3f p[3];
+
+            for (auto& point : p)
+            {
+                const cv::Point& sample =
+                    samplePool[_rng.uniform(0, static_cast<int32_t>(samplePool.size()))];
+
+                point = GetPoint(pointCloud, sample.x, sample.y);
+            }
+
+            cv::Vec3f normal =
+                (p[1] - p[0]).cross(p[2] - p[0]);
+
+            const float length =
+                static_cast<float>(cv::norm(normal));
+
+            if (length < 1e-6f)
+            {
+                continue;
+            }
+
+            normal *= 1.0f / length;
+
+            float offset = -normal.dot(p[0]);
+
+            //
+            // Orient the normal towards the camera at the origin.
+            //
+            if (offset < 0.0f)
+            {
+                normal = -normal;
+                offset = -offset;
+            }
+
+            hypotheses.emplace_back(normal[0], normal[1], normal[2], offset);
+        }
+
+        if (hypotheses.empty())
+        {
+            return false;
+        }
+
+        //
+        // Score all hypotheses in parallel against the remaining points.
+        //
+        std::vector<int32_t> scores(
+            hypotheses.size());
+
+        concurrency::parallel_for(0, static_cast<int32_t>(hypotheses.size()), [&](int32_t i)
+        {
+            scores[i] = CountInliers(
+                _scoringX.data(),
+                _scoringY.data(),
+                _scoringZ.data(),
+                _scoringNormalX.data(),
+                _scoringNormalY.data(),
+                _scoringNormalZ.data(),
+                static_cast<int32_t>(_scoringX.size()),
+                hypotheses[i],
+                _settings.InlierDistance,
+                minimumNormalCosine);
+        });
+
+        const size_t best =
+            std::max_element(scores.begin(), scores.end()) - scores.begin();
+
+        if (scores[best] * _settings.ScoringStride * _settings.ScoringStride < _settings.MinimumNumberOfInliers)
+        {
+            return false;
+        }
+
+        //
+        // Refine the best hypothesis by least squares on all of its inliers.
+        //
+        const cv::Vec4f hypothesis = hypotheses[best];
+        const cv::Vec3f hypothesisNormal(hypothesis[0], hypothesis[1], hypothesis[2]);
+
+        concurrency::combinable<PlaneMoments> partialMoments;
+
+        concurrency::parallel_for(0, pointCloud.Z.rows, [&](int32_t y)
+        {
+            PlaneMoments& moments = partialMoments.local();
+
+            const uint8_t* labelRow = labels.ptr<uint8_t>(y);
+
+            for (int32_t x = 0; x < pointCloud.Z.cols; ++x)
+            {
+                if (0 != labelRow[x] || !HasNormal(normals, x, y))
+                {
+                    continue;
+                }
+
+                const cv::Vec3f point = GetPoint(pointCloud, x, y);
+
+                if (fabsf(hypothesisNormal.dot(point) + hypothesis[3]) <= _settings.InlierDistance &&
+                    hypothesisNormal.dot(GetNormal(normals, x, y)) >= minimumNormalCosine)
+                {
+                    moments.Add(point);
+                }
+            }
+        });
+
+        PlaneMoments moments;
+
+        partialMoments.combine_each([&](const PlaneMoments& partial)
+        {
+            moments.Merge(partial);
+        });
+
+        if (moments.Count < _settings.MinimumNumberOfInliers)
+        {
+            return false;
+        }
+
+        const cv::Vec3d centroid =
+            moments.Sum * (1.0 / moments.Count);
+
+        const cv::Matx33d covariance =
+            moments.SumOfProducts * (1.0 / moments.Count) - centroid * centroid.t();
+
+        cv::Matx31d eigenvalues;
+        cv::Matx33d eigenvectors;
+
+        cv::eigen(
+            covariance,
+            eigenvalues,
+            eigenvectors);
+
+        //
+        // The eigenvalues are sorted in descending order, so the normal is the last row.
+        //
+        cv::Vec3f normal(
+            static_cast<float>(eigenvectors(2, 0)),
+            static_cast<float>(eigenvectors(2, 1)),
+            static_cast<float>(eigenvectors(2, 2)));
+
+        if (normal.dot(hypothesisNormal) < 0.0f)
+        {
+            normal = -normal;
+        }
+
+        plane->Normal = normal;
+        plane->Centroid = cv::Vec3f(
+            static_cast<float>(centroid[0]),
+            static_cast<float>(centroid[1]),
+            static_cast<float>(centroid[2]));
+        plane->Offset = -normal.dot(plane->Centroid);
+        plane->Id = -1;
+
+        concurrency::combinable<int32_t> partialInliers;
+
+        concurrency::parallel_for(0, pointCloud.Z.rows, [&](int32_t y)
+        {
+            int32_t& inliers = partialInliers.local();
+
+            uint8_t* labelRow = labels.ptr<uint8_t>(y);
+
+            for (int32_t x = 0; x < pointCloud.Z.cols; ++x)
+            {
+                if (0 != labelRow[x] || !HasNormal(normals, x, y))
+                {
+                    continue;
+                }
+
+                if (fabsf(normal.dot(GetPoint(pointCloud, x, y)) + plane->Offset) <= _settings.InlierDistance &&
+                    normal.dot(GetNormal(normals, x, y)) >= minimumNormalCosine)
+                {
+                    labelRow[x] = label;
+                    ++inliers;
+                }
+            }
+        });
+
+        plane->NumberOfInliers =
+            partialInliers.combine(std::plus<int32_t>());
+
+        return true;
+    }
+
+    void PlaneDetector::Detect(
+        _In_ const OrganizedPointCloud& pointCloud,
+        _In_ const OrganizedNormals& normals,
+        _Out_ std::vector<DetectedPlane>& planes,
+        _Out_ cv::Mat& labels)
+    {
+        REQUIRES(pointCloud.Z.size() == normals.Z.size());
+
+        planes.clear();
+
+        labels.create(pointCloud.Z.size(), CV_8UC1);
+        labels.setTo(0);
+
+        ComputeCells(
+            pointCloud,
+            normals);
+
+        GrowRegions();
+
+        CollectScoringPoints(
+            pointCloud,
+            normals,
+            labels);
+
+        for (int32_t region = 0; region < static_cast<int32_t>(_regions.size()); ++region)
+        {
+            if (static_cast<int32_t>(planes.size()) >= _settings.MaximumNumberOfPlanes)
+            {
+                break;
+            }
+
+            DetectedPlane plane;
+
+            if (!FitPlane(
+                pointCloud,
+                normals,
+                region,
+                static_cast<uint8_t>(planes.size() + 1),
+                labels,
+                &plane))
+            {
+                continue;
+            }
+
+            planes.push_back(plane);
+
+            CollectScoringPoints(
+                pointCloud,
+                normals,
+                labels);
+        }
+
+        //
+        // The planes were found in the order of the size of their seed regions. Sort
+        // them by their support, and relabel the pixels to match.
+        //
+        std::vector<int32_t> order(
+            planes.size());
+
+        std::iota(
+            order.begin(),
+            order.end(),
+            0);
+
+        std::stable_sort(
+            order.begin(),
+            order.end(),
+            [&](int32_t a, int32_t b)
+        {
+            return planes[a].NumberOfInliers > planes[b].NumberOfInliers;
+        });
+
+        std::vector<DetectedPlane> sortedPlanes;
+        sortedPlanes.reserve(planes.size());
+
+        cv::Mat relabel(1, 256, CV_8UC1, cv::Scalar(0));
+
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            sortedPlanes.push_back(planes[order[i]]);
+
+            relabel.at<uint8_t>(order[i] + 1) = static_cast<uint8_t>(i + 1);
+        }
+
+        planes.swap(sortedPlanes);
+
+        cv::LUT(
+            labels,
+            relabel,
+            labels);
+    }
+
+    PlaneTracker::PlaneTracker(
+        _In_ float maximumNormalAngleInDegrees,
+        _In_ float maximumOffsetDifference,
+        _In_ int32_t maximumFramesWithoutObservation)
+        : _minimumNormalCosine(cosf(maximumNormalAngleInDegrees * static_cast<float>(CV_PI) / 180.0f))
+        , _maximumOffsetDifference(maximumOffsetDifference)
+        , _maximumFramesWithoutObservation(maximumFramesWithoutObservation)
+        , _nextId(0)
+    {
+    }
+
+    void PlaneTracker::Reset()
+    {
+        _nextId = 0;
+        _trackedPlanes.clear();
+    }
+
+    void PlaneTracker::Update(
+        _In_ const cv::Matx44f& cameraToWorld,
+        _Inout_ std::vector<DetectedPlane>& planes)
+    {
+        const cv::Matx33f rotation = cameraToWorld.get_minor<3, 3>(0, 0);
+        const cv::Vec3f translation(cameraToWorld(0, 3), cameraToWorld(1, 3), cameraToWorld(2, 3));
+
+        std::vector<bool> observed(
+            _trackedPlanes.size(),
+            false);
+
+        //
+        // The planes are sorted by their support, so the best supported planes get
+        // to pick their match first.
+        //
+        for (auto& plane : planes)
+        {
+            const cv::Vec3f normal = rotation * plane.Normal;
+            const cv::Vec3f centroid = rotation * plane.Centroid + translation;
+            const float offset = -normal.dot(centroid);
+
+            int32_t bestMatch = -1;
+            float bestOffsetDifference = _maximumOffsetDifference;
+
+            for (size_t i = 0; i < _trackedPlanes.size(); ++i)
+            {
+                const TrackedPlane& trackedPlane = _trackedPlanes[i];
+
+                if (observed[i] || trackedPlane.Normal.dot(normal) < _minimumNormalCosine)
+                {
+                    continue;
+                }
+
+                const float offsetDifference =
+                    fabsf(trackedPlane.Offset - offset);
+
+                if (offsetDifference <= bestOffsetDifference)
+                {
+                    bestMatch = static_cast<int32_t>(i);
+                    bestOffsetDifference = offsetDifference;
+                }
+            }
+
+            if (bestMatch < 0)
+            {
+                TrackedPlane trackedPlane;
+
+                trackedPlane.Id = _nextId++;
+                trackedPlane.Normal = normal;
+                trackedPlane.Offset = offset;
+                trackedPlane.Centroid = centroid;
+                trackedPlane.NumberOfObservations = 1;
+                trackedPlane.FramesSinceLastObservation = 0;
+
+                _trackedPlanes.push_back(trackedPlane);
+                observed.push_back(true);
+
+                plane.Id = trackedPlane.Id;
+
+                continue;
+            }
+
+            //
+            // Average the observations so the tracked plane becomes more accurate over time.
+            //
+            TrackedPlane& trackedPlane = _trackedPlanes[bestMatch];
+
+            const float weight =
+                1.0f / (std::min(trackedPlane.NumberOfObservations, 30) + 1);
+
+            trackedPlane.Normal = cv::normalize(trackedPlane.Normal * (1.0f - weight) + normal * weight);
+            trackedPlane.Centroid = trackedPlane.Centroid * (1.0f - weight) + centroid * weight;
+            trackedPlane.Offset = trackedPlane.Offset * (1.0f - weight) + offset * weight;
+            ++trackedPlane.NumberOfObservations;
+            trackedPlane.FramesSinceLastObservation = 0;
+
+            observed[bestMatch] = true;
+
+            plane.Id = trackedPlane.Id;
+        }
+
+        for (size_t i = 0; i < _trackedPlanes.size(); ++i)
+        {
+            if (!observed[i])
+            {
+                ++_trackedPlanes[i].FramesSinceLastObservation;
+            }
+        }
+
+        _trackedPlanes.erase(
+            std::remove_if(
+                _trackedPlanes.begin(),
+                _trackedPlanes.end(),
+                [this](const TrackedPlane& trackedPlane)
+        {
+            return trackedPlane.FramesSinceLastObservation > _maximumFramesWithoutObservation;
+        }),
+            _trackedPlanes.end());
+    }
+
+    const std::vector<TrackedPlane>& PlaneTracker::GetTrackedPlanes() const
+    {
+        return _trackedPlanes;
+    }
+}
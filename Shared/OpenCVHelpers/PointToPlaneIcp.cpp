@@ -0,0 +1,443 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#include "pch.h"
+
+namespace rmcv
+{
+    namespace
+    {
+        const int32_t c_rowsPerBand = 8;
+
+        //
+        // Normal equations of the linearized point-to-plane problem. Only the upper
+        // triangle of the symmetric 6x6 matrix is accumulated.
+        //
+        struct NormalEquations
+        {
+            double JtJ[21];
+            double Jtr[6];
+            double SquaredError;
+            int32_t NumberOfInliers;
+
+            NormalEquations()
+            {
+                memset(this, 0, sizeof(*this));
+            }
+
+            void Add(
+                _In_ const float* jacobian,
+                _In_ float residual,
+                _In_ float weight)
+            {
+                int32_t k = 0;
+
+                for (int32_t i = 0; i < 6; ++i)
+                {
+                    const double weightedJacobian =
+                        weight * jacobian[i];
+
+                    for (int32_t j = i; j < 6; ++j)
+                    {
+                        JtJ[k++] += weightedJacobian * jacobian[j];
+                    }
+
+                    Jtr[i] += weightedJacobian * residual;
+                }
+
+                SquaredError += residual * residual;
+                ++NumberOfInliers;
+            }
+
+            void Merge(
+                _In_ const NormalEquations& other)
+            {
+                for (int32_t i = 0; i < 21; ++i)
+                {
+                    JtJ[i] += other.JtJ[i];
+                }
+
+                for (int32_t i = 0; i < 6; ++i)
+                {
+                    Jtr[i] += other.Jtr[i];
+                }
+
+                SquaredError += other.SquaredError;
+                NumberOfInliers += other.NumberOfInliers;
+            }
+
+            //
+            // Solves for the twist (rotation, translation) that minimizes the residuals.
+            //
+            bool Solve(
+                _Out_ cv::Vec6d* twist) const
+            {
+                cv::Matx66d A;
+                cv::Vec6d b;
+
+                int32_t k = 0;
+
+                for (int32_t i = 0; i < 6; ++i)
+                {
+                    for (int32_t j = i; j < 6; ++j)
+                    {
+                        A(i, j) = A(j, i) = JtJ[k++];
+                    }
+
+                    b[i] = -Jtr[i];
+                }
+
+                return cv::solve(
+                    A,
+                    b,
+                    *twist,
+                    cv::DECOMP_CHOLESKY);
+            }
+        };
+
+        cv::Matx44f TwistToTransform(
+            _In_ const cv::Vec6d& twist)
+        {
+            cv::Matx33d rotation;
+
+            cv::Rodrigues(
+                cv::Vec3d(twist[0], twist[1], twist[2]),
+                rotation);
+
+            cv::Matx44f transform =
+                cv::Matx44f::eye();
+
+            for (int32_t i = 0; i < 3; ++i)
+            {
+                for (int32_t j = 0; j < 3; ++j)
+                {
+                    transform(i, j) = static_cast<float>(rotation(i, j));
+                }
+
+                transform(i, 3) = static_cast<float>(twist[3 + i]);
+            }
+
+            return transform;
+        }
+
+        //
+        // Subsamples a CV_32FC1 plane by the given integer factor.
+        //
+        void Subsample(
+            _In_ const cv::Mat& image,
+            _In_ int32_t scale,
+            _Out_ cv::Mat& subsampledImage)
+        {
+            subsampledImage.create(
+                (image.rows + scale - 1) / scale,
+                (image.cols + scale - 1) / scale,
+                CV_32FC1);
+
+            for (int32_t y = 0; y < subsampledImage.rows; ++y)
+            {
+                const float* sourceRow = image.ptr<float>(y * scale);
+                float* destinationRow = subsampledImage.ptr<float>(y);
+
+                for (int32_t x = 0; x < subsampledImage.cols; ++x)
+                {
+                    destinationRow[x] = sourceRow[x * scale];
+                }
+            }
+        }
+    }
+
+    PointToPlaneIcp::PointToPlaneIcp(
+        _In_ const DepthRayTable& rayTable,
+        _In_ const PointToPlaneIcpSettings& settings)
+        : _settings(settings)
+        , _rayTable(rayTable)
+    {
+        REQUIRES(
+            _settings.PyramidLevels >= 1 &&
+            _settings.PyramidLevels <= static_cast<int32_t>(_settings.Iterations.size()));
+
+        CreateDepthProjection(
+            _rayTable,
+            _projection);
+    }
+
+    void PointToPlaneIcp::BuildPyramid(
+        _In_ const cv::Mat& depthImage,
+        _In_ float minimumDistance,
+        _In_ float maximumDistance,
+        _Inout_ std::vector<PyramidLevel>& pyramid)
+    {
+        pyramid.resize(
+            _settings.PyramidLevels);
+
+        BackprojectDepthImage(
+            depthImage,
+            _rayTable,
+            minimumDistance,
+            maximumDistance,
+            pyramid[0].Points);
+
+        pyramid[0].Scale = 1;
+
+        //
+        // Subsampling instead of averaging keeps the points on the measured surfaces
+        // and avoids mixing depths across discontinuities.
+        //
+        for (int32_t level = 1; level < _settings.PyramidLevels; ++level)
+        {
+            const int32_t scale = 1 << level;
+
+            pyramid[level].Scale = scale;
+
+            Subsample(pyramid[0].Points.X, scale, pyramid[level].Points.X);
+            Subsample(pyramid[0].Points.Y, scale, pyramid[level].Points.Y);
+            Subsample(pyramid[0].Points.Z, scale, pyramid[level].Points.Z);
+        }
+
+        for (auto& level : pyramid)
+        {
+            EstimateOrganizedNormals(
+                level.Points,
+                _settings.MaximumRelativeDepthChange * level.Scale,
+                level.Normals);
+        }
+    }
+
+    void PointToPlaneIcp::SetTarget(
+        _In_ const cv::Mat& depthImage,
+        _In_ float minimumDistance,
+        _In_ float maximumDistance)
+    {
+        BuildPyramid(
+            depthImage,
+            minimumDistance,
+            maximumDistance,
+            _target);
+    }
+
+    bool PointToPlaneIcp::Align(
+        _In_ const cv::Mat& depthImage,
+        _In_ float minimumDistance,
+        _In_ float maximumDistance,
+        _In_ const cv::Matx44f& initialSourceToTarget,
+        _Out_ PointToPlaneIcpResult* result)
+    {
+        REQUIRES(!_target.empty());
+
+        BuildPyramid(
+            depthImage,
+            minimumDistance,
+            maximumDistance,
+            _source);
+
+        const float maximumSquaredDistance =
+            _settings.MaximumCorrespondenceDistance * _settings.MaximumCorrespondenceDistance;
+
+        const float minimumNormalCosine =
+            cosf(_settings.MaximumNormalAngleInDegrees * static_cast<float>(CV_PI) / 180.0f);
+
+        const float huberThreshold =
+            _settings.HuberThreshold;
+
+        cv::Matx44f sourceToTarget =
+            initialSourceToTarget;
+
+        NormalEquations lastEquations;
+        bool solved = true;
+
+        for (int32_t level = _settings.PyramidLevels - 1; level >= 0 && solved; --level)
+        {
+            const PyramidLevel& source = _source[level];
+            const PyramidLevel& target = _target[level];
+
+            const int32_t scale = source.Scale;
+            const int32_t targetWidth = target.Points.Z.cols;
+            const int32_t targetHeight = target.Points.Z.rows;
+
+            const int32_t bandCount =
+                (source.Points.Z.rows + c_rowsPerBand - 1) / c_rowsPerBand;
+
+            for (int32_t iteration = 0; iteration < _settings.Iterations[level]; ++iteration)
+            {
+                const cv::Matx44f transform = sourceToTarget;
+
+                concurrency::combinable<NormalEquations> partialEquations;
+
+                concurrency::parallel_for(0, bandCount, [&](int32_t band)
+                {
+                    NormalEquations& equations =
+                        partialEquations.local();
+
+                    const int32_t endRow =
+                        std::min(source.Points.Z.rows, (band + 1) * c_rowsPerBand);
+
+                    for (int32_t y = band * c_rowsPerBand; y < endRow; ++y)
+                    {
+                        const float* sourceX = source.Points.X.ptr<float>(y);
+                        const float* sourceY = source.Points.Y.ptr<float>(y);
+                        const float* sourceZ = source.Points.Z.ptr<float>(y);
+
+                        const float* sourceNormalX = source.Normals.X.ptr<float>(y);
+                        const float* sourceNormalY = source.Normals.Y.ptr<float>(y);
+                        const float* sourceNormalZ = source.Normals.Z.ptr<float>(y);
+
+                        for (int32_t x = 0; x < source.Points.Z.cols; ++x)
+                        {
+                            if (0.0f == sourceZ[x] ||
+                                (0.0f == sourceNormalX[x] && 0.0f == sourceNormalY[x] && 0.0f == sourceNormalZ[x]))
+                            {
+                                continue;
+                            }
+
+                            const cv::Vec3f q(
+                                transform(0, 0) * sourceX[x] + transform(0, 1) * sourceY[x] + transform(0, 2) * sourceZ[x] + transform(0, 3),
+                                transform(1, 0) * sourceX[x] + transform(1, 1) * sourceY[x] + transform(1, 2) * sourceZ[x] + transform(1, 3),
+                                transform(2, 0) * sourceX[x] + transform(2, 1) * sourceY[x] + transform(2, 2) * sourceZ[x] + transform(2, 3));
+
+                            //
+                            // Projective data association: the correspondence is the target
+                            // point the transformed source point projects onto.
+                            //
+                            float column, row;
+
+                            if (!ProjectToDepthImage(_projection, q[0], q[1], q[2], &column, &row))
+                            {
+                                continue;
+                            }
+
+                            const int32_t targetColumn =
+                                cvRound(column / scale);
+
+                            const int32_t targetRow =
+                                cvRound(row / scale);
+
+                            if (targetColumn < 0 || targetColumn >= targetWidth ||
+                                targetRow < 0 || targetRow >= targetHeight)
+                            {
+                                continue;
+                            }
+
+                            const cv::Vec3f n(
+                                target.Normals.X.at<float>(targetRow, targetColumn),
+                                target.Normals.Y.at<float>(targetRow, targetColumn),
+                                target.Normals.Z.at<float>(targetRow, targetColumn));
+
+                            if (0.0f == n[0] && 0.0f == n[1] && 0.0f == n[2])
+                            {
+                                continue;
+                            }
+
+                            const cv::Vec3f d(
+                                target.Points.X.at<float>(targetRow, targetColumn),
+                                target.Points.Y.at<float>(targetRow, targetColumn),
+                                target.Points.Z.at<float>(targetRow, targetColumn));
+
+                            const cv::Vec3f difference = q - d;
+
+                            if (difference.dot(difference) > maximumSquaredDistance)
+                            {
+                                continue;
+                            }
+
+                            const cv::Vec3f rotatedNormal(
+                                transform(0, 0) * sourceNormalX[x] + transform(0, 1) * sourceNormalY[x] + transform(0, 2) * sourceNormalZ[x],
+                                transform(1, 0) * sourceNormalX[x] + transform(1, 1) * sourceNormalY[x] + transform(1, 2) * sourceNormalZ[x],
+                                transform(2, 0) * sourceNormalX[x] + transform(2, 1) * sourceNormalY[x] + transform(2, 2) * sourceNormalZ[x]);
+
+                            if (rotatedNormal.dot(n) < minimumNormalCosine)
+                            {
+                                continue;
+                            }
+
+                            const float residual =
+                                n.dot(difference);
+
+                            const float absoluteResidual =
+                                fabsf(residual);
+
+                            const float weight =
+                                absoluteResidual <= huberThreshold ? 1.0f : huberThreshold / absoluteResidual;
+
+                            //
+                            // Derivative of the residual with respect to a small rotation
+                            // and translation applied on the left of the current transform.
+                            //
+                            const cv::Vec3f qCrossN = q.cross(n);
+
+                            const float jacobian[6] =
+                            {
+                                qCrossN[0], qCrossN[1], qCrossN[2],
+                                n[0], n[1], n[2]
+                            };
+
+                            equations.Add(
+                                jacobian,
+                                residual,
+                                weight);
+                        }
+                    }
+                });
+
+                NormalEquations equations;
+
+                partialEquations.combine_each([&](const NormalEquations& partial)
+                {
+                    equations.Merge(partial);
+                });
+
+                lastEquations = equations;
+
+                cv::Vec6d twist;
+
+                if (equations.NumberOfInliers < 6 || !equations.Solve(&twist))
+                {
+                    solved = false;
+                    break;
+                }
+
+                sourceToTarget =
+                    TwistToTransform(twist) * sourceToTarget;
+
+                if (cv::norm(twist) < 1e-6)
+                {
+                    break;
+                }
+            }
+        }
+
+        int32_t numberOfValidSourcePoints =
+            cv::countNonZero(_source[0].Points.Z);
+
+        result->NumberOfInliers = lastEquations.NumberOfInliers;
+
+        result->InlierFraction =
+            numberOfValidSourcePoints > 0 ?
+                static_cast<float>(lastEquations.NumberOfInliers) / numberOfValidSourcePoints :
+                0.0f;
+
+        result->RootMeanSquareError =
+            lastEquations.NumberOfInliers > 0 ?
+                static_cast<float>(sqrt(lastEquations.SquaredError / lastEquations.NumberOfInliers)) :
+                0.0f;
+
+        //
+        // The statistics refer to the last iteration on the finest level, i.e. to the
+        // transform before its final update.
+        //
+        result->Converged =
+            solved && result->InlierFraction >= _settings.MinimumInlierFraction;
+
+        result->SourceToTarget =
+            result->Converged ? sourceToTarget : initialSourceToTarget;
+
+        return result->Converged;
+    }
+}
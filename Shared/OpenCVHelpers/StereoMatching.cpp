@@ -0,0 +1,714 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+#include "pch.h"
+
+namespace rmcv
+{
+    namespace
+    {
+        //
+        // Number of bits of the 5x5 census signature, i.e. the maximum matching cost.
+        //
+        const int16_t c_maximumCost = 24;
+
+        //
+        // Padding value of the aggregation buffers; small enough to not overflow when
+        // the penalties are added.
+        //
+        const int16_t c_infiniteCost = 0x3fff;
+
+        const int32_t c_columnsPerBand = 16;
+
+        uint32_t PopCount(
+            _In_ uint32_t value)
+        {
+            value = value - ((value >> 1) & 0x55555555);
+            value = (value & 0x33333333) + ((value >> 2) & 0x33333333);
+            value = (value + (value >> 4)) & 0x0f0f0f0f;
+            value = value + (value >> 8);
+            value = value + (value >> 16);
+
+            return value & 0x3f;
+        }
+
+        //
+        // Computes the census signatures of one row: each bit tells whether a pixel of the
+        // 5x5 neighborhood is darker than the center. The two border pixels are zero.
+        //
+        void CensusTransformRow(
+            _In_ const cv::Mat& image,
+            _In_ int32_t y,
+            _Out_ uint32_t* census)
+        {
+            const int32_t width = image.cols;
+
+            if (y < 2 || y >= image.rows - 2)
+            {
+                std::fill(census, census + width, 0);
+                return;
+            }
+
+            const uint8_t* rows[5] =
+            {
+                image.ptr<uint8_t>(y - 2),
+                image.ptr<uint8_t>(y - 1),
+                image.ptr<uint8_t>(y),
+                image.ptr<uint8_t>(y + 1),
+                image.ptr<uint8_t>(y + 2)
+            };
+
+            census[0] = census[1] = 0;
+            census[width - 2] = census[width - 1] = 0;
+
+            for (int32_t x = 2; x < width - 2; ++x)
+            {
+                const uint8_t center = rows[2][x];
+
+                uint32_t signature = 0;
+
+                for (int32_t j = 0; j < 5; ++j)
+                {
+                    for (int32_t i = -2; i <= 2; ++i)
+                    {
+                        if (2 == j && 0 == i)
+                        {
+                            continue;
+                        }
+
+                        signature = (signature << 1) | (rows[j][x + i] < center ? 1 : 0);
+                    }
+                }
+
+                census[x] = signature;
+            }
+        }
+
+        //
+        // Computes the Hamming distances between the census signatures of each left pixel
+        // and the right pixels at all disparities, stored as costs[x * disparities + d].
+        //
+        void ComputeCostRow(
+            _In_ const uint32_t* leftCensus,
+            _In_ const uint32_t* rightCensus,
+            _In_ int32_t width,
+            _In_ int32_t disparities,
+            _Out_ int16_t* costs)
+        {
+            for (int32_t x = 0; x < width; ++x)
+            {
+                int16_t* pixelCosts = costs + x * disparities;
+                int32_t d = 0;
+
+#if RMCV_USE_SSE2
+                const __m128i left = _mm_set1_epi32(leftCensus[x]);
+                const __m128i m1 = _mm_set1_epi32(0x55555555);
+                const __m128i m2 = _mm_set1_epi32(0x33333333);
+                const __m128i m4 = _mm_set1_epi32(0x0f0f0f0f);
+                const __m128i m6 = _mm_set1_epi32(0x3f);
+
+                //
+                // Four disparities at a time; the right signatures at x - d - 3 .. x - d
+                // are loaded at once and reversed.
+                //
+                for (; d + 4 <= disparities && x - d - 3 >= 0; d += 4)
+                {
+                    __m128i right =
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(rightCensus + x - d - 3));
+
+                    right = _mm_shuffle_epi32(right, _MM_SHUFFLE(0, 1, 2, 3));
+
+                    __m128i v = _mm_xor_si128(left, right);
+
+                    v = _mm_sub_epi32(v, _mm_and_si128(_mm_srli_epi32(v, 1), m1));
+                    v = _mm_add_epi32(_mm_and_si128(v, m2), _mm_and_si128(_mm_srli_epi32(v, 2), m2));
+                    v = _mm_and_si128(_mm_add_epi32(v, _mm_srli_epi32(v, 4)), m4);
+                    v = _mm_add_epi32(v, _mm_srli_epi32(v, 8));
+                    v = _mm_add_epi32(v, _mm_srli_epi32(v, 16));
+                    v = _mm_and_si128(v, m6);
+
+                    //
+                    // The distances fit into 16 bits, so pack the four lanes.
+                    //
+                    v = _mm_packs_epi32(v, v);
+
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(pixelCosts + d), v);
+                }
+#endif /* RMCV_USE_SSE2 */
+
+                for (; d < disparities; ++d)
+                {
+                    pixelCosts[d] =
+                        x - d >= 0 ?
+                            static_cast<int16_t>(PopCount(leftCensus[x] ^ rightCensus[x - d])) :
+                            c_maximumCost;
+                }
+            }
+        }
+
+        //
+        // One step of semi-global matching along a path:
+        //
+        //   L(p, d) = C(p, d) + min(L(p - r, d), L(p - r, d +- 1) + P1, min L(p - r) + P2)
+        //             - min L(p - r)
+        //
+        // The path costs of the previous pixel are padded with c_infiniteCost at -1 and
+        // at disparities, which avoids special cases for the neighboring disparities.
+        // Returns the minimum of the new path costs.
+        //
+        int16_t AggregatePixel(
+            _In_ const int16_t* previous,
+            _In_ int16_t previousMinimum,
+            _In_ const int16_t* costs,
+            _In_ int32_t disparities,
+            _In_ int16_t smallPenalty,
+            _In_ int16_t largePenalty,
+            _Out_ int16_t* current,
+            _Inout_ uint16_t* aggregatedCosts)
+        {
+#if RMCV_USE_SSE2
+            const __m128i p1 = _mm_set1_epi16(smallPenalty);
+            const __m128i jump = _mm_set1_epi16(static_cast<int16_t>(previousMinimum + largePenalty));
+            const __m128i minimum = _mm_set1_epi16(previousMinimum);
+
+            __m128i currentMinimum = _mm_set1_epi16(c_infiniteCost);
+
+            for (int32_t d = 0; d < disparities; d += 8)
+            {
+                __m128i best =
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(previous + d));
+
+                best = _mm_min_epi16(best, _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(previous + d - 1)), p1));
+                best = _mm_min_epi16(best, _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(previous + d + 1)), p1));
+                best = _mm_min_epi16(best, jump);
+
+                const __m128i pathCost =
+                    _mm_add_epi16(
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(costs + d)),
+                        _mm_sub_epi16(best, minimum));
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(current + d), pathCost);
+
+                currentMinimum = _mm_min_epi16(currentMinimum, pathCost);
+
+                __m128i* sum = reinterpret_cast<__m128i*>(aggregatedCosts + d);
+
+                _mm_storeu_si128(sum, _mm_add_epi16(_mm_loadu_si128(sum), pathCost));
+            }
+
+            currentMinimum = _mm_min_epi16(currentMinimum, _mm_shuffle_epi32(currentMinimum, _MM_SHUFFLE(1, 0, 3, 2)));
+            currentMinimum = _mm_min_epi16(currentMinimum, _mm_shuffle_epi32(currentMinimum, _MM_SHUFFLE(2, 3, 0, 1)));
+            currentMinimum = _mm_min_epi16(currentMinimum, _mm_shufflelo_epi16(currentMinimum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+            return static_cast<int16_t>(_mm_cvtsi128_si32(currentMinimum));
+#else
+            int16_t currentMinimum = c_infiniteCost;
+
+            for (int32_t d = 0; d < disparities; ++d)
+            {
+                int16_t best = previous[d];
+
+                best = std::min<int16_t>(best, previous[d - 1] + smallPenalty);
+                best = std::min<int16_t>(best, previous[d + 1] + smallPenalty);
+                best = std::min<int16_t>(best, previousMinimum + largePenalty);
+
+                current[d] = costs[d] + best - previousMinimum;
+                currentMinimum = std::min(currentMinimum, current[d]);
+
+                aggregatedCosts[d] += current[d];
+            }
+
+            return currentMinimum;
+#endif /* RMCV_USE_SSE2 */
+        }
+
+        //
+        // Path cost buffer for one pixel with the padding on either side.
+        //
+        struct PathCosts
+        {
+            std::vector<int16_t> Buffer;
+            int16_t Minimum;
+
+            void Reset(
+                _In_ int32_t disparities)
+            {
+                Buffer.assign(disparities + 2, 0);
+                Buffer.front() = Buffer.back() = c_infiniteCost;
+                Minimum = 0;
+            }
+
+            int16_t* Data()
+            {
+                return Buffer.data() + 1;
+            }
+        };
+
+        void AggregateHorizontalPaths(
+            _In_ const int16_t* costs,
+            _In_ int32_t width,
+            _In_ int32_t disparities,
+            _In_ int16_t smallPenalty,
+            _In_ int16_t largePenalty,
+            _Inout_ uint16_t* aggregatedCosts)
+        {
+            PathCosts previous, current;
+
+            for (int32_t direction = 0; direction < 2; ++direction)
+            {
+                previous.Reset(disparities);
+                current.Reset(disparities);
+
+                for (int32_t i = 0; i < width; ++i)
+                {
+                    const int32_t x =
+                        0 == direction ? i : width - 1 - i;
+
+                    current.Minimum = AggregatePixel(
+                        previous.Data(),
+                        previous.Minimum,
+                        costs + x * disparities,
+                        disparities,
+                        smallPenalty,
+                        largePenalty,
+                        current.Data(),
+                        aggregatedCosts + x * disparities);
+
+                    std::swap(previous, current);
+                }
+            }
+        }
+
+        void AggregateVerticalPaths(
+            _In_ const int16_t* costs,
+            _In_ int32_t width,
+            _In_ int32_t height,
+            _In_ int32_t disparities,
+            _In_ int32_t beginColumn,
+            _In_ int32_t endColumn,
+            _In_ int16_t smallPenalty,
+            _In_ int16_t largePenalty,
+            _Inout_ uint16_t* aggregatedCosts)
+        {
+            std::vector<PathCosts> previous(endColumn - beginColumn);
+            std::vector<PathCosts> current(endColumn - beginColumn);
+
+            //
+            // Walk the rows in order and keep the path costs of each column of the band,
+            // so the memory accesses stay contiguous within a row.
+            //
+            for (int32_t direction = 0; direction < 2; ++direction)
+            {
+                for (int32_t x = beginColumn; x < endColumn; ++x)
+                {
+                    previous[x - beginColumn].Reset(disparities);
+                    current[x - beginColumn].Reset(disparities);
+                }
+
+                for (int32_t i = 0; i < height; ++i)
+                {
+                    const int32_t y =
+                        0 == direction ? i : height - 1 - i;
+
+                    for (int32_t x = beginColumn; x < endColumn; ++x)
+                    {
+                        PathCosts& previousPixel = previous[x - beginColumn];
+                        PathCosts& currentPixel = current[x - beginColumn];
+
+                        const size_t offset =
+                            (static_cast<size_t>(y) * width + x) * disparities;
+
+                        currentPixel.Minimum = AggregatePixel(
+                            previousPixel.Data(),
+                            previousPixel.Minimum,
+                            costs + offset,
+                            disparities,
+                            smallPenalty,
+                            largePenalty,
+                            currentPixel.Data(),
+                            aggregatedCosts + offset);
+
+                        std::swap(previousPixel, currentPixel);
+                    }
+                }
+            }
+        }
+
+        //
+        // Winner-takes-all selection with a uniqueness test, sub-pixel interpolation and
+        // a left-right consistency check for one row.
+        //
+        void SelectDisparityRow(
+            _In_ const uint16_t* aggregatedCosts,
+            _In_ int32_t width,
+            _In_ int32_t disparities,
+            _In_ int32_t uniquenessRatio,
+            _In_ int32_t maximumLeftRightDifference,
+            _Inout_ std::vector<int32_t>& rightDisparities,
+            _Out_ float* disparity)
+        {
+            //
+            // The disparity of a right pixel minimizes the costs of the left pixels that
+            // map onto it.
+            //
+            rightDisparities.assign(width, -1);
+
+            std::vector<uint32_t> rightCosts(
+                width,
+                std::numeric_limits<uint32_t>::max());
+
+            for (int32_t x = 0; x < width; ++x)
+            {
+                const uint16_t* pixelCosts = aggregatedCosts + x * disparities;
+
+                for (int32_t d = 0; d <= std::min(x, disparities - 1); ++d)
+                {
+                    if (pixelCosts[d] < rightCosts[x - d])
+                    {
+                        rightCosts[x - d] = pixelCosts[d];
+                        rightDisparities[x - d] = d;
+                    }
+                }
+            }
+
+            for (int32_t x = 0; x < width; ++x)
+            {
+                const uint16_t* pixelCosts = aggregatedCosts + x * disparities;
+
+                disparity[x] = -1.0f;
+
+                int32_t best = 0;
+
+                for (int32_t d = 1; d < disparities; ++d)
+                {
+                    if (pixelCosts[d] < pixelCosts[best])
+                    {
+                        best = d;
+                    }
+                }
+
+                if (best > x)
+                {
+                    continue;
+                }
+
+                bool unique = true;
+
+                for (int32_t d = 0; d < disparities && unique; ++d)
+                {
+                    unique =
+                        std::abs(d - best) <= 1 ||
+                        pixelCosts[d] * 100 >= pixelCosts[best] * (100 + uniquenessRatio);
+                }
+
+                if (!unique || std::abs(rightDisparities[x - best] - best) > maximumLeftRightDifference)
+                {
+                    continue;
+                }
+
+                float subpixelOffset = 0.0f;
+
+                if (best > 0 && best < disparities - 1)
+                {
+                    const int32_t denominator =
+                        pixelCosts[best - 1] - 2 * pixelCosts[best] + pixelCosts[best + 1];
+
+                    if (denominator > 0)
+                    {
+                        subpixelOffset =
+                            0.5f * (pixelCosts[best - 1] - pixelCosts[best + 1]) / denominator;
+                    }
+                }
+
+                disparity[x] = best + subpixelOffset;
+            }
+        }
+    }
+
+    void CreateStereoRectification(
+        _In_ const cv::Mat& leftUnitPlaneCoordinates,
+        _In_ const cv::Mat& rightUnitPlaneCoordinates,
+        _In_ const cv::Matx44f& leftToRight,
+        _In_ int32_t rectifiedWidth,
+        _In_ int32_t rectifiedHeight,
+        _Out_ StereoRectification& rectification)
+    {
+        REQUIRES(CV_32FC2 == leftUnitPlaneCoordinates.type());
+        REQUIRES(CV_32FC2 == rightUnitPlaneCoordinates.type());
+
+        DepthRayTable leftRays, rightRays;
+        DepthProjection leftProjection, rightProjection;
+
+        CreateDepthRayTable(leftUnitPlaneCoordinates, leftRays);
+        CreateDepthRayTable(rightUnitPlaneCoordinates, rightRays);
+        CreateDepthProjection(leftRays, leftProjection);
+        CreateDepthProjection(rightRays, rightProjection);
+
+        const cv::Matx33f leftToRightRotation = leftToRight.get_minor<3, 3>(0, 0);
+        const cv::Vec3f leftToRightTranslation(leftToRight(0, 3), leftToRight(1, 3), leftToRight(2, 3));
+
+        //
+        // The rectified X axis points from the left to the right camera center.
+        //
+        const cv::Vec3f rightCenter =
+            -(leftToRightRotation.t() * leftToRightTranslation);
+
+        rectification.Baseline =
+            static_cast<float>(cv::norm(rightCenter));
+
+        REQUIRES(rectification.Baseline > 0.0f);
+
+        const cv::Vec3f xAxis =
+            rightCenter * (1.0f / rectification.Baseline);
+
+        //
+        // The rectified Z axis is the average of the two optical axes, made orthogonal
+        // to the baseline.
+        //
+        cv::Vec3f zAxis =
+            cv::Vec3f(0.0f, 0.0f, 1.0f) + leftToRightRotation.t() * cv::Vec3f(0.0f, 0.0f, 1.0f);
+
+        zAxis = cv::normalize(zAxis - xAxis * xAxis.dot(zAxis));
+
+        const cv::Vec3f yAxis =
+            zAxis.cross(xAxis);
+
+        for (int32_t i = 0; i < 3; ++i)
+        {
+            rectification.LeftToRectified(0, i) = xAxis[i];
+            rectification.LeftToRectified(1, i) = yAxis[i];
+            rectification.LeftToRectified(2, i) = zAxis[i];
+        }
+
+        //
+        // Keep the resolution of the left camera at its image center.
+        //
+        const cv::Vec2f* centerRow =
+            leftUnitPlaneCoordinates.ptr<cv::Vec2f>(leftUnitPlaneCoordinates.rows / 2);
+
+        const int32_t centerColumn =
+            leftUnitPlaneCoordinates.cols / 2;
+
+        const float unitPlaneSpacing = 0.5f * static_cast<float>(
+            cv::norm(centerRow[centerColumn + 1] - centerRow[centerColumn - 1]));
+
+        REQUIRES(unitPlaneSpacing > 0.0f);
+
+        rectification.Width = rectifiedWidth;
+        rectification.Height = rectifiedHeight;
+        rectification.FocalLength = 1.0f / unitPlaneSpacing;
+        rectification.PrincipalPointX = 0.5f * (rectifiedWidth - 1);
+        rectification.PrincipalPointY = 0.5f * (rectifiedHeight - 1);
+
+        cv::Mat leftMapX(rectifiedHeight, rectifiedWidth, CV_32FC1);
+        cv::Mat leftMapY(rectifiedHeight, rectifiedWidth, CV_32FC1);
+        cv::Mat rightMapX(rectifiedHeight, rectifiedWidth, CV_32FC1);
+        cv::Mat rightMapY(rectifiedHeight, rectifiedWidth, CV_32FC1);
+
+        const cv::Matx33f rectifiedToLeft =
+            rectification.LeftToRectified.t();
+
+        concurrency::parallel_for(0, rectifiedHeight, [&](int32_t y)
+        {
+            for (int32_t x = 0; x < rectifiedWidth; ++x)
+            {
+                //
+                // The rectified cameras look down the negative Z axis.
+                //
+                const cv::Vec3f rectifiedDirection(
+                    (x - rectification.PrincipalPointX) / rectification.FocalLength,
+                    (y - rectification.PrincipalPointY) / rectification.FocalLength,
+                    -1.0f);
+
+                const cv::Vec3f leftDirection = rectifiedToLeft * rectifiedDirection;
+                const cv::Vec3f rightDirection = leftToRightRotation * leftDirection;
+
+                float column, row;
+
+                if (!ProjectToDepthImage(leftProjection, leftDirection[0], leftDirection[1], leftDirection[2], &column, &row))
+                {
+                    column = row = -1.0f;
+                }
+
+                leftMapX.at<float>(y, x) = column;
+                leftMapY.at<float>(y, x) = row;
+
+                if (!ProjectToDepthImage(rightProjection, rightDirection[0], rightDirection[1], rightDirection[2], &column, &row))
+                {
+                    column = row = -1.0f;
+                }
+
+                rightMapX.at<float>(y, x) = column;
+                rightMapY.at<float>(y, x) = row;
+            }
+        });
+
+        cv::convertMaps(leftMapX, leftMapY, rectification.LeftMap1, rectification.LeftMap2, CV_16SC2);
+        cv::convertMaps(rightMapX, rightMapY, rectification.RightMap1, rectification.RightMap2, CV_16SC2);
+    }
+
+    StereoMatcher::StereoMatcher(
+        _In_ const StereoRectification& rectification,
+        _In_ const StereoMatchingSettings& settings)
+        : _rectification(rectification)
+        , _settings(settings)
+    {
+        REQUIRES(_settings.NumberOfDisparities > 0 && 0 == _settings.NumberOfDisparities % 8);
+    }
+
+    void StereoMatcher::Compute(
+        _In_ const cv::Mat& leftImage,
+        _In_ const cv::Mat& rightImage,
+        _Out_ cv::Mat& disparity)
+    {
+        REQUIRES(CV_8UC1 == leftImage.type() && CV_8UC1 == rightImage.type());
+
+        const int32_t width = _rectification.Width;
+        const int32_t height = _rectification.Height;
+        const int32_t disparities = _settings.NumberOfDisparities;
+
+        cv::remap(leftImage, _rectifiedLeft, _rectification.LeftMap1, _rectification.LeftMap2, cv::INTER_LINEAR);
+        cv::remap(rightImage, _rectifiedRight, _rectification.RightMap1, _rectification.RightMap2, cv::INTER_LINEAR);
+
+        _leftCensus.create(height, width, CV_32SC1);
+        _rightCensus.create(height, width, CV_32SC1);
+
+        const size_t rowSize =
+            static_cast<size_t>(width) * disparities;
+
+        _costs.resize(rowSize * height);
+        _aggregatedCosts.assign(rowSize * height, 0);
+
+        concurrency::parallel_for(0, height, [&](int32_t y)
+        {
+            CensusTransformRow(_rectifiedLeft, y, _leftCensus.ptr<uint32_t>(y));
+            CensusTransformRow(_rectifiedRight, y, _rightCensus.ptr<uint32_t>(y));
+
+            ComputeCostRow(
+                _leftCensus.ptr<uint32_t>(y),
+                _rightCensus.ptr<uint32_t>(y),
+                width,
+                disparities,
+                _costs.data() + y * rowSize);
+        });
+
+        const int16_t smallPenalty = static_cast<int16_t>(_settings.SmallPenalty);
+        const int16_t largePenalty = static_cast<int16_t>(_settings.LargePenalty);
+
+        concurrency::parallel_for(0, height, [&](int32_t y)
+        {
+            AggregateHorizontalPaths(
+                _costs.data() + y * rowSize,
+                width,
+                disparities,
+                smallPenalty,
+                largePenalty,
+                _aggregatedCosts.data() + y * rowSize);
+        });
+
+        const int32_t bandCount =
+            (width + c_columnsPerBand - 1) / c_columnsPerBand;
+
+        concurrency::parallel_for(0, bandCount, [&](int32_t band)
+        {
+            AggregateVerticalPaths(
+                _costs.data(),
+                width,
+                height,
+                disparities,
+                band * c_columnsPerBand,
+                std::min(width, (band + 1) * c_columnsPerBand),
+                smallPenalty,
+                largePenalty,
+                _aggregatedCosts.data());
+        });
+
+        disparity.create(height, width, CV_32FC1);
+
+        concurrency::parallel_for(0, height, [&](int32_t y)
+        {
+            std::vector<int32_t> rightDisparities;
+
+            SelectDisparityRow(
+                _aggregatedCosts.data() + y * rowSize,
+                width,
+                disparities,
+                _settings.UniquenessRatio,
+                _settings.MaximumLeftRightDifference,
+                rightDisparities,
+                disparity.ptr<float>(y));
+        });
+    }
+
+    const cv::Mat& StereoMatcher::GetRectifiedLeftImage() const
+    {
+        return _rectifiedLeft;
+    }
+
+    void ReprojectDisparity(
+        _In_ const cv::Mat& disparity,
+        _In_ const StereoRectification& rectification,
+        _In_ float minimumDistance,
+        _In_ float maximumDistance,
+        _Out_ OrganizedPointCloud& pointCloud)
+    {
+        REQUIRES(CV_32FC1 == disparity.type());
+
+        pointCloud.X.create(disparity.size(), CV_32FC1);
+        pointCloud.Y.create(disparity.size(), CV_32FC1);
+        pointCloud.Z.create(disparity.size(), CV_32FC1);
+
+        const cv::Matx33f rectifiedToLeft =
+            rectification.LeftToRectified.t();
+
+        const float focalLengthTimesBaseline =
+            rectification.FocalLength * rectification.Baseline;
+
+        concurrency::parallel_for(0, disparity.rows, [&](int32_t y)
+        {
+            const float* disparityRow = disparity.ptr<float>(y);
+
+            float* pointX = pointCloud.X.ptr<float>(y);
+            float* pointY = pointCloud.Y.ptr<float>(y);
+            float* pointZ = pointCloud.Z.ptr<float>(y);
+
+            for (int32_t x = 0; x < disparity.cols; ++x)
+            {
+                pointX[x] = pointY[x] = pointZ[x] = 0.0f;
+
+                if (disparityRow[x] <= 0.0f)
+                {
+                    continue;
+                }
+
+                const float depth =
+                    focalLengthTimesBaseline / disparityRow[x];
+
+                const cv::Vec3f point = rectifiedToLeft * cv::Vec3f(
+                    depth * (x - rectification.PrincipalPointX) / rectification.FocalLength,
+                    depth * (y - rectification.PrincipalPointY) / rectification.FocalLength,
+                    -depth);
+
+                const float distance =
+                    static_cast<float>(cv::norm(point));
+
+                if (distance < minimumDistance || distance > maximumDistance)
+                {
+                    continue;
+                }
+
+                pointX[x] = point[0];
+                pointY[x] = point[1];
+                pointZ[x] = point[2];
+            }
+        });
+    }
+}
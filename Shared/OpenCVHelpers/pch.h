@@ -15,11 +15,19 @@
 
 #include <map>
 #include <array>
+#include <cmath>
+#include <numeric>
+#include <limits>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <cstddef>
 #include <stdexcept>
 #include <shared_mutex>
+#include <unordered_map>
 #include <unordered_set>
 
 #if !defined(WIN32_LEAN_AND_MEAN)
@@ -42,15 +50,32 @@
 #include <wrl.h>
 #include <agile.h>
 #include <collection.h>
+#include <ppl.h>
 #include <ppltasks.h>
 #include <memorybuffer.h>
 
 #include <windows.graphics.directx.direct3d11.interop.h>
 
+//
+// The per-pixel loops use SSE2 on x86/x64 and fall back to scalar code on ARM.
+//
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#define RMCV_USE_SSE2 1
+#else
+#define RMCV_USE_SSE2 0
+#endif /* defined(_M_IX86) || defined(_M_X64) */
+
 #include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
 
 #include <Debugging/All.h>
 #include <Io/All.h>
 #include <Graphics/All.h>
 #include <Rendering/All.h>
 #include <OpenCVHelpers/OpenCVHelpers.h>
+#include <OpenCVHelpers/OrganizedPointCloud.h>
+#include <OpenCVHelpers/PointToPlaneIcp.h>
+#include <OpenCVHelpers/PlaneDetection.h>
+#include <OpenCVHelpers/StereoMatching.h>
+#include <OpenCVHelpers/OccupancyMap.h>
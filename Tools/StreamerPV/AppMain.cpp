@@ -228,6 +228,9 @@ namespace StreamerPV
 			delete _sensorFrameStreamer;
 			_sensorFrameStreamer = nullptr;
 
+			delete _headPoseStreamingServer;
+			_headPoseStreamingServer = nullptr;
+
 		}).wait();
 	}
 
@@ -247,6 +250,12 @@ namespace StreamerPV
         _sensorFrameStreamer =
             ref new HoloLensForCV::SensorFrameStreamer();
 
+        _headPoseStreamingServer =
+            ref new HoloLensForCV::HeadPoseStreamingServer(
+                _spatialPerception,
+                L"23950",
+                100 /* posesPerSecond */);
+
         for (const auto enabledSensorType : enabledSensorTypes)
         {
             _sensorFrameStreamer->Enable(
@@ -25,6 +25,13 @@ using namespace std::placeholders;
 
 namespace StreamerVLC
 {
+    //
+    // Also stream the long throw depth sensor as point clouds, for point_cloud_receiver.py.
+    // At most one point is sent per cube of the voxel size (in meters).
+    //
+    static const bool c_streamPointCloud = true;
+    static const float c_pointCloudVoxelSize = 0.01f;
+
     // Loads and initializes application assets when the application is loaded.
     AppMain::AppMain(const std::shared_ptr<Graphics::DeviceResources>& deviceResources)
         : Holographic::AppMainBase(deviceResources)
@@ -247,6 +254,9 @@ namespace StreamerVLC
 			delete _sensorFrameStreamer;
 			_sensorFrameStreamer = nullptr;
 
+			delete _headPoseStreamingServer;
+			_headPoseStreamingServer = nullptr;
+
 		}).wait();
 	}
 
@@ -278,15 +288,39 @@ namespace StreamerVLC
         enabledSensorTypes.emplace_back(
             HoloLensForCV::SensorType::VisibleLightRightRight);
 
+        std::vector<HoloLensForCV::SensorType> pointCloudSensorTypes;
+
+        if (c_streamPointCloud)
+        {
+            pointCloudSensorTypes.emplace_back(
+                HoloLensForCV::SensorType::LongThrowToFDepth);
+        }
+
         _sensorFrameStreamer =
             ref new HoloLensForCV::SensorFrameStreamer();
 
+        _headPoseStreamingServer =
+            ref new HoloLensForCV::HeadPoseStreamingServer(
+                _spatialPerception,
+                L"23950",
+                100 /* posesPerSecond */);
+
         for (const auto enabledSensorType : enabledSensorTypes)
         {
             _sensorFrameStreamer->Enable(
                 enabledSensorType);
         }
 
+        //
+        // The depth frames are only streamed as point clouds, not as images.
+        //
+        for (const auto pointCloudSensorType : pointCloudSensorTypes)
+        {
+            _sensorFrameStreamer->EnablePointCloud(
+                pointCloudSensorType,
+                c_pointCloudVoxelSize);
+        }
+
         _holoLensMediaFrameSourceGroup =
             ref new HoloLensForCV::MediaFrameSourceGroup(
                 _selectedHoloLensMediaFrameSourceGroupType,
@@ -299,6 +333,12 @@ namespace StreamerVLC
                 enabledSensorType);
         }
 
+        for (const auto pointCloudSensorType : pointCloudSensorTypes)
+        {
+            _holoLensMediaFrameSourceGroup->Enable(
+                pointCloudSensorType);
+        }
+
         concurrency::create_task(_holoLensMediaFrameSourceGroup->StartAsync()).then(
             [&]()
         {
@@ -56,6 +56,9 @@ namespace StreamerVLC
         // HoloLens media frame server manager
         HoloLensForCV::SensorFrameStreamer^ _sensorFrameStreamer;
 
+        // Head pose server, streaming independently of the images
+        HoloLensForCV::HeadPoseStreamingServer^ _headPoseStreamingServer;
+
         // Camera preview
         std::unique_ptr<Rendering::SlateRenderer> _slateRenderer;
         Rendering::Texture2DPtr _cameraPreviewTexture;